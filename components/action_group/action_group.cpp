@@ -1,105 +1,525 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 #include <esp_log.h>
+#include <charconv>
+#include <mutex>
+#include <unordered_set>
 #include "action_group.h"
 #include "idevice.h"
 #include "indicator.h"
 #include "esp_timer.h"
 #include "commons.h"
 #include "lord_manager.h"
+#include "scene_trace.h"
+#include "metrics.h"
 
 #define TAG "ACTION_GROUP"
 
-static void executeAllAtomicActionTask(void* pvParameter) {
-    ActionGroup* self = static_cast<ActionGroup*>(pvParameter);
+// 操作名与操作码的对照表, 同一个操作码的第一个名字作为规范名
+struct OpcodeName {
+    const char* name;
+    Opcode op;
+};
 
-    for (const auto& atomic_action : self->actions) {
-        uint32_t v = 0;
-        if (xTaskNotifyWait(0, ActionGroup::CANCEL_BIT, &v, 0) == pdTRUE && (v & ActionGroup::CANCEL_BIT)) {
-            ESP_LOGW(TAG, "任务收到取消信号，中止执行");
+static constexpr OpcodeName opcode_names[] = {
+    {"开",               Opcode::OPEN},
+    {"打开",             Opcode::OPEN},
+    {"关",               Opcode::CLOSE},
+    {"关闭",             Opcode::CLOSE},
+    {"反转",             Opcode::TOGGLE},
+    {"调光",             Opcode::DIMMING},
+    {"睡眠",             Opcode::SLEEP},
+    {"拔卡",             Opcode::REMOVE_CARD},
+    {"插卡",             Opcode::INSERT_CARD},
+    {"添加",             Opcode::STATE_ADD},
+    {"删除",             Opcode::STATE_REMOVE},
+    {"如果存在此状态则跳出", Opcode::STATE_BREAK_IF_EXIST},
+    {"延时",             Opcode::DELAY},
+    {"调用",             Opcode::AG_CALL},
+    {"中断",             Opcode::AG_INTERRUPT},
+    {"生成任意键执行",    Opcode::AG_SET_ANY_KEY},
+    {"删除任意键执行",    Opcode::AG_CLEAR_ANY_KEY},
+    {"记录快照",          Opcode::SNAPSHOT_RECORD},
+    {"读取并删除快照",    Opcode::SNAPSHOT_RESTORE},
+    {"删除快照",          Opcode::SNAPSHOT_DELETE},
+    {"清除快照并跳出",    Opcode::SNAPSHOT_CLEAR_AND_BREAK},
+    {"亮",               Opcode::INDICATOR_ON},
+    {"灭",               Opcode::INDICATOR_OFF},
+    {"亮1秒",            Opcode::INDICATOR_FLASH},
+    {"制冷",             Opcode::AC_COOLING},
+    {"制热",             Opcode::AC_HEATING},
+    {"通风",             Opcode::AC_FAN},
+    {"高风",             Opcode::AC_FAN_HIGH},
+    {"中风",             Opcode::AC_FAN_MEDIUM},
+    {"低风",             Opcode::AC_FAN_LOW},
+    {"自动",             Opcode::AC_FAN_AUTO},
+    {"风量加大",          Opcode::AC_FAN_UP},
+    {"风量减小",          Opcode::AC_FAN_DOWN},
+    {"温度升高",          Opcode::AC_TEMP_UP},
+    {"温度降低",          Opcode::AC_TEMP_DOWN},
+    {"调节温度",          Opcode::AC_SET_TEMP},
+    {"发送",             Opcode::RS485_SEND},
+    {"打开功放",          Opcode::BGM_AMP_ON},
+    {"关闭功放",          Opcode::BGM_AMP_OFF},
+    {"播放",             Opcode::BGM_PLAY},
+    {"停止",             Opcode::BGM_STOP},
+    {"播放/暂停",         Opcode::BGM_PLAY_PAUSE},
+    {"上一首",            Opcode::BGM_PREV},
+    {"下一首",            Opcode::BGM_NEXT},
+    {"音量加",            Opcode::BGM_VOLUME_UP},
+    {"音量减",            Opcode::BGM_VOLUME_DOWN},
+    {"打开蓝牙模式",      Opcode::BGM_BL_OPEN},
+    {"关闭蓝牙模式",      Opcode::BGM_BL_CLOSE},
+    {"反转模式",          Opcode::BGM_TOGGLE_MODE},
+};
+
+Opcode opcodeFromName(std::string_view operation) {
+    for (const auto& [name, op] : opcode_names) {
+        if (operation == name) {
+            return op;
+        }
+    }
+    return Opcode::NONE;
+}
+
+const char* opcodeName(Opcode op) {
+    for (const auto& [name, code] : opcode_names) {
+        if (code == op) {
+            return name;
+        }
+    }
+    return "";
+}
+
+static bool parse_non_negative_int(std::string_view text, int32_t& out) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+    return result.ec == std::errc() && out >= 0;
+}
+
+AtomicAction compileAtomicAction(IDevice* target_device, std::string_view operation, std::string_view parameter,
+                                 bool register_names) {
+    AtomicAction action{.target_device = target_device, .op = opcodeFromName(operation)};
+    if (action.op == Opcode::NONE) {
+        ESP_LOGW(TAG, "未知的操作[%.*s], did(%u)", (int)operation.size(), operation.data(),
+                 target_device ? target_device->getDid() : 0);
+        return action;
+    }
+
+    switch (target_device ? target_device->getType() : DeviceType::NONE) {
+        case DeviceType::ROOM_STATE:
+            action.param.state = register_names ? room_state_id(parameter) : room_state_find(parameter);
+            if (action.param.state == ROOM_STATE_NONE) {
+                ESP_LOGW(TAG, "不认识的房间状态[%.*s]", (int)parameter.size(), parameter.data());
+                action.op = Opcode::NONE;
+            }
+            break;
+        case DeviceType::DELAYER:
+        case DeviceType::ACTION_GROUP_OP:
+            if (!parse_non_negative_int(parameter, action.param.value)) {
+                ESP_LOGE(TAG, "[%.*s]参数非法: %.*s", (int)operation.size(), operation.data(),
+                         (int)parameter.size(), parameter.data());
+                action.op = Opcode::NONE;
+            }
+            break;
+        case DeviceType::INDICATOR: {
+            std::string text(parameter);
+            int pid, bid;
+            if (sscanf(text.c_str(), "%d,%d", &pid, &bid) != 2) {
+                ESP_LOGE(TAG, "Indicator参数错误, 无法获取按键: %s", text.c_str());
+                action.op = Opcode::NONE;
+                break;
+            }
+            action.param.pid = pid;
+            action.param.bid = bid;
             break;
         }
-        if (self->cancelled()) {
-            ESP_LOGW(TAG, "检测到取消标志，中止执行");
+        case DeviceType::INFRARED_AIR:
+        case DeviceType::SINGLE_AIR:
+            if (action.op == Opcode::AC_SET_TEMP && !parse_non_negative_int(parameter, action.param.value)) {
+                ESP_LOGE(TAG, "调节温度参数非法: %.*s", (int)parameter.size(), parameter.data());
+                action.op = Opcode::NONE;
+            }
+            break;
+        default:
             break;
+    }
+    return action;
+}
+
+// 动作组执行池: 固定几个执行者任务从队列里取动作组执行, 不再每次按键都创建一个任务
+#define ACTION_EXECUTOR_COUNT       3
+#define ACTION_EXECUTOR_STACK_SIZE  4096
+#define ACTION_JOB_QUEUE_LEN        16
+
+struct ActionJob {
+    ActionGroup* group;
+    int64_t enqueue_us;                         // 入队时间, 用于统计排队等待
+};
+
+static QueueHandle_t action_job_queue = nullptr;
+static ActionExecutorStats executor_stats = {};
+static std::mutex executor_mutex;               // 保护executor_stats以及各动作组的运行状态/task_handle
+// 投递过的动作组, 析构时移除. 队列里的指针可能在排队期间随重新解析配置被释放,
+// 执行者和延时定时器回调只有在这里找得到时才去碰它; 只比较指针值, 不解引用
+static std::unordered_set<const ActionGroup*> live_groups;
+
+static MetricCounter m_ag_runs("ag.runs");
+static MetricCounter m_ag_rejected("ag.rejected");            // 队列满被丢弃
+static MetricHistogram m_ag_wait_ms("ag.wait_ms", {1, 5, 10, 50, 100, 500, 1000});
+static MetricHistogram m_ag_total_ms("ag.total_ms", {10, 50, 100, 250, 500, 1000, 5000});
+
+static void actionExecutorTask(void* pvParameter) {
+    ActionJob job;
+    while (true) {
+        if (xQueueReceive(action_job_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
         }
-        if (atomic_action.target_device) {
-            atomic_action.target_device->execute(atomic_action.operation, atomic_action.parameter, self, !self->is_mode());
-        } else {
-            ESP_LOGE(TAG, "动作组(%d)找不到目标设备", self->getAid());
+        int64_t wait_us = esp_timer_get_time() - job.enqueue_us;
+
+        // 上一个动作组结束后才到达的取消位不能影响这一个
+        ulTaskNotifyValueClear(nullptr, ActionGroup::CANCEL_BIT);
+        xTaskNotifyStateClear(nullptr);
+
+        {
+            std::lock_guard<std::mutex> lock(executor_mutex);
+            executor_stats.queued--;
+            if (live_groups.count(job.group) == 0) {
+                ESP_LOGW(TAG, "动作组在排队时被释放, 跳过");
+                continue;
+            }
+            if (!job.group->beginRun(xTaskGetCurrentTaskHandle())) {
+                continue;
+            }
+            executor_stats.busy++;
+            executor_stats.last_wait_us = wait_us;
+            executor_stats.total_wait_us += wait_us;
+            if (wait_us > executor_stats.max_wait_us) {
+                executor_stats.max_wait_us = wait_us;
+            }
+        }
+        m_ag_wait_ms.record(wait_us / 1000);
+        if (wait_us > 50 * 1000) {
+            ESP_LOGW(TAG, "动作组(%d)排队等待了%lldus", job.group->getAid(), wait_us);
+        }
+
+        // 执行到结束或者挂起在延时上, 挂起时执行者直接去取下一个
+        bool done = job.group->resume();
+
+        std::lock_guard<std::mutex> lock(executor_mutex);
+        executor_stats.busy--;
+        if (done) {
+            executor_stats.executed++;
         }
     }
+}
 
-    // 完成动作组, 发布所有已注册的面板按键指示灯更新函数
-    IndicatorHolder::getInstance().callAllAndClear();
+void initActionExecutors() {
+    if (action_job_queue) {
+        return;
+    }
+    action_job_queue = xQueueCreate(ACTION_JOB_QUEUE_LEN, sizeof(ActionJob));
+    if (!action_job_queue) {
+        ESP_LOGE(TAG, "创建动作组队列失败");
+        return;
+    }
+    metrics_watch_queue("ag_jobs", action_job_queue);
+    for (int i = 0; i < ACTION_EXECUTOR_COUNT; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "ActionExec%d", i);
+        if (xTaskCreate(actionExecutorTask, name, ACTION_EXECUTOR_STACK_SIZE, nullptr, 5, nullptr) != pdPASS) {
+            ESP_LOGE(TAG, "创建动作组执行者%d失败", i);
+        }
+    }
+}
+
+ActionExecutorStats getActionExecutorStats() {
+    std::lock_guard<std::mutex> lock(executor_mutex);
+    return executor_stats;
+}
+
+void logActionExecutorStats() {
+    ActionExecutorStats st = getActionExecutorStats();
+    ESP_LOGI(TAG, "执行池: 执行者%d个, 忙碌%u, 排队%u, 延时中%u, 已执行%lu, 丢弃%lu, 饱和%lu次, 等待 最近%lldus/最长%lldus/平均%lldus",
+             ACTION_EXECUTOR_COUNT, st.busy, st.queued, st.sleeping, st.executed, st.rejected, st.saturated,
+             st.last_wait_us, st.max_wait_us, st.executed ? st.total_wait_us / st.executed : 0);
+}
+
+ActionGroup::~ActionGroup() {
+    {
+        // 先持锁摘掉自己, 已经卡在executor_mutex上的延时定时器回调拿到锁后找不到本动作组, 不会再碰它;
+        // 还在队列里的条目也由执行者取出时丢掉
+        std::lock_guard<std::mutex> lock(executor_mutex);
+        live_groups.erase(this);
+        if (run_state == RunState::SLEEPING) {
+            executor_stats.sleeping--;
+        }
+        if (run_state == RunState::QUEUED || run_state == RunState::SLEEPING) {
+            SceneTracer::getInstance().cancelled(trace_run, pc);
+            SceneTracer::getInstance().end(trace_run);
+        }
+        run_state = RunState::IDLE;
+    }
+    if (resume_timer) {
+        esp_timer_stop(resume_timer);
+        esp_timer_delete(resume_timer);
+    }
+}
 
-    self->clearTaskHandle();
-    vTaskDelete(nullptr);
+// 调用者必须持有executor_mutex
+bool ActionGroup::enqueue() {
+    if (executor_stats.busy >= ACTION_EXECUTOR_COUNT) {
+        executor_stats.saturated++;
+        ESP_LOGW(TAG, "执行者全忙, 动作组(%d)进入排队", aid);
+    }
+    ActionJob job = {this, esp_timer_get_time()};
+    if (xQueueSend(action_job_queue, &job, 0) != pdTRUE) {
+        return false;
+    }
+    live_groups.insert(this);
+    run_state = RunState::QUEUED;
+    executor_stats.queued++;
+    return true;
 }
 
 void ActionGroup::executeAllAtomicAction() {
     static auto& lord = LordManager::instance();
 
     lord.last_action_group_time = esp_timer_get_time() / 1000ULL;
-    // 检查是否已有任务在运行
-    if (task_handle != nullptr) {
-        ESP_LOGW(TAG, "动作已在执行中，跳过新任务创建");
+    if (!action_job_queue) {
+        ESP_LOGE(TAG, "执行池未初始化");
         return;
     }
 
+    {
+        std::lock_guard<std::mutex> lock(executor_mutex);
+        // 检查是否已在执行, 排队或延时中
+        if (run_state != RunState::IDLE) {
+            ESP_LOGW(TAG, "动作已在执行中，跳过新任务创建");
+            return;
+        }
+        cancel_flag = false;
+        pc = 0;
+        pending_sleep_ms = 0;
+        run_start_us = esp_timer_get_time();
+        if (!enqueue()) {
+            ESP_LOGE(TAG, "动作组队列已满, 丢弃动作组(%d)", aid);
+            executor_stats.rejected++;
+            m_ag_rejected.inc();
+            return;
+        }
+        m_ag_runs.inc();
+        // 执行者要先拿到executor_mutex才能开始, 所以在这里开始记录不会漏掉第一个动作
+        trace_run = SceneTracer::getInstance().begin(aid);
+    }
+
     // 判断执行完后是否要进入某种模式
     if (is_mode()) {
-        ESP_LOGI(TAG, "进入模式[%s]", name.c_str());
-        add_log_entry("mode", 0, "进入" + name, "");
+        ESP_LOGI(TAG, "进入模式[%s]", getName());
+        add_op_log(OpLogKind::MODE, aid, Opcode::NONE, 0);
     }
+}
+
+// 调用者必须持有executor_mutex
+bool ActionGroup::beginRun(TaskHandle_t executor) {
+    auto& tracer = SceneTracer::getInstance();
+    // 同一地址上换了个新动作组时, 旧的队列条目对它无效
+    if (run_state != RunState::QUEUED) {
+        return false;
+    }
+    if (sleep_since_us != 0) {
+        tracer.slept(trace_run, (esp_timer_get_time() - sleep_since_us) / 1000);
+        sleep_since_us = 0;
+    } else if (pc == 0) {
+        tracer.started(trace_run);
+    }
+    if (cancel_flag) {
+        ESP_LOGW(TAG, "动作组(%d)在排队时被取消", aid);
+        run_state = RunState::IDLE;
+        tracer.cancelled(trace_run, pc);
+        tracer.end(trace_run);
+        return false;
+    }
+    run_state = RunState::RUNNING;
+    task_handle = executor;
+    return true;
+}
 
-    cancel_flag = false;
+bool ActionGroup::resume() {
+    auto& tracer = SceneTracer::getInstance();
+    while (pc < actions.size()) {
+        uint32_t v = 0;
+        if (xTaskNotifyWait(0, CANCEL_BIT, &v, 0) == pdTRUE && (v & CANCEL_BIT)) {
+            ESP_LOGW(TAG, "任务收到取消信号，中止执行");
+            tracer.cancelled(trace_run, pc);
+            break;
+        }
+        if (cancel_flag) {
+            ESP_LOGW(TAG, "检测到取消标志，中止执行");
+            tracer.cancelled(trace_run, pc);
+            break;
+        }
 
-    // 创建新任务
-    BaseType_t ret = xTaskCreate(
-        executeAllAtomicActionTask,
-        "ExecuteAtomicActions",
-        4096,
-        this,
-        5,
-        &task_handle
-    );
+        const auto& atomic_action = actions[pc++];
+        int64_t step_start_us = esp_timer_get_time();
+        if (atomic_action.target_device) {
+            atomic_action.target_device->execute(atomic_action.op, atomic_action.param, this, !is_mode());
+        } else {
+            ESP_LOGE(TAG, "动作组(%d)找不到目标设备", aid);
+        }
+        tracer.step(trace_run, atomic_action.target_device ? atomic_action.target_device->getDid() : 0xFFFF,
+                    atomic_action.op, esp_timer_get_time() - step_start_us);
 
-    if (ret != pdPASS) {
-        ESP_LOGE(TAG, "创建动作执行任务失败");
+        if (pending_sleep_ms == 0) {
+            continue;
+        }
+        // 这个动作请求了延时, 启动定时器后让出执行者
+        uint32_t ms = pending_sleep_ms;
+        pending_sleep_ms = 0;
+        std::lock_guard<std::mutex> lock(executor_mutex);
+        if (cancel_flag) {
+            tracer.cancelled(trace_run, pc);
+            break;
+        }
+        if (!resume_timer) {
+            const esp_timer_create_args_t args = {
+                .callback = &ActionGroup::onResumeTimer,
+                .arg = this,
+                .dispatch_method = ESP_TIMER_TASK,
+                .name = "ag_resume",
+                .skip_unhandled_events = false,
+            };
+            if (esp_timer_create(&args, &resume_timer) != ESP_OK) {
+                ESP_LOGE(TAG, "动作组(%d)创建延时定时器失败, 跳过延时", aid);
+                resume_timer = nullptr;
+                continue;
+            }
+        }
+        sleep_since_us = esp_timer_get_time();
+        wake_at_us = sleep_since_us + (int64_t)ms * 1000;
+        esp_timer_start_once(resume_timer, (uint64_t)ms * 1000);
+        run_state = RunState::SLEEPING;
         task_handle = nullptr;
+        executor_stats.sleeping++;
+        return false;
+    }
+
+    finish();
+    return true;
+}
+
+void ActionGroup::runInline(std::vector<int64_t>& step_us) {
+    auto& tracer = SceneTracer::getInstance();
+    LordManager::instance().last_action_group_time = esp_timer_get_time() / 1000ULL;
+    {
+        std::lock_guard<std::mutex> lock(executor_mutex);
+        cancel_flag = false;
+        pc = 0;
+        pending_sleep_ms = 0;
+        run_start_us = esp_timer_get_time();
+        // task_handle留空, 期间的取消只置cancel_flag, 不会把通知发到调用者的任务上
+        run_state = RunState::RUNNING;
+        m_ag_runs.inc();
+        trace_run = tracer.begin(aid);
+        tracer.started(trace_run);
+    }
+
+    step_us.assign(actions.size(), -1);
+    while (pc < actions.size()) {
+        if (cancel_flag) {
+            tracer.cancelled(trace_run, pc);
+            break;
+        }
+        uint16_t i = pc++;
+        const auto& atomic_action = actions[i];
+        int64_t step_start_us = esp_timer_get_time();
+        atomic_action.target_device->execute(atomic_action.op, atomic_action.param, this, !is_mode());
+        step_us[i] = esp_timer_get_time() - step_start_us;
+        tracer.step(trace_run, atomic_action.target_device->getDid(), atomic_action.op, step_us[i]);
+        if (pending_sleep_ms != 0) {
+            ESP_LOGW(TAG, "动作组(%d)在调用者任务里执行, 不支持延时, 忽略%lums", aid, pending_sleep_ms);
+            pending_sleep_ms = 0;
+        }
+    }
+    finish();
+}
+
+void ActionGroup::onResumeTimer(void* arg) {
+    ActionGroup* self = static_cast<ActionGroup*>(arg);
+    std::lock_guard<std::mutex> lock(executor_mutex);
+    // 等锁期间被释放了, 先只比较指针
+    if (live_groups.count(self) == 0) {
         return;
     }
+    // 已经被取消了
+    if (self->run_state != RunState::SLEEPING) {
+        return;
+    }
+    // 已经触发的回调可能在等锁期间, 动作组被取消又重新执行并停到了新的延时上;
+    // 定时器只会晚到不会早到, 没到这一轮的到期时间就是上一轮留下的, 不能提前唤醒
+    if (esp_timer_get_time() < self->wake_at_us) {
+        return;
+    }
+    if (!self->enqueue()) {
+        // 队列满了就稍后再试, 延时多一点总比丢掉后半截动作好
+        ESP_LOGW(TAG, "动作组队列已满, 动作组(%d)稍后继续", self->aid);
+        self->wake_at_us = esp_timer_get_time() + 20 * 1000;
+        esp_timer_start_once(self->resume_timer, 20 * 1000);
+        return;
+    }
+    executor_stats.sleeping--;
 }
 
-void ActionGroup::clearTaskHandle() {
+void ActionGroup::finish() {
+    // 完成动作组, 刷新所有被标记过的面板按键指示灯
+    IndicatorHolder::getInstance().requestFlush();
+    int64_t total_us = esp_timer_get_time() - run_start_us;
+    m_ag_total_ms.record(total_us / 1000);
+    ESP_LOGI(TAG, "动作组(%d)执行结束, %u个动作, 耗时%lldus", aid, actions.size(), total_us);
+
+    std::lock_guard<std::mutex> lock(executor_mutex);
+    SceneTracer::getInstance().end(trace_run);
+    run_state = RunState::IDLE;
     task_handle = nullptr;
 }
 
 void ActionGroup::suicide() {
     // 在销毁此动作组前更新指示灯
-    IndicatorHolder::getInstance().callAllAndClear();
+    IndicatorHolder::getInstance().requestFlush();
     request_cancel();
 }
 
-bool ActionGroup::delay_ms(uint32_t ms) {
-    if (cancel_flag) return false;
-    uint32_t v = 0;
-    BaseType_t hit = xTaskNotifyWait(0, CANCEL_BIT, &v, pdMS_TO_TICKS(ms));
-    if ((hit == pdTRUE && (v & CANCEL_BIT)) || cancel_flag) {
-        return false; // 被取消
-    }
-    return true; // 正常睡满
+void ActionGroup::sleep_ms(uint32_t ms) {
+    pending_sleep_ms = ms;
 }
 
 void ActionGroup::request_cancel() {
-    cancel_flag = true;
-    if (task_handle != nullptr) {
-        #if (INCLUDE_xTaskAbortDelay == 1)
-        // 如果当前在 vTaskDelay 中，立刻唤醒
-        xTaskAbortDelay(task_handle);
-        #endif
-        // 置位取消位，唤醒任何 xTaskNotifyWait
-        xTaskNotify(task_handle, CANCEL_BIT, eSetBits);
-    }
-}
\ No newline at end of file
+    bool was_sleeping = false;
+    {
+        // 持锁, 保证通知不会落到已经换去执行别的动作组的执行者上
+        std::lock_guard<std::mutex> lock(executor_mutex);
+        cancel_flag = true;
+        if (run_state == RunState::RUNNING && task_handle != nullptr) {
+            #if (INCLUDE_xTaskAbortDelay == 1)
+            // 如果当前在 vTaskDelay 中，立刻唤醒
+            xTaskAbortDelay(task_handle);
+            #endif
+            // 置位取消位，唤醒任何 xTaskNotifyWait
+            xTaskNotify(task_handle, CANCEL_BIT, eSetBits);
+        } else if (run_state == RunState::SLEEPING) {
+            // 停在延时上的直接结束, 不用等定时器
+            esp_timer_stop(resume_timer);
+            executor_stats.sleeping--;
+            SceneTracer::getInstance().slept(trace_run, (esp_timer_get_time() - sleep_since_us) / 1000);
+            SceneTracer::getInstance().cancelled(trace_run, pc);
+            sleep_since_us = 0;
+            // 没有执行者在跑它, 但在finish()之前也不能被再次投递或再次取消
+            run_state = RunState::RUNNING;
+            was_sleeping = true;
+        }
+    }
+    if (was_sleeping) {
+        ESP_LOGW(TAG, "动作组(%d)在延时中被取消", aid);
+        finish();
+    }
+}
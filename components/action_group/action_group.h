@@ -3,45 +3,110 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <string_view>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
+#include "enums.h"
+#include "string_pool.h"
+#include "room_state.h"
 
 // extern int64_t last_action_group_time;
 
 class IDevice;
 
+// 解析配置时就解析好的参数, 执行时不再from_chars/sscanf
+struct ActionParam {
+    int32_t value = 0;                          // 延时秒数, 动作组id, 目标温度
+    uint8_t pid = 0;                            // 指示灯的面板id
+    uint8_t bid = 0;                            // 指示灯的按键id
+    RoomStateId state = ROOM_STATE_NONE;        // 房间状态id
+};
+
 // 最原子级的一条操作, 某种意义上
 struct AtomicAction {
     IDevice* target_device;                     // 本操作的目标设备
-    std::string operation;                      // 操作名, 直接交由某个设备处理
-    std::string parameter;                      // 有什么是字符串不能表示的呢
+    Opcode op = Opcode::NONE;                   // 操作码, 由操作名编译而来
+    ActionParam param;                          // 预解析的参数
 };
+
+// 动作组执行池的统计
+struct ActionExecutorStats {
+    uint32_t executed;                          // 已执行完的动作组数
+    uint32_t rejected;                          // 队列已满被丢弃的次数
+    uint32_t saturated;                         // 入队时所有执行者都在忙的次数
+    int64_t last_wait_us;                       // 最近一次排队等待时间
+    int64_t max_wait_us;                        // 最长排队等待时间
+    int64_t total_wait_us;                      // 累计排队等待时间, 除以executed得平均值
+    uint8_t busy;                               // 当前正在执行的执行者数
+    uint8_t queued;                             // 当前排队中的动作组数
+    uint16_t sleeping;                          // 当前停在延时上的动作组数, 不占用执行者
+};
+
+void initActionExecutors();                     // 创建执行池, 必须在任何动作组执行前调用
+ActionExecutorStats getActionExecutorStats();
+void logActionExecutorStats();
+
+// 把操作名和参数编译成AtomicAction, 无法识别的操作名会得到Opcode::NONE
+// 解析配置时register_names为true, 新的房间状态名会登记下来; 后台下发的操作传false, 只认已有的名字
+AtomicAction compileAtomicAction(IDevice* target_device, std::string_view operation, std::string_view parameter,
+                                 bool register_names = true);
+Opcode opcodeFromName(std::string_view operation);
+const char* opcodeName(Opcode op);              // 操作码的规范名, 用于日志和上报
+
+constexpr uint16_t CTL_BATCH_AID = 0xFFFE;      // 后台批量控制的临时动作组, 在执行记录里和配置的动作组区分开
     
 // 动作组基类
+// 动作组是可恢复的: 执行到延时时只记下程序计数器并启动定时器, 然后让出执行者,
+// 定时器到期再把自己投递回执行池从断点继续, 所以停在延时上的动作组不占任务栈
 class ActionGroup {
 public:
-    ActionGroup(uint16_t aid, const std::string& name, bool is_mode, std::vector<AtomicAction> actions)
-        : actions(actions), aid(aid), name(name), mode(is_mode) {}
+    ActionGroup(uint16_t aid, std::string_view name, bool is_mode, std::vector<AtomicAction> actions)
+        : actions(actions), aid(aid), name(intern_str(name)), mode(is_mode) {}
+    ~ActionGroup();
     
     uint16_t getAid() const { return aid; }
-    const std::string& getName() const { return name; }
+    const char* getName() const { return str_of(name); }
     bool is_mode() const { return mode; }
 
-    // 取消/可中断延时接口
+    // 取消/延时接口
     static constexpr uint32_t CANCEL_BIT = 0x1;   // 任务通知位：取消
-    bool delay_ms(uint32_t ms);                   // 可被取消的睡眠，true=睡满，false=被取消
-    void request_cancel();                        // 请求取消（唤醒正在睡眠的任务）
+    void sleep_ms(uint32_t ms);                   // 在当前动作执行完后挂起本动作组ms毫秒, 只能在执行者里调用
+    void request_cancel();                        // 请求取消, 正在延时的动作组会被立即结束
     bool cancelled() const { return cancel_flag; }
 
-    void executeAllAtomicAction();
-    void clearTaskHandle();
+    void executeAllAtomicAction();              // 投递到执行池, 不会阻塞
+    // 在调用者的任务里直接执行完, 不经过执行池, 用于后台批量控制这种临时拼出来的动作组;
+    // 不能让出执行者, 所以不支持延时. step_us按下标填每个动作的耗时, 没执行到的是-1
+    void runInline(std::vector<int64_t>& step_us);
+    bool beginRun(TaskHandle_t executor);       // 执行者取到本动作组时持executor_mutex调用, 返回false表示排队期间已被取消
+    bool resume();                              // 从程序计数器处继续执行, true=执行完毕, false=挂起在延时上
     void suicide();
     
     std::vector<AtomicAction> actions;
 private:
+    enum class RunState : uint8_t {
+        IDLE,                                     // 没有在执行
+        QUEUED,                                   // 已投递, 等待执行者
+        RUNNING,                                  // 某个执行者正在执行
+        SLEEPING,                                 // 停在延时上, 等定时器
+    };
+
     uint16_t aid;
-    std::string name;
+    StrHandle name;
     bool mode;
     volatile bool cancel_flag = false;            // 取消标志
-    TaskHandle_t task_handle = nullptr;
+    RunState run_state = RunState::IDLE;
+    uint16_t pc = 0;                              // 下一个要执行的动作
+    uint32_t pending_sleep_ms = 0;                // 当前动作请求的延时, 0表示不延时
+    int64_t run_start_us = 0;
+    int64_t sleep_since_us = 0;                   // 开始延时的时间, 用于记录实际延时了多久
+    int64_t wake_at_us = 0;                       // 每次启动定时器时记下的到期时间, 没到点的回调是上一轮延时留下的
+    uint32_t trace_run = 0;                       // 本次执行在SceneTracer里的记录号
+    TaskHandle_t task_handle = nullptr;           // 正在执行本动作组的执行者
+    esp_timer_handle_t resume_timer = nullptr;    // 延时结束后把自己投递回执行池, 第一次延时时才创建
+
+    bool enqueue();
+    void finish();
+    static void onResumeTimer(void* arg);
 };
@@ -0,0 +1,122 @@
+#include <esp_timer.h>
+#include <cstring>
+#include "scene_trace.h"
+
+SceneTrace* SceneTracer::slot(RunId run) {
+    if (run == 0) {
+        return nullptr;
+    }
+    SceneTrace* trace = &runs[run % SCENE_TRACE_RUNS];
+    return trace->run_id == run ? trace : nullptr;
+}
+
+SceneHistogram* SceneTracer::histOf(uint16_t aid) {
+    for (size_t i = 0; i < hist_count; i++) {
+        if (hists[i].aid == aid) {
+            return &hists[i];
+        }
+    }
+    if (hist_count < SCENE_HIST_AIDS) {
+        hists[hist_count].aid = aid;
+        return &hists[hist_count++];
+    }
+    return nullptr;
+}
+
+SceneTracer::RunId SceneTracer::begin(uint16_t aid) {
+    std::lock_guard<std::mutex> lock(mutex);
+    RunId run = next_run_id++;
+    if (next_run_id == 0) {
+        next_run_id = 1;
+    }
+    SceneTrace* trace = &runs[run % SCENE_TRACE_RUNS];
+    memset(trace, 0, sizeof(SceneTrace));
+    trace->run_id = run;
+    trace->aid = aid;
+    trace->cancel_pc = SCENE_TRACE_NOT_CANCELLED;
+    trace->start_us = esp_timer_get_time();
+    return run;
+}
+
+void SceneTracer::started(RunId run) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (SceneTrace* trace = slot(run)) {
+        trace->wait_us = esp_timer_get_time() - trace->start_us;
+    }
+}
+
+void SceneTracer::step(RunId run, uint16_t did, Opcode op, uint32_t dur_us) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (SceneTrace* trace = slot(run)) {
+        if (trace->step_count < SCENE_TRACE_STEPS) {
+            trace->steps[trace->step_count] = SceneTraceStep{did, op, dur_us, 0};
+        }
+        trace->step_count++;
+        trace->busy_us += dur_us;
+    }
+}
+
+void SceneTracer::slept(RunId run, uint32_t slept_ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    SceneTrace* trace = slot(run);
+    if (trace && trace->step_count > 0 && trace->step_count <= SCENE_TRACE_STEPS) {
+        trace->steps[trace->step_count - 1].slept_ms = slept_ms;
+    }
+}
+
+void SceneTracer::cancelled(RunId run, uint16_t pc) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (SceneTrace* trace = slot(run)) {
+        trace->cancel_pc = pc;
+    }
+}
+
+void SceneTracer::end(RunId run) {
+    std::lock_guard<std::mutex> lock(mutex);
+    SceneTrace* trace = slot(run);
+    if (!trace || trace->finished) {
+        return;
+    }
+    trace->finished = true;
+    trace->total_us = esp_timer_get_time() - trace->start_us;
+
+    if (SceneHistogram* hist = histOf(trace->aid)) {
+        size_t bucket = 0;
+        while (bucket < SCENE_HIST_BUCKETS - 1 && trace->busy_us >= bucket_edges_ms[bucket] * 1000) {
+            bucket++;
+        }
+        if (hist->counts[bucket] < UINT16_MAX) {
+            hist->counts[bucket]++;
+        }
+        if (trace->cancel_pc != SCENE_TRACE_NOT_CANCELLED && hist->cancelled < UINT16_MAX) {
+            hist->cancelled++;
+        }
+    }
+}
+
+size_t SceneTracer::snapshotRuns(SceneTrace* out, size_t max) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t n = 0;
+    // 从最旧的槽开始
+    for (size_t i = 0; i < SCENE_TRACE_RUNS && n < max; i++) {
+        const SceneTrace& trace = runs[(next_run_id + i) % SCENE_TRACE_RUNS];
+        if (trace.run_id != 0) {
+            out[n++] = trace;
+        }
+    }
+    return n;
+}
+
+size_t SceneTracer::snapshotHistograms(SceneHistogram* out, size_t max) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t n = hist_count < max ? hist_count : max;
+    memcpy(out, hists, n * sizeof(SceneHistogram));
+    return n;
+}
+
+void SceneTracer::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    memset(runs, 0, sizeof(runs));
+    memset(hists, 0, sizeof(hists));
+    hist_count = 0;
+}
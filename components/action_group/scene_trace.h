@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include "enums.h"
+
+#define SCENE_TRACE_RUNS        8       // 环形缓冲里保留最近几次执行
+#define SCENE_TRACE_STEPS       24      // 每次执行最多记录几个动作, 多出的只计入总耗时
+#define SCENE_HIST_AIDS         32      // 直方图最多统计多少个动作组
+#define SCENE_HIST_BUCKETS      8
+
+constexpr uint16_t SCENE_TRACE_NOT_CANCELLED = 0xFFFF;
+
+struct SceneTraceStep {
+    uint16_t did;
+    Opcode op;
+    uint32_t dur_us;                    // 动作本身的执行耗时
+    uint32_t slept_ms;                  // 该动作之后挂起了多久(延时), 0表示没有
+};
+
+struct SceneTrace {
+    uint32_t run_id;                    // 0表示空槽
+    uint16_t aid;
+    uint16_t step_count;                // 实际执行的动作数, 可能大于SCENE_TRACE_STEPS
+    uint16_t cancel_pc;                 // 在第几个动作前被取消, SCENE_TRACE_NOT_CANCELLED表示没被取消
+    bool finished;
+    int64_t start_us;                   // 投递到执行池的时间
+    uint32_t wait_us;                   // 第一次排队等待执行者的时间
+    uint32_t busy_us;                   // 所有动作执行耗时之和, 不含延时与排队
+    uint32_t total_us;                  // 从投递到结束的总耗时
+    SceneTraceStep steps[SCENE_TRACE_STEPS];
+};
+
+struct SceneHistogram {
+    uint16_t aid;
+    uint16_t cancelled;
+    uint16_t counts[SCENE_HIST_BUCKETS];    // 按busy_us分桶
+};
+
+// 动作组执行记录, 全部是固定大小的静态内存
+class SceneTracer {
+public:
+    using RunId = uint32_t;
+    static constexpr uint32_t bucket_edges_ms[SCENE_HIST_BUCKETS - 1] = {10, 50, 100, 250, 500, 1000, 5000};
+
+    static SceneTracer& getInstance() {
+        static SceneTracer instance;
+        return instance;
+    }
+
+    RunId begin(uint16_t aid);
+    void started(RunId run);
+    void step(RunId run, uint16_t did, Opcode op, uint32_t dur_us);
+    void slept(RunId run, uint32_t slept_ms);
+    void cancelled(RunId run, uint16_t pc);
+    void end(RunId run);
+
+    // 按时间顺序拷出, 返回条数
+    size_t snapshotRuns(SceneTrace* out, size_t max);
+    size_t snapshotHistograms(SceneHistogram* out, size_t max);
+    void clear();
+
+private:
+    SceneTrace runs[SCENE_TRACE_RUNS] = {};
+    SceneHistogram hists[SCENE_HIST_AIDS] = {};
+    size_t hist_count = 0;
+    RunId next_run_id = 1;
+    std::mutex mutex;
+
+    SceneTrace* slot(RunId run);        // 槽已被新的执行覆盖时返回nullptr
+    SceneHistogram* histOf(uint16_t aid);
+
+    SceneTracer() = default;
+    SceneTracer(const SceneTracer&) = delete;
+    SceneTracer& operator=(const SceneTracer&) = delete;
+};
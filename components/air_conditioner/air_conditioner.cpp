@@ -22,8 +22,8 @@ static ACMode bitsToMode(uint8_t mode_bits);
 static ACFanSpeed bitsToFanSpeed(uint8_t fan_speed_bits);
 static uint8_t modeToBits(ACMode mode);
 static uint8_t fanSpeedToBits(ACFanSpeed fan_speed);
-static std::string modeBitsToName(uint8_t mode_bits);
-static std::string fanSpeedBitsToName(uint8_t fan_speed_bits);
+static Opcode modeBitsToOpcode(uint8_t mode_bits);
+static Opcode fanSpeedBitsToOpcode(uint8_t fan_speed_bits);
 
 // 用户操作温控器来触发
 void AirConBase::update_state(uint8_t state, uint8_t temps) {
@@ -43,21 +43,21 @@ void AirConBase::update_state(uint8_t state, uint8_t temps) {
 
     // 上报空调操作
     if (power == 0x00 && is_running.load() == true) {
-        add_log_entry("air", did, "关闭", "");        // 因为是用户操控温控器面板, 所以传true让它记录日志
+        add_op_log(OpLogKind::AIR_PANEL, did, Opcode::CLOSE);        // 因为是用户操控温控器面板, 所以让它记录日志
     } else if (power == 0x01 && is_running.load() == false) {
-        add_log_entry("air", did, "打开", "");
+        add_op_log(OpLogKind::AIR_PANEL, did, Opcode::OPEN);
     }
 
     if (mode.load() != bitsToMode(mode_bits)) {
-        add_log_entry("air", did, modeBitsToName(mode_bits), "");
+        add_op_log(OpLogKind::AIR_PANEL, did, modeBitsToOpcode(mode_bits));
     }
 
     if (fan_speed.load() != bitsToFanSpeed(fan_speed_bits)) {
-        add_log_entry("air", did, fanSpeedBitsToName(fan_speed_bits), "");
+        add_op_log(OpLogKind::AIR_PANEL, did, fanSpeedBitsToOpcode(fan_speed_bits));
     }
 
     if (target_temp_val != target_temp.load()) {
-        add_log_entry("air", did, "调整至" + std::to_string(target_temp_val) + "度", "");
+        add_op_log(OpLogKind::AIR_PANEL, did, Opcode::AC_SET_TEMP, target_temp_val);
     }
 
     // 更新模式
@@ -72,12 +72,15 @@ void AirConBase::update_state(uint8_t state, uint8_t temps) {
 }
 
 // 另一种操控空调的方式, 比如语音控制, 后台控制
-void SinglePipeFCU::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
-    add_log_entry("air", did, operation, parameter, should_log);
-    ESP_LOGI_CYAN(TAG, "空调[%s] 收到操作[%s] param[%s]", name.c_str(), operation.c_str(), parameter.c_str());
+void SinglePipeFCU::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
+    if (op == Opcode::NONE) {
+        return;
+    }
+    add_op_log(OpLogKind::AIR, did, op, param.value, should_log);
+    ESP_LOGI_CYAN(TAG, "空调[%s] 收到操作[%s] param[%d]", getName(), opcodeName(op), (int)param.value);
 
     // 直接处理关闭
-    if (operation == "关" || operation == "关闭") {
+    if (op == Opcode::CLOSE) {
         power_off();
         sync_states();
         return;
@@ -88,53 +91,70 @@ void SinglePipeFCU::execute(std::string operation, std::string parameter, Action
     xTimerStop(shutdown_after_timer, 0);
 
     // 这种方式打开空调时, 固定使用全局默认配置的目标温度和风速
-    if (operation == "开" || operation == "打开") {
-        target_temp.store(AirConGlobalConfig::getInstance().default_target_temp);
-        fan_speed.store(AirConGlobalConfig::getInstance().default_fan_speed);
-        mode.store(AirConGlobalConfig::getInstance().default_mode);
-    } else if (operation == "制冷") {
-        mode.store(ACMode::COOLING);
-    } else if (operation == "制热") {
-        mode.store(ACMode::HEATING);
-    } else if (operation == "通风") {
-        mode.store(ACMode::FAN);
-    } else if (operation == "高风") {
-        fan_speed.store(ACFanSpeed::HIGH);
-    } else if (operation == "中风") {
-        fan_speed.store(ACFanSpeed::MEDIUM);
-    } else if (operation == "低风") {
-        fan_speed.store(ACFanSpeed::LOW);
-    } else if (operation == "自动") {
-        fan_speed.store(ACFanSpeed::AUTO);
-    } else if (operation == "风量加大") {
-        if (fan_speed.load() == ACFanSpeed::LOW) {
-            fan_speed.store(ACFanSpeed::MEDIUM);
-        } else if (fan_speed.load() == ACFanSpeed::MEDIUM) {
+    switch (op) {
+        case Opcode::OPEN:
+            target_temp.store(AirConGlobalConfig::getInstance().default_target_temp);
+            fan_speed.store(AirConGlobalConfig::getInstance().default_fan_speed);
+            mode.store(AirConGlobalConfig::getInstance().default_mode);
+            break;
+        case Opcode::AC_COOLING:
+            mode.store(ACMode::COOLING);
+            break;
+        case Opcode::AC_HEATING:
+            mode.store(ACMode::HEATING);
+            break;
+        case Opcode::AC_FAN:
+            mode.store(ACMode::FAN);
+            break;
+        case Opcode::AC_FAN_HIGH:
             fan_speed.store(ACFanSpeed::HIGH);
-        }
-    } else if (operation == "风量减小") {
-        if (fan_speed.load() == ACFanSpeed::HIGH) {
+            break;
+        case Opcode::AC_FAN_MEDIUM:
             fan_speed.store(ACFanSpeed::MEDIUM);
-        } else if (fan_speed.load() == ACFanSpeed::MEDIUM) {
+            break;
+        case Opcode::AC_FAN_LOW:
             fan_speed.store(ACFanSpeed::LOW);
+            break;
+        case Opcode::AC_FAN_AUTO:
+            fan_speed.store(ACFanSpeed::AUTO);
+            break;
+        case Opcode::AC_FAN_UP:
+            if (fan_speed.load() == ACFanSpeed::LOW) {
+                fan_speed.store(ACFanSpeed::MEDIUM);
+            } else if (fan_speed.load() == ACFanSpeed::MEDIUM) {
+                fan_speed.store(ACFanSpeed::HIGH);
+            }
+            break;
+        case Opcode::AC_FAN_DOWN:
+            if (fan_speed.load() == ACFanSpeed::HIGH) {
+                fan_speed.store(ACFanSpeed::MEDIUM);
+            } else if (fan_speed.load() == ACFanSpeed::MEDIUM) {
+                fan_speed.store(ACFanSpeed::LOW);
+            }
+            break;
+        case Opcode::AC_TEMP_UP: {
+            uint8_t current_temp = target_temp.load();
+            if (current_temp < 31) {
+                target_temp.store(current_temp + 1);
+            }
+            break;
         }
-    } else if (operation == "温度升高") {
-        uint8_t current_temp = target_temp.load();
-        if (current_temp < 31) {
-            target_temp.store(current_temp + 1);
-        }
-    } else if (operation == "温度降低") {
-        uint8_t current_temp = target_temp.load();
-        if (current_temp > 16) {
-            target_temp.store(current_temp - 1);
+        case Opcode::AC_TEMP_DOWN: {
+            uint8_t current_temp = target_temp.load();
+            if (current_temp > 16) {
+                target_temp.store(current_temp - 1);
+            }
+            break;
         }
-    } else if (operation == "调节温度") {
-        int temp = std::stoi(parameter);
-        
-        temp = std::max(16, std::min(temp, 31));
+        case Opcode::AC_SET_TEMP: {
+            int temp = std::max(16, std::min<int>(param.value, 31));
 
-        ESP_LOGI(TAG, "调节温度至%d\n", temp);
-        target_temp.store(static_cast<uint8_t>(temp));
+            ESP_LOGI(TAG, "调节温度至%d\n", temp);
+            target_temp.store(static_cast<uint8_t>(temp));
+            break;
+        }
+        default:
+            break;
     }
 
     adjust_relay_states();
@@ -175,6 +195,7 @@ void SinglePipeFCU::sync_states() {
     temps |= ((room_temp.load() - 16) & 0x0F) << 0;
 
     generate_response(AIR_CON, AIR_CON_CONTROL, 0x00, state, temps);
+    notify_device_state_changed();
 }
 
 void SinglePipeFCU::staticShutdownAfterTimerCallback(TimerHandle_t xTimer) {
@@ -374,64 +395,84 @@ void AirConBase::power_off() {
     // ESP_LOGI(TAG, "空调%d已关闭", ac_id);
 }
 
-void InfraredAC::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
-    add_log_entry("air", did, operation, parameter, should_log);
-    ESP_LOGI_CYAN(TAG, "空调[%s] 收到操作[%s]", name.c_str(), operation.c_str());
+void InfraredAC::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
+    if (op == Opcode::NONE) {
+        return;
+    }
+    add_op_log(OpLogKind::AIR, did, op, param.value, should_log);
+    ESP_LOGI_CYAN(TAG, "空调[%s] 收到操作[%s]", getName(), opcodeName(op));
 
-    if (operation == "关" || operation == "关闭") {
+    if (op == Opcode::CLOSE) {
         power_off();
         sync_states();
         return;
     }
 
     is_running.store(true);
-    if (operation == "开" || operation == "打开") {
-        target_temp.store(AirConGlobalConfig::getInstance().default_target_temp);
-        fan_speed.store(AirConGlobalConfig::getInstance().default_fan_speed);
-        mode.store(AirConGlobalConfig::getInstance().default_mode);
-    } else if (operation == "制冷") {
-        mode.store(ACMode::COOLING);
-    } else if (operation == "制热") {
-        mode.store(ACMode::HEATING);
-    } else if (operation == "通风") {
-        mode.store(ACMode::FAN);
-    } else if (operation == "高风") {
-        fan_speed.store(ACFanSpeed::HIGH);
-    } else if (operation == "中风") {
-        fan_speed.store(ACFanSpeed::MEDIUM);
-    } else if (operation == "低风") {
-        fan_speed.store(ACFanSpeed::LOW);
-    } else if (operation == "自动") {
-        fan_speed.store(ACFanSpeed::AUTO);
-    } else if (operation == "风量加大") {
-        if (fan_speed.load() == ACFanSpeed::LOW) {
-            fan_speed.store(ACFanSpeed::MEDIUM);
-        } else if (fan_speed.load() == ACFanSpeed::MEDIUM) {
+    switch (op) {
+        case Opcode::OPEN:
+            target_temp.store(AirConGlobalConfig::getInstance().default_target_temp);
+            fan_speed.store(AirConGlobalConfig::getInstance().default_fan_speed);
+            mode.store(AirConGlobalConfig::getInstance().default_mode);
+            break;
+        case Opcode::AC_COOLING:
+            mode.store(ACMode::COOLING);
+            break;
+        case Opcode::AC_HEATING:
+            mode.store(ACMode::HEATING);
+            break;
+        case Opcode::AC_FAN:
+            mode.store(ACMode::FAN);
+            break;
+        case Opcode::AC_FAN_HIGH:
             fan_speed.store(ACFanSpeed::HIGH);
-        }
-    } else if (operation == "风量减小") {
-        if (fan_speed.load() == ACFanSpeed::HIGH) {
+            break;
+        case Opcode::AC_FAN_MEDIUM:
             fan_speed.store(ACFanSpeed::MEDIUM);
-        } else if (fan_speed.load() == ACFanSpeed::MEDIUM) {
+            break;
+        case Opcode::AC_FAN_LOW:
             fan_speed.store(ACFanSpeed::LOW);
+            break;
+        case Opcode::AC_FAN_AUTO:
+            fan_speed.store(ACFanSpeed::AUTO);
+            break;
+        case Opcode::AC_FAN_UP:
+            if (fan_speed.load() == ACFanSpeed::LOW) {
+                fan_speed.store(ACFanSpeed::MEDIUM);
+            } else if (fan_speed.load() == ACFanSpeed::MEDIUM) {
+                fan_speed.store(ACFanSpeed::HIGH);
+            }
+            break;
+        case Opcode::AC_FAN_DOWN:
+            if (fan_speed.load() == ACFanSpeed::HIGH) {
+                fan_speed.store(ACFanSpeed::MEDIUM);
+            } else if (fan_speed.load() == ACFanSpeed::MEDIUM) {
+                fan_speed.store(ACFanSpeed::LOW);
+            }
+            break;
+        case Opcode::AC_TEMP_UP: {
+            uint8_t current_temp = target_temp.load();
+            if (current_temp < 31) {
+                target_temp.store(current_temp + 1);
+            }
+            break;
         }
-    } else if (operation == "温度升高") {
-        uint8_t current_temp = target_temp.load();
-        if (current_temp < 31) {
-            target_temp.store(current_temp + 1);
+        case Opcode::AC_TEMP_DOWN: {
+            uint8_t current_temp = target_temp.load();
+            if (current_temp > 16) {
+                target_temp.store(current_temp - 1);
+            }
+            break;
         }
-    } else if (operation == "温度降低") {
-        uint8_t current_temp = target_temp.load();
-        if (current_temp > 16) {
-            target_temp.store(current_temp - 1);
+        case Opcode::AC_SET_TEMP: {
+            int temp = std::max(16, std::min<int>(param.value, 31));
+
+            ESP_LOGI(TAG, "调节温度至%d\n", temp);
+            target_temp.store(static_cast<uint8_t>(temp));
+            break;
         }
-    } else if (operation == "调节温度") {
-        int temp = std::stoi(parameter);
-        
-        temp = std::max(16, std::min(temp, 31));
-        
-        ESP_LOGI(TAG, "调节温度至%d\n", temp);
-        target_temp.store(static_cast<uint8_t>(temp));
+        default:
+            break;
     }
 
     sync_states();
@@ -467,6 +508,7 @@ void InfraredAC::sync_states() {
     temps |= ((room_temp.load() - 16) & 0x0F) << 0;
 
     generate_response(AIR_CON, AIR_CON_CONTROL, 0x00, state, temps);
+    notify_device_state_changed();
     // generate_response(AIR_CON, 0x08, 0x00, state, temps);
 }
 
@@ -529,26 +571,26 @@ static uint8_t fanSpeedToBits(ACFanSpeed fan_speed) {
     }
 }
 
-static std::string modeBitsToName(uint8_t mode_bits) {
+static Opcode modeBitsToOpcode(uint8_t mode_bits) {
     switch (mode_bits) {
-        case 0x00: return "制冷";
-        case 0x01: return "制热";
-        case 0x03: return "通风";
+        case 0x00: return Opcode::AC_COOLING;
+        case 0x01: return Opcode::AC_HEATING;
+        case 0x03: return Opcode::AC_FAN;
         default:
             ESP_LOGE(TAG, "未知模式位: 0x%2x", mode_bits);
-            return "未知模式";
+            return Opcode::NONE;
     }
 }
 
-static std::string fanSpeedBitsToName(uint8_t fan_speed_bits) {
+static Opcode fanSpeedBitsToOpcode(uint8_t fan_speed_bits) {
     switch (fan_speed_bits) {
-        case 0x00: return "低风";
-        case 0x01: return "中风";
-        case 0x02: return "高风";
-        case 0x03: return "自动";
+        case 0x00: return Opcode::AC_FAN_LOW;
+        case 0x01: return Opcode::AC_FAN_MEDIUM;
+        case 0x02: return Opcode::AC_FAN_HIGH;
+        case 0x03: return Opcode::AC_FAN_AUTO;
         default:
             ESP_LOGE(TAG, "未知风速位: 0x%2x", fan_speed_bits);
-            return "未知风速";
+            return Opcode::NONE;
     }
 }
 
@@ -154,7 +154,7 @@ public:
         }
     }
 
-    void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
+    void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
     void update_state(uint8_t state, uint8_t temps) override;
     void sync_states() override;
 
@@ -187,7 +187,7 @@ class InfraredAC : public AirConBase {
 public:
     InfraredAC(uint16_t did, const std::string& name, const std::string&carry_state, uint8_t ac_id)
         : AirConBase(did, name, carry_state, ac_id, DeviceType::INFRARED_AIR, ACType::INFRARED) {}
-    void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
+    void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
     void update_state(uint8_t state, uint8_t temps) override;
     void sync_states() override;
 
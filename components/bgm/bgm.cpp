@@ -5,36 +5,51 @@
 
 #define TAG "BGM"
 
-void BGM::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
-    ESP_LOGI_CYAN(TAG, "单继电器设备[%s]收到操作[%s]", name.c_str(), operation.c_str());
-    if (operation == "打开功放") {
-        generate_response(0x80, 0x01, 0x00, 0x26, 0x01);
-    } else if (operation == "关闭功放") {
-        generate_response(0x80, 0x01, 0x00, 0x26, 0x00);
-    } else if (operation == "播放") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_PLAY);
-    } else if (operation == "停止") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_STOP);
-    } else if (operation == "播放/暂停") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_PLAY_AND_PAUSE);
-    } else if (operation == "上一首") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_PREV);
-    } else if (operation == "下一首") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_NEXT);
-    } else if (operation == "音量加") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_VOLUME_UP);
-    } else if (operation == "音量减") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_VOLUME_DOWN);
-    } else if (operation == "打开蓝牙模式") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_BL_OPEN);
-    } else if (operation == "关闭蓝牙模式") {
-        generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_BL_CLOSE);
-    } else if (operation == "反转模式") {
-        if (curr_mode == BGMMode::BL) {
-            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_BL_CLOSE);
-        } else {
+void BGM::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
+    ESP_LOGI_CYAN(TAG, "背景音乐[%s]收到操作[%s]", getName(), opcodeName(op));
+    switch (op) {
+        case Opcode::BGM_AMP_ON:
+            generate_response(0x80, 0x01, 0x00, 0x26, 0x01);
+            break;
+        case Opcode::BGM_AMP_OFF:
+            generate_response(0x80, 0x01, 0x00, 0x26, 0x00);
+            break;
+        case Opcode::BGM_PLAY:
+            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_PLAY);
+            break;
+        case Opcode::BGM_STOP:
+            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_STOP);
+            break;
+        case Opcode::BGM_PLAY_PAUSE:
+            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_PLAY_AND_PAUSE);
+            break;
+        case Opcode::BGM_PREV:
+            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_PREV);
+            break;
+        case Opcode::BGM_NEXT:
+            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_NEXT);
+            break;
+        case Opcode::BGM_VOLUME_UP:
+            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_VOLUME_UP);
+            break;
+        case Opcode::BGM_VOLUME_DOWN:
+            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_VOLUME_DOWN);
+            break;
+        case Opcode::BGM_BL_OPEN:
             generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_BL_OPEN);
-        }
+            break;
+        case Opcode::BGM_BL_CLOSE:
+            generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_BL_CLOSE);
+            break;
+        case Opcode::BGM_TOGGLE_MODE:
+            if (curr_mode == BGMMode::BL) {
+                generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_BL_CLOSE);
+            } else {
+                generate_response(BGM_CON, 0x00, 0x00, 0x00, BGM_CON_BL_OPEN);
+            }
+            break;
+        default:
+            break;
     }
 }
 
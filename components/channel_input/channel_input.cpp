@@ -4,27 +4,17 @@
 #include "channel_input.h"
 #include "commons.h"
 #include "lord_manager.h"
-#include "drycontact_out.h"
 #include "esp_timer.h"
-#include <lamp.h>
 
 #define TAG "CHANNEL_INPUT"
 
 void ChannelInput::execute() {
-    ESP_LOGI_CYAN(TAG, "channel(%u)[%s]开始执行动作组(%u/%u)", channel, name.c_str(), current_index + 1, action_groups.size());
+    ESP_LOGI_CYAN(TAG, "channel(%u)[%s]开始执行动作组(%u/%u)", channel, getName(), current_index + 1, action_groups.size());
     static auto& lord = LordManager::instance();
 
     if (lord.isSleep()) {
         lord.useAliveHeartBeat();
-        for (auto* dry : lord.getDevicesByType<Lamp>()) {
-            dry->syncAssBtnToDevState();
-        }
-        for (auto* dry : lord.getDevicesByType<SingleRelayDevice>()) {
-            dry->syncAssBtnToDevState();
-        }
-        for (auto* dry : lord.getDevicesByType<DryContactOut>()) {
-            dry->syncAssBtnToDevState();
-        }
+        lord.syncAllAssBtnToDevState();
     }
     
     // 干接点同样可以忽略任意键执行
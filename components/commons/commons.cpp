@@ -2,9 +2,11 @@
 #include "esp_log.h"
 #include "../my_mqtt/my_mqtt.h"
 #include "esp_partition.h"
+#include "esp_timer.h"
 #include "freertos/task.h"
 #include "freertos/FreeRTOS.h"
 #include <stdexcept>
+#include <atomic>
 
 #include "action_group.h"
 #include "rs485_comm.h"
@@ -14,6 +16,8 @@
 #include "identity.h"
 #include "rs485_command.h"
 #include "network.h"
+#include "op_journal.h"
+#include "lord_manager.h"
 
 #define TAG "commons"
 
@@ -31,55 +35,183 @@ time_t get_current_timestamp() {
 }
 
 // *************** 上报操作日志 ***************
-void add_log_entry(const std::string& devicetype, uint16_t deviceid, const std::string& operation,
-                   std::string param, bool should_log) {
+static OpLogRing<OP_LOG_CAPACITY> op_log_ring;
+
+void add_op_log(OpLogKind kind, uint16_t did, Opcode op, int32_t param, bool should_log) {
     if (!should_log) return;
-    
-    std::lock_guard<std::mutex> lock(log_mutex); // 确保线程安全
+    op_log_ring.append({static_cast<uint32_t>(get_current_timestamp()), did, kind, static_cast<uint8_t>(op), param});
+}
 
-    if (log_array.size() >= LOG_MAX_SIZE) {
-        ESP_LOGI(TAG, "一分钟内日志抵达上限, 移除最旧的日志");
-        log_array.erase(log_array.begin());
+// 拼成和以前一样的上报格式, 后台不用改
+json opLogToJson(const OpLogRecord& rec) {
+    const char* devicetype = "";
+    std::string operation;
+    std::string param;
+    Opcode op = static_cast<Opcode>(rec.op);
+    switch (rec.kind) {
+        case OpLogKind::MODE:
+            devicetype = "mode";
+            // 离线日志里的记录可能是好几次重启之前的, 配置换过的话这个aid已经不在了
+            if (ActionGroup* mode = LordManager::instance().getActionGroupByAid(rec.did)) {
+                operation = std::string("进入") + mode->getName();
+            } else {
+                operation = "进入模式(" + std::to_string(rec.did) + ")";
+            }
+            break;
+        case OpLogKind::CURTAIN:
+            devicetype = "cur";
+            operation = opcodeName(op);
+            break;
+        case OpLogKind::AIR:
+            devicetype = "air";
+            operation = opcodeName(op);
+            if (op == Opcode::AC_SET_TEMP) {
+                param = std::to_string(rec.param);
+            }
+            break;
+        case OpLogKind::AIR_PANEL:
+            devicetype = "air";
+            if (op == Opcode::OPEN) {
+                operation = "打开";
+            } else if (op == Opcode::CLOSE) {
+                operation = "关闭";
+            } else if (op == Opcode::AC_SET_TEMP) {
+                operation = "调整至" + std::to_string(rec.param) + "度";
+            } else if (op == Opcode::NONE) {
+                operation = "未知";
+            } else {
+                operation = opcodeName(op);
+            }
+            break;
     }
-    nlohmann::json entry = {
+    return {
         {"devicetype", devicetype},
-        {"deviceid", std::to_string(deviceid)},
+        {"deviceid", std::to_string(rec.did)},
         {"operation", operation},
         {"param", param},
-        {"tm", std::to_string(get_current_timestamp())}
+        {"tm", std::to_string(rec.tm)}
     };
-    log_array.push_back(entry);
 }
 
-std::vector<nlohmann::json> fetch_and_clear_logs() {
-    std::lock_guard<std::mutex> lock(log_mutex); // 确保线程安全
-    std::vector<nlohmann::json> current_logs = std::move(log_array); // 移动数据
-    log_array.clear();
-    return current_logs;
+static void publish_op_log_batch(json& list) {
+    json msg;
+    msg["type"] = "log";
+    msg["mac"] = getSerialNum();
+    msg["list"] = std::move(list);
+    mqtt_publish_message(msg.dump(), 0, 0);
+    list = json::array();
 }
 
-void report_op_logs(void) {
+static void publish_op_logs_directly() {
     if (!(network_is_ready()) || !mqtt_connected) {
         ESP_LOGW(TAG, "无网络, 不上报操作日志");
         return;
     }
-    
-    auto logs = fetch_and_clear_logs();
-    if (!logs.empty()) {
-        while (!logs.empty()) {
-            size_t batch_size = std::min(logs.size(), LOG_MAX_SIZE / 2);
-            std::vector<nlohmann::json> batch(logs.begin(), logs.begin() + batch_size);
-            logs.erase(logs.begin(), logs.begin() + batch_size);
-
-            nlohmann::json json;
-            json["type"] = "log";
-            json["mac"] = getSerialNum();
-            json["list"] = batch;
-
-            mqtt_publish_message(json.dump(), 0, 0);
+    json list = json::array();
+    uint32_t lost = op_log_ring.drain([&](const OpLogRecord& rec) {
+        list.push_back(opLogToJson(rec));
+        if (list.size() >= OP_LOG_BATCH) {
+            publish_op_log_batch(list);
         }
-    } else {
-        // ESP_LOGI(TAG, "日志数组为空, 无需发送");
+    });
+    if (!list.empty()) {
+        publish_op_log_batch(list);
+    }
+    if (lost) {
+        ESP_LOGW(TAG, "操作日志超过%u条, 覆盖了最旧的%lu条(累计%lu)", OP_LOG_CAPACITY, lost, op_log_ring.totalDropped());
+    }
+}
+
+// 只有上报任务会调用, 环形缓冲的读者只有它一个
+void report_op_logs(void) {
+    auto& journal = OpJournal::getInstance();
+    if (!journal.isReady()) {
+        publish_op_logs_directly();
+        return;
+    }
+
+    // 先整批落盘, 一次上报周期只写一次文件
+    OpLogRecord recs[OP_LOG_CAPACITY];
+    size_t n = 0;
+    uint32_t lost = op_log_ring.drain([&](const OpLogRecord& rec) {
+        recs[n++] = rec;
+    });
+    journal.append(recs, n);
+    if (lost) {
+        ESP_LOGW(TAG, "操作日志超过%u条, 覆盖了最旧的%lu条(累计%lu)", OP_LOG_CAPACITY, lost, op_log_ring.totalDropped());
+    }
+
+    if (network_is_ready() && mqtt_connected) {
+        journal.sendNextBatch();
+    }
+}
+
+static TaskHandle_t op_log_task_handle = nullptr;
+
+// 每分钟落盘并上报一次; 在线且离线日志有积压时每OP_LOG_SEND_INTERVAL_MS发一批, 直到追上
+static void op_log_task(void* param) {
+    while (true) {
+        report_op_logs();
+        bool catching_up = mqtt_connected && OpJournal::getInstance().hasBacklog();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(catching_up ? OP_LOG_SEND_INTERVAL_MS : 60000));
+    }
+    vTaskDelete(nullptr);
+}
+
+void startOpLogReporter() {
+    OpJournal::getInstance().init();
+    xTaskCreate(op_log_task, "report_operation_task", 8192, nullptr, 3, &op_log_task_handle);
+}
+
+void kickOpLogReporter() {
+    if (op_log_task_handle) {
+        xTaskNotifyGive(op_log_task_handle);
+    }
+}
+
+json benchOpLogAppend(uint32_t count) {
+    static OpLogRing<OP_LOG_CAPACITY> bench_ring;       // 不碰真正的操作日志
+    OpLogRecord rec = {static_cast<uint32_t>(get_current_timestamp()), 1, OpLogKind::AIR, static_cast<uint8_t>(Opcode::AC_SET_TEMP), 26};
+
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < count; i++) {
+        rec.param = i;
+        bench_ring.append(rec);
+    }
+    int64_t ring_us = esp_timer_get_time() - start;
+    size_t heap_after = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    // 对照: 以前每条日志都要拼一个json对象
+    uint32_t json_count = std::min<uint32_t>(count, 1000);
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < json_count; i++) {
+        json entry = opLogToJson(rec);
+    }
+    int64_t json_us = esp_timer_get_time() - start;
+
+    json result;
+    result["type"] = "oplog_bench";
+    result["count"] = count;
+    result["ring_ns_per_op"] = count ? ring_us * 1000 / count : 0;
+    result["ring_heap_delta"] = static_cast<int64_t>(heap_before) - static_cast<int64_t>(heap_after);
+    result["json_ns_per_op"] = json_count ? json_us * 1000 / json_count : 0;
+    result["record_bytes"] = sizeof(OpLogRecord);
+    ESP_LOGI(TAG, "操作日志追加%lu次: %lldns/次, 堆变化%d字节; 拼json %lldns/次",
+             count, count ? ring_us * 1000 / count : 0, (int)(heap_before - heap_after), json_count ? json_us * 1000 / json_count : 0);
+    return result;
+}
+
+// *************** 设备状态变化 ***************
+static std::atomic<TaskHandle_t> device_state_listener{nullptr};
+
+void set_device_state_listener(TaskHandle_t task) {
+    device_state_listener.store(task, std::memory_order_release);
+}
+
+void notify_device_state_changed() {
+    if (TaskHandle_t task = device_state_listener.load(std::memory_order_acquire)) {
+        xTaskNotifyGive(task);
     }
 }
 
@@ -88,9 +220,17 @@ void printCurrentFreeMemory(const std::string& msg_head) {
         msg_head.c_str(), heap_caps_get_free_size(MALLOC_CAP_INTERNAL), heap_caps_get_free_size(MALLOC_CAP_DMA));
 }
 
+// 调试信息不进环形缓冲, 直接单独发一条
 void urgentPublishDebugLog(const std::string& msg) {
-    add_log_entry("debug", 0, "", msg);
-    report_op_logs();
+    json list = json::array();
+    list.push_back({
+        {"devicetype", "debug"},
+        {"deviceid", "0"},
+        {"operation", ""},
+        {"param", msg},
+        {"tm", std::to_string(get_current_timestamp())}
+    });
+    publish_op_log_batch(list);
 }
 
 std::vector<uint8_t> pavectorseHexToFixedArray(const std::string& hexString) {
@@ -13,20 +13,28 @@ extern "C" {
 #include <ctime>
 #include <esp_sntp.h>
 #include <esp_log.h>
+#include "enums.h"
+#include "op_log_ring.h"
 
 void printCurrentFreeMemory(const std::string& head = "当前内存");  // 打印内存
 std::vector<uint8_t> pavectorseHexToFixedArray(const std::string& hexString);// 将指令码字符串解析成array
 time_t get_current_timestamp();                             // 获取当前时间
 
 // *************** 上报操作日志 ***************
-static std::vector<nlohmann::json> log_array;
-static std::mutex log_mutex;
-const size_t LOG_MAX_SIZE = 50;
-void add_log_entry(const std::string& devicetype, uint16_t deviceid,
-                   const std::string& operation, std::string param, bool should_log = true);
-std::vector<nlohmann::json> fetch_and_clear_logs();
+const size_t OP_LOG_CAPACITY = 64;      // 一分钟上报一次, 超过就覆盖最旧的
+const size_t OP_LOG_BATCH = 25;         // 每条mqtt消息最多带的日志数
+const uint32_t OP_LOG_SEND_INTERVAL_MS = 500;   // 补传离线日志时两批之间的最短间隔
+void add_op_log(OpLogKind kind, uint16_t did, Opcode op, int32_t param = 0, bool should_log = true);
+nlohmann::json opLogToJson(const OpLogRecord& rec);
 void report_op_logs(void);
+void startOpLogReporter();              // 挂载littlefs与NVS之后调用, 打开离线日志并启动上报任务
+void kickOpLogReporter();               // mqtt连上时调用, 立即开始补传
 void urgentPublishDebugLog(const std::string& msg);
+nlohmann::json benchOpLogAppend(uint32_t count);     // 测追加耗时与是否分配内存, 给oracle用
+
+// *************** 设备状态变化 ***************
+void set_device_state_listener(TaskHandle_t task);  // 状态上报任务启动时登记自己
+void notify_device_state_changed();                 // 设备状态变了就调用, 只是叫醒上报任务, 哪里都能调
 
 #define ESP_LOGI_CYAN(tag, fmt, ...) \
     ESP_LOGI(tag, "%s" fmt "%s", "\033[1;36m", ##__VA_ARGS__, "\033[0m")
@@ -0,0 +1,295 @@
+#include "op_journal.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "commons.h"
+#include "identity.h"
+#include "../my_mqtt/my_mqtt.h"
+
+#define TAG "OP_JOURNAL"
+#define NVS_NS  "op_journal"
+#define NVS_KEY "acked"
+
+using json = nlohmann::json;
+
+static_assert(sizeof(OpLogRecord) == 12, "OpLogRecord会写进flash, 不要随便改布局");
+
+const char* OpJournal::segPath(uint8_t seg) {
+    return seg == 0 ? "/littlefs/oplog0.bin" : "/littlefs/oplog1.bin";
+}
+
+uint32_t OpJournal::entryCrc(const Entry& e) {
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t*>(&e), offsetof(Entry, crc));
+}
+
+// 段内的序号是连续的, 第i条就是first + i, 坏掉的条目也占位置
+void OpJournal::scanSegment(uint8_t seg, uint32_t& first, uint32_t& last) {
+    seg_count[seg] = 0;
+    first = last = 0;
+
+    struct stat st;
+    if (stat(segPath(seg), &st) != 0) {
+        return;
+    }
+    // 掉电时写了半条, 截掉
+    if (st.st_size % sizeof(Entry) != 0) {
+        ESP_LOGW(TAG, "%s末尾有半条记录, 截断", segPath(seg));
+        truncate(segPath(seg), st.st_size - st.st_size % sizeof(Entry));
+    }
+    FILE* f = fopen(segPath(seg), "rb");
+    if (!f) {
+        return;
+    }
+    Entry e;
+    uint32_t index = 0;
+    bool found = false;
+    while (fread(&e, sizeof(e), 1, f) == 1) {
+        if (entryCrc(e) == e.crc) {
+            if (!found) {
+                first = e.seq - index;
+                found = true;
+            }
+            last = e.seq;
+        }
+        index++;
+    }
+    fclose(f);
+    if (found) {
+        seg_count[seg] = index;
+        last = first + index - 1;
+    } else if (index > 0) {
+        ESP_LOGE(TAG, "%s里没有一条完好的记录, 丢弃", segPath(seg));
+        corrupt += index;
+        remove(segPath(seg));
+    }
+}
+
+void OpJournal::init() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) == ESP_OK) {
+        nvs_get_u32(h, NVS_KEY, &acked_seq);
+        nvs_close(h);
+    }
+
+    uint32_t last[2];
+    scanSegment(0, seg_first[0], last[0]);
+    scanSegment(1, seg_first[1], last[1]);
+
+    // 序号更大的是正在追加的段
+    if (seg_count[0] && seg_count[1]) {
+        active = seg_first[1] > seg_first[0] ? 1 : 0;
+    } else {
+        active = seg_count[1] ? 1 : 0;
+    }
+    if (seg_count[active]) {
+        next_seq = last[active] + 1;
+    } else {
+        next_seq = acked_seq + 1;
+    }
+    // NVS和日志文件对不上(比如其中一个被擦过), 以日志文件为准
+    if (acked_seq >= next_seq) {
+        acked_seq = next_seq - 1;
+    }
+    uint8_t older = active ^ 1;
+    uint32_t oldest = seg_count[older] ? seg_first[older] : seg_first[active];
+    if (seg_count[active] && acked_seq + 1 < oldest) {
+        acked_seq = oldest - 1;
+    }
+    saved_acked = acked_seq;
+    ready = true;
+    ESP_LOGI(TAG, "离线操作日志: 段%u/%u条, 下一序号%lu, 已确认至%lu, 积压%lu条",
+             seg_count[0], seg_count[1], next_seq, acked_seq, next_seq - 1 - acked_seq);
+}
+
+// 调用者必须持有mutex. 丢弃时挪过去的确认位置也等persistAcked记, 没记上就重启的话init会按最旧的段修正
+void OpJournal::rotate() {
+    uint8_t older = active ^ 1;
+    if (seg_count[older]) {
+        uint32_t older_last = seg_first[older] + seg_count[older] - 1;
+        if (older_last > acked_seq) {
+            uint32_t n = older_last - std::max(acked_seq, seg_first[older] - 1);
+            lost += n;
+            ESP_LOGW(TAG, "日志写满, 丢弃%lu条未上传的操作日志", n);
+            acked_seq = older_last;
+        }
+    }
+    remove(segPath(older));
+    seg_count[older] = 0;
+    active = older;
+}
+
+void OpJournal::append(const OpLogRecord* recs, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ready) {
+        return;
+    }
+
+    while (count > 0) {
+        if (seg_count[active] >= SEG_RECORDS) {
+            rotate();
+        }
+        size_t n = std::min(count, SEG_RECORDS - seg_count[active]);
+        FILE* f = fopen(segPath(active), "ab");
+        if (!f) {
+            ESP_LOGE(TAG, "打开%s失败, %u条操作日志没有落盘", segPath(active), count);
+            return;
+        }
+        if (seg_count[active] == 0) {
+            seg_first[active] = next_seq;
+        }
+        for (size_t i = 0; i < n; i++) {
+            Entry e = {next_seq, recs[i], 0};
+            e.crc = entryCrc(e);
+            if (fwrite(&e, sizeof(e), 1, f) != 1) {
+                ESP_LOGE(TAG, "写入%s失败", segPath(active));
+                n = i;
+                break;
+            }
+            next_seq++;
+            seg_count[active]++;
+        }
+        fclose(f);
+        if (n == 0) {
+            return;
+        }
+        recs += n;
+        count -= n;
+    }
+}
+
+// 调用者必须持有mutex, 按序号顺序读出未确认的条目, 跳过CRC不对的
+size_t OpJournal::readBacklog(Entry* out, size_t max) {
+    size_t got = 0;
+    uint32_t want = acked_seq + 1;
+    for (uint8_t seg : {(uint8_t)(active ^ 1), active}) {
+        if (got >= max || seg_count[seg] == 0) {
+            continue;
+        }
+        uint32_t seg_last = seg_first[seg] + seg_count[seg] - 1;
+        if (seg_last < want) {
+            continue;
+        }
+        uint32_t index = want > seg_first[seg] ? want - seg_first[seg] : 0;
+        FILE* f = fopen(segPath(seg), "rb");
+        if (!f) {
+            continue;
+        }
+        fseek(f, index * sizeof(Entry), SEEK_SET);
+        Entry e;
+        while (got < max && fread(&e, sizeof(e), 1, f) == 1) {
+            uint32_t seq = seg_first[seg] + index++;
+            if (entryCrc(e) != e.crc || e.seq != seq) {
+                corrupt++;
+                ESP_LOGW(TAG, "操作日志%lu校验失败, 跳过", seq);
+                continue;
+            }
+            out[got++] = e;
+        }
+        fclose(f);
+        want = seg_last + 1;
+    }
+    return got;
+}
+
+bool OpJournal::sendNextBatch() {
+    persistAcked();
+
+    Entry batch[BATCH];
+    size_t n;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (acks.isAcked(inflight_msg)) {
+            uploaded += inflight_last - acked_seq;
+            acked_seq = inflight_last;
+            inflight_msg = -1;
+        }
+        if (!ready || acked_seq + 1 >= next_seq) {
+            return false;
+        }
+        if (inflight_msg >= 0 && esp_timer_get_time() - inflight_since < RESEND_US) {
+            return false;
+        }
+        if (inflight_msg >= 0) {
+            ESP_LOGW(TAG, "批次(msg_id %d)超时未确认, 重发", inflight_msg);
+            inflight_msg = -1;
+        }
+
+        n = readBacklog(batch, BATCH);
+        if (n == 0) {
+            // 剩下的全是坏的, 直接算确认
+            acked_seq = next_seq - 1;
+            return false;
+        }
+    }
+
+    json list = json::array();
+    for (size_t i = 0; i < n; i++) {
+        json item = opLogToJson(batch[i].rec);
+        item["seq"] = std::to_string(batch[i].seq);
+        list.push_back(std::move(item));
+    }
+    json msg;
+    msg["type"] = "log";
+    msg["mac"] = getSerialNum();
+    msg["list"] = std::move(list);
+
+    // 发布不能持有mutex, 见onPublished
+    int msg_id = mqtt_publish_message(msg.dump(), 1, 0);
+    if (msg_id < 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    inflight_msg = msg_id;
+    acks.expect(msg_id);
+    inflight_last = batch[n - 1].seq;
+    inflight_since = esp_timer_get_time();
+    return true;
+}
+
+bool OpJournal::hasBacklog() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ready && acked_seq + 1 < next_seq;
+}
+
+void OpJournal::segmentPaths(const char* paths[2]) {
+    std::lock_guard<std::mutex> lock(mutex);
+    paths[0] = segPath(active ^ 1);
+    paths[1] = segPath(active);
+}
+
+OpJournal::Stats OpJournal::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return {next_seq, acked_seq, uploaded, lost, corrupt};
+}
+
+// 每批都写NVS太频繁, 确认位置变了也要隔SAVE_ACKED_US才写一次, 而且在mutex外面写, 不挡append.
+// 掉电时最多重发最后这段时间里已确认的条目, 后台按seq去重
+void OpJournal::persistAcked() {
+    uint32_t seq;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t now = esp_timer_get_time();
+        if (!ready || acked_seq == saved_acked || (saved_at != 0 && now - saved_at < SAVE_ACKED_US)) {
+            return;
+        }
+        seq = saved_acked = acked_seq;
+        saved_at = now;
+    }
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_u32(h, NVS_KEY, seq) == ESP_OK) {
+        nvs_commit(h);
+    }
+    nvs_close(h);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <atomic>
+#include "op_log_ring.h"
+#include "puback_tracker.h"
+
+// 操作日志的离线日志, 存在littlefs上, 断网期间的操作不会丢
+// 两个定长段文件轮流追加, 每条带序号和CRC, 总大小有上限; 写满一段就清掉更旧的那段
+// 上传按序号顺序一批一批发(QoS1), 收到PUBACK才算确认; 确认位置隔一段时间才记进NVS,
+// 重启后从记下的位置继续. 没确认或确认了没来得及记的批次会重发, 后台按(mac, seq)去重就是恰好一次
+class OpJournal {
+public:
+    static OpJournal& getInstance() {
+        static OpJournal instance;
+        return instance;
+    }
+
+    void init();                                        // 挂载littlefs与NVS之后调用, 扫描段文件恢复序号
+    void append(const OpLogRecord* recs, size_t count); // 一次调用只写一次文件, 调用者自己攒批
+    // 只在上报任务里调用: 先处理收到的PUBACK, 再在没有在途批次且有积压时发一批, 返回是否发出
+    bool sendNextBatch();
+    // MQTT_EVENT_PUBLISHED, 在mqtt任务里调用, 只交给acks记下
+    // 不能在这里拿mutex: mqtt任务派发事件时持有客户端的锁, 而发布时要先拿这把锁
+    void onPublished(int msg_id) { acks.onPublished(msg_id); }
+    bool hasBacklog();
+    bool isReady() const { return ready; }              // littlefs没挂上时为false, 只能直接上报
+    void segmentPaths(const char* paths[2]);            // 两个段文件, 旧的在前, 给GET_FILE上传用
+
+    struct Stats {
+        uint32_t next_seq;
+        uint32_t acked_seq;
+        uint32_t uploaded;      // 本次开机确认的条数
+        uint32_t lost;          // 没上传就被轮转清掉的条数
+        uint32_t corrupt;       // CRC不对被跳过的条数
+    };
+    Stats getStats();
+
+private:
+    static constexpr size_t SEG_RECORDS = 512;          // 每段最多条数, 两段一共约20KB
+    static constexpr size_t BATCH = 25;                 // 每批最多条数
+    static constexpr int64_t RESEND_US = 10 * 1000 * 1000;  // 发出后这么久没PUBACK就重发
+    static constexpr int64_t SAVE_ACKED_US = 60 * 1000 * 1000;  // 确认位置最多这么久写一次NVS
+
+    struct Entry {
+        uint32_t seq;
+        OpLogRecord rec;
+        uint32_t crc;           // 前面所有字节的CRC32
+    };
+
+    std::mutex mutex;
+    bool ready = false;
+    uint8_t active = 0;                 // 正在追加的段, 另一段是更旧的
+    uint32_t seg_count[2] = {};         // 每段已有条数
+    uint32_t seg_first[2] = {};         // 每段第一条的序号, 空段无意义
+    uint32_t next_seq = 1;
+    uint32_t acked_seq = 0;             // 此序号及之前的都已确认
+    uint32_t saved_acked = 0;           // NVS里记着的确认位置, 落后于acked_seq
+    int64_t saved_at = 0;
+
+    PubackTracker acks;                 // 告警和文件块的PUBACK也会送来, 只认在途批次的
+    int inflight_msg = -1;              // 在途批次的msg_id, -1表示没有
+    uint32_t inflight_last = 0;         // 在途批次的最后一个序号
+    int64_t inflight_since = 0;
+
+    uint32_t uploaded = 0;
+    uint32_t lost = 0;
+    uint32_t corrupt = 0;
+
+    static const char* segPath(uint8_t seg);
+    static uint32_t entryCrc(const Entry& e);
+    void scanSegment(uint8_t seg, uint32_t& first, uint32_t& last);
+    void rotate();
+    size_t readBacklog(Entry* out, size_t max);
+    void persistAcked();
+
+    OpJournal() = default;
+    OpJournal(const OpJournal&) = delete;
+    OpJournal& operator=(const OpJournal&) = delete;
+};
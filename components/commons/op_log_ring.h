@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// 操作日志的来源, 决定上报时devicetype和operation怎么拼
+enum class OpLogKind : uint8_t {
+    MODE,           // 进入模式, did是模式的aid, 上报时才查名字; 不能存StrHandle, 重启或重新解析配置后句柄就变了
+    CURTAIN,        // 窗帘, op是Opcode
+    AIR,            // 后台/语音/动作组操作空调, op是Opcode, 调温时param是温度
+    AIR_PANEL,      // 用户在温控器面板上操作, op是换算成的Opcode, 调温时param是温度
+};
+
+// 一条操作日志, 定长POD, 追加时不分配内存, 上报时才拼成json
+struct OpLogRecord {
+    uint32_t tm;        // 时间戳, 0表示时间未同步
+    uint16_t did;
+    OpLogKind kind;
+    uint8_t op;         // Opcode
+    int32_t param;
+};
+
+// 多生产者单消费者的定长环形缓冲, 满了就覆盖最旧的
+// 追加只有一次fetch_add加几次原子store, 不加锁也不分配内存, 可以在任何任务里调用;
+// 每个槽带一个序号, 读者靠它判断槽是否已写完、是否在读的过程中被覆盖(seqlock)
+template <size_t N>
+class OpLogRing {
+    static_assert((N & (N - 1)) == 0, "N必须是2的幂");
+public:
+    void append(const OpLogRecord& rec) {
+        uint32_t idx = head.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots[idx & (N - 1)];
+        slot.seq.store(0, std::memory_order_relaxed);   // 0表示正在写
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.rec = rec;
+        slot.seq.store(idx + 1, std::memory_order_release);
+    }
+
+    // 取出所有还没读过的记录, 按追加顺序交给fn, 返回被覆盖(丢失)的条数
+    // 只能有一个读者, 正在写的槽会留到下次再读
+    template <typename Fn>
+    uint32_t drain(Fn&& fn) {
+        uint32_t end = head.load(std::memory_order_acquire);
+        uint32_t lost = 0;
+        if (end - tail > N) {
+            lost += end - tail - N;
+            tail = end - N;
+        }
+        while (tail != end) {
+            Slot& slot = slots[tail & (N - 1)];
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq == 0 || (int32_t)(seq - (tail + 1)) < 0) {
+                // 写者拿到了位置但还没写完(可能被抢占了), 下次再读
+                break;
+            }
+            if (seq != tail + 1) {
+                // 读到之前已被新记录覆盖
+                lost++;
+                tail++;
+                continue;
+            }
+            OpLogRecord rec = slot.rec;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq) {
+                lost++;
+                tail++;
+                continue;
+            }
+            fn(rec);
+            tail++;
+        }
+        dropped += lost;
+        return lost;
+    }
+
+    uint32_t appended() const { return head.load(std::memory_order_relaxed); }
+    uint32_t totalDropped() const { return dropped; }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        OpLogRecord rec;
+    };
+    Slot slots[N];
+    std::atomic<uint32_t> head{0};
+    uint32_t tail = 0;          // 只有读者改
+    uint32_t dropped = 0;       // 只有读者改
+};
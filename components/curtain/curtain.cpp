@@ -6,18 +6,24 @@
 
 #define TAG "CURTAIN"
 
-void Curtain::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
+void Curtain::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
     static auto& lord = LordManager::instance();
-    ESP_LOGI_CYAN(TAG, "窗帘[%s]收到操作[%s]", name.c_str(), operation.c_str());
-    if (operation == "开") {
-        add_log_entry("cur", did, operation, parameter, should_log);
-        handleOpenAction();
-    } else if (operation == "关") {
-        add_log_entry("cur", did, operation, parameter, should_log);
-        handleCloseAction();
-    } else if (operation == "反转") {
-        // 反转先不管
-        // handleReverseAction();
+    ESP_LOGI_CYAN(TAG, "窗帘[%s]收到操作[%s]", getName(), opcodeName(op));
+    switch (op) {
+        case Opcode::OPEN:
+            add_op_log(OpLogKind::CURTAIN, did, op, 0, should_log);
+            handleOpenAction();
+            break;
+        case Opcode::CLOSE:
+            add_op_log(OpLogKind::CURTAIN, did, op, 0, should_log);
+            handleCloseAction();
+            break;
+        case Opcode::TOGGLE:
+            // 反转先不管
+            // handleReverseAction();
+            break;
+        default:
+            break;
     }
     // // 后台管理对窗帘的操作特殊处理
     // else if (operation == "开") {
@@ -66,19 +72,19 @@ void Curtain::handleOpenAction() {
     action_buttons = open_buttons;
 
     if (state == CurtainState::OPEN) {
-        ESP_LOGI(TAG, "[%s]已经彻底打开, 不做任何操作", name.c_str());
+        ESP_LOGI(TAG, "[%s]已经彻底打开, 不做任何操作", getName());
         // 熄灭指示灯
         updateButtonIndicator(action_buttons, false);
         return;
     } else if (state == CurtainState::CLOSED || state == CurtainState::STOPPED) {
-        ESP_LOGI(TAG, "开始打开[%s]...", name.c_str());
+        ESP_LOGI(TAG, "开始打开[%s]...", getName());
         startAction(open_channel, CurtainState::OPENING, action_buttons);
         last_action = LastAction::OPENING;
     } else if (state == CurtainState::OPENING) {
-        ESP_LOGI(TAG, "停止打开[%s]", name.c_str());
+        ESP_LOGI(TAG, "停止打开[%s]", getName());
         stopCurrentAction();
     } else if (state == CurtainState::CLOSING) {
-        ESP_LOGI(TAG, "停止关闭, 开始打开[%s]", name.c_str());
+        ESP_LOGI(TAG, "停止关闭, 开始打开[%s]", getName());
         // 熄灭“窗帘关”按钮的指示灯
         updateButtonIndicator(close_buttons, false);
         stopCurrentAction();
@@ -91,19 +97,19 @@ void Curtain::handleCloseAction() {
     action_buttons = close_buttons;
 
     if (state == CurtainState::CLOSED) {
-        ESP_LOGI(TAG, "[%s]已经彻底关闭, 不做任何操作", name.c_str());
+        ESP_LOGI(TAG, "[%s]已经彻底关闭, 不做任何操作", getName());
         // 熄灭指示灯
         updateButtonIndicator(action_buttons, false);
         return;
     } else if (state == CurtainState::OPEN || state == CurtainState::STOPPED) {
-        ESP_LOGI(TAG, "开始关闭[%s]...", name.c_str());
+        ESP_LOGI(TAG, "开始关闭[%s]...", getName());
         startAction(close_channel, CurtainState::CLOSING, action_buttons);
         last_action = LastAction::CLOSING;
     } else if (state == CurtainState::CLOSING) {
-        ESP_LOGI(TAG, "停止关闭[%s]", name.c_str());
+        ESP_LOGI(TAG, "停止关闭[%s]", getName());
         stopCurrentAction();
     } else if (state == CurtainState::OPENING) {
-        ESP_LOGI(TAG, "停止打开, 开始关闭[%s]", name.c_str());
+        ESP_LOGI(TAG, "停止打开, 开始关闭[%s]", getName());
         // 熄灭“窗帘开”按钮的指示灯
         updateButtonIndicator(open_buttons, false);
         stopCurrentAction();
@@ -116,35 +122,35 @@ void Curtain::handleCloseAction() {
 //     action_buttons = reverse_buttons;
 //     if (state == State::CLOSED) {
 //         // 当前是关闭状态，开始打开
-//         ESP_LOGI(TAG, "开始打开[%s]...", name.c_str());
+//         ESP_LOGI(TAG, "开始打开[%s]...", getName());
 //         startAction(output_open, State::OPENING, action_buttons);
 //         last_action = LastAction::OPENING;
 //     } else if (state == State::OPENING) {
 //         // 正在打开，停止打开
-//         ESP_LOGI(TAG, "停止打开[%s]", name.c_str());
+//         ESP_LOGI(TAG, "停止打开[%s]", getName());
 //         stopCurrentAction();
 //         // 保持 last_action 为 OPENING
 //     } else if (state == State::STOPPED) {
 //         // 已停止，根据上一次动作方向决定下一步
 //         if (last_action == LastAction::OPENING) {
 //             // 上一次是打开，反转为关闭
-//             ESP_LOGI(TAG, "开始关闭[%s]...", name.c_str());
+//             ESP_LOGI(TAG, "开始关闭[%s]...", getName());
 //             startAction(output_close, State::CLOSING, action_buttons);
 //             last_action = LastAction::CLOSING;
 //         } else {
 //             // 上一次是关闭或未定义，开始打开
-//             ESP_LOGI(TAG, "开始打开[%s]...", name.c_str());
+//             ESP_LOGI(TAG, "开始打开[%s]...", getName());
 //             startAction(output_open, State::OPENING, action_buttons);
 //             last_action = LastAction::OPENING;
 //         }
 //     } else if (state == State::CLOSING) {
 //         // 正在关闭，停止关闭
-//         ESP_LOGI(TAG, "停止关闭[%s]", name.c_str());
+//         ESP_LOGI(TAG, "停止关闭[%s]", getName());
 //         stopCurrentAction();
 //         // 保持 last_action 为 CLOSING
 //     } else if (state == State::OPEN) {
 //         // 当前是打开状态，开始关闭
-//         ESP_LOGI(TAG, "开始关闭[%s]...", name.c_str());
+//         ESP_LOGI(TAG, "开始关闭[%s]...", getName());
 //         startAction(output_close, State::CLOSING, action_buttons);
 //         last_action = LastAction::CLOSING;
 //     }
@@ -153,6 +159,7 @@ void Curtain::handleCloseAction() {
 void Curtain::startAction(uint8_t channel, CurtainState newState, const std::vector<PanelButtonPair> action_buttons) {
     controlRelay(channel, 0x01);
     state = newState;
+    notify_device_state_changed();
 
     if (actionTaskHandle != nullptr) {
         vTaskDelete(actionTaskHandle);
@@ -182,6 +189,7 @@ void Curtain::stopCurrentAction() {
         controlRelay(close_channel, false);
     }
     state = CurtainState::STOPPED;
+    notify_device_state_changed();
 
     // 删除正在运行的任务
     if (actionTaskHandle != nullptr) {
@@ -195,7 +203,7 @@ void Curtain::stopCurrentAction() {
 
 void Curtain::completeAction() {
     if (state == CurtainState::OPENING) {
-        ESP_LOGI(TAG, "[%s]已打开", name.c_str());
+        ESP_LOGI(TAG, "[%s]已打开", getName());
         controlRelay(open_channel, false);
         state = CurtainState::OPEN;
         // 熄灭指示灯
@@ -203,7 +211,7 @@ void Curtain::completeAction() {
         // 重置 last_action
         last_action = LastAction::NONE;
     } else if (state == CurtainState::CLOSING) {
-        ESP_LOGI(TAG, "[%s]已关闭", name.c_str());
+        ESP_LOGI(TAG, "[%s]已关闭", getName());
         controlRelay(close_channel, false);
         state = CurtainState::CLOSED;
         // 熄灭指示灯
@@ -211,6 +219,7 @@ void Curtain::completeAction() {
         // 重置 last_action
         last_action = LastAction::NONE;
     }
+    notify_device_state_changed();
 
     // 清理任务句柄
     actionTaskHandle = nullptr;
@@ -224,5 +233,5 @@ void Curtain::updateButtonIndicator(std::vector<PanelButtonPair> buttons, bool s
         }
     }
 
-    IndicatorHolder::getInstance().callAllAndClear();
+    IndicatorHolder::getInstance().requestFlush();
 }
\ No newline at end of file
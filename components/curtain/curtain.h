@@ -22,7 +22,7 @@ public:
         }
     }
 
-    void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
+    void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
     void addAssBtn(PanelButtonPair) override { ESP_LOGW("Curtain", "窗帘不该使用addAssBtn"); }
     void syncAssBtnToDevState() override { ESP_LOGW("Curtain", "窗帘不该使用syncAssBtnToDevState"); }
     bool isOn() const override;
@@ -5,18 +5,24 @@
 
 #define TAG "DRYCONTACT_OUT"
 
-void DryContactOut::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
-    ESP_LOGI_CYAN(TAG, "干接点输出[%s]收到操作[%s]", name.c_str(), operation.c_str());
-    if (operation == "开" || operation == "打开") {
-        open_self(should_log);
-    } else if (operation == "关" || operation == "关闭") {
-        close_self(should_log);
-    } else if (operation == "反转") {
-        if (isOn()) {
-            close_self(should_log);
-        } else {
+void DryContactOut::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
+    ESP_LOGI_CYAN(TAG, "干接点输出[%s]收到操作[%s]", getName(), opcodeName(op));
+    switch (op) {
+        case Opcode::OPEN:
             open_self(should_log);
-        }
+            break;
+        case Opcode::CLOSE:
+            close_self(should_log);
+            break;
+        case Opcode::TOGGLE:
+            if (isOn()) {
+                close_self(should_log);
+            } else {
+                open_self(should_log);
+            }
+            break;
+        default:
+            break;
     }
 }
 
@@ -29,7 +35,7 @@ void DryContactOut::open_self(bool should_log) {
     current_state = State::ON;
     updateButtonIndicator(true);
     change_state(true);
-    sync_link_devices("开");
+    sync_link_devices(Opcode::OPEN);
     close_repel_devices();
 }
 
@@ -38,7 +44,7 @@ void DryContactOut::close_self(bool should_log) {
     current_state = State::OFF;
     updateButtonIndicator(false);
     change_state(false);
-    sync_link_devices("关");
+    sync_link_devices(Opcode::CLOSE);
 }
 
 void DryContactOut::updateButtonIndicator(bool state) {
@@ -8,10 +8,11 @@ public:
     DryContactOut(uint16_t did, const std::string& name, const std::string&carry_state, uint8_t channel)
         : IDevice(did, DeviceType::DRY_CONTACT, name, carry_state), channel(channel) {}
 
-    void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
+    void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
     void addAssBtn(PanelButtonPair pair) override { associated_buttons.push_back(pair); }
     void syncAssBtnToDevState() override;
     bool isOn() const override { return current_state == State::ON; }
+    uint8_t getChannel() const { return channel; }
 protected:
     uint8_t channel;
     void open_self(bool should_log);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 // 这个理应与Laminor2的DeviceType顺序一样
 enum class DeviceType {
   // 预设设备类型
@@ -48,3 +50,78 @@ enum class TriggerType {
   INFRARED_TIMEOUT,
   NONE = 255
 };
+
+// 动作的操作码, 解析配置时由操作名编译而来, 执行时不再比较字符串
+// 名字与操作码的对应表在action_group.cpp里
+enum class Opcode : uint8_t {
+  NONE,
+
+  // 通用开关
+  OPEN,                     // 开 / 打开
+  CLOSE,                    // 关 / 关闭
+  TOGGLE,                   // 反转
+
+  // 灯
+  DIMMING,                  // 调光
+
+  // 心跳包
+  SLEEP,                    // 睡眠
+  REMOVE_CARD,              // 拔卡
+  INSERT_CARD,              // 插卡
+
+  // 房间状态
+  STATE_ADD,                // 添加
+  STATE_REMOVE,             // 删除
+  STATE_BREAK_IF_EXIST,     // 如果存在此状态则跳出
+
+  // 延时
+  DELAY,                    // 延时
+
+  // 动作组操作
+  AG_CALL,                  // 调用
+  AG_INTERRUPT,             // 中断
+  AG_SET_ANY_KEY,           // 生成任意键执行
+  AG_CLEAR_ANY_KEY,         // 删除任意键执行
+
+  // 快照
+  SNAPSHOT_RECORD,          // 记录快照
+  SNAPSHOT_RESTORE,         // 读取并删除快照
+  SNAPSHOT_DELETE,          // 删除快照
+  SNAPSHOT_CLEAR_AND_BREAK, // 清除快照并跳出
+
+  // 指示灯
+  INDICATOR_ON,             // 亮
+  INDICATOR_OFF,            // 灭
+  INDICATOR_FLASH,          // 亮1秒
+
+  // 空调
+  AC_COOLING,               // 制冷
+  AC_HEATING,               // 制热
+  AC_FAN,                   // 通风
+  AC_FAN_HIGH,              // 高风
+  AC_FAN_MEDIUM,            // 中风
+  AC_FAN_LOW,               // 低风
+  AC_FAN_AUTO,              // 自动
+  AC_FAN_UP,                // 风量加大
+  AC_FAN_DOWN,              // 风量减小
+  AC_TEMP_UP,               // 温度升高
+  AC_TEMP_DOWN,             // 温度降低
+  AC_SET_TEMP,              // 调节温度
+
+  // 485指令码
+  RS485_SEND,               // 发送
+
+  // 背景音乐
+  BGM_AMP_ON,               // 打开功放
+  BGM_AMP_OFF,              // 关闭功放
+  BGM_PLAY,                 // 播放
+  BGM_STOP,                 // 停止
+  BGM_PLAY_PAUSE,           // 播放/暂停
+  BGM_PREV,                 // 上一首
+  BGM_NEXT,                 // 下一首
+  BGM_VOLUME_UP,            // 音量加
+  BGM_VOLUME_DOWN,          // 音量减
+  BGM_BL_OPEN,              // 打开蓝牙模式
+  BGM_BL_CLOSE,             // 关闭蓝牙模式
+  BGM_TOGGLE_MODE,          // 反转模式
+};
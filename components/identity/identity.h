@@ -3,15 +3,19 @@
 #include <string>
 
 #define MODEL_NAME "xzrcu24"            // 板子型号
-#define AETHORAC_VERSION "1.1.0"        // 固件版本
+#define AETHORAC_VERSION "1.2.0"        // 固件版本
 #define AETHORAC_VERSION_MAJOR 1
-#define AETHORAC_VERSION_MINOR 1
+#define AETHORAC_VERSION_MINOR 2
 #define AETHORAC_VERSION_PATCH 0
 
 #define SERIAL_PART_LABEL  "serial_num"
 #define SERIAL_LEN         8
 
-#define LOGIC_CONFIG_FILE_PATH  "/littlefs/config.json"
+#define LOGIC_CONFIG_FILE_PATH  "/littlefs/config.json"     // 老固件的配置文件, 开机时收编进槽A
+#define CONFIG_SLOT_A_PATH      "/littlefs/config_a.json"
+#define CONFIG_SLOT_B_PATH      "/littlefs/config_b.json"
+#define CONFIG_STAGING_PATH     "/littlefs/config_new.json" // 正在接收的新配置, 校验通过才改名成槽文件
+#define CONFIG_IMAGE_FILE_PATH  "/littlefs/config.bin"      // config.json编译出的二进制镜像
 
 const char *getSerialNum();
 void read_room_info_from_nvs(std::string &hotel_name, std::string &room_name);
\ No newline at end of file
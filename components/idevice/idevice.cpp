@@ -7,17 +7,26 @@
 #define TAG "IDEVICE"
 
 void IDevice::change_state(bool state) {
-    if (carry_state.empty()) {
+    notify_device_state_changed();
+    if (carry_state == ROOM_STATE_NONE) {
         return;
     }
     if (state) {
-        add_state(carry_state);
+        RoomStateStore::getInstance().add(carry_state);
     } else {
-        remove_state(carry_state);
+        RoomStateStore::getInstance().remove(carry_state);
     }
 }
 
-void IDevice::sync_link_devices(std::string operation, bool should_log) {
+void IDevice::executeByName(const std::string& operation, const std::string& parameter, ActionGroup* self_action_group, bool should_log) {
+    AtomicAction action = compileAtomicAction(this, operation, parameter, false);
+    if (action.op == Opcode::NONE) {
+        return;
+    }
+    execute(action.op, action.param, self_action_group, should_log);
+}
+
+void IDevice::sync_link_devices(Opcode op, bool should_log) {
     static auto& lord = LordManager::instance();
 
     // 如果should_log是false, 说明此时正在执行某种情景模式, 那就不操控联动设备
@@ -29,7 +38,7 @@ void IDevice::sync_link_devices(std::string operation, bool should_log) {
     for (auto link_did : link_dids) {
         if (IDevice* dev = lord.getDeviceByDid(link_did)) {
             if (!dev->isOperated()) {
-                dev->execute(operation, "", nullptr, should_log);
+                dev->execute(op, {}, nullptr, should_log);
             }
         }
     }
@@ -41,7 +50,7 @@ void IDevice::close_repel_devices(void) {
 
     for (auto repel_did : repel_dids) {
         if (IDevice* dev = lord.getDeviceByDid(repel_did)) {
-            dev->execute("关", "");
+            dev->execute(Opcode::CLOSE);
         }
     }
 }
\ No newline at end of file
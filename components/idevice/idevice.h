@@ -4,6 +4,7 @@
 #include <vector>
 #include "enums.h"
 #include "action_group.h"
+#include "string_pool.h"
 #include "esp_log.h"
 
 struct PanelButtonPair {
@@ -14,32 +15,35 @@ struct PanelButtonPair {
 // 所有设备的基类
 class IDevice {
 public:
-    IDevice(uint16_t did, DeviceType type, const std::string& name, const std::string& carry_state)
-        : did(did), type(type), name(name), carry_state(carry_state) {}
+    IDevice(uint16_t did, DeviceType type, std::string_view name, std::string_view carry_state)
+        : did(did), type(type), name(intern_str(name)), carry_state(room_state_id(carry_state)) {}
 
     virtual ~IDevice() = default;
-    virtual void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) = 0;
+    virtual void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) = 0;
+    // 按操作名执行, 只给后台"ctl"这种无法预先编译的地方用
+    void executeByName(const std::string& operation, const std::string& parameter, ActionGroup* self_action_group = nullptr, bool should_log = false);
     virtual void addAssBtn(PanelButtonPair) = 0;// 添加关联按钮(按键指示灯)至本设备
     virtual void syncAssBtnToDevState() { ESP_LOGW("IDevice", "基类方法不该被调用到"); } // 将本设备可能拥有的关联按键的指示灯, 调整至本设备的onoff状态
     virtual bool isOn() const = 0;
+    const std::vector<PanelButtonPair>& getAssBtns() const { return associated_buttons; }
     bool isOperated(void) { return operated_flag; };
     uint16_t getDid()  const { return did;  }
     DeviceType getType() const { return type; }
-    const std::string& getName() const { return name; }
+    const char* getName() const { return str_of(name); }
     void addLinkDidsAndRepelDids(const std::vector<uint16_t> lkds, const std::vector<uint16_t> rpds) { link_dids = lkds; repel_dids = rpds;}
 
 protected:
     uint16_t did;
     DeviceType type;
-    std::string  name;
-    std::string carry_state;                            // 此设备会携带的房间状态
+    StrHandle name;
+    RoomStateId carry_state;                            // 此设备会携带的房间状态
     void change_state(bool state);                      // 更改携带的房间状态
     virtual void updateButtonIndicator(bool state) = 0;
     std::vector<PanelButtonPair> associated_buttons;    // 关联按钮
 
     std::vector<uint16_t> link_dids;                  // 此设备动作时会同时操作联动设备
     std::vector<uint16_t> repel_dids;                 // 开启此设备会关闭排斥设备(关闭当然不会)
-    void sync_link_devices(std::string operation, bool should_log = true);// 同步操作联动设备
+    void sync_link_devices(Opcode op, bool should_log = true);// 同步操作联动设备
     void close_repel_devices(void);                     // 关闭排斥设备
 
 private:
@@ -8,19 +8,20 @@
 
 class InputBase {
 public:
-    InputBase(uint16_t iid, InputType type, const std::string& name, std::set<InputTag> tags, std::vector<std::unique_ptr<ActionGroup>>&& action_groups)
-        : iid(iid), type(type), name(name), tags(tags), action_groups(std::move(action_groups)) {}
+    InputBase(uint16_t iid, InputType type, std::string_view name, std::set<InputTag> tags, std::vector<std::unique_ptr<ActionGroup>>&& action_groups)
+        : iid(iid), type(type), name(intern_str(name)), tags(tags), action_groups(std::move(action_groups)) {}
         
     virtual void execute() = 0;
     uint16_t getIid() const { return iid; }
     InputType getType() const { return type; }
-    const std::string& getName() const { return name; }
+    const char* getName() const { return str_of(name); }
     std::set<InputTag> getTags() const { return tags; }
+    const std::vector<std::unique_ptr<ActionGroup>>& getActionGroups() const { return action_groups; }
 
 protected:
     uint16_t iid;
     InputType type;
-    std::string name;
+    StrHandle name;
     std::set<InputTag> tags;
     std::vector<std::unique_ptr<ActionGroup>> action_groups;
 
@@ -1,16 +1,53 @@
 #include "indicator.h"
+#include "esp_log.h"
 
-void IndicatorHolder::callAllAndClear() {
-    for (const auto& func : functions) {
-        func();
+#define TAG "INDICATOR"
+
+void IndicatorHolder::start(PublishFunc func) {
+    publish = func;
+    if (flusher) {
+        return;
+    }
+    if (xTaskCreate(flusherTask, "IndicatorFlush", 3072, this, 6, &flusher) != pdPASS) {
+        ESP_LOGE(TAG, "创建指示灯刷新任务失败, 退回同步刷新");
+        flusher = nullptr;
+    }
+}
+
+void IndicatorHolder::markDirty(uint8_t pid) {
+    dirty[pid / 32].fetch_or(1u << (pid % 32), std::memory_order_release);
+}
+
+void IndicatorHolder::requestFlush() {
+    if (flusher) {
+        xTaskNotifyGive(flusher);
+    } else {
+        flushNow();
+    }
+}
+
+void IndicatorHolder::flushNow() {
+    if (!publish) {
+        return;
+    }
+    for (size_t w = 0; w < DIRTY_WORDS; w++) {
+        // 整个字一次取走, 取走之后再标记的面板留给下一轮
+        uint32_t bits = dirty[w].exchange(0, std::memory_order_acquire);
+        while (bits) {
+            int b = __builtin_ctz(bits);
+            bits &= bits - 1;
+            publish(w * 32 + b);
+        }
     }
-    functions.clear();
-    registeredPanels.clear();
 }
 
-void IndicatorHolder::addFunction(FunctionType func, const void* panelPtr) {
-    if (registeredPanels.find(panelPtr) == registeredPanels.end()) {
-        functions.push_back(func);
-        registeredPanels.insert(panelPtr);
+void IndicatorHolder::flusherTask(void* arg) {
+    auto* self = static_cast<IndicatorHolder*>(arg);
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(DEBOUNCE_MS));
+        // 防抖期间到达的请求已经合并进位图了, 清掉通知免得空跑一轮
+        ulTaskNotifyTake(pdTRUE, 0);
+        self->flushNow();
     }
-}
\ No newline at end of file
+}
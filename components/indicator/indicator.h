@@ -1,13 +1,15 @@
 #pragma once
 
-#include <vector>
-#include <unordered_set>
-#include <bits/std_function.h>
+#include <atomic>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
-// 一个动作组完全执行完后, 一次性更新指示灯
+// 面板指示灯的统一刷新: 各处只在位图里标记哪个面板需要刷新, 由一个刷新任务攒几毫秒后
+// 给每个脏面板只发一帧背光, 多个场景同时改同一个面板既不会踩坏对方, 也不会重复发帧
 class IndicatorHolder {
 public:
-    using FunctionType = std::function<void()>;
+    using PublishFunc = void (*)(uint8_t pid);
 
     // 获取单例实例
     static IndicatorHolder& getInstance() {
@@ -15,15 +17,25 @@ public:
         return instance;
     }
 
-    // 添加函数
-    void addFunction(FunctionType func, const void* panelPtr);
+    // 创建刷新任务, publish负责真正发出某个面板的背光帧
+    void start(PublishFunc publish);
 
-    // 调用所有函数并清空
-    void callAllAndClear();
+    // 标记面板需要刷新, 无锁, 任何任务和定时器回调里都能调用
+    void markDirty(uint8_t pid);
+
+    // 请求刷新所有已标记的面板, 不阻塞; 刷新任务还没创建时当场同步刷新
+    void requestFlush();
 
 private:
-    std::vector<FunctionType> functions;
-    std::unordered_set<const void*> registeredPanels;
+    static constexpr uint32_t DEBOUNCE_MS = 10;     // 收到请求后再等一个tick, 把紧接着的修改合并进同一帧
+    static constexpr size_t DIRTY_WORDS = 256 / 32; // pid是uint8_t, 一个面板一位
+
+    std::atomic<uint32_t> dirty[DIRTY_WORDS] = {};
+    PublishFunc publish = nullptr;
+    TaskHandle_t flusher = nullptr;
+
+    void flushNow();
+    static void flusherTask(void* arg);
 
     // 私有化构造函数和赋值运算符，确保单例
     IndicatorHolder() = default;
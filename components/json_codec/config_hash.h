@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+// 配置文件内容的SHA-256, 用来认配置: 槽里是哪份配置, 镜像是从哪份配置编译的
+struct ConfigHash {
+    uint8_t bytes[32] = {};
+
+    bool operator==(const ConfigHash& other) const { return memcmp(bytes, other.bytes, sizeof(bytes)) == 0; }
+    bool operator!=(const ConfigHash& other) const { return !(*this == other); }
+
+    std::string hex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string s(sizeof(bytes) * 2, '0');
+        for (size_t i = 0; i < sizeof(bytes); i++) {
+            s[i * 2] = digits[bytes[i] >> 4];
+            s[i * 2 + 1] = digits[bytes[i] & 0x0F];
+        }
+        return s;
+    }
+};
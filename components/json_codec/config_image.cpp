@@ -0,0 +1,411 @@
+#include "config_image.h"
+#include <string.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#ifdef ESP_PLATFORM
+#include "esp_app_desc.h"
+#endif
+
+#define TAG "CONFIG_IMAGE"
+
+#define CONFIG_IMAGE_MAGIC      0x47464341      // "ACFG"
+#define CONFIG_IMAGE_VERSION    2               // 记录格式变了就加一
+#define CONFIG_IMAGE_RECORD_MAX 0xFFFF          // 记录长度用u16存
+
+enum RecordKind : uint8_t {
+    RECORD_COMMON = 1,
+    RECORD_DEVICE,
+    RECORD_ACTION_GROUP,
+    RECORD_INPUT,
+};
+
+struct ImageHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint8_t firmware[8];                        // 生成镜像的固件, 操作码等枚举值跟着固件走
+    uint8_t source[8];                          // 源配置哈希的前8字节
+    uint32_t body_size;
+    uint32_t body_crc;
+    uint32_t records;
+};
+static_assert(sizeof(ImageHeader) == 36, "ImageHeader会写进flash, 不要随便改布局");
+
+// 同一份固件编译出的镜像才能用, 主机上没有固件信息, 全填0
+static void firmwareId(uint8_t out[8]) {
+#ifdef ESP_PLATFORM
+    memcpy(out, esp_app_get_description()->app_elf_sha256, 8);
+#else
+    memset(out, 0, 8);
+#endif
+}
+
+ConfigImageWriter::ConfigImageWriter(FILE* file) : file(file) {
+    ImageHeader header = {};
+    ok = fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+void ConfigImageWriter::put16(uint16_t v) {
+    rec.push_back(v & 0xFF);
+    rec.push_back(v >> 8);
+}
+
+void ConfigImageWriter::put32(uint32_t v) {
+    put16(v & 0xFFFF);
+    put16(v >> 16);
+}
+
+void ConfigImageWriter::putStr(std::string_view s) {
+    size_t len = std::min<size_t>(s.size(), 0xFFFF);
+    put16(len);
+    rec.insert(rec.end(), s.data(), s.data() + len);
+}
+
+void ConfigImageWriter::putActions(const std::vector<ActionSpec>& actions) {
+    put16(actions.size());
+    for (const auto& a : actions) {
+        put16(a.did);
+        put8(static_cast<uint8_t>(a.op));
+        put32(a.param.value);
+        put8(a.param.pid);
+        put8(a.param.bid);
+        putStr(a.state_name);
+    }
+}
+
+void ConfigImageWriter::flush(uint8_t kind) {
+    if (ok && rec.size() > CONFIG_IMAGE_RECORD_MAX) {
+        ESP_LOGE(TAG, "记录太大(%u字节), 不生成镜像", rec.size());
+        ok = false;
+    }
+    if (ok) {
+        uint8_t head[3] = {kind, (uint8_t)(rec.size() & 0xFF), (uint8_t)(rec.size() >> 8)};
+        if (fwrite(head, sizeof(head), 1, file) != 1 || (!rec.empty() && fwrite(rec.data(), rec.size(), 1, file) != 1)) {
+            ESP_LOGE(TAG, "写入镜像失败");
+            ok = false;
+        }
+        body_crc = esp_rom_crc32_le(body_crc, head, sizeof(head));
+        body_crc = esp_rom_crc32_le(body_crc, rec.data(), rec.size());
+        body_size += sizeof(head) + rec.size();
+        records++;
+    }
+    rec.clear();
+}
+
+void ConfigImageWriter::addCommon(const CommonSpec& spec) {
+    put8(spec.use_day_night);
+    put8(spec.day_time_point);
+    put8(spec.night_time_point);
+    flush(RECORD_COMMON);
+}
+
+void ConfigImageWriter::addDevice(const DeviceSpec& spec) {
+    put8(static_cast<uint8_t>(spec.type));
+    put16(spec.did);
+    putStr(spec.name);
+    putStr(spec.carry_state);
+    putStr(spec.code);
+    put8(spec.ch);
+    put8(spec.close_ch);
+    put8(spec.air_id);
+    put8(spec.wc);
+    put8(spec.lc);
+    put8(spec.mc);
+    put8(spec.hc);
+    put32(spec.runtime);
+    for (const auto* dids : {&spec.link_dids, &spec.repel_dids}) {
+        put16(dids->size());
+        for (uint16_t did : *dids) {
+            put16(did);
+        }
+    }
+    flush(RECORD_DEVICE);
+}
+
+void ConfigImageWriter::addActionGroup(const ActionGroupSpec& spec) {
+    put16(spec.aid);
+    putStr(spec.name);
+    put8(spec.is_mode);
+    putActions(spec.actions);
+    flush(RECORD_ACTION_GROUP);
+}
+
+void ConfigImageWriter::addInput(const InputSpec& spec) {
+    put8(static_cast<uint8_t>(spec.type));
+    put16(spec.iid);
+    putStr(spec.name);
+    put8(spec.tags.size());
+    for (uint8_t tag : spec.tags) {
+        put8(tag);
+    }
+    put8(spec.pid);
+    put8(spec.bid);
+    put32(spec.lbd);
+    put8(spec.ch);
+    put8(static_cast<uint8_t>(spec.trigger));
+    put32(spec.duration);
+    putStr(spec.code);
+    put16(spec.groups.size());
+    for (const auto& group : spec.groups) {
+        putActions(group);
+    }
+    flush(RECORD_INPUT);
+}
+
+bool ConfigImageWriter::finish(const ConfigHash& source) {
+    if (!ok) {
+        return false;
+    }
+    ImageHeader header = {
+        .magic = CONFIG_IMAGE_MAGIC,
+        .version = CONFIG_IMAGE_VERSION,
+        .header_size = sizeof(ImageHeader),
+        .firmware = {},
+        .source = {},
+        .body_size = body_size,
+        .body_crc = body_crc,
+        .records = records,
+    };
+    firmwareId(header.firmware);
+    memcpy(header.source, source.bytes, sizeof(header.source));
+    if (fflush(file) != 0 || fseek(file, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0) {
+        ESP_LOGE(TAG, "写入镜像头失败");
+        return false;
+    }
+    ESP_LOGI(TAG, "生成配置镜像: %lu条记录, %lu字节", records, body_size);
+    return true;
+}
+
+// 按写入的顺序读回一条记录, 越界时ok变成false, 之后读到的都是0
+class RecordReader {
+public:
+    RecordReader(const uint8_t* data, size_t len) : p(data), end(data + len) {}
+
+    bool ok() const { return good && p == end; }      // 读完了且正好读完
+    bool failed() const { return !good; }
+
+    uint8_t get8() {
+        if (!need(1)) return 0;
+        return *p++;
+    }
+    uint16_t get16() {
+        if (!need(2)) return 0;
+        uint16_t v = p[0] | (p[1] << 8);
+        p += 2;
+        return v;
+    }
+    uint32_t get32() {
+        uint32_t lo = get16();
+        return lo | ((uint32_t)get16() << 16);
+    }
+    std::string_view getStr() {
+        uint16_t len = get16();
+        if (!need(len)) return {};
+        std::string_view s(reinterpret_cast<const char*>(p), len);
+        p += len;
+        return s;
+    }
+    void getActions(std::vector<ActionSpec>& out) {
+        uint16_t n = get16();
+        for (uint16_t i = 0; i < n && good; i++) {
+            ActionSpec a;
+            a.did = get16();
+            a.op = static_cast<Opcode>(get8());
+            a.param.value = get32();
+            a.param.pid = get8();
+            a.param.bid = get8();
+            a.state_name = getStr();
+            out.push_back(a);
+        }
+    }
+
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+    bool good = true;
+
+    bool need(size_t n) {
+        if (!good || (size_t)(end - p) < n) {
+            good = false;
+            return false;
+        }
+        return true;
+    }
+};
+
+// 校验通过后才会调用, 解码出错说明写镜像的代码和读的对不上
+static bool decodeRecord(uint8_t kind, const uint8_t* data, size_t len, ConfigImageSink& sink) {
+    RecordReader r(data, len);
+    switch (kind) {
+        case RECORD_COMMON: {
+            CommonSpec spec;
+            spec.use_day_night = r.get8();
+            spec.day_time_point = r.get8();
+            spec.night_time_point = r.get8();
+            if (!r.ok()) return false;
+            sink.onCommon(spec);
+            return true;
+        }
+        case RECORD_DEVICE: {
+            DeviceSpec spec;
+            spec.type = static_cast<DeviceType>(r.get8());
+            spec.did = r.get16();
+            spec.name = r.getStr();
+            spec.carry_state = r.getStr();
+            spec.code = r.getStr();
+            spec.ch = r.get8();
+            spec.close_ch = r.get8();
+            spec.air_id = r.get8();
+            spec.wc = r.get8();
+            spec.lc = r.get8();
+            spec.mc = r.get8();
+            spec.hc = r.get8();
+            spec.runtime = r.get32();
+            for (auto* dids : {&spec.link_dids, &spec.repel_dids}) {
+                uint16_t n = r.get16();
+                for (uint16_t i = 0; i < n && !r.failed(); i++) {
+                    dids->push_back(r.get16());
+                }
+            }
+            if (!r.ok()) return false;
+            sink.onDevice(spec);
+            return true;
+        }
+        case RECORD_ACTION_GROUP: {
+            ActionGroupSpec spec;
+            spec.aid = r.get16();
+            spec.name = r.getStr();
+            spec.is_mode = r.get8();
+            r.getActions(spec.actions);
+            if (!r.ok()) return false;
+            sink.onActionGroup(spec);
+            return true;
+        }
+        case RECORD_INPUT: {
+            InputSpec spec;
+            spec.type = static_cast<InputType>(r.get8());
+            spec.iid = r.get16();
+            spec.name = r.getStr();
+            uint8_t tag_count = r.get8();
+            for (uint8_t i = 0; i < tag_count; i++) {
+                spec.tags.push_back(r.get8());
+            }
+            spec.pid = r.get8();
+            spec.bid = r.get8();
+            spec.lbd = (int32_t)r.get32();
+            spec.ch = r.get8();
+            spec.trigger = static_cast<TriggerType>(r.get8());
+            spec.duration = r.get32();
+            spec.code = r.getStr();
+            uint16_t group_count = r.get16();
+            for (uint16_t i = 0; i < group_count && !r.failed(); i++) {
+                r.getActions(spec.groups.emplace_back());
+            }
+            if (!r.ok()) return false;
+            sink.onInput(spec);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// 文件头对得上才值得去算校验
+static bool checkHeader(const ImageHeader& header, const ConfigHash& source) {
+    uint8_t firmware[8];
+    firmwareId(firmware);
+    if (header.magic != CONFIG_IMAGE_MAGIC || header.version != CONFIG_IMAGE_VERSION ||
+        header.header_size != sizeof(ImageHeader)) {
+        ESP_LOGW(TAG, "镜像格式不对, 忽略");
+        return false;
+    }
+    if (memcmp(header.firmware, firmware, sizeof(firmware)) != 0) {
+        ESP_LOGI(TAG, "镜像是别的固件生成的, 忽略");
+        return false;
+    }
+    if (memcmp(header.source, source.bytes, sizeof(header.source)) != 0) {
+        ESP_LOGI(TAG, "镜像不是当前配置编译的, 忽略");
+        return false;
+    }
+    return true;
+}
+
+bool readConfigImage(FILE* file, const ConfigHash& source, ConfigImageSink& sink) {
+    ImageHeader header;
+    if (fseek(file, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, file) != 1) {
+        return false;
+    }
+    if (!checkHeader(header, source)) {
+        return false;
+    }
+
+    // 第一遍只算校验, 不完整或者被改过的镜像一条都不注册
+    std::vector<uint8_t> buf(1024);
+    uint32_t crc = 0;
+    uint32_t total = 0;
+    size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), file)) > 0) {
+        crc = esp_rom_crc32_le(crc, buf.data(), n);
+        total += n;
+    }
+    if (total != header.body_size || crc != header.body_crc) {
+        ESP_LOGE(TAG, "镜像校验失败(%lu/%lu字节), 忽略", total, header.body_size);
+        return false;
+    }
+
+    if (fseek(file, sizeof(ImageHeader), SEEK_SET) != 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header.records; i++) {
+        uint8_t head[3];
+        if (fread(head, sizeof(head), 1, file) != 1) {
+            return false;
+        }
+        size_t len = head[1] | (head[2] << 8);
+        if (buf.size() < len) {
+            buf.resize(len);
+        }
+        if (len > 0 && fread(buf.data(), len, 1, file) != 1) {
+            return false;
+        }
+        if (!decodeRecord(head[0], buf.data(), len, sink)) {
+            ESP_LOGE(TAG, "第%lu条记录无法解码", i + 1);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readConfigImage(const uint8_t* data, size_t len, const ConfigHash& source, ConfigImageSink& sink) {
+    ImageHeader header;
+    if (len < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (!checkHeader(header, source)) {
+        return false;
+    }
+    const uint8_t* p = data + sizeof(header);
+    const uint8_t* end = data + len;
+    if (header.body_size > (size_t)(end - p) || esp_rom_crc32_le(0, p, header.body_size) != header.body_crc) {
+        ESP_LOGE(TAG, "镜像校验失败(%u/%lu字节), 忽略", len - sizeof(header), header.body_size);
+        return false;
+    }
+    end = p + header.body_size;
+
+    // 记录直接在原地解码, 字符串也直接指向这块内存
+    for (uint32_t i = 0; i < header.records; i++) {
+        if (end - p < 3) {
+            return false;
+        }
+        size_t rec_len = p[1] | (p[2] << 8);
+        if ((size_t)(end - p - 3) < rec_len || !decodeRecord(p[0], p + 3, rec_len, sink)) {
+            ESP_LOGE(TAG, "第%lu条记录无法解码", i + 1);
+            return false;
+        }
+        p += 3 + rec_len;
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+#include "enums.h"
+#include "action_group.h"
+#include "config_hash.h"
+
+// 二进制配置镜像: config.json解析、编译好的结果, 开机直接按记录注册, 不用再解析json、比较操作名
+// 镜像只是json的缓存, 按源配置的哈希认配置, 解析json成功后重新生成;
+// 格式版本、固件、源配置的哈希或校验对不上就当它不存在, 回退到json
+//
+// 下面几个结构是json和镜像共用的中间形式, 两条路径最后都走同一套注册代码.
+// 字符串指向解析中的json或镜像缓冲, 只在注册回调期间有效
+
+struct CommonSpec {
+    bool use_day_night = false;
+    uint8_t day_time_point = 7;
+    uint8_t night_time_point = 19;
+};
+
+struct DeviceSpec {
+    DeviceType type = DeviceType::NONE;
+    uint16_t did = 0;
+    std::string_view name;
+    std::string_view carry_state;
+    std::string_view code;                      // RS485的指令码
+    uint8_t ch = 127;                           // 继电器/干接点通道, 窗帘的开通道
+    uint8_t close_ch = 127;                     // 窗帘的关通道
+    uint8_t air_id = 0;
+    uint8_t wc = 127;                           // 单冷空调的水阀和三档风速通道
+    uint8_t lc = 127;
+    uint8_t mc = 127;
+    uint8_t hc = 127;
+    uint32_t runtime = 10;                      // 窗帘运行时间
+    std::vector<uint16_t> link_dids;
+    std::vector<uint16_t> repel_dids;
+};
+
+// 编译好的AtomicAction, 目标设备换成did
+struct ActionSpec {
+    uint16_t did = 0;
+    Opcode op = Opcode::NONE;
+    ActionParam param;
+    std::string_view state_name;                // 目标是房间状态时的状态名, 房间状态id是运行时分配的, 不能存
+};
+
+struct ActionGroupSpec {
+    uint16_t aid = 0;
+    std::string_view name;
+    bool is_mode = false;
+    std::vector<ActionSpec> actions;
+};
+
+struct InputSpec {
+    InputType type = InputType::NONE;
+    uint16_t iid = 0;
+    std::string_view name;
+    std::vector<uint8_t> tags;
+    std::vector<std::vector<ActionSpec>> groups;
+    uint8_t pid = 0;                            // 面板按键
+    uint8_t bid = 0;
+    int32_t lbd = -1;                           // 面板按键绑定的设备, -1表示不绑定
+    uint8_t ch = 0;                             // 干接点输入
+    TriggerType trigger = TriggerType::NONE;
+    uint32_t duration = 1;
+    std::string_view code;                      // 语音指令
+};
+
+// 边解析json边把记录追加进镜像文件, 最后回填文件头
+class ConfigImageWriter {
+public:
+    explicit ConfigImageWriter(FILE* file);
+
+    void addCommon(const CommonSpec& spec);
+    void addDevice(const DeviceSpec& spec);
+    void addActionGroup(const ActionGroupSpec& spec);
+    void addInput(const InputSpec& spec);
+    bool finish(const ConfigHash& source);      // 写入失败或者有记录太大时返回false, 这份镜像不能用
+
+private:
+    FILE* file;
+    std::vector<uint8_t> rec;                   // 当前记录, 每条记录复用
+    uint32_t body_size = 0;
+    uint32_t body_crc = 0;
+    uint32_t records = 0;
+    bool ok = true;
+
+    void put8(uint8_t v) { rec.push_back(v); }
+    void put16(uint16_t v);
+    void put32(uint32_t v);
+    void putStr(std::string_view s);
+    void putActions(const std::vector<ActionSpec>& actions);
+    void flush(uint8_t kind);
+};
+
+class ConfigImageSink {
+public:
+    virtual ~ConfigImageSink() = default;
+    virtual void onCommon(const CommonSpec& spec) = 0;
+    virtual void onDevice(const DeviceSpec& spec) = 0;
+    virtual void onActionGroup(const ActionGroupSpec& spec) = 0;
+    virtual void onInput(const InputSpec& spec) = 0;
+};
+
+// 先校验整个文件再逐条回调, 校验不过时不会有任何回调
+// source是当前配置的哈希, 和生成镜像时的对不上说明镜像不是这份配置的
+bool readConfigImage(FILE* file, const ConfigHash& source, ConfigImageSink& sink);
+// 镜像已经整个在内存里(比如映射进来的flash), 不拷贝, 回调里的字符串直接指向data
+bool readConfigImage(const uint8_t* data, size_t len, const ConfigHash& source, ConfigImageSink& sink);
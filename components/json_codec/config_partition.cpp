@@ -0,0 +1,163 @@
+#include "config_partition.h"
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+#define TAG "CONFIG_PARTITION"
+
+static const char* const SLOT_LABELS[2] = {"cfg_a", "cfg_b"};
+
+void ConfigPartition::find() {
+    if (found) {
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        slots[i] = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, SUBTYPE, SLOT_LABELS[i]);
+    }
+    found = true;
+    if (slots[0] && slots[1]) {
+        ESP_LOGI(TAG, "配置分区: %s@0x%lx(%luKB), %s@0x%lx(%luKB)",
+                 slots[0]->label, slots[0]->address, slots[0]->size / 1024,
+                 slots[1]->label, slots[1]->address, slots[1]->size / 1024);
+    } else {
+        ESP_LOGI(TAG, "分区表里没有配置分区, 配置镜像存littlefs");
+    }
+}
+
+bool ConfigPartition::isAvailable() {
+    std::lock_guard<std::mutex> lock(mutex);
+    find();
+    return slots[0] && slots[1];
+}
+
+size_t ConfigPartition::capacity() {
+    std::lock_guard<std::mutex> lock(mutex);
+    find();
+    if (!slots[0] || !slots[1]) {
+        return 0;
+    }
+    return std::min(slots[0]->size, slots[1]->size) - sizeof(SlotHeader);
+}
+
+bool ConfigPartition::readHeader(int slot, SlotHeader& header) {
+    if (esp_partition_read(slots[slot], 0, &header, sizeof(header)) != ESP_OK) {
+        return false;
+    }
+    return header.magic == SLOT_MAGIC && header.state == STATE_VALID &&
+           header.length > 0 && header.length <= slots[slot]->size - sizeof(SlotHeader);
+}
+
+bool ConfigPartition::write(FILE* image) {
+    std::lock_guard<std::mutex> lock(mutex);
+    find();
+    if (!slots[0] || !slots[1]) {
+        return false;
+    }
+    if (fseek(image, 0, SEEK_END) != 0) {
+        return false;
+    }
+    long length = ftell(image);
+    if (length <= 0 || (size_t)length > std::min(slots[0]->size, slots[1]->size) - sizeof(SlotHeader)) {
+        ESP_LOGW(TAG, "镜像%ld字节, 放不进配置分区", length);
+        return false;
+    }
+
+    // 写进代数更旧的槽, 作废了的槽也算代数, 保证代数一直往上涨
+    SlotHeader headers[2];
+    uint32_t generation[2] = {};
+    for (int i = 0; i < 2; i++) {
+        readHeader(i, headers[i]);
+        if (headers[i].magic == SLOT_MAGIC) {
+            generation[i] = headers[i].generation;
+        }
+    }
+    int target = generation[0] <= generation[1] ? 0 : 1;
+    const esp_partition_t* part = slots[target];
+
+    size_t erase_len = (sizeof(SlotHeader) + length + part->erase_size - 1) / part->erase_size * part->erase_size;
+    esp_err_t err = esp_partition_erase_range(part, 0, erase_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "擦除%s失败: %s", part->label, esp_err_to_name(err));
+        return false;
+    }
+
+    std::vector<uint8_t> buf(1024);
+    uint32_t crc = 0;
+    size_t offset = 0;
+    fseek(image, 0, SEEK_SET);
+    size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), image)) > 0) {
+        err = esp_partition_write(part, sizeof(SlotHeader) + offset, buf.data(), n);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "写%s失败: %s", part->label, esp_err_to_name(err));
+            return false;
+        }
+        crc = esp_rom_crc32_le(crc, buf.data(), n);
+        offset += n;
+    }
+    if (offset != (size_t)length) {
+        ESP_LOGE(TAG, "读镜像文件失败(%u/%ld字节)", offset, length);
+        return false;
+    }
+
+    // 槽头最后写, state保持擦除后的全FF
+    SlotHeader header = {};
+    header.magic = SLOT_MAGIC;
+    header.generation = std::max(generation[0], generation[1]) + 1;
+    header.length = length;
+    header.crc = crc;
+    err = esp_partition_write(part, 0, &header, offsetof(SlotHeader, state));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "写%s槽头失败: %s", part->label, esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGI(TAG, "配置镜像写入%s, 第%lu代, %ld字节", part->label, header.generation, length);
+    return true;
+}
+
+bool ConfigPartition::load(const std::function<bool(const uint8_t* data, size_t len)>& load) {
+    std::lock_guard<std::mutex> lock(mutex);
+    find();
+    if (!slots[0] || !slots[1]) {
+        return false;
+    }
+    SlotHeader headers[2];
+    bool valid[2];
+    for (int i = 0; i < 2; i++) {
+        valid[i] = readHeader(i, headers[i]);
+    }
+    int order[2] = {0, 1};
+    if (valid[1] && (!valid[0] || headers[1].generation > headers[0].generation)) {
+        std::swap(order[0], order[1]);
+    }
+
+    for (int i : order) {
+        if (!valid[i]) {
+            continue;
+        }
+        const void* ptr;
+        esp_partition_mmap_handle_t handle;
+        esp_err_t err = esp_partition_mmap(slots[i], 0, sizeof(SlotHeader) + headers[i].length,
+                                           ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "映射%s失败: %s", slots[i]->label, esp_err_to_name(err));
+            continue;
+        }
+        const uint8_t* data = static_cast<const uint8_t*>(ptr) + sizeof(SlotHeader);
+        bool ok = false;
+        if (esp_rom_crc32_le(0, data, headers[i].length) != headers[i].crc) {
+            ESP_LOGE(TAG, "%s第%lu代校验失败", slots[i]->label, headers[i].generation);
+        } else {
+            ok = load(data, headers[i].length);
+        }
+        esp_partition_munmap(handle);
+        if (ok) {
+            ESP_LOGI(TAG, "从%s加载第%lu代配置镜像", slots[i]->label, headers[i].generation);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <mutex>
+#include "esp_partition.h"
+
+// 存二进制配置镜像的裸分区, 开机时用esp_partition_mmap映射进来原地解码, 不经过VFS也不拷进内存
+// 两个槽各是一个分区(cfg_a, cfg_b), 放在两个OTA分区后面64KB对齐剩下的空隙里, 不挪动已有的分区;
+// 老的分区表里没有这两个分区, 那就照旧用littlefs上的config.bin
+//
+// 每个槽开头是槽头, 后面是镜像. 写的时候写进代数更旧的那个槽, 先擦除写镜像, 最后才写槽头,
+// 中途断电时这个槽头是全FF, 另一个槽不受影响. 镜像按源配置的哈希认配置, 所以两个槽正好是当前和上一份配置的镜像
+class ConfigPartition {
+public:
+    static ConfigPartition& getInstance() {
+        static ConfigPartition instance;
+        return instance;
+    }
+
+    static constexpr esp_partition_subtype_t SUBTYPE = static_cast<esp_partition_subtype_t>(0x7A);
+
+    bool isAvailable();                         // 分区表里有两个槽
+    size_t capacity();                          // 单个槽能放的镜像大小, 没有分区时为0
+    bool write(FILE* image);                    // 从头读整个镜像文件写进去, 放不下或写失败返回false
+    // 按代数从新到旧把每个有效槽映射进来交给load, load返回true就停下; 映射只在load期间有效
+    bool load(const std::function<bool(const uint8_t* data, size_t len)>& load);
+
+private:
+    static constexpr uint32_t SLOT_MAGIC = 0x544F4C53;     // "SLOT"
+    static constexpr uint32_t STATE_VALID = 0xFFFFFFFF;    // 擦除后的值, 写槽头时不写这个字段
+
+    struct SlotHeader {
+        uint32_t magic;
+        uint32_t generation;                    // 每写一次加一, 大的是新的
+        uint32_t length;                        // 镜像字节数
+        uint32_t crc;                           // 整个镜像的CRC32
+        uint32_t state;                         // STATE_VALID, 留着以后不擦除就能作废一个槽
+        uint32_t reserved[3];
+    };
+    static_assert(sizeof(SlotHeader) == 32, "SlotHeader在flash里, 不要随便改布局");
+
+    std::mutex mutex;
+    const esp_partition_t* slots[2] = {};
+    bool found = false;
+
+    ConfigPartition() = default;
+    void find();
+    bool readHeader(int slot, SlotHeader& header);
+};
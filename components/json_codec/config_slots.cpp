@@ -0,0 +1,266 @@
+#include "config_slots.h"
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "nvs.h"
+#include "identity.h"
+#include "../json.hpp"
+#include "json_codec.h"
+
+#define TAG "CONFIG_SLOTS"
+#define NVS_NS  "config_slots"
+#define NVS_KEY "state"
+
+const char* ConfigSlots::slotPath(uint8_t slot) {
+    return slot == 0 ? CONFIG_SLOT_A_PATH : CONFIG_SLOT_B_PATH;
+}
+
+bool ConfigSlots::hashFile(const char* path, ConfigHash& hash, uint32_t& size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    uint8_t buf[512];
+    ssize_t n;
+    size = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        mbedtls_sha256_update(&sha, buf, n);
+        size += n;
+    }
+    mbedtls_sha256_finish(&sha, hash.bytes);
+    mbedtls_sha256_free(&sha);
+    close(fd);
+    return n == 0;
+}
+
+void ConfigSlots::init() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ready) {
+        return;
+    }
+    ready = true;
+
+    nvs_handle_t h;
+    if (nvs_open(NVS_NS, NVS_READWRITE, &h) == ESP_OK) {
+        size_t len = sizeof(state);
+        if (nvs_get_blob(h, NVS_KEY, &state, &len) != ESP_OK || len != sizeof(state) ||
+            state.version != STATE_VERSION || state.active > 1) {
+            state = {};
+        }
+        nvs_close(h);
+    }
+    state.version = STATE_VERSION;
+    // 上次没收完或者没用上的暂存文件
+    unlink(CONFIG_STAGING_PATH);
+
+    // 老固件只有一个config.json, 收编成槽A的第1代
+    if (state.slots[0].generation == 0 && state.slots[1].generation == 0) {
+        Slot slot = {};
+        if (rename(LOGIC_CONFIG_FILE_PATH, slotPath(0)) == 0 && hashFile(slotPath(0), slot.hash, slot.size)) {
+            slot.generation = 1;
+            state.slots[0] = slot;
+            state.active = 0;
+            save();
+            ESP_LOGI(TAG, "已把%s收编为槽A, %lu字节", LOGIC_CONFIG_FILE_PATH, slot.size);
+        }
+    }
+
+    // 槽文件和记录对不上(比如littlefs被格式化过)就当空槽
+    for (uint8_t i = 0; i < 2; i++) {
+        struct stat st;
+        Slot& slot = state.slots[i];
+        if (slot.generation != 0 && (stat(slotPath(i), &st) != 0 || (uint32_t)st.st_size != slot.size)) {
+            ESP_LOGW(TAG, "槽%c的文件不见了或大小不对, 作废", 'A' + i);
+            slot = {};
+        }
+    }
+    if (state.slots[state.active].generation == 0 && state.slots[1 - state.active].generation != 0) {
+        state.active = 1 - state.active;
+    }
+    const Slot& cur = state.slots[state.active];
+    if (cur.generation != 0) {
+        ESP_LOGI(TAG, "当前配置: 槽%c, 第%lu代, %lu字节, %.16s", 'A' + state.active,
+                 cur.generation, cur.size, cur.hash.hex().c_str());
+    }
+}
+
+bool ConfigSlots::save() {
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(NVS_NS, NVS_READWRITE, &h);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(h, NVS_KEY, &state, sizeof(state));
+        if (err == ESP_OK) {
+            err = nvs_commit(h);
+        }
+        nvs_close(h);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "保存槽表失败: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+bool ConfigSlots::active(Slot& slot, const char** path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    slot = state.slots[state.active];
+    if (path) {
+        *path = slotPath(state.active);
+    }
+    return slot.generation != 0;
+}
+
+bool ConfigSlots::previous(Slot& slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    slot = state.slots[1 - state.active];
+    return slot.generation != 0;
+}
+
+bool ConfigSlots::loaded(ConfigHash& hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    hash = loaded_hash;
+    return has_loaded;
+}
+
+void ConfigSlots::setLoaded(const ConfigHash* hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    has_loaded = hash != nullptr;
+    loaded_hash = hash ? *hash : ConfigHash{};
+}
+
+bool ConfigSlots::beginWrite() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closeWrite();
+    // 只写暂存文件, 槽和槽表要到commit确定切换时才动, 重发的同一份配置abort掉就什么都没变
+    write_fd = open(CONFIG_STAGING_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (write_fd < 0) {
+        ESP_LOGE(TAG, "打开%s失败: %s", CONFIG_STAGING_PATH, strerror(errno));
+        return false;
+    }
+    write_size = 0;
+    mbedtls_sha256_init(&write_sha);
+    mbedtls_sha256_starts(&write_sha, 0);
+    return true;
+}
+
+bool ConfigSlots::write(const void* data, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (write_fd < 0) {
+        return false;
+    }
+    ssize_t n = ::write(write_fd, data, len);
+    if (n != (ssize_t)len) {
+        ESP_LOGE(TAG, "写%s失败: %s", CONFIG_STAGING_PATH, n < 0 ? strerror(errno) : "空间不足");
+        closeWrite();
+        return false;
+    }
+    mbedtls_sha256_update(&write_sha, static_cast<const uint8_t*>(data), len);
+    write_size += len;
+    return true;
+}
+
+bool ConfigSlots::writtenHash(ConfigHash& hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (write_fd < 0) {
+        return false;
+    }
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_clone(&sha, &write_sha);
+    mbedtls_sha256_finish(&sha, hash.bytes);
+    mbedtls_sha256_free(&sha);
+    return true;
+}
+
+bool ConfigSlots::commit() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (write_fd < 0) {
+        return false;
+    }
+    Slot slot = {};
+    mbedtls_sha256_finish(&write_sha, slot.hash.bytes);
+    slot.size = write_size;
+    closeWrite();
+
+    // 回读一遍, 确认flash里的就是收到的
+    ConfigHash stored;
+    uint32_t stored_size;
+    if (!hashFile(CONFIG_STAGING_PATH, stored, stored_size) || stored != slot.hash || stored_size != slot.size) {
+        ESP_LOGE(TAG, "新配置回读校验失败");
+        return false;
+    }
+    if (!validateLogicConfigFile(CONFIG_STAGING_PATH)) {
+        ESP_LOGE(TAG, "新配置格式不对, 不切换");
+        return false;
+    }
+
+    // 两个槽都空时放槽A, 否则换掉上一份配置. 先从槽表里拿掉它再改名,
+    // 中途断电时槽表里要么还是旧的那份, 要么是空槽, 不会指着对不上的文件
+    uint8_t target = state.slots[state.active].generation == 0 ? state.active : 1 - state.active;
+    if (state.slots[target].generation != 0) {
+        state.slots[target] = {};
+        if (!save()) {
+            return false;
+        }
+    }
+    if (rename(CONFIG_STAGING_PATH, slotPath(target)) != 0) {
+        ESP_LOGE(TAG, "新配置改名为%s失败: %s", slotPath(target), strerror(errno));
+        return false;
+    }
+
+    slot.generation = std::max(state.slots[0].generation, state.slots[1].generation) + 1;
+    State next = state;
+    next.slots[target] = slot;
+    next.active = target;
+    State prev = state;
+    state = next;
+    if (!save()) {
+        state = prev;
+        return false;
+    }
+    ESP_LOGI(TAG, "切换到槽%c, 第%lu代, %lu字节, %.16s", 'A' + target,
+             slot.generation, slot.size, slot.hash.hex().c_str());
+    return true;
+}
+
+void ConfigSlots::abort() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closeWrite();
+    unlink(CONFIG_STAGING_PATH);
+}
+
+void ConfigSlots::closeWrite() {
+    if (write_fd >= 0) {
+        close(write_fd);
+        write_fd = -1;
+        mbedtls_sha256_free(&write_sha);
+    }
+}
+
+bool ConfigSlots::rollback() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (write_fd >= 0) {
+        ESP_LOGW(TAG, "正在写新配置, 不能回滚");
+        return false;
+    }
+    uint8_t target = 1 - state.active;
+    if (state.slots[target].generation == 0) {
+        ESP_LOGW(TAG, "没有上一份配置, 不能回滚");
+        return false;
+    }
+    state.active = target;
+    if (!save()) {
+        state.active = 1 - target;
+        return false;
+    }
+    const Slot& slot = state.slots[target];
+    ESP_LOGI(TAG, "回滚到槽%c, 第%lu代, %.16s", 'A' + target, slot.generation, slot.hash.hex().c_str());
+    return true;
+}
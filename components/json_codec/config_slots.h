@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include "mbedtls/sha256.h"
+#include "config_hash.h"
+
+// 配置文件的A/B槽: 两个槽文件, 新配置先写进暂存文件, 回读校验、检查格式都通过了才改名成不在用的槽,
+// 再在NVS里把当前槽切过去(NVS的一次提交是原子的), 写到一半断电或者配置有问题都不影响当前配置.
+// 上一份配置留在另一个槽里, 直到新配置确定要切换才被换掉, 回滚只改NVS里的指针.
+// 每个槽记着代数和内容哈希, 二进制镜像按哈希认配置, 所以回滚时上一份配置的镜像还能直接用
+class ConfigSlots {
+public:
+    static ConfigSlots& getInstance() {
+        static ConfigSlots instance;
+        return instance;
+    }
+
+    struct Slot {
+        uint32_t generation;                    // 0表示空槽
+        uint32_t size;
+        ConfigHash hash;
+    };
+
+    void init();                                // 挂载littlefs与NVS之后调用, 老版本的config.json收编为槽A
+
+    // 当前配置, 没有配置时返回false
+    bool active(Slot& slot, const char** path = nullptr);
+    bool previous(Slot& slot);                  // 可以回滚到的上一份配置
+
+    // 新配置分块写进暂存文件, commit通过后才换进槽里生效; 中途失败或者不想要了调abort, 两个槽都不受影响
+    bool beginWrite();
+    bool write(const void* data, size_t len);
+    bool writtenHash(ConfigHash& hash);         // 到目前为止写进去的内容的哈希, 不影响接着写
+    bool commit();
+    void abort();
+
+    bool rollback();                            // 切回上一份配置, 之后要重新加载配置
+
+    // 已经加载生效的配置, 加载任务写, mqtt和上报在别的任务里读, 所以也放在锁里; 还没加载好时返回false
+    bool loaded(ConfigHash& hash);
+    void setLoaded(const ConfigHash* hash);     // 开始重新加载时传nullptr, 加载成功后传配置哈希
+
+private:
+    static constexpr uint8_t STATE_VERSION = 1;
+
+    // 存在NVS里的槽表
+    struct State {
+        uint8_t version;
+        uint8_t active;                         // 当前槽, 两个槽都空时无意义
+        uint8_t reserved[2];
+        Slot slots[2];
+    };
+
+    std::mutex mutex;
+    State state = {};
+    bool ready = false;
+    bool has_loaded = false;
+    ConfigHash loaded_hash;
+
+    int write_fd = -1;                          // 正在写的暂存文件
+    uint32_t write_size = 0;
+    mbedtls_sha256_context write_sha;
+
+    ConfigSlots() = default;
+    bool save();
+    void closeWrite();
+    static const char* slotPath(uint8_t slot);
+    static bool hashFile(const char* path, ConfigHash& hash, uint32_t& size);
+};
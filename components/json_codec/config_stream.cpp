@@ -0,0 +1,298 @@
+#include "config_stream.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "esp_log.h"
+
+#define TAG "CONFIG_STREAM"
+
+static bool is_ws(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+ConfigStream::ConfigStream(Sink& sink) : sink(sink) {
+    key[0] = '\0';
+    alc = yyjson_alc_dyn_new();     // 申请失败就用默认的malloc
+}
+
+ConfigStream::~ConfigStream() {
+    free(buf);
+    if (alc) {
+        yyjson_alc_dyn_free(alc);
+    }
+}
+
+void ConfigStream::feed(const char* data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        size_t n = state == State::CAPTURE ? captureRun(data + i, len - i) : 0;
+        if (n > 0) {
+            i += n;
+        } else {
+            put(data[i++]);
+        }
+    }
+}
+
+void ConfigStream::finish() {
+    if (state != State::LINE_START) {
+        put('\n');
+    }
+}
+
+void ConfigStream::put(char c) {
+    if (c == '\n' && state != State::LINE_START && state != State::HEADER) {
+        // json的字符串里不会有裸换行, 所以对象没结束就换行说明这一行被截断了
+        if (state != State::LINE_END && state != State::SKIP_LINE) {
+            fail();
+        }
+        endLine();
+        return;
+    }
+
+    switch (state) {
+        case State::LINE_START:
+            if (c == '\n') {
+                endLine();
+                return;
+            }
+            if (is_ws(c)) return;
+            if (c == '{') {
+                state = State::EXPECT_KEY;
+                return;
+            }
+            state = State::HEADER;
+            header_len = 0;
+            [[fallthrough]];
+        case State::HEADER:
+            if (c == '\n') {
+                while (header_len && is_ws(header[header_len - 1])) header_len--;
+                sink.onHeader(line, std::string_view(header, header_len));
+                endLine();
+            } else if (header_len < HEADER_MAX) {
+                header[header_len++] = c;
+            }
+            return;
+        case State::EXPECT_KEY:
+            if (is_ws(c)) return;
+            if (c == '"') {
+                state = State::KEY;
+                key_len = 0;
+                key_esc = false;
+            } else if (c == '}') {
+                state = State::LINE_END;
+            } else {
+                fail();
+            }
+            return;
+        case State::KEY:
+            if (key_esc) {
+                key_esc = false;
+            } else if (c == '\\') {
+                key_esc = true;
+            } else if (c == '"') {
+                key[key_len] = '\0';
+                state = State::AFTER_KEY;
+                return;
+            }
+            if (key_len < KEY_MAX - 1) {
+                key[key_len++] = c;
+            }
+            return;
+        case State::AFTER_KEY:
+            if (is_ws(c)) return;
+            if (c == ':') {
+                state = State::EXPECT_VALUE;
+            } else {
+                fail();
+            }
+            return;
+        case State::EXPECT_VALUE:
+            if (is_ws(c)) return;
+            if (c == '[') {
+                sink.onSection(key, true);
+                state = State::EXPECT_ELEM;
+                return;
+            }
+            if (c == ',' || c == '}' || c == ']') {
+                fail();
+                return;
+            }
+            sink.onSection(key, false);
+            capture_parent = State::AFTER_VALUE;
+            state = State::CAPTURE;
+            break;
+        case State::EXPECT_ELEM:
+            if (is_ws(c) || c == ',') return;
+            if (c == ']') {
+                state = State::AFTER_VALUE;
+                return;
+            }
+            if (c == '}') {
+                fail();
+                return;
+            }
+            capture_parent = State::EXPECT_ELEM;
+            state = State::CAPTURE;
+            break;
+        case State::CAPTURE:
+            break;
+        case State::AFTER_VALUE:
+            if (is_ws(c)) return;
+            if (c == ',') {
+                state = State::EXPECT_KEY;
+            } else if (c == '}') {
+                state = State::LINE_END;
+            } else {
+                fail();
+            }
+            return;
+        case State::LINE_END:
+            if (!is_ws(c)) {
+                fail();
+            }
+            return;
+        case State::SKIP_LINE:
+            return;
+    }
+
+    // 拷贝一个值, 只需要跟踪字符串和括号层数就知道它在哪结束
+    if (cap_in_str) {
+        if (cap_esc) {
+            cap_esc = false;
+        } else if (c == '\\') {
+            cap_esc = true;
+        } else if (c == '"') {
+            cap_in_str = false;
+        }
+        append(&c, 1);
+        return;
+    }
+    if (cap_depth == 0 && (c == ',' || c == '}' || c == ']')) {
+        // 标量到头了, 这个字符属于外层
+        emit();
+        state = capture_parent;
+        put(c);
+        return;
+    }
+    append(&c, 1);
+    if (c == '"') {
+        cap_in_str = true;
+    } else if (c == '{' || c == '[') {
+        cap_depth++;
+    } else if ((c == '}' || c == ']') && --cap_depth == 0) {
+        emit();
+        state = capture_parent;
+    }
+}
+
+// 值中间的字符整段拷贝, 碰到可能让值结束的字符就停下交给put
+size_t ConfigStream::captureRun(const char* data, size_t len) {
+    size_t i = 0;
+    for (; i < len; i++) {
+        char c = data[i];
+        if (c == '\n') {
+            break;
+        }
+        if (cap_in_str) {
+            if (cap_esc) {
+                cap_esc = false;
+            } else if (c == '\\') {
+                cap_esc = true;
+            } else if (c == '"') {
+                cap_in_str = false;
+            }
+        } else if (c == '"') {
+            cap_in_str = true;
+        } else if (c == '{' || c == '[') {
+            cap_depth++;
+        } else if (c == '}' || c == ']') {
+            if (cap_depth <= 1) {
+                break;
+            }
+            cap_depth--;
+        } else if (c == ',' && cap_depth == 0) {
+            break;
+        }
+    }
+    append(data, i);
+    return i;
+}
+
+void ConfigStream::append(const char* data, size_t len) {
+    if (cap_overflow || len == 0) {
+        return;
+    }
+    if (buf_len + len > ITEM_MAX) {
+        cap_overflow = true;
+        return;
+    }
+    if (buf_len + len + YYJSON_PADDING_SIZE > buf_cap) {
+        size_t new_cap = buf_cap ? buf_cap : 1024;
+        while (new_cap < buf_len + len + YYJSON_PADDING_SIZE) {
+            new_cap *= 2;
+        }
+        new_cap = std::min<size_t>(new_cap, ITEM_MAX + YYJSON_PADDING_SIZE);
+        char* p = static_cast<char*>(realloc(buf, new_cap));
+        if (!p) {
+            cap_overflow = true;
+            return;
+        }
+        buf = p;
+        buf_cap = new_cap;
+        if (buf_cap > peak_item) {
+            peak_item = buf_cap;
+        }
+    }
+    memcpy(buf + buf_len, data, len);
+    buf_len += len;
+}
+
+void ConfigStream::emit() {
+    item_count++;
+    if (cap_overflow) {
+        ESP_LOGE(TAG, "第%u行[%s]有一项超过%u字节, 跳过", line + 1, key, ITEM_MAX);
+        error_count++;
+        sink.onItemError(key);
+    } else if (buf_len > 0) {
+        memset(buf + buf_len, 0, YYJSON_PADDING_SIZE);
+        yyjson_read_err err;
+        yyjson_doc* doc = yyjson_read_opts(buf, buf_len, YYJSON_READ_INSITU, alc, &err);
+        if (doc) {
+            sink.onItem(key, yyjson_doc_get_root(doc));
+            yyjson_doc_free(doc);
+        } else {
+            ESP_LOGE(TAG, "第%u行[%s]解析失败: %s", line + 1, key, err.msg);
+            error_count++;
+            sink.onItemError(key);
+        }
+    }
+    buf_len = 0;
+    cap_depth = 0;
+    cap_in_str = false;
+    cap_esc = false;
+    cap_overflow = false;
+}
+
+void ConfigStream::fail() {
+    error_count++;
+    if (state == State::CAPTURE || state == State::EXPECT_ELEM) {
+        ESP_LOGE(TAG, "第%u行[%s]不完整", line + 1, key);
+        sink.onItemError(key);
+    } else {
+        ESP_LOGE(TAG, "第%u行格式错误", line + 1);
+    }
+    state = State::SKIP_LINE;
+}
+
+void ConfigStream::endLine() {
+    line++;
+    state = State::LINE_START;
+    key[0] = '\0';
+    key_len = 0;
+    buf_len = 0;
+    cap_depth = 0;
+    cap_in_str = false;
+    cap_esc = false;
+    cap_overflow = false;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string_view>
+#include "yyjson.h"
+
+// 按块流式解析NDJSON格式的逻辑配置, 不需要整个文件都在内存里
+// 每行是只有一个key的对象(比如 {"d": [...]}), 也可以是版本号这种不是json的行.
+// 值是数组时每个元素单独拷出来原地解析再交给回调, 否则整个值解析一次;
+// 所以峰值内存只取决于最大的单个元素, 和文件多大、一行有多长都无关
+class ConfigStream {
+public:
+    class Sink {
+    public:
+        virtual ~Sink() = default;
+        virtual void onHeader(size_t line, std::string_view text) {}   // 不是json对象的行
+        virtual void onSection(const char* key, bool is_array) {}      // 开始解析一个顶层key的值
+        virtual void onItem(const char* key, yyjson_val* val) = 0;     // 非数组的值本身或数组里的一个元素, val只在回调里有效
+        virtual void onItemError(const char* key) {}                   // 值或元素太大、不是合法json或者行被截断, 已跳过
+    };
+
+    static constexpr size_t ITEM_MAX = 32 * 1024;   // 单个元素最多这么多字节, 超过的跳过
+
+    explicit ConfigStream(Sink& sink);
+    ~ConfigStream();
+
+    void feed(const char* data, size_t len);
+    void finish();                                  // 文件末尾没有换行时补上最后一行
+
+    size_t lines() const { return line; }
+    size_t items() const { return item_count; }
+    size_t errors() const { return error_count; }
+    size_t peakItemBytes() const { return peak_item; }  // 拷贝缓冲的峰值, 即最大的单个元素
+
+private:
+    static constexpr size_t KEY_MAX = 16;
+    static constexpr size_t HEADER_MAX = 64;
+
+    enum class State : uint8_t {
+        LINE_START,     // 行首, 还不知道是不是json
+        HEADER,         // 不是json的行
+        EXPECT_KEY,
+        KEY,            // 在key的字符串里
+        AFTER_KEY,
+        EXPECT_VALUE,
+        EXPECT_ELEM,    // 在数组里等下一个元素
+        CAPTURE,        // 正在拷贝一个值或元素
+        AFTER_VALUE,
+        LINE_END,       // 行对象已经结束, 等换行
+        SKIP_LINE,      // 这一行有错, 丢到换行为止
+    };
+
+    Sink& sink;
+    State state = State::LINE_START;
+    State capture_parent = State::AFTER_VALUE;      // 拷贝完回到哪个状态
+    size_t line = 0;
+
+    char key[KEY_MAX];
+    size_t key_len = 0;
+    bool key_esc = false;
+
+    char header[HEADER_MAX];
+    size_t header_len = 0;
+
+    char* buf = nullptr;                            // 当前值的拷贝, 后面留YYJSON_PADDING_SIZE给原地解析
+    size_t buf_cap = 0;
+    size_t buf_len = 0;
+    uint32_t cap_depth = 0;
+    bool cap_in_str = false;
+    bool cap_esc = false;
+    bool cap_overflow = false;
+
+    yyjson_alc* alc = nullptr;                      // 各元素共用, 内存在元素之间复用
+    size_t item_count = 0;
+    size_t error_count = 0;
+    size_t peak_item = 0;
+
+    void put(char c);
+    size_t captureRun(const char* data, size_t len);
+    void append(const char* data, size_t len);
+    void emit();
+    void endLine();
+    void fail();
+
+    ConfigStream(const ConfigStream&) = delete;
+    ConfigStream& operator=(const ConfigStream&) = delete;
+};
@@ -1,9 +1,10 @@
-#include "json.hpp"
+#include "../json.hpp"
 #include <esp_log.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <vector>
 #include <memory>
+#include <optional>
 #include <esp_timer.h>
 
 #include "lord_manager.h"
@@ -12,6 +13,9 @@
 #include "action_group.h"
 #include "commons.h"
 #include "room_state.h"
+#include "string_pool.h"
+#include "scene_trace.h"
+#include "metrics.h"
 #include "lamp.h"
 #include "relay_out.h"
 #include "drycontact_out.h"
@@ -19,13 +23,30 @@
 #include "air_conditioner.h"
 #include <rs485_comm.h>
 #include "yyjson.h"
+#include "json_codec.h"
+#include "config_stream.h"
+#include "config_image.h"
+#include "config_partition.h"
+#include "config_slots.h"
 #include <stm32_comm_types.h>
 #include <stm32_tx.h>
 #include "stm32_rx.h"
 #define TAG "JSON_CODEC"
 
+#define CONFIG_READ_CHUNK   1024        // 读配置文件的块大小
+#define CONFIG_IMAGE_TMP_PATH   CONFIG_IMAGE_FILE_PATH ".tmp"
+
 using json = nlohmann::json;
 
+static MetricCounter m_json_config_parse("json.config_parse");
+static MetricCounter m_json_config_error("json.config_error");              // 整个配置无法解析
+static MetricCounter m_json_config_bad_section("json.config_bad_section");  // 某一段缺失或格式不对, 跳过
+static MetricCounter m_json_config_image_load("json.config_image_load");    // 从二进制镜像加载, 没解析json
+static MetricGauge m_json_config_ready_ms("json.config_ready_ms");          // 开机到配置加载完的毫秒数
+static MetricHistogram m_json_config_parse_ms("json.config_parse_ms", {50, 100, 250, 500, 1000, 2000, 5000});
+static MetricCounter m_json_state_keyframe("json.state_keyframe");
+static MetricCounter m_json_state_delta("json.state_delta");
+
 std::vector<std::string_view> splitByLineView(std::string_view content) {
     std::vector<std::string_view> lines;
     size_t start = 0;
@@ -41,407 +62,703 @@ std::vector<std::string_view> splitByLineView(std::string_view content) {
     return lines;
 }
 
-inline const char* json_get_str_safe(yyjson_val* obj, const char* key, const char* def = "") {
-    yyjson_val *v = yyjson_obj_get(obj, key);
-    return (v && yyjson_is_str(v)) ? yyjson_get_str(v) : def;
+// json那条路径逐项打印注册日志, 从镜像加载时只打印汇总, 几百行串口日志本身就要好几秒
+static bool log_items = true;
+#define CONFIG_LOGI(format, ...) do { if (log_items) ESP_LOGI(TAG, format, ##__VA_ARGS__); } while (0)
+
+// ================ json -> Spec ================
+
+static void decodeCommonConfig(yyjson_val* common_config_obj, CommonSpec& spec) {
+    spec.use_day_night = json_get_bool_safe(common_config_obj, "useDayNight");
+    spec.day_time_point = json_get_int_safe(common_config_obj, "dayTimePoint", 7);
+    spec.night_time_point = json_get_int_safe(common_config_obj, "nightTimePoint", 19);
+    // if (yyjson_val* air_config_obj = yyjson_obj_get(common_config_obj, "airConfig")) {
+    //     auto& air_config = AirConGlobalConfig::getInstance();
+    //     air_config.default_target_temp = json_get_int_safe(air_config_obj, "defaultTargetTemp", 26);
+    //     air_config.default_mode = static_cast<ACMode>(json_get_int_safe(air_config_obj, "defaultMode", 0));
+    //     air_config.default_fan_speed = static_cast<ACFanSpeed>(json_get_int_safe(air_config_obj, "defaultFanSpeed", 0));
+    //     air_config.stop_threshold = json_get_int_safe(air_config_obj, "stopThreshold", 1);
+    //     air_config.rework_threshold = json_get_int_safe(air_config_obj, "reworkThreshold", 1);
+    //     air_config.stop_action = static_cast<ACStopAction>(json_get_int_safe(air_config_obj, "stopAction", 0));
+    //     air_config.remove_card_air_usable = json_get_bool_safe(air_config_obj, "removeCardAirUsable", false);
+    //     if (yyjson_val* auto_fan_obj = yyjson_obj_get(air_config_obj, "autoFan"); yyjson_is_obj(auto_fan_obj)) {
+    //         air_config.low_diff = json_get_int_safe(auto_fan_obj, "lowFanTempDiff", 2);
+    //         air_config.high_diff = json_get_int_safe(auto_fan_obj, "highFanTempDiff", 2);
+    //         air_config.auto_fun_wind_speed = static_cast<ACFanSpeed>(json_get_int_safe(auto_fan_obj, "autoVentFanSpeed", 1));
+    //     } else {
+    //         ESP_LOGW(TAG, "配置[autoFan]错误");
+    //     }
+    //     air_config.shutdown_after_duration = json_get_int_safe(air_config_obj, "shutdownAfterDuration", 0);
+    //     air_config.shutdown_after_fan_speed = static_cast<ACFanSpeed>(json_get_int_safe(air_config_obj, "shutdownAfterFanSpeed", 0));
+    // } else {
+    //     ESP_LOGW(TAG, "配置[airConfig]错误");
+    // }
 }
 
-inline int json_get_int_safe(yyjson_val* obj, const char* key, int def = 0) {
-    yyjson_val *v = yyjson_obj_get(obj, key);
-    return (v && yyjson_is_int(v)) ? yyjson_get_int(v) : def;
+static void decodeDeviceConfig(yyjson_val* dev_obj, DeviceSpec& spec) {
+    spec.type = static_cast<DeviceType>(json_get_int_safe(dev_obj, "type", (int)DeviceType::NONE));
+    spec.did = json_get_int_safe(dev_obj, "did", -1);
+    if (spec.type == DeviceType::NONE) {
+        ESP_LOGW(TAG, "错误的设备类型, did(%u)", spec.did);
+    }
+    spec.name = json_get_str_safe(dev_obj, "n", "");
+    spec.carry_state = json_get_str_safe(dev_obj, "ct", "");
+
+    for (auto [key, dids] : {std::pair{"lkds", &spec.link_dids}, std::pair{"rpds", &spec.repel_dids}}) {
+        if (yyjson_val* arr = yyjson_obj_get(dev_obj, key); yyjson_is_arr(arr)) {
+            size_t idx1, max1;
+            yyjson_val* item1;
+            yyjson_arr_foreach(arr, idx1, max1, item1) {
+                if (item1 && yyjson_is_int(item1)) {
+                    dids->push_back(yyjson_get_int(item1));
+                }
+            }
+        }
+    }
+
+    switch (spec.type) {
+        case DeviceType::LAMP:
+        case DeviceType::RELAY:
+        case DeviceType::DRY_CONTACT:
+        case DeviceType::DOORBELL:
+            spec.ch = json_get_int_safe(dev_obj, "ch", 127);
+            break;
+        case DeviceType::CURTAIN:
+            spec.ch = json_get_int_safe(dev_obj, "oc", 127);
+            spec.close_ch = json_get_int_safe(dev_obj, "cc", 127);
+            spec.runtime = json_get_int_safe(dev_obj, "rt", 10);
+            break;
+        case DeviceType::INFRARED_AIR:
+            spec.air_id = json_get_int_safe(dev_obj, "aid", 0);
+            break;
+        case DeviceType::SINGLE_AIR:
+            spec.air_id = json_get_int_safe(dev_obj, "aid", 0);
+            spec.wc = json_get_int_safe(dev_obj, "wc", 127);
+            spec.lc = json_get_int_safe(dev_obj, "lc", 127);
+            spec.mc = json_get_int_safe(dev_obj, "mc", 127);
+            spec.hc = json_get_int_safe(dev_obj, "hc", 127);
+            break;
+        case DeviceType::RS485:
+            spec.code = json_get_str_safe(dev_obj, "cd", "");
+            break;
+        default:
+            break;
+    }
 }
 
-inline bool json_get_bool_safe(yyjson_val* obj, const char* key, bool def = false) {
-    yyjson_val *v = yyjson_obj_get(obj, key);
-    return (v && yyjson_is_bool(v)) ? yyjson_get_bool(v) : def;
+// 在这里就把操作名编译成操作码, 非法的动作直接丢掉
+static void compileActions(yyjson_val* action_arr, std::vector<ActionSpec>& out) {
+    auto& lord = LordManager::instance();
+    size_t idx, max;
+    yyjson_val* item;
+    yyjson_arr_foreach(action_arr, idx, max, item) {
+        if (!item || !yyjson_is_obj(item)) continue;
+        uint16_t target_did = json_get_int_safe(item, "t", -1);
+        IDevice* dev = lord.getDeviceByDid(target_did);
+        if (!dev) {
+            ESP_LOGW(TAG, "设备(%u)不存在", target_did);
+            continue;
+        }
+        AtomicAction action = compileAtomicAction(dev, json_get_str_safe(item, "o", ""), json_get_str_safe(item, "p", ""));
+        if (action.op == Opcode::NONE) continue;
+        ActionSpec spec = {.did = target_did, .op = action.op, .param = action.param};
+        if (action.param.state != ROOM_STATE_NONE) {
+            spec.state_name = str_of(RoomStateStore::getInstance().nameOf(action.param.state));
+        }
+        out.push_back(spec);
+    }
 }
 
-void parseLocalLogicConfig(void) {
-    int file_fd = open(LOGIC_CONFIG_FILE_PATH, O_RDONLY);
-    if (file_fd < 0) {
-        ESP_LOGE(TAG, "打开本地配置文件失败: %s (%s)", LOGIC_CONFIG_FILE_PATH, strerror(errno));
-        return;
+static void decodeActionGroupConfig(yyjson_val* ag_obj, ActionGroupSpec& spec) {
+    spec.name = json_get_str_safe(ag_obj, "n", "");
+    spec.aid = json_get_int_safe(ag_obj, "aid", -1);
+    spec.is_mode = json_get_bool_safe(ag_obj, "m", false);
+    if (yyjson_val* action_arr = yyjson_obj_get(ag_obj, "a"); yyjson_is_arr(action_arr)) {
+        compileActions(action_arr, spec.actions);
+    } else {
+        ESP_LOGE(TAG, "配置[a][a]错误");
     }
+}
 
-    struct stat file_stat;
-    if (fstat(file_fd, &file_stat) < 0) {
-        ESP_LOGE(TAG, "获取文件状态失败: %s (%s)", LOGIC_CONFIG_FILE_PATH, strerror(errno));
-        close(file_fd);
-        return;
+static void decodeInputConfig(yyjson_val* input_obj, InputSpec& spec) {
+    spec.name = json_get_str_safe(input_obj, "n", "");
+    spec.iid = json_get_int_safe(input_obj, "iid", -1);
+    spec.type = static_cast<InputType>(json_get_int_safe(input_obj, "type", (int)InputType::NONE));
+    if (yyjson_val* tgs_arr = yyjson_obj_get(input_obj, "tgs"); yyjson_is_arr(tgs_arr)) {
+        size_t idx1, max1;
+        yyjson_val* item1;
+        yyjson_arr_foreach(tgs_arr, idx1, max1, item1) {
+            if (item1 && yyjson_is_int(item1)) {
+                spec.tags.push_back(yyjson_get_int(item1));
+            }
+        }
     }
 
-    size_t file_size = file_stat.st_size;
-    if (file_size <= 0) {
-        ESP_LOGE(TAG, "文件为空: %s", LOGIC_CONFIG_FILE_PATH);
-        close(file_fd);
-        return;
+    if (yyjson_val* ag_arr = yyjson_obj_get(input_obj, "a"); yyjson_is_arr(ag_arr)) {
+        size_t idx1, max1;
+        yyjson_val* actions_arr;
+        yyjson_arr_foreach(ag_arr, idx1, max1, actions_arr) {
+            if (!actions_arr || !yyjson_is_arr(actions_arr)) continue;
+            compileActions(actions_arr, spec.groups.emplace_back());
+        }
+    } else {
+        ESP_LOGE(TAG, "配置[i][a]错误, iid: %u", spec.iid);
     }
 
-    // 读取文件内容
-    std::string config_json(file_size, '\0');
-    size_t total_read = 0;
-    while (total_read < file_size) {
-        ssize_t n = read(file_fd, &config_json[total_read], file_size - total_read);
-        if (n < 0) {
-            ESP_LOGE(TAG, "读取文件失败: %s (%s)", LOGIC_CONFIG_FILE_PATH, strerror(errno));
-            close(file_fd);
-            return;
+    if (spec.type == InputType::PANEL_BTN) {
+        spec.pid = json_get_int_safe(input_obj, "pid", -1);
+        spec.bid = json_get_int_safe(input_obj, "bid", -1);
+        spec.lbd = json_get_int_safe(input_obj, "lbd", -1);
+    } else if (spec.type == InputType::DRY_CONTACT) {
+        spec.ch = json_get_int_safe(input_obj, "ch");
+        spec.trigger = static_cast<TriggerType>(json_get_int_safe(input_obj, "tt", (int)TriggerType::NONE));
+        if (spec.trigger == TriggerType::INFRARED) {
+            spec.duration = json_get_int_safe(input_obj, "du", 1);
         }
-        if (n == 0) break;
-        total_read += n;
+    } else if (spec.type == InputType::VOICE_CMD) {
+        spec.code = json_get_str_safe(input_obj, "cd");
     }
-    close(file_fd);
+}
 
-    if (config_json.empty()) {
-        ESP_LOGW(TAG, "本地没有配置文件");
-        return;
+// ================ Spec -> 注册, json和镜像共用 ================
+
+static void registerCommonConfig(const CommonSpec& spec) {
+    auto& lord = LordManager::instance();
+    lord.useDayNight = spec.use_day_night;
+    lord.dayTimePoint = spec.day_time_point;
+    lord.nightTimePoint = spec.night_time_point;
+}
+
+static void registerDeviceConfig(const DeviceSpec& spec) {
+    auto& lord = LordManager::instance();
+    uint16_t did = spec.did;
+    std::string name(spec.name);
+    std::string carry_state(spec.carry_state);
+    const char* nm = name.c_str();
+    const char* st = carry_state.c_str();
+
+    switch (spec.type) {
+        case DeviceType::LAMP:
+            CONFIG_LOGI("注册Lamp, did(%u), nm(%s), ch(%u), st(%s)", did, nm, spec.ch, st);
+            lord.registerLamp(did, name, carry_state, spec.ch, spec.link_dids, spec.repel_dids);
+            break;
+        case DeviceType::CURTAIN:
+            CONFIG_LOGI("注册Curtain, did(%u), nm(%s), oc(%u), cc(%u), rt(%lu), st(%s)",
+                        did, nm, spec.ch, spec.close_ch, spec.runtime, st);
+            lord.registerCurtain(did, name, carry_state, spec.ch, spec.close_ch, spec.runtime);
+            break;
+        case DeviceType::INFRARED_AIR:
+            CONFIG_LOGI("注册InfraredAir, did(%u), nm(%s), id(%u), st(%s)", did, nm, spec.air_id, st);
+            lord.registerIngraredAir(did, name, carry_state, spec.air_id);
+            break;
+        case DeviceType::SINGLE_AIR:
+            CONFIG_LOGI("注册SingleAir, did(%u), nm(%s), id(%u), wc(%u), lc(%u), mc(%u), hc(%u), st(%s)",
+                        did, nm, spec.air_id, spec.wc, spec.lc, spec.mc, spec.hc, st);
+            lord.registerSingleAir(did, name, carry_state, spec.air_id, spec.wc, spec.lc, spec.mc, spec.hc);
+            break;
+        case DeviceType::RS485: {
+            std::string code(spec.code);
+            CONFIG_LOGI("注册RS485, did(%u), nm(%s), code(%s), st(%s)", did, nm, code.c_str(), st);
+            lord.registerRs485(did, name, carry_state, code);
+            break;
+        }
+        case DeviceType::RELAY:
+            CONFIG_LOGI("注册RelayOut, did(%u), nm(%s), ch(%u), st(%s)", did, nm, spec.ch, st);
+            lord.registerRelayOut(did, name, carry_state, spec.ch, spec.link_dids, spec.repel_dids);
+            break;
+        case DeviceType::DRY_CONTACT:
+            CONFIG_LOGI("注册DryContactOut, did(%u), nm(%s), ch(%u), st(%s)", did, nm, spec.ch, st);
+            lord.registerDryContactOut(did, name, carry_state, spec.ch, spec.link_dids, spec.repel_dids);
+            break;
+        case DeviceType::DOORBELL:
+            CONFIG_LOGI("注册门铃, did(%u), nm(%s), ch(%u), st(%s)", did, nm, spec.ch, st);
+            lord.registerRelayOut(did, name, carry_state, spec.ch, spec.link_dids, spec.repel_dids);
+            break;
+        case DeviceType::BGM:
+            CONFIG_LOGI("注册背景音乐, did(%u), nm(%s), st(%s)", did, nm, st);
+            lord.registerBGM(did, name, carry_state);
+            break;
+        case DeviceType::HEARTBEAT:
+        case DeviceType::ROOM_STATE:
+        case DeviceType::DELAYER:
+        case DeviceType::ACTION_GROUP_OP:
+        case DeviceType::SNAPSHOT:
+        case DeviceType::INDICATOR:
+            CONFIG_LOGI("注册预设设备, did(%u), nm(%s)", did, nm);
+            lord.registerPreset(did, name, carry_state, spec.type);
+            break;
+        default:
+            ESP_LOGE(TAG, "未处理的设备类型: %i", (int)spec.type);
+            break;
     }
-    printCurrentFreeMemory("读完文件");
+}
 
+// 把did换回设备指针, 房间状态按名字重新登记
+static std::vector<AtomicAction> linkActions(const std::vector<ActionSpec>& specs) {
     auto& lord = LordManager::instance();
-    lord.clearAll();
+    std::vector<AtomicAction> actions;
+    actions.reserve(specs.size());
+    for (const auto& spec : specs) {
+        IDevice* dev = lord.getDeviceByDid(spec.did);
+        if (!dev) {
+            ESP_LOGW(TAG, "设备(%u)不存在", spec.did);
+            continue;
+        }
+        AtomicAction action = {.target_device = dev, .op = spec.op, .param = spec.param};
+        action.param.state = spec.state_name.empty() ? ROOM_STATE_NONE : room_state_id(spec.state_name);
+        actions.push_back(action);
+    }
+    return actions;
+}
+
+static void registerActionGroupConfig(const ActionGroupSpec& spec) {
+    std::string name(spec.name);
+    std::vector<AtomicAction> actions = linkActions(spec.actions);
+    CONFIG_LOGI("注册模式, aid(%u), nm(%s), is_mode(%u), size(%u)",
+                spec.aid, name.c_str(), spec.is_mode, actions.size());
+    LordManager::instance().registerActionGroup(spec.aid, name, spec.is_mode, std::move(actions));
+}
 
-    const auto lines = splitByLineView(config_json);
-    if (lines.size() < 2) {
-        ESP_LOGE(TAG, "本地配置文件错误");
+// 如果有lightBindDevice, 就把此面板按键绑定给对应设备
+static void bindPanelButton(int lbd, uint8_t pid, uint8_t bid, const std::vector<std::unique_ptr<ActionGroup>>& action_groups) {
+    IDevice* dev = LordManager::instance().getDeviceByDid(lbd);
+    if (!dev) {
         return;
     }
-    
-    ESP_LOGI(TAG, "================ 解析全局配置 ================");
-    yyjson_doc* common_config_doc = yyjson_read(lines[2].data(), lines[2].size(), YYJSON_READ_NOFLAG);
-    yyjson_val* common_config_root = yyjson_doc_get_root(common_config_doc);
-    printCurrentFreeMemory();
-    if (yyjson_val* common_config_obj = yyjson_obj_get(common_config_root, "c"); yyjson_is_obj(common_config_obj)) {
-        lord.useDayNight = json_get_bool_safe(common_config_obj, "useDayNight");
-        lord.dayTimePoint = json_get_int_safe(common_config_obj, "dayTimePoint", 7);
-        lord.nightTimePoint = json_get_int_safe(common_config_obj, "nightTimePoint", 19);
-        // if (yyjson_val* air_config_obj = yyjson_obj_get(common_config_obj, "airConfig")) {
-        //     auto& air_config = AirConGlobalConfig::getInstance();
-        //     air_config.default_target_temp = json_get_int_safe(air_config_obj, "defaultTargetTemp", 26);
-        //     air_config.default_mode = static_cast<ACMode>(json_get_int_safe(air_config_obj, "defaultMode", 0));
-        //     air_config.default_fan_speed = static_cast<ACFanSpeed>(json_get_int_safe(air_config_obj, "defaultFanSpeed", 0));
-        //     air_config.stop_threshold = json_get_int_safe(air_config_obj, "stopThreshold", 1);
-        //     air_config.rework_threshold = json_get_int_safe(air_config_obj, "reworkThreshold", 1);
-        //     air_config.stop_action = static_cast<ACStopAction>(json_get_int_safe(air_config_obj, "stopAction", 0));
-        //     air_config.remove_card_air_usable = json_get_bool_safe(air_config_obj, "removeCardAirUsable", false);
-        //     if (yyjson_val* auto_fan_obj = yyjson_obj_get(air_config_obj, "autoFan"); yyjson_is_obj(auto_fan_obj)) {
-        //         air_config.low_diff = json_get_int_safe(auto_fan_obj, "lowFanTempDiff", 2);
-        //         air_config.high_diff = json_get_int_safe(auto_fan_obj, "highFanTempDiff", 2);
-        //         air_config.auto_fun_wind_speed = static_cast<ACFanSpeed>(json_get_int_safe(auto_fan_obj, "autoVentFanSpeed", 1));
-        //     } else {
-        //         ESP_LOGW(TAG, "配置[autoFan]错误");
-        //     }
-        //     air_config.shutdown_after_duration = json_get_int_safe(air_config_obj, "shutdownAfterDuration", 0);
-        //     air_config.shutdown_after_fan_speed = static_cast<ACFanSpeed>(json_get_int_safe(air_config_obj, "shutdownAfterFanSpeed", 0));
-        // } else {
-        //     ESP_LOGW(TAG, "配置[airConfig]错误");
-        // }
+    DeviceType dev_type = dev->getType();
+    if (dev_type == DeviceType::LAMP) {
+        if (Lamp* lamp = dynamic_cast<Lamp*>(dev)) {
+            lamp->addAssBtn(PanelButtonPair({pid, bid}));
+            CONFIG_LOGI("绑定%u,%u至%s(%u)", pid, bid, dev->getName(), dev->getDid());
+        }
+    } else if (dev_type == DeviceType::CURTAIN) {
+        if (Curtain* curtain = dynamic_cast<Curtain*>(dev)) {
+            // 遍历当前按键的所有动作组
+            for (auto& ag : action_groups) {
+                for (auto& a : ag->actions) {
+                    if (a.op == Opcode::OPEN) {
+                        curtain->addOpenAssBtn(PanelButtonPair({pid, bid}));
+                        CONFIG_LOGI("绑定%u,%u至%s(%u) 开", pid, bid, dev->getName(), dev->getDid());
+                    } else if (a.op == Opcode::CLOSE) {
+                        curtain->addCloseAssBtn(PanelButtonPair({pid, bid}));
+                        CONFIG_LOGI("绑定%u,%u至%s(%u) 关", pid, bid, dev->getName(), dev->getDid());
+                    }
+                }
+            }
+        }
+    } else if (dev_type == DeviceType::RELAY) {
+        if (SingleRelayDevice* relay = dynamic_cast<SingleRelayDevice*>(dev)) {
+            relay->addAssBtn(PanelButtonPair({pid, bid}));
+            CONFIG_LOGI("绑定%u,%u至%s(%u)", pid, bid, dev->getName(), dev->getDid());
+        }
+    } else if (dev_type == DeviceType::DRY_CONTACT) {
+        if (DryContactOut* dry = dynamic_cast<DryContactOut*>(dev)) {
+            dry->addAssBtn(PanelButtonPair({pid, bid}));
+            CONFIG_LOGI("绑定%u,%u至%s(%u)", pid, bid, dev->getName(), dev->getDid());
+        }
+    } else if (dev_type == DeviceType::BGM) {
+        if (BGM* bgm = dynamic_cast<BGM*>(dev)) {
+            bgm->addAssBtn(PanelButtonPair({pid, bid}));
+            CONFIG_LOGI("绑定%u,%u至%s(%u)", pid, bid, dev->getName(), dev->getDid());
+        }
     } else {
-        ESP_LOGW(TAG, "配置[c]错误");
+        ESP_LOGW(TAG, "无效的关联设备: %s(%u)", dev->getName(), dev->getDid());
     }
-    yyjson_doc_free(common_config_doc);
+}
 
-    ESP_LOGI(TAG, "================ 解析设备 ================");
-    printCurrentFreeMemory();
-    yyjson_doc* devices_config_doc = yyjson_read(lines[3].data(), lines[3].size(), YYJSON_READ_NOFLAG);
-    yyjson_val* devices_config_root = yyjson_doc_get_root(devices_config_doc);
-    if (yyjson_val* devices_arr = yyjson_obj_get(devices_config_root, "d"); yyjson_is_arr(devices_arr)) {
-        size_t idx, max;
-        yyjson_val* dev_obj;
-
-        yyjson_arr_foreach(devices_arr, idx, max, dev_obj) {
-            if (!dev_obj || !yyjson_is_obj(dev_obj)) continue;
-
-            DeviceType dtype = static_cast<DeviceType>(json_get_int_safe(dev_obj, "type", (int)DeviceType::NONE));
-            uint16_t did = json_get_int_safe(dev_obj, "did", -1);
-            if (dtype == DeviceType::NONE) {
-                ESP_LOGW(TAG, "错误的设备类型, did(%u)", did);
-            }
+static void registerInputConfig(const InputSpec& spec) {
+    auto& lord = LordManager::instance();
+    uint16_t iid = spec.iid;
+    std::string name(spec.name);
+    const char* nm = name.c_str();
+    std::set<InputTag> tags_set;
+    for (uint8_t tag : spec.tags) {
+        tags_set.insert(static_cast<InputTag>(tag));
+    }
+    std::vector<std::unique_ptr<ActionGroup>> action_groups;
+    for (const auto& group : spec.groups) {
+        action_groups.push_back(std::make_unique<ActionGroup>(static_cast<uint16_t>(-1), "", false, linkActions(group)));
+    }
 
-            const char* name = json_get_str_safe(dev_obj, "n", "");
-            const char* carry_state = json_get_str_safe(dev_obj, "ct", "");
+    if (spec.type == InputType::PANEL_BTN) {
+        if (spec.lbd > -1) {
+            bindPanelButton(spec.lbd, spec.pid, spec.bid, action_groups);
+        }
+        CONFIG_LOGI("注册按键, iid(%u), nm(%s), pid(%u), bid(%u), tags_size(%d), g_size(%u)",
+                    iid, nm, spec.pid, spec.bid, tags_set.size(), action_groups.size());
+        lord.registerPanelKeyInput(iid, name, tags_set, spec.pid, spec.bid, std::move(action_groups));
+    } else if (spec.type == InputType::DRY_CONTACT) {
+        CONFIG_LOGI("注册干接点输入, iid(%d), tp(%d), nm(%s), ch(%d), tt(%d), tags_size(%d), g_size(%d), du(%lu)",
+                    iid, (int)spec.type, nm, spec.ch, (int)spec.trigger, tags_set.size(), action_groups.size(), spec.duration);
+        lord.registerDryContactInput(iid, name, tags_set, spec.ch, spec.trigger, spec.duration, std::move(action_groups));
+    } else if (spec.type == InputType::VOICE_CMD) {
+        std::string code(spec.code);
+        CONFIG_LOGI("注册语音指令输入, iid(%d), tp(%d), nm(%s), code(%s), tags_size(%d), g_size(%d)",
+                    iid, (int)spec.type, nm, code.c_str(), tags_set.size(), action_groups.size());
+        lord.registerVoiceInput(iid, name, tags_set, code, std::move(action_groups));
+    }
+}
 
-            std::vector<uint16_t> link_dids;
-            if (yyjson_val* lkds_arr = yyjson_obj_get(dev_obj, "lkds"); yyjson_is_arr(lkds_arr)) {
-                size_t idx1, max1;
-                yyjson_val* item1;
-                yyjson_arr_foreach(lkds_arr, idx1, max1, item1) {
-                    if (item1 && yyjson_is_int(item1)) {
-                        link_dids.push_back(yyjson_get_int(item1));
-                    }
-                }
-            }
+static void beginLogicConfig() {
+    LordManager::instance().clearAll();
+    StringPool::getInstance().resetStats();
+}
 
-            std::vector<uint16_t> repel_dids;
-            if (yyjson_val* rpds_arr = yyjson_obj_get(dev_obj, "rpds"); yyjson_is_arr(rpds_arr)) {
-                size_t idx1, max1;
-                yyjson_val* item1;
-                yyjson_arr_foreach(rpds_arr, idx1, max1, item1) {
-                    if (item1 && yyjson_is_int(item1)) {
-                        repel_dids.push_back(yyjson_get_int(item1));
-                    }
-                }
-            }
+static void endLogicConfig() {
+    LordManager::instance().buildWakeIndicatorMap();
+    ESP_LOGI(TAG, "================ 配置解析完成 ================");
+    StringPool::getInstance().logStats();
+}
 
-            switch (dtype) {
-                case DeviceType::LAMP: {
-                    uint8_t ch = json_get_int_safe(dev_obj, "ch", 127);
-                    ESP_LOGI(TAG, "注册Lamp, did(%u), nm(%s), ch(%u), st(%s)",
-                                            did, name, ch, carry_state);
-                    lord.registerLamp(did, name, carry_state, ch, link_dids, repel_dids);
-                    break;
-                }
-                case DeviceType::CURTAIN: {
-                    uint8_t oc = json_get_int_safe(dev_obj, "oc", 127);
-                    uint8_t cc = json_get_int_safe(dev_obj, "cc", 127);
-                    uint64_t rt = json_get_int_safe(dev_obj, "rt", 10);
-                    ESP_LOGI(TAG, "注册Curtain, did(%u), nm(%s), oc(%u), cc(%u), rt(%llu), st(%s)",
-                                                did, name, oc, cc, rt, carry_state);
-                    lord.registerCurtain(did, name, carry_state,oc, cc, rt);
-                    break;
-                }
-                case DeviceType::INFRARED_AIR: {
-                    uint8_t airId = json_get_int_safe(dev_obj, "aid", 0);
-                    ESP_LOGI(TAG, "注册InfraredAir, did(%u), nm(%s), id(%u), st(%s)",
-                                                    did, name, airId, carry_state);
-                    lord.registerIngraredAir(did, name, carry_state, airId);
-                    break;
-                }
-                case DeviceType::SINGLE_AIR: {
-                    uint8_t airId = json_get_int_safe(dev_obj, "aid", 0);
-                    uint8_t wc = json_get_int_safe(dev_obj, "wc", 127);
-                    uint8_t lc = json_get_int_safe(dev_obj, "lc", 127);
-                    uint8_t mc = json_get_int_safe(dev_obj, "mc", 127);
-                    uint8_t hc = json_get_int_safe(dev_obj, "hc", 127);
-                    ESP_LOGI(TAG, "注册SingleAir, did(%u), nm(%s), id(%u), wc(%u), lc(%u), mc(%u), hc(%u), st(%s)",
-                                                    did, name, airId, wc, lc, mc, hc, carry_state);
-                    lord.registerSingleAir(did, name, carry_state, airId, wc, lc, mc, hc);
-                    break;
-                }
-                case DeviceType::RS485: {
-                    const char* code = json_get_str_safe(dev_obj, "cd", "");
-                    ESP_LOGI(TAG, "注册RS485, did(%u), nm(%s), code(%s), st(%s)",
-                                                did, name, code, carry_state);
-                    lord.registerRs485(did, name, carry_state, code);
-                    break;
-                }
-                case DeviceType::RELAY: {
-                    uint8_t ch = json_get_int_safe(dev_obj, "ch", 127);
-                    ESP_LOGI(TAG, "注册RelayOut, did(%u), nm(%s), ch(%u), st(%s)",
-                                            did, name, ch, carry_state);
-                    lord.registerRelayOut(did, name, carry_state, ch, link_dids, repel_dids);
-                    break;
-                }
-                case DeviceType::DRY_CONTACT: {
-                    uint8_t ch = json_get_int_safe(dev_obj, "ch", 127);
-                    ESP_LOGI(TAG, "注册DryContactOut, did(%u), nm(%s), ch(%u), st(%s)",
-                                            did, name, ch, carry_state);
-                    lord.registerDryContactOut(did, name, carry_state, ch, link_dids, repel_dids);
-                    break;
-                }
-                case DeviceType::DOORBELL: {
-                    uint8_t ch = json_get_int_safe(dev_obj, "ch", 127);
-                    ESP_LOGI(TAG, "注册门铃, did(%u), nm(%s), ch(%u), st(%s)",
-                                            did, name, ch, carry_state);
-                    lord.registerRelayOut(did, name, carry_state, ch, link_dids, repel_dids);
-                    break;
-                }
-                case DeviceType::BGM: {
-                    ESP_LOGI(TAG, "注册背景音乐, did(%u), nm(%s), st(%s)",
-                                               did, name, carry_state);
-                    lord.registerBGM(did, name, carry_state);
-                    break;
-                }
-                case DeviceType::HEARTBEAT:
-                case DeviceType::ROOM_STATE:
-                case DeviceType::DELAYER:
-                case DeviceType::ACTION_GROUP_OP:
-                case DeviceType::SNAPSHOT:
-                case DeviceType::INDICATOR: {
-                    ESP_LOGI(TAG, "注册预设设备, did(%u), nm(%s)",
-                                                did, name);
-                    lord.registerPreset(did, name, carry_state, dtype);
-                    break;
-                }
-                default:
-                    ESP_LOGE(TAG, "未处理的设备类型: %i", (int)dtype);
-                    break;
-            }
+enum Section : uint8_t { NONE, COMMON, DEVICES, ACTION_GROUPS, INPUTS };
+
+static const char* sectionKey(Section s) {
+    switch (s) {
+        case COMMON: return "c";
+        case DEVICES: return "d";
+        case ACTION_GROUPS: return "a";
+        case INPUTS: return "i";
+        default: return "";
+    }
+}
+
+static Section sectionOf(const char* key) {
+    for (Section s : {COMMON, DEVICES, ACTION_GROUPS, INPUTS}) {
+        if (strcmp(key, sectionKey(s)) == 0) {
+            return s;
         }
-    } else {
-        ESP_LOGW(TAG, "配置[d]错误");
     }
-    yyjson_doc_free(devices_config_doc);
+    return NONE;
+}
 
-    ESP_LOGI(TAG, "================ 解析自定义模式 ================");
-    printCurrentFreeMemory();
-    yyjson_doc* action_groups_config_doc = yyjson_read(lines[4].data(), lines[4].size(), YYJSON_READ_NOFLAG);
-    yyjson_val* action_groups_config_root = yyjson_doc_get_root(action_groups_config_doc);
-    if (yyjson_val* action_groups_arr = yyjson_obj_get(action_groups_config_root, "a"); yyjson_is_arr(action_groups_arr)) {
-        size_t idx, max;
-        yyjson_val* ag_obj;
-
-        yyjson_arr_foreach(action_groups_arr, idx, max, ag_obj) {
-            if (!ag_obj || !yyjson_is_obj(ag_obj)) continue;
-            const char* name = json_get_str_safe(ag_obj, "n", "");
-            uint16_t aid = json_get_int_safe(ag_obj, "aid", -1);
-            bool is_mode = json_get_bool_safe(ag_obj, "m", false);
-
-            std::vector<AtomicAction> actions;
-            if (yyjson_val* action_arr = yyjson_obj_get(ag_obj, "a"); yyjson_is_arr(action_arr)) {
-                size_t idx1, max1;
-                yyjson_val* item1;
-                yyjson_arr_foreach(action_arr, idx1, max1, item1) {
-                    if (!item1 || !yyjson_is_obj(item1)) continue;
-                    uint16_t target_did = json_get_int_safe(item1, "t", -1);
-                    if (IDevice* dev = lord.getDeviceByDid(target_did)) {
-                        actions.push_back(AtomicAction{
-                            .target_device = dev,
-                            .operation = json_get_str_safe(item1, "o", ""),
-                            .parameter = json_get_str_safe(item1, "p", "")
-                        });
-                    } else {
-                        ESP_LOGW(TAG, "设备(%u)不存在", target_did);
-                    }
-                }
-            } else {
-                ESP_LOGE(TAG, "配置[a][a]错误");
+// 边解码边注册, 每解析出一个设备/动作组/输入就注册, 用完就丢
+// 设备那一行在动作组和输入前面, 所以引用设备时设备已经注册好了
+// image不为空时顺便把每一项写进二进制镜像
+class LogicConfigParser : public ConfigStream::Sink {
+public:
+    explicit LogicConfigParser(ConfigImageWriter* image = nullptr) : stream(*this), image(image) {
+        m_json_config_parse.inc();
+        log_items = true;
+        beginLogicConfig();
+    }
+
+    void feed(const char* data, size_t len) {
+        stream.feed(data, len);
+    }
+
+    bool finish() {
+        stream.finish();
+        if (stream.lines() < 6) {
+            m_json_config_error.inc();
+            ESP_LOGE(TAG, "本地配置文件错误");
+            return false;
+        }
+        for (Section s : {COMMON, DEVICES, ACTION_GROUPS, INPUTS}) {
+            if (!(seen & (1 << s))) {
+                m_json_config_bad_section.inc();
+                ESP_LOGW(TAG, "配置[%s]错误", sectionKey(s));
             }
-            ESP_LOGI(TAG, "注册模式, aid(%u), nm(%s), is_mode(%u), size(%u)",
-                                     aid, name, is_mode, actions.size());
-            lord.registerActionGroup(aid, name, is_mode, actions);
         }
-    } else {
-        ESP_LOGW(TAG, "配置[a]错误");
+        m_json_config_parse_ms.record((esp_timer_get_time() - parse_start) / 1000);
+        endLogicConfig();
+        ESP_LOGI(TAG, "共%u行, %u项, %u项出错, 最大单项缓冲%u字节",
+                 stream.lines(), stream.items(), stream.errors(), stream.peakItemBytes());
+        return true;
     }
-    yyjson_doc_free(action_groups_config_doc);
 
-    ESP_LOGI(TAG, "================ 解析输入 ================");
-    printCurrentFreeMemory();
-    yyjson_doc* inputs_config_doc = yyjson_read(lines[5].data(), lines[5].size(), YYJSON_READ_NOFLAG);
-    yyjson_val* inputs_config_root = yyjson_doc_get_root(inputs_config_doc);
-    if (yyjson_val* inputs_arr = yyjson_obj_get(inputs_config_root, "i"); yyjson_is_arr(inputs_arr)) {
-        size_t idx, max;
-        yyjson_val* input_obj;
-        yyjson_arr_foreach(inputs_arr, idx, max, input_obj) {
-            if (!input_obj || !yyjson_is_obj(input_obj)) continue;
-            const char* name = json_get_str_safe(input_obj, "n", "");
-            uint16_t iid = json_get_int_safe(input_obj, "iid", -1);
-            InputType itype = static_cast<InputType>(json_get_int_safe(input_obj, "type", (int)InputType::NONE));
-            // InputTag tag = static_cast<InputTag>(json_get_int_safe(input_obj, "tg", (int)InputTag::NONE));
-            std::set<InputTag> tags_set;
-            if (yyjson_val* tgs_arr = yyjson_obj_get(input_obj, "tgs"); yyjson_is_arr(tgs_arr)) {
-                size_t idx1, max1;
-                yyjson_val* item1;
-                yyjson_arr_foreach(tgs_arr, idx1, max1, item1) {
-                    if (item1 && yyjson_is_int(item1)) {
-                        tags_set.insert(static_cast<InputTag>(yyjson_get_int(item1)));
-                    }
-                }
+    void onSection(const char* key, bool is_array) override {
+        current = NONE;
+        Section s = sectionOf(key);
+        switch (s) {
+            case COMMON: ESP_LOGI(TAG, "================ 解析全局配置 ================"); break;
+            case DEVICES: ESP_LOGI(TAG, "================ 解析设备 ================"); break;
+            case ACTION_GROUPS: ESP_LOGI(TAG, "================ 解析自定义模式 ================"); break;
+            case INPUTS: ESP_LOGI(TAG, "================ 解析输入 ================"); break;
+            default:
+                ESP_LOGW(TAG, "未知的配置[%s], 跳过", key);
+                return;
+        }
+        printCurrentFreeMemory();
+        // [c]是对象, 其它都是数组
+        if (is_array != (s != COMMON)) {
+            m_json_config_bad_section.inc();
+            ESP_LOGW(TAG, "配置[%s]错误", key);
+            return;
+        }
+        current = s;
+        if (s != COMMON) {
+            seen |= 1 << s;
+        }
+    }
+
+    void onItem(const char* key, yyjson_val* val) override {
+        if (!yyjson_is_obj(val)) {
+            if (current == COMMON) {
+                m_json_config_bad_section.inc();
+                ESP_LOGW(TAG, "配置[c]错误");
             }
-            
-            std::vector<std::unique_ptr<ActionGroup>> action_groups;
-            if (yyjson_val* ag_arr = yyjson_obj_get(input_obj, "a"); yyjson_is_arr(ag_arr)) {
-                size_t idx1, max1;
-                yyjson_val* actions_arr;
-                yyjson_arr_foreach(ag_arr, idx1, max1, actions_arr) {
-                    if (!actions_arr || !yyjson_is_arr(actions_arr)) continue;
-                    size_t idx2, max2;
-                    yyjson_val* action_obj;
-                    std::vector<AtomicAction> actions;
-                    yyjson_arr_foreach(actions_arr, idx2, max2, action_obj) {
-                        if (!action_obj || !yyjson_is_obj(action_obj)) continue;
-                        uint16_t target_did = json_get_int_safe(action_obj, "t", -1);
-                        if (IDevice* dev = lord.getDeviceByDid(target_did)) {
-                            actions.push_back(AtomicAction{
-                                .target_device = dev,
-                                .operation = json_get_str_safe(action_obj, "o", ""),
-                                .parameter = json_get_str_safe(action_obj, "p", "")
-                            });
-                        } else {
-                            ESP_LOGW(TAG, "设备(%u)不存在", target_did);
-                        }
-                    }
-                    action_groups.push_back(std::make_unique<ActionGroup>(static_cast<uint16_t>(-1), "", false, actions));
-                }
-            } else {
-                ESP_LOGE(TAG, "配置[i][a]错误, iid: %u", iid);
+            return;
+        }
+        switch (current) {
+            case COMMON: {
+                seen |= 1 << COMMON;
+                CommonSpec spec;
+                decodeCommonConfig(val, spec);
+                registerCommonConfig(spec);
+                if (image) image->addCommon(spec);
+                break;
+            }
+            case DEVICES: {
+                DeviceSpec spec;
+                decodeDeviceConfig(val, spec);
+                registerDeviceConfig(spec);
+                if (image) image->addDevice(spec);
+                break;
+            }
+            case ACTION_GROUPS: {
+                ActionGroupSpec spec;
+                decodeActionGroupConfig(val, spec);
+                registerActionGroupConfig(spec);
+                if (image) image->addActionGroup(spec);
+                break;
+            }
+            case INPUTS: {
+                InputSpec spec;
+                decodeInputConfig(val, spec);
+                registerInputConfig(spec);
+                if (image) image->addInput(spec);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void onItemError(const char* key) override {
+        m_json_config_bad_section.inc();
+    }
+
+private:
+    ConfigStream stream;
+    ConfigImageWriter* image;
+    int64_t parse_start = esp_timer_get_time();
+    Section current = NONE;
+    uint8_t seen = 0;               // 出现过且格式正确的段
+};
+
+// 只解析配置文本并注册设备, 动作组与输入, 不碰文件也不做上电同步, 主机上的scene_sim也直接调用它
+// image_out不为空时顺便把编译结果写成二进制镜像, config是记进镜像的源配置哈希
+bool parseLogicConfig(std::string_view config_json, FILE* image_out, const ConfigHash& config) {
+    std::optional<ConfigImageWriter> image;
+    if (image_out) {
+        image.emplace(image_out);
+    }
+    LogicConfigParser parser(image ? &*image : nullptr);
+    parser.feed(config_json.data(), config_json.size());
+    return parser.finish() && (!image || image->finish(config));
+}
+
+// 只检查结构不注册: 四段都在且类型对, 每一项都是合法的json对象, 设备/动作组/输入都带着id.
+// 新配置切换过去之前用, 不动当前正在用的配置
+class LogicConfigValidator : public ConfigStream::Sink {
+public:
+    LogicConfigValidator() : stream(*this) {}
+
+    void feed(const char* data, size_t len) {
+        stream.feed(data, len);
+    }
+
+    bool finish() {
+        stream.finish();
+        bool ok = stream.lines() >= 6 && stream.errors() == 0 && bad_items == 0;
+        for (Section s : {COMMON, DEVICES, ACTION_GROUPS, INPUTS}) {
+            if (!(seen & (1 << s))) {
+                ESP_LOGW(TAG, "新配置缺少[%s]", sectionKey(s));
+                ok = false;
             }
+        }
+        ESP_LOGI(TAG, "新配置检查: %u行, %u项, %u项有错%s", stream.lines(), stream.items(),
+                 stream.errors() + bad_items, ok ? "" : ", 不能用");
+        return ok;
+    }
 
-            if (itype == InputType::PANEL_BTN) {
-                uint8_t pid = json_get_int_safe(input_obj, "pid", -1);;
-                uint8_t bid = json_get_int_safe(input_obj, "bid", -1);;
-                // 如果有lightBindDevice, 就把此面板按键绑定给对应设备
-                if (int lbd = json_get_int_safe(input_obj, "lbd", -1); lbd > -1) {
-                    if (IDevice* dev = lord.getDeviceByDid(lbd)) {
-                        DeviceType dev_type = dev->getType();
-                        if (dev_type == DeviceType::LAMP) {
-                            if (Lamp* lamp = dynamic_cast<Lamp*>(dev)) {
-                                lamp->addAssBtn(PanelButtonPair({pid, bid}));
-                                ESP_LOGI(TAG, "绑定%u,%u至%s(%u)", pid, bid, dev->getName().c_str(), dev->getDid());
-                            }
-                        } else if (dev_type == DeviceType::CURTAIN) {
-                            if (Curtain* curtain = dynamic_cast<Curtain*>(dev)) {
-                                // 遍历当前按键的所有动作组
-                                for (auto& ag : action_groups) {
-                                    for (auto& a : ag->actions) {
-                                        if (a.operation == "开") {
-                                            curtain->addOpenAssBtn(PanelButtonPair({pid, bid}));
-                                            ESP_LOGI(TAG, "绑定%u,%u至%s(%u) 开", pid, bid, dev->getName().c_str(), dev->getDid());
-                                        } else if (a.operation == "关") {
-                                            curtain->addCloseAssBtn(PanelButtonPair({pid, bid}));
-                                            ESP_LOGI(TAG, "绑定%u,%u至%s(%u) 关", pid, bid, dev->getName().c_str(), dev->getDid());
-                                        }
-                                    }
-                                }
-                            }
-                        } else if (dev_type == DeviceType::RELAY) {
-                            if (SingleRelayDevice* relay = dynamic_cast<SingleRelayDevice*>(dev)) {
-                                relay->addAssBtn(PanelButtonPair({pid, bid}));
-                                ESP_LOGI(TAG, "绑定%u,%u至%s(%u)", pid, bid, dev->getName().c_str(), dev->getDid());
-                            }
-                        } else if (dev_type == DeviceType::DRY_CONTACT) {
-                            if (DryContactOut* dry = dynamic_cast<DryContactOut*>(dev)) {
-                                dry->addAssBtn(PanelButtonPair({pid, bid}));
-                                ESP_LOGI(TAG, "绑定%u,%u至%s(%u)", pid, bid, dev->getName().c_str(), dev->getDid());
-                            }
-                        } else if (dev_type == DeviceType::BGM) {
-                            if (BGM* bgm = dynamic_cast<BGM*>(dev)) {
-                                bgm->addAssBtn(PanelButtonPair({pid, bid}));
-                                ESP_LOGI(TAG, "绑定%u,%u至%s(%u)", pid, bid, dev->getName().c_str(), dev->getDid());
-                            }
-                        } else {
-                            ESP_LOGW(TAG, "无效的关联设备: %s(%u)", dev->getName().c_str(), dev->getDid());
-                        }
-                    }
-                }
-                ESP_LOGI(TAG, "注册按键, iid(%u), nm(%s), pid(%u), bid(%u), tags_size(%d), g_size(%u)",
-                                        iid, name, pid, bid, tags_set.size(), action_groups.size());
-                lord.registerPanelKeyInput(iid, name, tags_set, pid, bid, std::move(action_groups));
-            } else if (itype == InputType::DRY_CONTACT) {
-                uint8_t channel = json_get_int_safe(input_obj, "ch");
-                TriggerType tt = static_cast<TriggerType>(json_get_int_safe(input_obj, "tt", (int)TriggerType::NONE));
-                uint64_t duration = 1;
-                if (tt == TriggerType::INFRARED) {
-                    duration = json_get_int_safe(input_obj, "du", 1);
-                }
+    void onSection(const char* key, bool is_array) override {
+        current = sectionOf(key);
+        if (current != NONE && is_array == (current != COMMON)) {
+            seen |= 1 << current;
+        } else {
+            current = NONE;
+        }
+    }
+
+    void onItem(const char* key, yyjson_val* val) override {
+        const char* id_key = current == DEVICES ? "did" : current == ACTION_GROUPS ? "aid" : current == INPUTS ? "iid" : nullptr;
+        if (current == NONE) {
+            return;
+        }
+        if (!yyjson_is_obj(val) || (id_key && !yyjson_is_int(yyjson_obj_get(val, id_key)))) {
+            bad_items++;
+        }
+    }
+
+private:
+    ConfigStream stream;
+    Section current = NONE;
+    uint8_t seen = 0;
+    size_t bad_items = 0;
+};
+
+bool validateLogicConfigFile(const char* path) {
+    int file_fd = open(path, O_RDONLY);
+    if (file_fd < 0) {
+        ESP_LOGE(TAG, "打开配置文件失败: %s (%s)", path, strerror(errno));
+        return false;
+    }
+    char* chunk = static_cast<char*>(malloc(CONFIG_READ_CHUNK));
+    if (!chunk) {
+        close(file_fd);
+        return false;
+    }
+    LogicConfigValidator validator;
+    ssize_t n;
+    while ((n = read(file_fd, chunk, CONFIG_READ_CHUNK)) > 0) {
+        validator.feed(chunk, n);
+    }
+    free(chunk);
+    close(file_fd);
+    return validator.finish() && n == 0;
+}
+
+// 镜像里的记录已经是编译好的, 直接注册
+class ConfigImageLoader : public ConfigImageSink {
+public:
+    void onCommon(const CommonSpec& spec) override { registerCommonConfig(spec); }
+    void onDevice(const DeviceSpec& spec) override { registerDeviceConfig(spec); devices++; }
+    void onActionGroup(const ActionGroupSpec& spec) override { registerActionGroupConfig(spec); action_groups++; }
+    void onInput(const InputSpec& spec) override { registerInputConfig(spec); inputs++; }
+
+    uint32_t devices = 0;
+    uint32_t action_groups = 0;
+    uint32_t inputs = 0;
+};
+
+template <typename... Source>
+static bool loadImage(const ConfigHash& config, Source... source) {
+    int64_t start = esp_timer_get_time();
+    log_items = false;
+    beginLogicConfig();
+    ConfigImageLoader loader;
+    bool ok = readConfigImage(source..., config, loader);
+    log_items = true;
+    if (!ok) {
+        // 校验不过时还没注册任何东西, 但不知道调用者后面会不会去解析json, 清干净
+        LordManager::instance().clearAll();
+        return false;
+    }
+    endLogicConfig();
+    ESP_LOGI(TAG, "从镜像加载%lu个设备, %lu个动作组, %lu个输入, 用时%lldms",
+             loader.devices, loader.action_groups, loader.inputs, (esp_timer_get_time() - start) / 1000);
+    return true;
+}
+
+bool loadLogicConfigImage(FILE* image, const ConfigHash& config) {
+    return loadImage(config, image);
+}
+
+bool loadLogicConfigImage(const uint8_t* image, size_t len, const ConfigHash& config) {
+    return loadImage(config, image, len);
+}
+
+// 镜像对得上就直接加载, 否则解析json, 成功后顺便生成镜像给下次开机用
+static bool loadLocalLogicConfig(ConfigHash& config) {
+    ConfigSlots::Slot slot;
+    const char* path;
+    if (!ConfigSlots::getInstance().active(slot, &path)) {
+        ESP_LOGW(TAG, "本地没有配置文件");
+        return false;
+    }
+    config = slot.hash;
 
-                ESP_LOGI(TAG, "注册干接点输入, iid(%d), tp(%d), nm(%s), ch(%d), tt(%d), tags_size(%d), g_size(%d), du(%lld)",
-                        iid, (int)itype, name, channel, (int)tt, tags_set.size(), action_groups.size(), duration);
-                lord.registerDryContactInput(iid, name, tags_set, channel, tt, duration, std::move(action_groups));
-            } else if (itype == InputType::VOICE_CMD) {
-                const char* code = json_get_str_safe(input_obj, "cd");
-                ESP_LOGI(TAG, "注册语音指令输入, iid(%d), tp(%d), nm(%s), code(%s), tags_size(%d), g_size(%d)",
-                        iid, (int)itype, name, code, tags_set.size(), action_groups.size());
-                lord.registerVoiceInput(iid, name, tags_set, code, std::move(action_groups));
+    // 有配置分区时镜像在分区里, 映射进来原地加载; 两个槽分别是当前和上一份配置的镜像
+    if (ConfigPartition::getInstance().load([&config](const uint8_t* data, size_t len) {
+            return loadLogicConfigImage(data, len, config);
+        })) {
+        m_json_config_image_load.inc();
+        return true;
+    }
+    if (FILE* image = fopen(CONFIG_IMAGE_FILE_PATH, "rb")) {
+        bool ok = loadLogicConfigImage(image, config);
+        fclose(image);
+        if (ok) {
+            m_json_config_image_load.inc();
+            return true;
+        }
+        ESP_LOGW(TAG, "配置镜像无效, 改为解析json");
+        remove(CONFIG_IMAGE_FILE_PATH);
+    }
+
+    int file_fd = open(path, O_RDONLY);
+    if (file_fd < 0) {
+        ESP_LOGE(TAG, "打开本地配置文件失败: %s (%s)", path, strerror(errno));
+        return false;
+    }
+
+    // 按块读, 读一块解析一块, 不需要整个文件都在内存里
+    char* chunk = static_cast<char*>(malloc(CONFIG_READ_CHUNK));
+    if (!chunk) {
+        ESP_LOGE(TAG, "申请读缓冲失败");
+        close(file_fd);
+        return false;
+    }
+    // 镜像写不了不影响这次开机, 只是下次还得解析json
+    FILE* image_out = fopen(CONFIG_IMAGE_TMP_PATH, "wb+");
+    bool ok;
+    {
+        std::optional<ConfigImageWriter> image;
+        if (image_out) {
+            image.emplace(image_out);
+        }
+        LogicConfigParser parser(image ? &*image : nullptr);
+        ssize_t n;
+        while ((n = read(file_fd, chunk, CONFIG_READ_CHUNK)) > 0) {
+            parser.feed(chunk, n);
+        }
+        if (n < 0) {
+            ESP_LOGE(TAG, "读取文件失败: %s (%s)", path, strerror(errno));
+        }
+        ok = parser.finish() && n == 0;
+        if (image_out) {
+            bool image_ok = ok && image->finish(config);
+            // 优先放进配置分区, 放不下或者没有分区再留在littlefs上
+            bool in_partition = image_ok && ConfigPartition::getInstance().write(image_out);
+            fclose(image_out);
+            if (in_partition) {
+                remove(CONFIG_IMAGE_FILE_PATH);
+                remove(CONFIG_IMAGE_TMP_PATH);
+            } else if (image_ok && rename(CONFIG_IMAGE_TMP_PATH, CONFIG_IMAGE_FILE_PATH) == 0) {
+                ESP_LOGI(TAG, "已生成配置镜像");
+            } else {
+                remove(CONFIG_IMAGE_TMP_PATH);
             }
         }
-    } else {
-        ESP_LOGW(TAG, "配置[i]错误");
     }
-    yyjson_doc_free(inputs_config_doc);
-    ESP_LOGI(TAG, "================ 配置解析完成 ================");
-    IndicatorHolder::getInstance().callAllAndClear();               // 同步指示灯
+    free(chunk);
+    close(file_fd);
+    return ok;
+}
+
+void parseLocalLogicConfig(void) {
+    int64_t start = esp_timer_get_time();
+    ConfigHash config;
+    ConfigSlots::getInstance().setLoaded(nullptr);
+    if (!loadLocalLogicConfig(config)) {
+        return;
+    }
+    ConfigSlots::getInstance().setLoaded(&config);
+    m_json_config_ready_ms.set(esp_timer_get_time() / 1000);
+    ESP_LOGI(TAG, "配置就绪, 加载用时%lldms, 开机后%lldms",
+             (esp_timer_get_time() - start) / 1000, esp_timer_get_time() / 1000);
+    IndicatorHolder::getInstance().requestFlush();               // 同步指示灯
     generate_response(AIR_CON, AIR_CON_INQUIRE_XZ, 0x00, 0x00, 0x00);  // 逼迫温控器上报状态
 
     // 断电后上电, 来一次插卡
@@ -488,6 +805,8 @@ json generateRegisterInfo() {
 
         auto& config_version = lord.getConfigGenerageTime();
         j["config_version"] = config_version;
+        ConfigHash config_hash;
+        j["config_hash"] = ConfigSlots::getInstance().loaded(config_hash) ? config_hash.hex() : "";
 
         std::string hotel_name, room_name;
         read_room_info_from_nvs(hotel_name, room_name);
@@ -564,64 +883,197 @@ json generateRegisterInfo() {
     return j;
 }
 
+// 状态报告里的一个设备, 决定它进哪个数组、带哪些字段
+enum class ReportCategory : uint8_t { LIGHT, CURTAIN, OTHER, AIR };
+
+struct DeviceReportState {
+    uint16_t did;
+    ReportCategory category;
+    uint8_t on;
+    uint8_t mode;           // 以下只有空调用
+    uint8_t fan_speed;
+    uint8_t target_temp;
+    uint8_t room_temp;
+
+    bool operator==(const DeviceReportState& o) const {
+        return did == o.did && category == o.category && on == o.on && mode == o.mode
+            && fan_speed == o.fan_speed && target_temp == o.target_temp && room_temp == o.room_temp;
+    }
+    bool operator!=(const DeviceReportState& o) const { return !(*this == o); }
+};
+
+// 上次发出去的状态, 增量报告拿它逐个比较. 只在上报任务里读写
+static std::vector<DeviceReportState> last_reported;
+static uint64_t last_reported_room_states = 0;
+static std::string last_reported_mode;
+
+static const char* reportCategoryKey(ReportCategory category) {
+    switch (category) {
+        case ReportCategory::LIGHT:   return "lights";
+        case ReportCategory::CURTAIN: return "curtains";
+        case ReportCategory::OTHER:   return "others";
+        case ReportCategory::AIR:     return "airs";
+    }
+    return "others";
+}
+
+// 按固定顺序采集所有设备的当前状态, 配置不变时顺序不变
+static void collectReportStates(std::vector<DeviceReportState>& out) {
+    auto& lord = LordManager::instance();
+    out.clear();
+    for (Lamp* lamp : lord.getDevicesByType<Lamp>()) {
+        out.push_back({lamp->getDid(), ReportCategory::LIGHT, lamp->isOn(), 0, 0, 0, 0});
+    }
+    for (Curtain* cur : lord.getDevicesByType<Curtain>()) {
+        out.push_back({cur->getDid(), ReportCategory::CURTAIN, cur->isOn(), 0, 0, 0, 0});
+    }
+    for (SingleRelayDevice* relay : lord.getDevicesByType<SingleRelayDevice>()) {
+        if (!dynamic_cast<Lamp*>(relay)) {
+            out.push_back({relay->getDid(), ReportCategory::OTHER, relay->isOn(), 0, 0, 0, 0});
+        }
+    }
+    for (DryContactOut* dry : lord.getDevicesByType<DryContactOut>()) {
+        out.push_back({dry->getDid(), ReportCategory::OTHER, dry->isOn(), 0, 0, 0, 0});
+    }
+    for (AirConBase* air : lord.getDevicesByType<AirConBase>()) {
+        out.push_back({air->getDid(), ReportCategory::AIR, air->isOn(),
+                       static_cast<uint8_t>(air->get_mode()), static_cast<uint8_t>(air->get_fan_speed()),
+                       air->get_target_temp(), air->get_room_temp()});
+    }
+}
+
+static void appendReportState(json& j, const DeviceReportState& s) {
+    json obj;
+    obj["id"] = s.did;
+    obj["state"] = s.on ? 1 : 0;
+    if (s.category == ReportCategory::AIR) {
+        obj["mode"] = s.mode;
+        obj["fan_speed"] = s.fan_speed;
+        obj["target_temp"] = s.target_temp;
+        obj["room_temp"] = s.room_temp;
+    }
+    j[reportCategoryKey(s.category)].push_back(std::move(obj));
+}
+
+// 完整的状态报告(关键帧), 同时把它作为之后增量报告的基准
 json generateReportStates() {
     json j;
     auto& lord = LordManager::instance();
+    auto& room_states = RoomStateStore::getInstance();
     try {
         j["mac"] = getSerialNum();
         j["type"] = "alldevicestate";
-
         j["lights"] = json::array();
-        for (Lamp* lamp : lord.getDevicesByType<Lamp>()) {
-            json lamp_obj;
-            lamp_obj["id"] = lamp->getDid();
-            lamp_obj["state"] = lamp->isOn() ? 1 : 0;
-            j["lights"].push_back(lamp_obj);
-        }
-
         j["curtains"] = json::array();
-        for (Curtain* cur : lord.getDevicesByType<Curtain>()) {
-            json cur_obj;
-            cur_obj["id"] = cur->getDid();
-            cur_obj["state"] = cur->isOn() ? 1 : 0;
-            j["curtains"].push_back(cur_obj);
+        j["others"] = json::array();
+        j["airs"] = json::array();
+
+        m_json_state_keyframe.inc();
+        collectReportStates(last_reported);
+        for (const auto& s : last_reported) {
+            appendReportState(j, s);
         }
 
-        j["others"] = json::array();
-        for (SingleRelayDevice* relay : lord.getDevicesByType<SingleRelayDevice>()) {
-            if (dynamic_cast<Lamp*>(relay)) {
+        last_reported_mode = lord.getLastModeName();
+        last_reported_room_states = room_states.bitmap();
+        j["mode"] = last_reported_mode;
+        j["states"] = room_states.toJson();
+    } catch (const std::exception& e) {
+        ESP_LOGE(TAG, "生成状态报告时出错: %s", e.what());
+    }
 
-            } else {
-                json relay_obj;
-                relay_obj["id"] = relay->getDid();
-                relay_obj["state"] = relay->isOn() ? 1 : 0;
-                j["others"].push_back(relay_obj);
+    return j;
+}
+
+// 只带上次报告之后变了的设备, 数组为空就不带; 模式和房间状态变了才带
+// 什么都没变返回null. 设备列表本身变了(重新下发过配置)没法用增量表达, 直接返回关键帧
+json generateDeltaStates() {
+    static std::vector<DeviceReportState> current;
+    auto& lord = LordManager::instance();
+    auto& room_states = RoomStateStore::getInstance();
+
+    collectReportStates(current);
+    if (current.size() != last_reported.size()) {
+        return generateReportStates();
+    }
+
+    json j;
+    try {
+        bool changed = false;
+        for (size_t i = 0; i < current.size(); i++) {
+            if (current[i].did != last_reported[i].did || current[i].category != last_reported[i].category) {
+                return generateReportStates();
+            }
+            if (current[i] != last_reported[i]) {
+                appendReportState(j, current[i]);
+                last_reported[i] = current[i];
+                changed = true;
             }
         }
-        for (DryContactOut* dry : lord.getDevicesByType<DryContactOut>()) {
-            json dry_obj;
-            dry_obj["id"] = dry->getDid();
-            dry_obj["state"] = dry->isOn() ? 1 : 0;
-            j["others"].push_back(dry_obj);
+        if (lord.getLastModeName() != last_reported_mode) {
+            last_reported_mode = lord.getLastModeName();
+            j["mode"] = last_reported_mode;
+            changed = true;
         }
-
-        j["airs"] = json::array();
-        for (AirConBase* air : lord.getDevicesByType<AirConBase>()) {
-            json air_obj;
-            air_obj["id"] = air->getDid();
-            air_obj["state"] = air->isOn() ? 1 : 0;
-            air_obj["mode"] = static_cast<int>(air->get_mode());
-            air_obj["fan_speed"] = static_cast<int>(air->get_fan_speed());
-            air_obj["target_temp"] = air->get_target_temp();
-            air_obj["room_temp"] = air->get_room_temp();
-            j["airs"].push_back(air_obj);
+        if (room_states.bitmap() != last_reported_room_states) {
+            last_reported_room_states = room_states.bitmap();
+            j["states"] = room_states.toJson();
+            changed = true;
         }
-
-        j["mode"] = lord.getLastModeName();
-        j["states"] = get_states_json();
+        if (!changed) {
+            return nullptr;
+        }
+        m_json_state_delta.inc();
+        j["mac"] = getSerialNum();
+        j["type"] = "devicestatedelta";
     } catch (const std::exception& e) {
-        ESP_LOGE(TAG, "生成状态报告时出错: %s", e.what());
+        ESP_LOGE(TAG, "生成增量状态报告时出错: %s", e.what());
+        return nullptr;
     }
 
     return j;
-}
\ No newline at end of file
+}
+
+// 最近几次动作组执行的逐步耗时, 以及每个动作组的耗时直方图
+json generateSceneTraces() {
+    auto& tracer = SceneTracer::getInstance();
+    json j;
+    j["mac"] = getSerialNum();
+    j["type"] = "scene_trace";
+
+    std::vector<SceneTrace> runs(SCENE_TRACE_RUNS);
+    runs.resize(tracer.snapshotRuns(runs.data(), runs.size()));
+    j["runs"] = json::array();
+    for (const auto& run : runs) {
+        json run_obj;
+        run_obj["aid"] = run.aid;
+        run_obj["start_ms"] = run.start_us / 1000;
+        run_obj["wait_us"] = run.wait_us;
+        run_obj["busy_us"] = run.busy_us;
+        run_obj["total_us"] = run.finished ? (int64_t)run.total_us : -1;   // -1表示还没执行完
+        run_obj["steps_total"] = run.step_count;
+        if (run.cancel_pc != SCENE_TRACE_NOT_CANCELLED) {
+            run_obj["cancel_at"] = run.cancel_pc;
+        }
+        // 每步: [did, 操作, 耗时us, 之后延时ms]
+        run_obj["steps"] = json::array();
+        for (size_t i = 0; i < run.step_count && i < SCENE_TRACE_STEPS; i++) {
+            const auto& step = run.steps[i];
+            run_obj["steps"].push_back({step.did, opcodeName(step.op), step.dur_us, step.slept_ms});
+        }
+        j["runs"].push_back(run_obj);
+    }
+
+    std::vector<SceneHistogram> hists(SCENE_HIST_AIDS);
+    hists.resize(tracer.snapshotHistograms(hists.data(), hists.size()));
+    j["hist_edges_ms"] = SceneTracer::bucket_edges_ms;
+    j["hist"] = json::array();
+    for (const auto& hist : hists) {
+        j["hist"].push_back({
+            {"aid", hist.aid},
+            {"cancelled", hist.cancelled},
+            {"counts", hist.counts}
+        });
+    }
+    return j;
+}
@@ -1,6 +1,32 @@
 #pragma once
 
+#include <stdio.h>
+#include <string_view>
+#include "yyjson.h"
+#include "config_hash.h"
+
+inline const char* json_get_str_safe(yyjson_val* obj, const char* key, const char* def = "") {
+    yyjson_val *v = yyjson_obj_get(obj, key);
+    return (v && yyjson_is_str(v)) ? yyjson_get_str(v) : def;
+}
+
+inline int json_get_int_safe(yyjson_val* obj, const char* key, int def = 0) {
+    yyjson_val *v = yyjson_obj_get(obj, key);
+    return (v && yyjson_is_int(v)) ? yyjson_get_int(v) : def;
+}
+
+inline bool json_get_bool_safe(yyjson_val* obj, const char* key, bool def = false) {
+    yyjson_val *v = yyjson_obj_get(obj, key);
+    return (v && yyjson_is_bool(v)) ? yyjson_get_bool(v) : def;
+}
+
 std::vector<std::string_view> splitByLineView(std::string_view content);
+bool parseLogicConfig(std::string_view config_json, FILE* image_out = nullptr, const ConfigHash& config = {});
+bool loadLogicConfigImage(FILE* image, const ConfigHash& config);  // 镜像无效时什么都不注册, 返回false
+bool loadLogicConfigImage(const uint8_t* image, size_t len, const ConfigHash& config);
+bool validateLogicConfigFile(const char* path);     // 只检查格式, 不注册
 void parseLocalLogicConfig(void);
 nlohmann::json generateRegisterInfo();
-nlohmann::json generateReportStates();
\ No newline at end of file
+nlohmann::json generateReportStates();     // 完整状态(关键帧)
+nlohmann::json generateDeltaStates();      // 只含变化的部分, 没变化时为null
+nlohmann::json generateSceneTraces();
\ No newline at end of file
@@ -3,11 +3,11 @@
 
 #define TAG "LAMP"
 
-void Lamp::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
-    // ESP_LOGI_CYAN(TAG, "灯[%s]收到操作[%s]", name.c_str(), operation.c_str());
-    if (operation == "调光") {
+void Lamp::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
+    // ESP_LOGI_CYAN(TAG, "灯[%s]收到操作[%s]", name.c_str(), opcodeName(op));
+    if (op == Opcode::DIMMING) {
 
     } else {
-        SingleRelayDevice::execute(operation, parameter, self_action_group, should_log);
+        SingleRelayDevice::execute(op, param, self_action_group, should_log);
     }
 }
\ No newline at end of file
@@ -13,5 +13,5 @@ public:
     Lamp(uint16_t did, const std::string& name, const std::string&carry_state, uint8_t channel, bool initial_state)
         : SingleRelayDevice(did, DeviceType::LAMP, name, carry_state, channel, initial_state) {}
 
-    void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
+    void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
 };
\ No newline at end of file
@@ -130,6 +130,32 @@ std::vector<ActionGroup*> LordManager::getAllModeActionGroup() {
     return result;
 }
 
+std::vector<ActionGroup*> LordManager::getAllActionGroups() {
+    std::vector<ActionGroup*> result;
+    for (const auto& [aid, ag_ptr] : action_groups_map) {
+        if (ag_ptr) {
+            result.push_back(ag_ptr.get());
+        }
+    }
+    return result;
+}
+
+std::vector<InputBase*> LordManager::getAllInputs() {
+    std::vector<InputBase*> result;
+    for (const auto& [pid, panel] : panels_map) {
+        for (auto* btn : panel->getButtons()) {
+            result.push_back(btn);
+        }
+    }
+    for (const auto& [iid, input_ptr] : channel_inputs_map) {
+        result.push_back(input_ptr.get());
+    }
+    for (const auto& [iid, voice_ptr] : voice_cmds_map) {
+        result.push_back(voice_ptr.get());
+    }
+    return result;
+}
+
 std::vector<ChannelInput*> LordManager::getAllChannelInputByChannelNum(uint8_t channel_num) {
     std::vector<ChannelInput*> result;
     for (auto& [_, input_ptr] : channel_inputs_map) {
@@ -179,6 +205,64 @@ void LordManager::wishIndicatorAllPanel(bool state) {
     }
 }
 
+void LordManager::buildWakeIndicatorMap() {
+    wake_indicator_map.clear();
+    wake_drycontacts.clear();
+
+    std::unordered_map<uint8_t, size_t> index_by_pid;
+    auto bind = [&](const IDevice* dev, uint8_t channel, bool is_relay) {
+        if (channel >= 64) {
+            ESP_LOGW(TAG, "%s(%u)的通道%u超出位图范围, 醒来时不会同步它的指示灯", dev->getName(), dev->getDid(), channel);
+            return;
+        }
+        for (const auto [pid, bid] : dev->getAssBtns()) {
+            Panel* panel = getPanelByPid(pid);
+            if (panel == nullptr || bid >= 8) {
+                continue;
+            }
+            auto [it, inserted] = index_by_pid.try_emplace(pid, wake_indicator_map.size());
+            if (inserted) {
+                wake_indicator_map.push_back({panel, 0, {}, {}});
+            }
+            auto& entry = wake_indicator_map[it->second];
+            entry.mask |= 1 << bid;
+            (is_relay ? entry.relay_bits : entry.drycontact_bits)[bid] |= 1ULL << channel;
+        }
+    };
+
+    // Lamp和门铃都是SingleRelayDevice
+    for (auto* relay : getDevicesByType<SingleRelayDevice>()) {
+        bind(relay, relay->getChannel(), true);
+    }
+    for (auto* dry : getDevicesByType<DryContactOut>()) {
+        if (!dry->getAssBtns().empty()) {
+            wake_drycontacts.push_back(dry);
+        }
+        bind(dry, dry->getChannel(), false);
+    }
+    ESP_LOGI(TAG, "唤醒指示灯表: %u个面板, %u个干接点输出", wake_indicator_map.size(), wake_drycontacts.size());
+}
+
+void LordManager::syncAllAssBtnToDevState() {
+    uint64_t relay_bits = readRelayPhysicsBitmap();
+    uint64_t drycontact_bits = 0;
+    for (auto* dry : wake_drycontacts) {
+        if (dry->isOn() && dry->getChannel() < 64) {
+            drycontact_bits |= 1ULL << dry->getChannel();
+        }
+    }
+
+    for (const auto& entry : wake_indicator_map) {
+        uint8_t states = 0;
+        for (uint8_t bid = 0; bid < 8; bid++) {
+            if ((entry.relay_bits[bid] & relay_bits) || (entry.drycontact_bits[bid] & drycontact_bits)) {
+                states |= 1 << bid;
+            }
+        }
+        entry.panel->wishIndicatorByMask(entry.mask, states);
+    }
+}
+
 void LordManager::handleVoiceCmd(uint8_t* code_data) {
     for (const auto& [iid, voice_ptr] : voice_cmds_map) {
         if (voice_ptr && memcmp(voice_ptr->getCode().data(), code_data, 8) == 0) {
@@ -219,14 +303,19 @@ void LordManager::clearAll() {
     action_groups_map.clear();
     channel_inputs_map.clear();
     panels_map.clear();
+    voice_cmds_map.clear();
+    wake_indicator_map.clear();
+    wake_drycontacts.clear();
+    // 名字都跟着配置走, 用它们的对象已经全部释放, 重建字符串池和房间状态表, 不让反复推配置把它们撑满
+    RoomStateStore::getInstance().reset();
 }
 
 void LordManager::setAlive(bool state) {
     the_rcu_is_alive = state;
     if (state) {
-        add_state("入住");
+        RoomStateStore::getInstance().add(ROOM_STATE_CHECK_IN);
     } else {
-        remove_state("入住");
+        RoomStateStore::getInstance().remove(ROOM_STATE_CHECK_IN);
     }
     ESP_LOGI("LORD_MANAGER", "切换至%s状态", the_rcu_is_alive ? "插卡" : "拔卡"); 
 }
@@ -252,6 +341,13 @@ void LordManager::syncAllRelayPhysicsOnoff() {
 void LordManager::updateRelayPhysicsState(uint8_t channel, uint8_t is_on) {
     xSemaphoreTake(relay_physics_map_mutex, pdMS_TO_TICKS(3000));
     relay_physics_map[channel] = is_on;
+    if (channel < 64) {
+        if (is_on) {
+            relay_physics_bits |= 1ULL << channel;
+        } else {
+            relay_physics_bits &= ~(1ULL << channel);
+        }
+    }
     xSemaphoreGive(relay_physics_map_mutex);
 }
 
@@ -268,6 +364,13 @@ bool LordManager::readRelayPhysicsState(uint8_t channel) {
     return result;
 }
 
+uint64_t LordManager::readRelayPhysicsBitmap() {
+    xSemaphoreTake(relay_physics_map_mutex, pdMS_TO_TICKS(3000));
+    uint64_t result = relay_physics_bits;
+    xSemaphoreGive(relay_physics_map_mutex);
+    return result;
+}
+
 void LordManager::syncAllDrycontactInputPhysicsOnoff() {
     for (int i = 1; i <= 16; i++) {
         sendStm32Cmd(CMD_DRYCONTACT_INPUT_QUERY, 0x00, i, 0x00, 0x00);
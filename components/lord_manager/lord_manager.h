@@ -16,6 +16,8 @@
 #include "room_state.h"
 #include "bgm.h"
 
+class DryContactOut;
+
 static std::array<uint8_t, 8> alive_heartbeat_code = {0x7F, 0xC0, 0xFF, 0xFF, 0x00, 0x80, 0xBD, 0x7E};
 static std::array<uint8_t, 8> sleep_heartbeat_code = {0x7F, 0xC0, 0xFF, 0xFF, 0x00, 0x00, 0x3D, 0x7E};
 
@@ -61,6 +63,8 @@ public:
     }
     ActionGroup* getActionGroupByAid(uint16_t aid);
     std::vector<ActionGroup*> getAllModeActionGroup();
+    std::vector<ActionGroup*> getAllActionGroups();
+    std::vector<InputBase*> getAllInputs();                     // 面板按键, 干接点输入与语音指令
     std::vector<ChannelInput*> getAllChannelInputByChannelNum(uint8_t channel_num);// 返回所有指定channel的实例
     ChannelInput* getAliveChannel();
     Panel* getPanelByPid(uint8_t pid);
@@ -74,6 +78,10 @@ public:
     void handlePanel(uint8_t panel_id, uint8_t target_buttons, uint8_t old_bl_state);
     void handleDimming(uint8_t panel_id, uint8_t target_buttons, uint8_t brightness);
     void wishIndicatorAllPanel(bool state);   // 希望操作所有面板的指示灯
+    // 配置解析完后调用, 把继电器/干接点输出通道与面板按键的关联编译成每面板的位掩码
+    void buildWakeIndicatorMap();
+    // 睡眠会熄灭所有指示灯, 醒来时按当前通断状态一次算出每个面板的背光并标记刷新
+    void syncAllAssBtnToDevState();
     
     // ================ 语音指令 ================
     void handleVoiceCmd(uint8_t* code_data);
@@ -89,6 +97,7 @@ public:
     void syncAllRelayPhysicsOnoff();
     void updateRelayPhysicsState(uint8_t channel, uint8_t is_on);
     bool readRelayPhysicsState(uint8_t channel);
+    uint64_t readRelayPhysicsBitmap();      // 第n位是继电器通道n, 只覆盖0~63通道
     void syncAllDrycontactInputPhysicsOnoff();
     void updateDrycontactInputPhysicsState(uint8_t channel, uint8_t is_on);
     bool readDrycontactInputPhysicsState(uint8_t channel);
@@ -142,6 +151,17 @@ private:
 
     SemaphoreHandle_t relay_physics_map_mutex;
     std::unordered_map<uint8_t, bool> relay_physics_map;                            // channel, state   // 继电器物理通断状态
+    uint64_t relay_physics_bits = 0;                                                // 同上, 位图形式, 和map一起在锁里更新
     SemaphoreHandle_t drycontactInput_physics_map_mutex;
     std::unordered_map<uint8_t, bool> drycontactInput_physics_map;                  // channel, state   // 干接点输入物理通断状态
+
+    // 唤醒时同步指示灯用的预编译表, 每个有关联按键的面板一项, 配置重载时重建
+    struct WakeIndicatorEntry {
+        Panel* panel;
+        uint8_t mask;                               // 有关联设备的按键, 其余按键醒来时不动
+        std::array<uint64_t, 8> relay_bits;         // 每个按键关联的继电器通道位
+        std::array<uint64_t, 8> drycontact_bits;    // 每个按键关联的干接点输出通道位
+    };
+    std::vector<WakeIndicatorEntry> wake_indicator_map;
+    std::vector<DryContactOut*> wake_drycontacts;   // 干接点输出的状态不在继电器位图里, 醒来时现拼
 };
\ No newline at end of file
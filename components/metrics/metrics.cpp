@@ -0,0 +1,130 @@
+#include "metrics.h"
+#include <stdlib.h>
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+using json = nlohmann::json;
+
+// 静态对象在启动时单线程构造, 但函数内的静态指标可能在任意任务里第一次构造, 所以用CAS挂链表
+static std::atomic<const Metric*> metric_head{nullptr};
+
+Metric::Metric(const char* name, MetricKind kind) : metric_name(name), metric_kind(kind) {
+    const Metric* head = metric_head.load(std::memory_order_relaxed);
+    do {
+        next_metric = head;
+    } while (!metric_head.compare_exchange_weak(head, this, std::memory_order_release, std::memory_order_relaxed));
+}
+
+const Metric* Metric::first() {
+    return metric_head.load(std::memory_order_acquire);
+}
+
+MetricHistogram::MetricHistogram(const char* name, std::initializer_list<uint32_t> bucket_edges)
+    : Metric(name, MetricKind::HISTOGRAM) {
+    for (uint32_t e : bucket_edges) {
+        if (edge_count >= MAX_BUCKETS - 1) {
+            break;
+        }
+        edges[edge_count++] = e;
+    }
+}
+
+void MetricHistogram::record(uint32_t v) {
+    size_t i = 0;
+    while (i < edge_count && v > edges[i]) {
+        i++;
+    }
+    counts[i].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    uint32_t cur = max_value.load(std::memory_order_relaxed);
+    while (v > cur && !max_value.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+    }
+}
+
+// *************** 队列 ***************
+#define METRICS_MAX_QUEUES 8
+
+struct WatchedQueue {
+    const char* name;
+    QueueHandle_t queue;
+};
+static WatchedQueue watched_queues[METRICS_MAX_QUEUES];
+static std::atomic<size_t> watched_queue_count{0};
+
+void metrics_watch_queue(const char* name, QueueHandle_t queue) {
+    if (!queue) {
+        return;
+    }
+    size_t i = watched_queue_count.load(std::memory_order_relaxed);
+    if (i >= METRICS_MAX_QUEUES) {
+        return;
+    }
+    // 只在初始化时登记, 不考虑并发登记
+    watched_queues[i] = {name, queue};
+    watched_queue_count.store(i + 1, std::memory_order_release);
+}
+
+json metricsToJson() {
+    json j;
+    j["uptime"] = esp_timer_get_time() / 1000000;
+    j["heap"] = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    j["heap_min"] = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+    json counters = json::object();
+    json gauges = json::object();
+    json hists = json::object();
+    for (const Metric* m = Metric::first(); m; m = m->next()) {
+        switch (m->kind()) {
+            case MetricKind::COUNTER:
+                counters[m->name()] = static_cast<const MetricCounter*>(m)->get();
+                break;
+            case MetricKind::GAUGE:
+                gauges[m->name()] = static_cast<const MetricGauge*>(m)->get();
+                break;
+            case MetricKind::HISTOGRAM: {
+                auto* h = static_cast<const MetricHistogram*>(m);
+                json edges = json::array();
+                json buckets = json::array();
+                for (size_t i = 0; i < h->bucketCount(); i++) {
+                    if (i + 1 < h->bucketCount()) {
+                        edges.push_back(h->edge(i));
+                    }
+                    buckets.push_back(h->bucket(i));
+                }
+                hists[m->name()] = {{"n", h->count()}, {"max", h->maxValue()}, {"le", std::move(edges)}, {"b", std::move(buckets)}};
+                break;
+            }
+        }
+    }
+    j["c"] = std::move(counters);
+    j["g"] = std::move(gauges);
+    j["h"] = std::move(hists);
+
+    // 队列: [当前深度, 容量]
+    json queues = json::object();
+    size_t queue_count = watched_queue_count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < queue_count; i++) {
+        UBaseType_t waiting = uxQueueMessagesWaiting(watched_queues[i].queue);
+        UBaseType_t spaces = uxQueueSpacesAvailable(watched_queues[i].queue);
+        queues[watched_queues[i].name] = {waiting, waiting + spaces};
+    }
+    j["q"] = std::move(queues);
+
+    // 各任务栈的历史最小剩余, ESP-IDF里单位是字节
+    json stacks = json::object();
+#if configUSE_TRACE_FACILITY
+    UBaseType_t task_count = uxTaskGetNumberOfTasks() + 4;     // 多留几个, 防止这期间有新任务
+    auto* tasks = static_cast<TaskStatus_t*>(malloc(task_count * sizeof(TaskStatus_t)));
+    if (tasks) {
+        task_count = uxTaskGetSystemState(tasks, task_count, nullptr);
+        for (UBaseType_t i = 0; i < task_count; i++) {
+            stacks[tasks[i].pcTaskName] = tasks[i].usStackHighWaterMark;
+        }
+        free(tasks);
+    }
+#endif
+    j["stack"] = std::move(stacks);
+
+    return j;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <initializer_list>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "../json.hpp"
+
+// 运行时指标: 计数器、仪表和固定分桶直方图
+// 指标都定义成命名空间作用域的静态对象, 构造时挂进全局链表(静态注册), 之后只做原子读写,
+// 不加锁不分配内存, 哪个任务都能记; 导出时才遍历链表拼json. 名字用"子系统.指标"
+enum class MetricKind : uint8_t { COUNTER, GAUGE, HISTOGRAM };
+
+class Metric {
+public:
+    const char* name() const { return metric_name; }
+    MetricKind kind() const { return metric_kind; }
+    const Metric* next() const { return next_metric; }
+    static const Metric* first();
+
+    Metric(const Metric&) = delete;
+    Metric& operator=(const Metric&) = delete;
+
+protected:
+    Metric(const char* name, MetricKind kind);
+
+private:
+    const char* metric_name;
+    MetricKind metric_kind;
+    const Metric* next_metric = nullptr;
+};
+
+// 只增不减的计数
+class MetricCounter : public Metric {
+public:
+    explicit MetricCounter(const char* name) : Metric(name, MetricKind::COUNTER) {}
+    void inc(uint32_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> value{0};
+};
+
+// 当前值, 可增可减
+class MetricGauge : public Metric {
+public:
+    explicit MetricGauge(const char* name) : Metric(name, MetricKind::GAUGE) {}
+    void set(int32_t v) { value.store(v, std::memory_order_relaxed); }
+    void add(int32_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+    int32_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int32_t> value{0};
+};
+
+// 按升序边界分桶, 值<=edges[i]落进第i个桶, 比最后一个边界还大的落进最后一个桶
+class MetricHistogram : public Metric {
+public:
+    static constexpr size_t MAX_BUCKETS = 8;
+
+    MetricHistogram(const char* name, std::initializer_list<uint32_t> edges);
+    void record(uint32_t v);
+
+    size_t bucketCount() const { return edge_count + 1; }
+    uint32_t edge(size_t i) const { return edges[i]; }
+    uint32_t bucket(size_t i) const { return counts[i].load(std::memory_order_relaxed); }
+    uint32_t count() const { return total.load(std::memory_order_relaxed); }
+    uint32_t maxValue() const { return max_value.load(std::memory_order_relaxed); }
+
+private:
+    uint32_t edges[MAX_BUCKETS - 1] = {};
+    uint8_t edge_count = 0;
+    std::atomic<uint32_t> counts[MAX_BUCKETS] = {};
+    std::atomic<uint32_t> total{0};
+    std::atomic<uint32_t> max_value{0};
+};
+
+// 导出时顺带报告这个队列的当前深度和容量, 只登记永不删除的队列
+void metrics_watch_queue(const char* name, QueueHandle_t queue);
+
+// 所有指标、各任务栈的剩余最小值(字节)、登记过的队列深度和堆内存, 拼成一条紧凑的json
+nlohmann::json metricsToJson();
@@ -0,0 +1,164 @@
+#include "alarm_channel.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "identity.h"
+#include "commons.h"
+#include "metrics.h"
+
+#define TAG "ALARM"
+
+static MetricCounter m_alarm_raised("alarm.raised");
+static MetricCounter m_alarm_acked("alarm.acked");
+static MetricCounter m_alarm_retry("alarm.retry");
+static MetricCounter m_alarm_dropped("alarm.dropped");
+static MetricHistogram m_alarm_ack_ms("alarm.ack_ms", {50, 100, 250, 500, 1000, 5000, 30000});
+
+// 要走告警通道的房间状态
+bool AlarmChannel::isAlarmState(RoomStateId id) {
+    return id == ROOM_STATE_SOS;
+}
+
+void AlarmChannel::start(PublishFunc publish_func) {
+    if (task) {
+        return;
+    }
+    publish = publish_func;
+    if (xTaskCreate(alarmTask, "alarm_task", 3072, this, 6, &task) != pdPASS) {
+        ESP_LOGE(TAG, "创建告警任务失败");
+        return;
+    }
+    RoomStateStore::getInstance().subscribe(onRoomStateChanged);
+}
+
+void AlarmChannel::onRoomStateChanged(RoomStateId id, bool present) {
+    if (isAlarmState(id)) {
+        getInstance().raise(id, present);
+    }
+}
+
+// 在改状态的任务里执行, 只拼消息、入队、叫醒告警任务
+void AlarmChannel::raise(RoomStateId id, bool present) {
+    int64_t now = esp_timer_get_time();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending_count == PENDING_MAX) {
+            // 挤掉最旧的, 最新的状态更重要
+            pending_head = (pending_head + 1) % PENDING_MAX;
+            pending_count--;
+            dropped++;
+            m_alarm_dropped.inc();
+            inflight_msg = -1;
+            front_tried = false;
+        }
+        Pending& p = pending[(pending_head + pending_count) % PENDING_MAX];
+        int n = snprintf(p.text, TEXT_SIZE,
+                         "{\"mac\":\"%s\",\"type\":\"alarm\",\"state\":\"%s\",\"on\":%d,\"seq\":%lu,\"happentime\":%lld}",
+                         getSerialNum(), str_of(RoomStateStore::getInstance().nameOf(id)), present ? 1 : 0,
+                         (unsigned long)next_seq++, (long long)get_current_timestamp());
+        p.len = std::min<int>(n, TEXT_SIZE - 1);
+        p.trigger_us = now;
+        pending_count++;
+        raised++;
+    }
+    m_alarm_raised.inc();
+    if (task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void AlarmChannel::onPublished(int msg_id) {
+    acks.onPublished(msg_id);
+    if (task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void AlarmChannel::kick() {
+    if (!task) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        next_try_us = 0;
+        retry_us = RETRY_MIN_US;
+    }
+    xTaskNotifyGive(task);
+}
+
+// 只在告警任务里调用: 先处理PUBACK, 再按需要发队首
+void AlarmChannel::step() {
+    int64_t now = esp_timer_get_time();
+    Pending front;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (acks.isAcked(inflight_msg)) {
+            const Pending& done = pending[pending_head];
+            last_ack_ms = (now - done.trigger_us) / 1000;
+            m_alarm_ack_ms.record(last_ack_ms);
+            ESP_LOGW(TAG, "告警已确认, 从触发到PUBACK %lums: %.*s", last_ack_ms, done.len, done.text);
+            pending_head = (pending_head + 1) % PENDING_MAX;
+            pending_count--;
+            acked++;
+            m_alarm_acked.inc();
+            inflight_msg = -1;
+            front_tried = false;
+            next_try_us = 0;
+            retry_us = RETRY_MIN_US;
+        }
+        if (pending_count == 0 || now < next_try_us) {
+            return;
+        }
+        if (inflight_msg >= 0) {
+            ESP_LOGW(TAG, "告警(msg_id %d)超时未确认, 重发", inflight_msg);
+            inflight_msg = -1;
+        }
+        front = pending[pending_head];
+        if (front_tried) {
+            m_alarm_retry.inc();
+        }
+        front_tried = true;
+        attempts++;
+    }
+
+    int msg_id = publish(front.text, front.len);
+    std::lock_guard<std::mutex> lock(mutex);
+    // 发布期间队首被挤掉了, 这次的结果作废, 下一轮发新的队首
+    if (pending_count == 0 || pending[pending_head].trigger_us != front.trigger_us) {
+        next_try_us = 0;
+        return;
+    }
+    if (msg_id < 0) {
+        next_try_us = now + retry_us;
+        retry_us = std::min(retry_us * 2, RETRY_MAX_US);
+        return;
+    }
+    inflight_msg = msg_id;
+    acks.expect(msg_id);
+    next_try_us = now + ACK_TIMEOUT_US;
+}
+
+void AlarmChannel::alarmTask(void* param) {
+    auto* self = static_cast<AlarmChannel*>(param);
+    while (true) {
+        self->step();
+
+        TickType_t wait = portMAX_DELAY;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            if (self->pending_count > 0) {
+                int64_t left_us = std::max<int64_t>(self->next_try_us - esp_timer_get_time(), 0);
+                wait = pdMS_TO_TICKS(left_us / 1000) + 1;
+            }
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+    vTaskDelete(nullptr);
+}
+
+AlarmChannel::Stats AlarmChannel::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return {raised, acked, attempts, dropped, static_cast<uint32_t>(pending_count), last_ack_ms};
+}
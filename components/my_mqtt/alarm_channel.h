@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "room_state.h"
+#include "puback_tracker.h"
+
+// SOS这类安全相关状态的专用告警通道, 不走状态上报和日志上报
+// 状态变化时当场拼好一条很短的消息放进待发队列, 由高优先级的告警任务直接以QoS1发布;
+// 收到PUBACK才出队, 没发出去或超时没确认就按退避一直重发, 断线重连后立即重发.
+// 每条带开机内递增的seq和触发时间, 后台按(mac, seq, happentime)去重
+class AlarmChannel {
+public:
+    static AlarmChannel& getInstance() {
+        static AlarmChannel instance;
+        return instance;
+    }
+
+    // 以QoS1发布到上行主题, 返回msg_id, 没发出去返回-1
+    using PublishFunc = int (*)(const char* data, size_t len);
+
+    void start(PublishFunc publish);                // 开机时调用一次, 创建告警任务并订阅房间状态
+    void kick();                                    // mqtt连上时调用, 立即重发还没确认的告警
+    // MQTT_EVENT_PUBLISHED, 在mqtt任务里调用; 和OpJournal一样不能拿mutex
+    void onPublished(int msg_id);
+
+    struct Stats {
+        uint32_t raised;        // 触发的告警数
+        uint32_t acked;         // 已确认的告警数
+        uint32_t attempts;      // 发布次数, 包括重发
+        uint32_t dropped;       // 待发队列满被挤掉的告警数
+        uint32_t pending;       // 还没确认的告警数
+        uint32_t last_ack_ms;   // 最近一条从触发到收到PUBACK的耗时
+    };
+    Stats getStats();
+
+private:
+    static constexpr size_t PENDING_MAX = 8;
+    static constexpr size_t TEXT_SIZE = 160;
+    static constexpr int64_t ACK_TIMEOUT_US = 3 * 1000 * 1000;  // 发出后这么久没PUBACK就重发
+    static constexpr int64_t RETRY_MIN_US = 1 * 1000 * 1000;    // 没发出去时的重试间隔, 每次翻倍
+    static constexpr int64_t RETRY_MAX_US = 30 * 1000 * 1000;
+
+    struct Pending {
+        int64_t trigger_us;
+        uint16_t len;
+        char text[TEXT_SIZE];
+    };
+
+    // 保护待发队列和发送状态, 发布时不持有, 所以mqtt任务里的kick也可以拿
+    std::mutex mutex;
+    Pending pending[PENDING_MAX];
+    size_t pending_head = 0;
+    size_t pending_count = 0;
+    uint32_t next_seq = 1;
+    int inflight_msg = -1;                  // 队首在途的msg_id, -1表示没有
+    bool front_tried = false;               // 队首发过至少一次, 再发就算重发
+    int64_t next_try_us = 0;
+    int64_t retry_us = RETRY_MIN_US;
+
+    PubackTracker acks;
+
+    uint32_t raised = 0;
+    uint32_t acked = 0;
+    uint32_t attempts = 0;
+    uint32_t dropped = 0;
+    uint32_t last_ack_ms = 0;
+
+    PublishFunc publish = nullptr;
+    TaskHandle_t task = nullptr;
+
+    static bool isAlarmState(RoomStateId id);
+    static void onRoomStateChanged(RoomStateId id, bool present);
+    void raise(RoomStateId id, bool present);
+    void step();
+    static void alarmTask(void* param);
+
+    AlarmChannel() = default;
+    AlarmChannel(const AlarmChannel&) = delete;
+    AlarmChannel& operator=(const AlarmChannel&) = delete;
+};
@@ -0,0 +1,210 @@
+#include "file_uploader.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "identity.h"
+#include "op_journal.h"
+#include "config_slots.h"
+#include "../json.hpp"
+#include "json_codec.h"
+#include "metrics.h"
+
+#define TAG "FILE_UPLOAD"
+
+static MetricCounter m_file_chunk("file.chunk");
+static MetricCounter m_file_done("file.done");
+static MetricCounter m_file_abort("file.abort");        // 超时、断线或被新请求取代
+
+void FileUploader::start(PublishFunc publish_func) {
+    if (task) {
+        return;
+    }
+    publish = publish_func;
+    if (xTaskCreate(uploadTask, "file_upload", 6144, this, 3, &task) != pdPASS) {
+        ESP_LOGE(TAG, "创建上传任务失败");
+        task = nullptr;
+    }
+}
+
+void FileUploader::request(const char* file, uint32_t offset) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        snprintf(req_file, sizeof(req_file), "%s", file);
+        req_offset = offset;
+        req_pending = true;
+        req_gen.fetch_add(1, std::memory_order_release);
+    }
+    if (task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void FileUploader::cancel() {
+    req_gen.fetch_add(1, std::memory_order_release);
+    if (task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void FileUploader::onPublished(int msg_id) {
+    acks.onPublished(msg_id);
+    if (task) {
+        xTaskNotifyGive(task);
+    }
+}
+
+bool FileUploader::openSource(const char* file, Source& src) {
+    if (strcmp(file, "config") == 0) {
+        ConfigSlots::Slot slot;
+        const char* path;
+        if (!ConfigSlots::getInstance().active(slot, &path)) {
+            return false;
+        }
+        src.paths[0] = path;
+        src.hash = slot.hash.hex();
+    } else if (strcmp(file, "journal") == 0) {
+        OpJournal::getInstance().segmentPaths(src.paths);
+    } else if (strcmp(file, "traces") == 0) {
+        // 执行记录在内存里, 每次请求现生成一份快照, 不大
+        src.text = generateSceneTraces().dump();
+        src.total = src.text.size();
+        return true;
+    } else {
+        return false;
+    }
+    // 大小在开始时定下来, 传的过程中段文件还在追加也只传到这里
+    bool any = false;
+    for (int i = 0; i < 2; i++) {
+        struct stat st;
+        if (src.paths[i] && stat(src.paths[i], &st) == 0) {
+            src.sizes[i] = st.st_size;
+            src.total += st.st_size;
+            any = true;
+        } else {
+            src.paths[i] = nullptr;
+        }
+    }
+    return any;
+}
+
+bool FileUploader::readSource(const Source& src, uint32_t offset, char* out, size_t len) {
+    if (src.paths[0] == nullptr && src.paths[1] == nullptr) {
+        memcpy(out, src.text.data() + offset, len);
+        return true;
+    }
+    for (int i = 0; i < 2 && len > 0; i++) {
+        if (offset >= src.sizes[i]) {
+            offset -= src.sizes[i];
+            continue;
+        }
+        size_t n = std::min<size_t>(len, src.sizes[i] - offset);
+        FILE* f = fopen(src.paths[i], "rb");
+        if (!f) {
+            return false;
+        }
+        bool ok = fseek(f, offset, SEEK_SET) == 0 && fread(out, 1, n, f) == n;
+        fclose(f);
+        if (!ok) {
+            return false;
+        }
+        out += n;
+        len -= n;
+        offset = 0;
+    }
+    return len == 0;
+}
+
+bool FileUploader::waitAck(int msg_id, uint32_t gen) {
+    int64_t deadline = esp_timer_get_time() + ACK_TIMEOUT_US;
+    acks.expect(msg_id);
+    while (!acks.isAcked(msg_id)) {
+        if (req_gen.load(std::memory_order_acquire) != gen || esp_timer_get_time() > deadline) {
+            return false;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    }
+    return true;
+}
+
+void FileUploader::upload(const char* file, uint32_t offset, uint32_t gen) {
+    char* buf = static_cast<char*>(malloc(HEADER_MAX + CHUNK_SIZE));
+    if (!buf) {
+        ESP_LOGE(TAG, "申请上传缓冲失败");
+        return;
+    }
+    Source src;
+    bool found = openSource(file, src);
+    if (!found || offset > src.total) {
+        int len = snprintf(buf, HEADER_MAX, "{\"mac\":\"%s\",\"type\":\"file_chunk\",\"file\":\"%s\",\"error\":\"%s\"}",
+                           getSerialNum(), file, found ? "bad offset" : "not found");
+        publish(buf, len);
+        free(buf);
+        return;
+    }
+    ESP_LOGI(TAG, "上传%s, 从%lu到%lu字节", file, offset, src.total);
+
+    int64_t start = esp_timer_get_time();
+    bool ok = true;
+    // 空文件也发一块, 后台靠offset+len==total判断传完
+    do {
+        if (req_gen.load(std::memory_order_acquire) != gen) {
+            ok = false;
+            break;
+        }
+        size_t n = std::min<size_t>(CHUNK_SIZE, src.total - offset);
+        int header = snprintf(buf, HEADER_MAX,
+                              "{\"mac\":\"%s\",\"type\":\"file_chunk\",\"file\":\"%s\",\"offset\":%lu,\"len\":%u,\"total\":%lu%s%s%s}\n",
+                              getSerialNum(), file, offset, n, src.total,
+                              src.hash.empty() ? "" : ",\"hash\":\"", src.hash.c_str(), src.hash.empty() ? "" : "\"");
+        if (!readSource(src, offset, buf + header, n)) {
+            ESP_LOGE(TAG, "读%s第%lu字节失败", file, offset);
+            ok = false;
+            break;
+        }
+        int msg_id = publish(buf, header + n);
+        if (msg_id < 0 || !waitAck(msg_id, gen)) {
+            ok = false;
+            break;
+        }
+        m_file_chunk.inc();
+        offset += n;
+    } while (offset < src.total);
+    free(buf);
+
+    if (ok) {
+        m_file_done.inc();
+        ESP_LOGI(TAG, "%s上传完成, %lu字节, 用时%lldms", file, src.total, (esp_timer_get_time() - start) / 1000);
+    } else {
+        m_file_abort.inc();
+        ESP_LOGW(TAG, "%s上传停在第%lu字节, 等后台续传", file, offset);
+    }
+}
+
+void FileUploader::uploadTask(void* param) {
+    auto* self = static_cast<FileUploader*>(param);
+    while (true) {
+        char file[sizeof(req_file)];
+        uint32_t offset;
+        uint32_t gen;
+        {
+            std::lock_guard<std::mutex> lock(self->mutex);
+            if (!self->req_pending) {
+                file[0] = '\0';
+            } else {
+                memcpy(file, self->req_file, sizeof(file));
+                offset = self->req_offset;
+                gen = self->req_gen.load(std::memory_order_acquire);
+                self->req_pending = false;
+            }
+        }
+        if (file[0] == '\0') {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        self->upload(file, offset, gen);
+    }
+    vTaskDelete(nullptr);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "puback_tracker.h"
+
+// GET_FILE的分块上传, 在自己的任务里把文件一块一块读出来发, 整个文件不用放进内存.
+// 每条消息是一行json头(文件名、偏移、本块长度、总长度)加换行, 后面跟最多CHUNK_SIZE字节的原始数据.
+// 每块以QoS1发出, 收到PUBACK才发下一块, outbox里最多压一块; 中途断线或者超时就停下,
+// 后台把已经收到的长度作为offset重新请求, 就从那里接着发
+class FileUploader {
+public:
+    static FileUploader& getInstance() {
+        static FileUploader instance;
+        return instance;
+    }
+
+    // 以QoS1发布到上行主题, 返回msg_id, 没发出去返回-1
+    using PublishFunc = int (*)(const char* data, size_t len);
+
+    static constexpr size_t CHUNK_SIZE = 4096;
+
+    void start(PublishFunc publish);                // 创建上传任务, 重复调用没关系
+    // 在mqtt任务里调用, 只记下请求叫醒上传任务, 正在传的会被新请求取代
+    // file: config(当前配置), journal(操作日志的两个段文件, 旧的在前), traces(动作组执行记录)
+    void request(const char* file, uint32_t offset);
+    void cancel();                                  // 断线时调用, 正在传的停下
+    // MQTT_EVENT_PUBLISHED, 在mqtt任务里调用; 和AlarmChannel一样不能拿mutex
+    void onPublished(int msg_id);
+
+private:
+    static constexpr size_t HEADER_MAX = 192;
+    static constexpr int64_t ACK_TIMEOUT_US = 10 * 1000 * 1000;
+
+    // 要上传的内容: 最多两个文件首尾相接, 或者一段现生成的文本
+    struct Source {
+        const char* paths[2] = {};
+        uint32_t sizes[2] = {};
+        std::string text;
+        std::string hash;                           // 配置的哈希, 续传时后台用来确认文件没换过
+        uint32_t total = 0;
+    };
+
+    std::mutex mutex;                               // 保护请求
+    char req_file[16] = {};
+    uint32_t req_offset = 0;
+    bool req_pending = false;
+    std::atomic<uint32_t> req_gen{0};               // 每次请求或取消加一, 正在传的发现变了就停
+
+    PubackTracker acks;
+
+    PublishFunc publish = nullptr;
+    TaskHandle_t task = nullptr;
+
+    static bool openSource(const char* file, Source& src);
+    static bool readSource(const Source& src, uint32_t offset, char* out, size_t len);
+    bool waitAck(int msg_id, uint32_t gen);
+    void upload(const char* file, uint32_t offset, uint32_t gen);
+    static void uploadTask(void* param);
+
+    FileUploader() = default;
+    FileUploader(const FileUploader&) = delete;
+    FileUploader& operator=(const FileUploader&) = delete;
+};
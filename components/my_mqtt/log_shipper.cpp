@@ -0,0 +1,119 @@
+#include "log_shipper.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "esp_timer.h"
+
+void LogShipper::start(PublishFunc publish_func) {
+    if (shipper) {
+        return;
+    }
+    publish = publish_func;
+    batch = static_cast<char*>(malloc(BATCH_BYTES));
+    if (!batch) {
+        printf("LogShipper: 申请发送缓冲失败\n");
+        return;
+    }
+    xTaskCreate(shipperTask, "log_shipper", 4096, this, 2, &shipper);
+}
+
+void LogShipper::write(const char* fmt, va_list args) {
+    // 发送任务自己(包括mqtt发布过程中)打的日志不进缓冲, 免得自己喂自己
+    if (shipper && xTaskGetCurrentTaskHandle() == shipper) {
+        return;
+    }
+    uint32_t idx = head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots[idx & (SLOT_COUNT - 1)];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    int n = vsnprintf(slot.text, SLOT_SIZE, fmt, args);
+    if (n < 0) {
+        n = 0;
+    } else if (n >= (int)SLOT_SIZE) {
+        n = SLOT_SIZE - 1;
+        slot.text[n - 1] = '\n';
+        truncated.fetch_add(1, std::memory_order_relaxed);
+    }
+    slot.len = n;
+    slot.seq.store(idx + 1, std::memory_order_release);
+}
+
+// 只在发送任务里调用, 按写入顺序取出能放进cap的行
+// 和OpLogRing一样靠槽位序号判断是否写完、是否在复制途中被覆盖
+size_t LogShipper::drainInto(char* buf, size_t cap, uint32_t& lost) {
+    uint32_t end = head.load(std::memory_order_acquire);
+    if (end - tail > SLOT_COUNT) {
+        lost += end - tail - SLOT_COUNT;
+        tail = end - SLOT_COUNT;
+    }
+    size_t used = 0;
+    while (tail != end) {
+        Slot& slot = slots[tail & (SLOT_COUNT - 1)];
+        uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == 0 || (int32_t)(seq - (tail + 1)) < 0) {
+            break;
+        }
+        if (seq != tail + 1) {
+            lost++;
+            tail++;
+            continue;
+        }
+        size_t len = std::min<size_t>(slot.len, SLOT_SIZE);
+        if (used + len > cap) {
+            break;
+        }
+        memcpy(buf + used, slot.text, len);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq) {
+            lost++;
+            tail++;
+            continue;
+        }
+        used += len;
+        shipped++;
+        tail++;
+    }
+    return used;
+}
+
+void LogShipper::shipperTask(void* param) {
+    auto* self = static_cast<LogShipper*>(param);
+    uint32_t tokens = BURST_BYTES;
+    uint32_t pending_lost = 0;                      // 还没在消息里注明的丢弃行数
+    int64_t last_refill = esp_timer_get_time();
+
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(FLUSH_INTERVAL_MS));
+
+        int64_t now = esp_timer_get_time();
+        tokens = std::min<uint64_t>(BURST_BYTES, tokens + (now - last_refill) * RATE_BYTES_PER_S / 1000000);
+        last_refill = now;
+
+        // 令牌不够时剩下的行留在缓冲里, 来不及发就会被覆盖
+        while (tokens >= SLOT_SIZE) {
+            size_t cap = std::min<size_t>(BATCH_BYTES, tokens);
+            size_t used = 0;
+            uint32_t noted = pending_lost;
+            if (noted) {
+                used = std::min<size_t>(snprintf(self->batch, cap, "[log_shipper] 丢弃了%lu行\n", noted), cap - 1);
+            }
+            uint32_t lost = 0;
+            size_t n = self->drainInto(self->batch + used, cap - used, lost);
+            self->dropped += lost;
+            pending_lost += lost;
+            if (n == 0) {
+                break;
+            }
+            self->publish(self->batch, used + n);
+            self->batches++;
+            tokens -= used + n;
+            pending_lost -= noted;
+        }
+    }
+    vTaskDelete(nullptr);
+}
+
+LogShipper::Stats LogShipper::getStats() const {
+    return {head.load(std::memory_order_relaxed), shipped, dropped, truncated.load(std::memory_order_relaxed), batches};
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// 把ESP_LOG日志异步、成批地发到mqtt日志主题
+// 日志钩子只把格式化好的一行写进定长槽位的环形缓冲(不加锁, 不碰网络), 由发送任务定时取出,
+// 攒成一条消息再发; 发送受字节令牌桶限速, 发不完的被新日志覆盖并计入丢弃数, 下一条消息开头会注明
+class LogShipper {
+public:
+    static LogShipper& getInstance() {
+        static LogShipper instance;
+        return instance;
+    }
+
+    using PublishFunc = void (*)(const char* data, size_t len);
+
+    void start(PublishFunc publish);                // 只创建一次发送任务
+    void write(const char* fmt, va_list args);      // 给日志钩子用, 任何任务都可以调用
+
+    struct Stats {
+        uint32_t lines;         // 写进环形缓冲的行数
+        uint32_t shipped;       // 已发出的行数
+        uint32_t dropped;       // 没来得及发就被覆盖的行数
+        uint32_t truncated;     // 超长被截断的行数
+        uint32_t batches;       // 发出的消息数
+    };
+    Stats getStats() const;
+
+private:
+    static constexpr size_t SLOT_COUNT = 32;            // 必须是2的幂
+    static constexpr size_t SLOT_SIZE = 256;            // 每行最多这么多字节, 多出的截掉
+    static constexpr size_t BATCH_BYTES = 2048;         // 每条消息最多这么多字节
+    static constexpr uint32_t FLUSH_INTERVAL_MS = 200;  // 最多攒这么久就发
+    static constexpr uint32_t RATE_BYTES_PER_S = 8192;  // 令牌桶速率
+    static constexpr uint32_t BURST_BYTES = 8192;       // 令牌桶容量
+
+    struct Slot {
+        std::atomic<uint32_t> seq{0};       // 0表示正在写, 否则是写入序号+1
+        uint16_t len;
+        char text[SLOT_SIZE];
+    };
+    Slot slots[SLOT_COUNT];
+    std::atomic<uint32_t> head{0};
+    uint32_t tail = 0;                      // 只有发送任务改
+
+    std::atomic<uint32_t> truncated{0};
+    uint32_t shipped = 0;
+    uint32_t dropped = 0;
+    uint32_t batches = 0;
+
+    PublishFunc publish = nullptr;
+    TaskHandle_t shipper = nullptr;
+    char* batch = nullptr;
+
+    size_t drainInto(char* buf, size_t cap, uint32_t& lost);
+    static void shipperTask(void* param);
+
+    LogShipper() = default;
+    LogShipper(const LogShipper&) = delete;
+    LogShipper& operator=(const LogShipper&) = delete;
+};
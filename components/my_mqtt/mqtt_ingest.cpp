@@ -0,0 +1,132 @@
+#include "mqtt_ingest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <charconv>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#define TAG "MQTT_INGEST"
+
+#define INGEST_LINE_BUF_SIZE    1024        // 控制类消息的一行远小于这个
+#define INGEST_POOL_SIZE        2048        // 一条ctl消息的文档不到300字节
+
+static char line_buf[INGEST_LINE_BUF_SIZE + YYJSON_PADDING_SIZE];
+static uint8_t doc_pool[INGEST_POOL_SIZE];
+static std::atomic<bool> shared_in_use{false};
+
+IngestLine::IngestLine(std::string_view line) {
+    char* buf;
+    if (line.size() <= INGEST_LINE_BUF_SIZE && !shared_in_use.exchange(true, std::memory_order_acquire)) {
+        owns_shared = true;
+        buf = line_buf;
+    } else {
+        heap_buf = static_cast<char*>(malloc(line.size() + YYJSON_PADDING_SIZE));
+        if (!heap_buf) {
+            err.code = YYJSON_READ_ERROR_MEMORY_ALLOCATION;
+            err.msg = "内存不足";
+            return;
+        }
+        buf = heap_buf;
+    }
+    memcpy(buf, line.data(), line.size());
+    memset(buf + line.size(), 0, YYJSON_PADDING_SIZE);
+
+    if (owns_shared) {
+        yyjson_alc alc;
+        yyjson_alc_pool_init(&alc, doc_pool, sizeof(doc_pool));
+        doc = yyjson_read_opts(buf, line.size(), YYJSON_READ_INSITU, &alc, &err);
+        if (doc || err.code != YYJSON_READ_ERROR_MEMORY_ALLOCATION) {
+            return;
+        }
+    }
+    doc = yyjson_read_opts(buf, line.size(), YYJSON_READ_INSITU, nullptr, &err);
+}
+
+IngestLine::~IngestLine() {
+    // 原地解析的字符串指向缓冲, 文档先释放
+    if (doc) {
+        yyjson_doc_free(doc);
+    }
+    free(heap_buf);
+    if (owns_shared) {
+        shared_in_use.store(false, std::memory_order_release);
+    }
+}
+
+yyjson_val* IngestLine::object() const {
+    yyjson_val* r = doc ? yyjson_doc_get_root(doc) : nullptr;
+    return yyjson_is_obj(r) ? r : nullptr;
+}
+
+bool field_int(yyjson_val* obj, const char* key, int& out) {
+    yyjson_val* v = yyjson_obj_get(obj, key);
+    if (yyjson_is_int(v)) {
+        out = static_cast<int>(yyjson_get_int(v));
+        return true;
+    }
+    if (yyjson_is_str(v)) {
+        const char* s = yyjson_get_str(v);
+        const char* end = s + yyjson_get_len(v);
+        int value;
+        auto [ptr, ec] = std::from_chars(s, end, value);
+        if (ec == std::errc() && ptr == end && ptr != s) {
+            out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+nlohmann::json benchMqttIngest(uint32_t count) {
+    static const char sample[] = R"({"devicetype":"lamp","deviceid":"12","operation":"开","param":"50"})";
+    std::string_view line{sample, sizeof(sample) - 1};
+    if (count == 0) {
+        count = 1;
+    }
+
+    // 先各跑一次量单条消息解析期间的堆占用
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t yy_heap;
+    {
+        IngestLine l(line);
+        yy_heap = heap_before - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    }
+    size_t nl_heap;
+    {
+        nlohmann::json j = nlohmann::json::parse(line, nullptr, false);
+        nl_heap = heap_before - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    }
+
+    int did = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < count; i++) {
+        IngestLine l(line);
+        if (yyjson_val* msg = l.object()) {
+            field_int(msg, "deviceid", did);
+        }
+    }
+    int64_t yy_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < count; i++) {
+        nlohmann::json j = nlohmann::json::parse(line, nullptr, false);
+        if (j.is_object()) {
+            did = std::atoi(j.value("deviceid", "-1").c_str());
+        }
+    }
+    int64_t nl_us = esp_timer_get_time() - start;
+
+    nlohmann::json result;
+    result["type"] = "ingest_bench";
+    result["count"] = count;
+    result["msg_bytes"] = line.size();
+    result["yyjson_ns_per_msg"] = yy_us * 1000 / count;
+    result["yyjson_heap_bytes"] = yy_heap;
+    result["nlohmann_ns_per_msg"] = nl_us * 1000 / count;
+    result["nlohmann_heap_bytes"] = nl_heap;
+    ESP_LOGI(TAG, "下行消息解析%lu次: yyjson %lldns/条, 堆%u字节; nlohmann %lldns/条, 堆%u字节",
+             count, yy_us * 1000 / count, yy_heap, nl_us * 1000 / count, nl_heap);
+    return result;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <string_view>
+#include "yyjson.h"
+#include "../json.hpp"
+
+// 下行消息的一行, 用yyjson原地解析, 不抛异常
+// 行先拷进一块复用的带填充缓冲, 文档节点从固定大小的静态内存池里分配, 常见的控制消息解析时不碰堆;
+// 行太长或内存池放不下才退回到堆上. 复用缓冲同一时刻只给一个IngestLine用, 第二个同时存在的自动走堆
+class IngestLine {
+public:
+    explicit IngestLine(std::string_view line);
+    ~IngestLine();
+
+    bool ok() const { return doc != nullptr; }
+    const char* error() const { return err.msg ? err.msg : ""; }
+    yyjson_val* root() const { return yyjson_doc_get_root(doc); }
+    yyjson_val* object() const;             // 根是对象时返回根, 否则返回nullptr
+
+    IngestLine(const IngestLine&) = delete;
+    IngestLine& operator=(const IngestLine&) = delete;
+
+private:
+    yyjson_doc* doc = nullptr;
+    yyjson_read_err err = {};
+    char* heap_buf = nullptr;
+    bool owns_shared = false;
+};
+
+// 字段是整数, 或者是能完整转换成整数的字符串(后台两种都会发)时写进out并返回true
+bool field_int(yyjson_val* obj, const char* key, int& out);
+
+// 用一条典型的ctl消息对比yyjson原地解析和nlohmann的耗时与堆占用, 给oracle用
+nlohmann::json benchMqttIngest(uint32_t count);
@@ -1,6 +1,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_log.h"
 #include "mqtt_client.h"
 #include "esp_mac.h"
@@ -22,7 +23,20 @@
 #include "identity.h"
 #include "my_mqtt.h"
 #include "json_codec.h"
+#include "config_slots.h"
+#include "mbedtls/sha256.h"
+#include "scene_trace.h"
+#include "op_journal.h"
+#include "log_shipper.h"
+#include "alarm_channel.h"
+#include "file_uploader.h"
+#include "mqtt_ingest.h"
+#include "room_state.h"
+#include "metrics.h"
 #include "../json.hpp"
+#include <atomic>
+#include <string_view>
+#include <unordered_map>
 #include <air_conditioner.h>
 
 
@@ -40,9 +54,25 @@ static std::string g_ota_url;
 
 static esp_err_t ota_dbg_handler(esp_http_client_event_t *e);
 static void handle_mqtt_ndjson(const char* data, size_t data_len);
+static void handle_mqtt_fragment(const char* data, size_t len, size_t offset, size_t total);
+static void cancel_config_rx();
+static void start_mqtt_worker();
+static void publish_log_batch(const char* data, size_t len);
+static int publish_qos1(const char* data, size_t len);
 
 bool mqtt_connected = false;
 
+static MetricCounter m_mqtt_tx("mqtt.tx");
+static MetricCounter m_mqtt_tx_fail("mqtt.tx_fail");          // 没连上或者客户端拒绝
+static MetricCounter m_mqtt_tx_bytes("mqtt.tx_bytes");
+static MetricCounter m_mqtt_rx("mqtt.rx");
+static MetricCounter m_mqtt_connect("mqtt.connect");
+static MetricCounter m_mqtt_disconnect("mqtt.disconnect");
+static MetricGauge m_mqtt_connected("mqtt.connected");
+static MetricCounter m_mqtt_rx_dropped("mqtt.rx_dropped");      // 超过缓冲又不是配置的消息
+static MetricCounter m_mqtt_config_unchanged("mqtt.config_unchanged");  // 重发的配置和当前一样, 跳过
+static MetricHistogram m_mqtt_handle_ms("mqtt.handle_ms", {1, 5, 10, 50, 100, 500, 1000});
+
 void ota_task(void *param) {
     ESP_LOGI("heap", "free=%u  min=%u",
          heap_caps_get_free_size(MALLOC_CAP_8BIT),
@@ -87,34 +117,69 @@ void start_ota_upgrade(const std::string &url) {
     xTaskCreatePinnedToCore(ota_task, "ota_task", 8192, nullptr, 5, nullptr, 1);
 }
 
-// 固定间隔上报所有设备状态
+static TaskHandle_t report_st_task_handle = nullptr;
+static std::atomic<bool> keyframe_requested{true};     // 下一次上报发完整状态
+
+static constexpr uint32_t STATE_COALESCE_MS = 300;                 // 被叫醒后再等这么久, 一串连续的变化合成一条
+static constexpr uint32_t STATE_POLL_MS = 10 * 1000;               // 没人叫醒也这么久比较一次, 兜住没有通知的变化
+static constexpr int64_t STATE_KEYFRAME_US = 5 * 60 * 1000000LL;   // 完整状态的间隔, 丢了增量也能在这之内纠正
+static constexpr int64_t RUNTIME_LOG_US = 60 * 60 * 1000000LL;
+static constexpr int64_t METRICS_INTERVAL_US = 5 * 60 * 1000000LL;
+static constexpr size_t CTL_BATCH_MAX = 32;                         // 一条批量ctl最多执行几项, 多出的回错误
+
+// 各子系统的计数/直方图、任务栈余量和队列深度, 定时上报, 也可以用oracle metrics随时要
+static void publish_metrics() {
+    json j = metricsToJson();
+    j["mac"] = getSerialNum();
+    j["type"] = "metrics";
+    mqtt_publish_message(j.dump(), 0, 0);
+}
+
+// 房间状态变化时叫醒上报任务
+static void on_room_state_changed(RoomStateId id, bool present) {
+    notify_device_state_changed();
+}
+
+// 设备状态变化时由notify_device_state_changed叫醒, 合并一小段时间内的变化后只发变了的设备;
+// 隔一段时间或者后台urge时发一次完整状态
 static void report_state_task(void *param) {
-    int runtime_counter = 0;
-    
+    int64_t last_keyframe = 0;
+    int64_t last_runtime_log = esp_timer_get_time();
+    int64_t last_metrics = last_runtime_log;
+
     while (true) {
-        report_states();
+        int64_t now = esp_timer_get_time();
+        // 生成报告时已经把内容记成"上次报告", 没发出去(断线、outbox满)的话这些变化就再也不会进增量,
+        // 所以下一轮改发完整状态
+        int sent = 0;
+        if (keyframe_requested.exchange(false) || now - last_keyframe >= STATE_KEYFRAME_US) {
+            sent = mqtt_publish_message(generateReportStates().dump(), 0, 0);
+            last_keyframe = now;
+        } else if (json delta = generateDeltaStates(); !delta.is_null()) {
+            sent = mqtt_publish_message(delta.dump(), 0, 0);
+            if (delta["type"] == "alldevicestate") {
+                last_keyframe = now;
+            }
+        }
+        if (sent < 0) {
+            keyframe_requested = true;
+        }
 
-        if (runtime_counter >= 60) {   
-            int64_t uptime_us = esp_timer_get_time();
-            int64_t uptime_s = uptime_us / 1000000;
+        if (now - last_runtime_log >= RUNTIME_LOG_US) {
             char log_msg[64];
-            snprintf(log_msg, sizeof(log_msg), "runtime: %lld", uptime_s);
+            snprintf(log_msg, sizeof(log_msg), "runtime: %lld", now / 1000000);
             urgentPublishDebugLog(log_msg);
-            runtime_counter = 0;
+            last_runtime_log = now;
+        }
+        if (now - last_metrics >= METRICS_INTERVAL_US) {
+            publish_metrics();
+            last_metrics = now;
         }
 
-        vTaskDelay(60000 / portTICK_PERIOD_MS);
-        runtime_counter++;
-    }
-    vTaskDelete(nullptr);
-}
-
-// 固定间隔上报过去一分钟的操作记录
-static void report_operation_task(void *param) {
-    while (true) {
-        report_op_logs();
-
-        vTaskDelay(60000 / portTICK_PERIOD_MS);
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STATE_POLL_MS)) > 0) {
+            vTaskDelay(pdMS_TO_TICKS(STATE_COALESCE_MS));
+            ulTaskNotifyTake(pdTRUE, 0);
+        }
     }
     vTaskDelete(nullptr);
 }
@@ -159,6 +224,8 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_CONNECTED: {
         mqtt_connected = true;
+        m_mqtt_connect.inc();
+        m_mqtt_connected.set(1);
         printf("MQTT 已连接\n");
         printCurrentFreeMemory();
         esp_mqtt_client_subscribe(client, down_topic, 0);
@@ -167,16 +234,18 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         // 注册本机
         register_the_rcu();
         // 启动报告状态任务
-        static TaskHandle_t report_st_task_handle;
         if (report_st_task_handle == nullptr) {
             xTaskCreate(report_state_task, "report_state_task", 4096, nullptr, 3, &report_st_task_handle);
+            set_device_state_listener(report_st_task_handle);
+        } else {
+            // 断线期间的增量都丢了, 重连后先发一次完整状态
+            report_states();
         }
-        // 启动报告操作任务
-        static TaskHandle_t report_op_task_handle;
-        if (report_op_task_handle == nullptr) {
-            xTaskCreate(report_operation_task, "report_operation_task", 8192, nullptr, 3, &report_op_task_handle);
-        }
+        // 操作日志上报任务开机就在跑(离线时只落盘), 叫醒它开始补传
+        kickOpLogReporter();
+        AlarmChannel::getInstance().kick();
 
+        LogShipper::getInstance().start(publish_log_batch);
         if (!orig_vprintf) {
             orig_vprintf = esp_log_set_vprintf(my_log_send_func);
         } else {
@@ -192,6 +261,10 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
     case MQTT_EVENT_DISCONNECTED: {
         mqtt_connected = false;
+        m_mqtt_disconnect.inc();
+        cancel_config_rx();                     // 断线后剩下的分片不会再来了
+        FileUploader::getInstance().cancel();
+        m_mqtt_connected.set(0);
         if (orig_vprintf) {
             esp_log_set_vprintf(orig_vprintf);
             ESP_LOGI(TAG, "日志重定向回本地");
@@ -202,9 +275,23 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         printCurrentFreeMemory();
         break;
     }
+    case MQTT_EVENT_PUBLISHED: {
+        OpJournal::getInstance().onPublished(event->msg_id);
+        AlarmChannel::getInstance().onPublished(event->msg_id);
+        FileUploader::getInstance().onPublished(event->msg_id);
+        break;
+    }
     case MQTT_EVENT_DATA: {
-        std::string msg_data(event->data, event->data_len);
-        handle_mqtt_ndjson(msg_data.c_str(), msg_data.size());
+        if (event->current_data_offset == 0) {
+            m_mqtt_rx.inc();
+        }
+        int64_t start = esp_timer_get_time();
+        if (event->total_data_len > event->data_len) {
+            handle_mqtt_fragment(event->data, event->data_len, event->current_data_offset, event->total_data_len);
+        } else {
+            handle_mqtt_ndjson(event->data, event->data_len);
+        }
+        m_mqtt_handle_ms.record((esp_timer_get_time() - start) / 1000);
         break;
     }
     default:
@@ -237,6 +324,7 @@ void mqtt_app_start() {
     snprintf(up_topic, sizeof(up_topic), "/XZRCU/UP/%s", getSerialNum());
     snprintf(log_topic, sizeof(log_topic), "/XZRCU/LOG/%s", getSerialNum());
 
+    start_mqtt_worker();
     client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(client, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     esp_mqtt_client_start(client);
@@ -250,14 +338,22 @@ void mqtt_app_stop(void) {
     }
 }
 
-void mqtt_publish_message(const std::string& message, int qos, int retain) {
+int mqtt_publish_message(const std::string& message, int qos, int retain) {
     if (!client || !network_is_ready() || !mqtt_connected) {
-        return;
+        m_mqtt_tx_fail.inc();
+        return -1;
     }
     char up_topic[40];
     snprintf(up_topic, sizeof(up_topic), "/XZRCU/UP/%s", getSerialNum());
     int msg_id = esp_mqtt_client_publish(client, up_topic, message.c_str(), message.length(), qos, retain);
+    if (msg_id < 0) {
+        m_mqtt_tx_fail.inc();
+    } else {
+        m_mqtt_tx.inc();
+        m_mqtt_tx_bytes.inc(message.length());
+    }
     printf("Message sent, msg_id=%d, topic=%s, message=%s\n", msg_id, up_topic, message.c_str());
+    return msg_id;
 }
 
 // 注册时携带所有信息
@@ -266,417 +362,823 @@ static void register_the_rcu() {
     mqtt_publish_message(json_str.c_str(), 0, 0);
 }
 
+// 让上报任务尽快发一次完整状态, 报告只在上报任务里生成
 void report_states() {
-    std::string json_str = generateReportStates().dump();
-    mqtt_publish_message(json_str.c_str(), 0, 0);
+    keyframe_requested.store(true);
+    notify_device_state_changed();
 }
 
-static void handle_mqtt_ndjson(const char* data, size_t data_len) {
-    std::string_view raw{data, data_len};
-    const auto lines = splitByLineView(raw);
+// 第一行只取出type就释放, 第二行复用同一块缓冲和内存池
+static bool read_message_type(std::string_view head, char (&type)[32]) {
+    IngestLine first(head);
+    if (!first.ok()) {
+        ESP_LOGW(TAG, "JSON 解析失败: %s", first.error());
+        return false;
+    }
+    yyjson_val* root = first.root();
+    if (!yyjson_is_obj(root) || yyjson_obj_size(root) == 0) {
+        ESP_LOGW(TAG, "解析后的 JSON 是空的");
+        return false;
+    }
+    // 第一个键必须是type
+    yyjson_obj_iter iter = yyjson_obj_iter_with(root);
+    yyjson_val* key = yyjson_obj_iter_next(&iter);
+    if (!yyjson_equals_str(key, "type")) {
+        return false;
+    }
+    const char* type_str = yyjson_get_str(yyjson_obj_iter_get_val(key));
+    if (!type_str) {
+        ESP_LOGW(TAG, "type不是字符串");
+        return false;
+    }
+    snprintf(type, sizeof(type), "%s", type_str);
+    return true;
+}
 
-    if (lines.empty()) {
-        ESP_LOGW(TAG, "接收到空行，忽略");
+// littlefs只有128K, 要同时放两个槽、暂存文件、config.bin(和它的.tmp)以及约20KB的操作日志,
+// 新配置在暂存文件旁边还得留些余量给元数据、按块取整和写配置期间还在增长的操作日志
+#define CONFIG_FS_RESERVE (8 * 1024)
+
+// 开始写暂存文件之前看剩余空间够不够放下len字节的配置, 不够就别开始收. 取不到信息时放行, 写不下时自然会失败
+static bool littlefs_fits_config(size_t len) {
+    size_t total = 0, used = 0;
+    esp_err_t ret = esp_littlefs_info("littlefs", &total, &used);
+    char buffer[128];
+    if (ret != ESP_OK) {
+        snprintf(buffer, sizeof(buffer), "获取 LittleFS 信息失败: %s", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "%s", buffer);
+        urgentPublishDebugLog(buffer);
+        return true;
+    }
+    ESP_LOGI(TAG, "LittleFS 总容量: %d 字节, 已用: %d 字节", total, used);
+    size_t free = total > used ? total - used : 0;
+    if (len + CONFIG_FS_RESERVE <= free) {
+        return true;
+    }
+    snprintf(buffer, sizeof(buffer), "配置%u字节, LittleFS只剩%u字节(要留%u), 放不下, 继续使用当前配置",
+             len, free, CONFIG_FS_RESERVE);
+    ESP_LOGE(TAG, "%s", buffer);
+    urgentPublishDebugLog(buffer);
+    return false;
+}
+
+// 新配置或回滚之后的加载任务还没跑完. 这期间再来的推送和回滚都直接拒绝, 不然会有两个加载任务同时跑;
+// 只在工作任务里置位, 加载任务跑完清掉
+static std::atomic<bool> config_reloading{false};
+
+static bool reject_while_reloading() {
+    if (!config_reloading.load()) {
+        return false;
+    }
+    ESP_LOGW(TAG, "上一份配置还在加载, 忽略这次配置操作");
+    urgentPublishDebugLog("上一份配置还在加载, 请稍后再试");
+    return true;
+}
+
+// 后台加载当前槽的配置, 完了重新注册; settle_ms是加载前先等的时间
+static void reload_config(const char* task_name, uint32_t settle_ms) {
+    config_reloading.store(true);
+    BaseType_t ret = xTaskCreate([](void *param) {
+        uint32_t settle_ms = reinterpret_cast<uintptr_t>(param);
+        if (settle_ms) {
+            printCurrentFreeMemory();
+            vTaskDelay(settle_ms / portTICK_PERIOD_MS);
+            printCurrentFreeMemory();
+        }
+        parseLocalLogicConfig();
+        vTaskDelay(2000 / portTICK_PERIOD_MS);   // 等物理查询结果
+        register_the_rcu();
+        config_reloading.store(false);
+        vTaskDelete(nullptr);
+    }, task_name, 8192, reinterpret_cast<void*>(static_cast<uintptr_t>(settle_ms)), 3, nullptr);
+    if (ret != pdPASS) {
+        config_reloading.store(false);
+        ESP_LOGE(TAG, "创建%s任务失败", task_name);
+    }
+}
+
+// 后台批量下发时经常重发同一份配置, 和已经加载生效的一样就不重新加载, 只回一条日志并重新注册
+static bool skip_unchanged_config(const ConfigHash& hash) {
+    auto& slots = ConfigSlots::getInstance();
+    ConfigSlots::Slot active;
+    ConfigHash loaded;
+    if (!slots.active(active) || active.hash != hash || !slots.loaded(loaded) || loaded != hash) {
+        return false;
+    }
+    ESP_LOGI(TAG, "配置没变(%.16s), 跳过", hash.hex().c_str());
+    m_mqtt_config_unchanged.inc();
+    urgentPublishDebugLog("配置没变, 跳过");
+    register_the_rcu();
+    return true;
+}
+
+// 新配置已经整个写进暂存文件, 校验通过就换进不在用的槽、切过去并重新加载, 不然继续用当前配置
+static void commit_new_config() {
+    auto& slots = ConfigSlots::getInstance();
+    if (reject_while_reloading()) {             // 接收分片期间可能来过回滚
+        slots.abort();
         return;
     }
+    if (!slots.commit()) {
+        slots.abort();
+        urgentPublishDebugLog("新配置校验失败, 继续使用当前配置");
+        return;
+    }
+    ESP_LOGI(TAG, "成功保存到文件, 5秒后应用配置");
+    reload_config("parsejson", 3000);
+}
+
+// 超过MQTT缓冲的消息会拆成好几个MQTT_EVENT_DATA送来, 只有配置会这么大.
+// 配置的分片按顺序直接写进暂存文件, 边写边算哈希, 整份配置不用放在内存里.
+// 大小的上限是littlefs的剩余空间: 第一个分片就按total_data_len检查, 放不下直接拒绝
+static struct {
+    bool writing = false;
+    size_t received = 0;
+    size_t total = 0;
+} config_rx;
 
-    json obj;   
-    try {
-        obj = json::parse(lines[0]);
-    } catch (const std::exception& e) {
-        ESP_LOGW(TAG, "JSON 解析失败: %s", e.what());
+static void abort_config_rx() {
+    if (config_rx.writing) {
+        ConfigSlots::getInstance().abort();
+        config_rx.writing = false;
+    }
+}
+
+// 在工作任务里按顺序执行, 第一个分片已经在mqtt任务里确认过是配置
+static void handle_config_fragment(const char* data, size_t len, size_t offset, size_t total) {
+    auto& slots = ConfigSlots::getInstance();
+    if (offset == 0) {
+        abort_config_rx();
+        ESP_LOGI(TAG, "通过MQTT分片接收 JSON 配置数据, 共%u字节", total);
+        if (reject_while_reloading() || !littlefs_fits_config(total)) {
+            return;
+        }
+        if (!slots.beginWrite()) {
+            slots.abort();
+            urgentPublishDebugLog("保存新配置失败, 继续使用当前配置");
+            return;
+        }
+        config_rx = {true, 0, total};
+    }
+    if (!config_rx.writing) {
         return;
     }
+    if (offset != config_rx.received || total != config_rx.total) {
+        ESP_LOGE(TAG, "配置分片不连续(收到%u, 应为%u), 放弃", offset, config_rx.received);
+        abort_config_rx();
+        urgentPublishDebugLog("配置分片不连续, 继续使用当前配置");
+        return;
+    }
+    if (!slots.write(data, len)) {
+        abort_config_rx();
+        urgentPublishDebugLog("保存新配置失败, 继续使用当前配置");
+        return;
+    }
+    config_rx.received += len;
+    if (config_rx.received < total) {
+        return;
+    }
+    config_rx.writing = false;
 
-    if (obj.empty()) {
-        ESP_LOGW(TAG, "解析后的 JSON 是空的");
+    // 收完才知道是不是重发的同一份配置; 写的只是暂存文件, 两个槽和槽表都没动过, 删掉暂存文件就行
+    ConfigHash hash;
+    if (slots.writtenHash(hash) && skip_unchanged_config(hash)) {
+        slots.abort();
         return;
     }
+    commit_new_config();
+}
 
-    auto it = obj.begin();
-    std::string_view key = it.key();
-    const json& value = it.value();
+// ================ 下行消息的处理函数, 都在工作任务里执行 ================
 
-    std::string type = value.get<std::string>();
+static void on_urge(std::string_view body) {
+    report_states();
+}
 
-    try {
-        const std::string& data_type = obj["type"];
-        if (key == "type") {
-            if (type == "urge") {
-                report_states();
-                return;
-            } else if (type == "ctl") {
-                if (auto msg = json::parse(lines[1]); msg.is_object()) {
-                    std::string dev_type = msg.value("devicetype", "");
-                    uint16_t dev_did = static_cast<uint16_t>(std::stoi(msg.value("deviceid", "-1")));
-                    std::string operation = msg.value("operation", "");
-                    std::string parameter;
-                    if (msg.contains("param")) {
-                        if (msg["param"].is_string()) {
-                            parameter = msg["param"];
-                        } else if (msg["param"].is_number()) {
-                            parameter = std::to_string(msg["param"].get<int>());
-                        }
-                    }
+// param可以是字符串也可以是数字
+static std::string ctl_param(yyjson_val* obj) {
+    yyjson_val* param = yyjson_obj_get(obj, "param");
+    if (yyjson_is_str(param)) {
+        return std::string(yyjson_get_str(param), yyjson_get_len(param));
+    } else if (yyjson_is_num(param)) {
+        return std::to_string(static_cast<int>(yyjson_get_num(param)));
+    }
+    return {};
+}
 
-                    if (dev_type == "mode") {
-                        for (auto* mode : LordManager::instance().getAllModeActionGroup()) {
-                            if (mode->getName() == operation) {
-                                ESP_LOGI_CYAN(TAG, "后台调用[%s]", mode->getName().c_str());
-                                mode->executeAllAtomicAction();
-                            }
-                        }
-                    } else {
-                        if (auto* dev = LordManager::instance().getDeviceByDid(dev_did)) {
-                            dev->execute(operation, parameter);
-                            // 后台单控完设备后要同步那个设备可能存在的按键指示灯
-                            IndicatorHolder::getInstance().callAllAndClear();
-                        }
-                    }
-                }
-                return;
-            } else if (type == "ota") {
-                auto msg = json::parse(lines[1]);
-                if (msg.is_object()) {
-                    if (msg.contains("ver") && msg["ver"].is_string() &&
-                        msg.contains("url") && msg["url"].is_string()) {
-                        const std::string ver = msg["ver"].get<std::string>();
-                        const std::string ota_url = msg["url"].get<std::string>();
-                        if (ver != AETHORAC_VERSION) {
-                            ESP_LOGI(TAG, "OTA: %s -> %s", AETHORAC_VERSION, ver.c_str());
-                            start_ota_upgrade(ota_url);
-                        } else {
-                            ESP_LOGI(TAG, "Same version, skip OTA.");
-                            urgentPublishDebugLog("OTA版本相同, 跳过升级");
-                        }
-                    }
-                }
-                return;
-            } else if (type == "oracle") {
-                ESP_LOGI("ORACLE", "mqtt: %s", lines[1].data());
-                auto msg = json::parse(lines[1]);
-
-                if (msg.is_object()) {
-                    if (msg.contains("operation") && msg["operation"].is_string()) {
-                        std::string operation = msg["operation"].get<std::string>();
-                        // 查stm32版本号
-                        if (operation == "stm32_version") {
-                            sendStm32Cmd(0xFF, 00, 00, 00, 00);
-                        }
-                        // 指定继电器进入测试模式
-                        else if (operation == "stm32_test") {
-                            if (msg.contains("target") && msg["target"].is_string()
-                            && msg.contains("state") && msg["state"].is_string()) {
-                                std::string target = msg["target"].get<std::string>();
-                                std::string state = msg["state"].get<std::string>();
-
-                                sendStm32Cmd(0x07, std::stoi(target), std::stoi(state), 00, 00);
-                            }
-                        }
-                        // 重定向控制台到mqtt
-                        else if (operation == "air_log") {
-                            if (msg.contains("state") && msg["state"].is_string()) {
-                                std::string state = msg["state"].get<std::string>();
-                                int state_int = std::stoi(state);
-
-                                if (state_int == 1) {
-                                    if (!orig_vprintf) {
-                                        orig_vprintf = esp_log_set_vprintf(my_log_send_func);
-                                    } else {
-                                        esp_log_set_vprintf(my_log_send_func);
-                                    }
-                                    ESP_LOGI(TAG, "日志已重定向至mqtt: %s", log_topic);
-                                } else if (orig_vprintf) {
-                                    esp_log_set_vprintf(orig_vprintf);
-                                    ESP_LOGI(TAG, "日志已重定向至初始值");
-                                }
-                            }
-                        }
-                        // 查询固件信息
-                        else if (operation == "ver") {
-                            xTaskCreate([](void *param) {
-                                vTaskDelay(pdMS_TO_TICKS(1000));
-                                report_firmware_status("");
-                                vTaskDelete(nullptr);
-                            }, "report_fireware_status_task", 4096, nullptr, 3, nullptr);
-                        }
-                        // 开关rs485日志打印
-                        else if (operation == "rs485_print") {
-                            if (msg.contains("state") && msg["state"].is_string()) {
-                                std::string state = msg["state"].get<std::string>();
-                                int state_int = std::stoi(state);
-
-                                if (state_int == 1) {
-                                    global_RS485_log_enable_flag = true;
-                                } else {
-                                    global_RS485_log_enable_flag = false;
-                                }
-                            }
-                        }
-                        // 开关stm32日志打印
-                        else if (operation == "stm32_print") {
-                            if (msg.contains("state") && msg["state"].is_string()) {
-                                std::string state = msg["state"].get<std::string>();
-                                int state_int = std::stoi(state);
-
-                                if (state_int == 1) {
-                                    global_STM32_log_enable_flag = true;
-                                } else {
-                                    global_STM32_log_enable_flag = false;
-                                }
-                            }
-                        }
-                        // 控制干接点输入
-                        else if (operation == "input_channel_ctl") {
-                            if (msg.contains("target") && msg["target"].is_string() &&
-                                msg.contains("state") && msg["state"].is_string()) {
-                                std::string target = msg["target"].get<std::string>();
-                                int target_int = std::stoi(target);
-                                
-                                std::string state = msg["state"].get<std::string>();
-                                int state_int = std::stoi(state);
-
-                                uart_frame_t frame;
-                                build_frame(CMD_DRYCONTACT_INPUT, 0x00, target_int, state_int, 0x00, &frame);
-                                handle_response(&frame);
-                            }
-                        }
-                        // 重启
-                        else if (operation == "restart") {
-                            ESP_LOGI(TAG, "收到重启命令, 准备重启");
-                            vTaskDelay(pdMS_TO_TICKS(2000));
-                            esp_restart();
-                        }
-                    }
-                }
-                return;
-            } else if (type == "GET_FILE") {
-                ESP_LOGI(TAG, "通过MQTT收到 GET_FILE 命令");
-                int file_fd = open(LOGIC_CONFIG_FILE_PATH, O_RDONLY);
-                if (file_fd < 0) {
-                    ESP_LOGE(TAG, "读取文件失败");
-                    std::string error_msg = "ERROR: File not found\n";
-                    mqtt_publish_message(error_msg, 1, 0);
-                } else {
-                    char file_buf[1024];
-                    ssize_t read_bytes;
-                    std::string file_data;
-                    // 分段读取文件内容
-                    while ((read_bytes = read(file_fd, file_buf, sizeof(file_buf))) > 0) {
-                        file_data.append(file_buf, read_bytes);
-                    }
-                    close(file_fd);
-                    // 结束标识
-                    mqtt_publish_message(file_data, 1, 0);
-                }
-                return;
-            } else if (type == "room_info") {
-                auto msg = json::parse(lines[1]);
-                if (msg.is_object()) {
-                    ESP_LOGI(TAG, "收到房间信息数据");
-                    if (msg.contains("hotel_name") && msg["hotel_name"].is_string() &&
-                        msg.contains("room_name") && msg["room_name"].is_string()) {
-                        
-                        std::string hotel_name = msg["hotel_name"].get<std::string>();
-                        std::string room_name = msg["room_name"].get<std::string>();
-
-                        ESP_LOGI(TAG, "hotel_name: %s, room_name: %s", hotel_name.c_str(), room_name.c_str());
-
-                        nvs_handle_t handle;
-                        esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
-                        if (err != ESP_OK) {
-                            ESP_LOGE(TAG, "打开 NVS 句柄失败: %s", esp_err_to_name(err));
-                            return;
-                        }
-                        err = nvs_set_str(handle, "hotel_name", hotel_name.c_str());
-                        if (err != ESP_OK) {
-                            ESP_LOGE(TAG, "写入 hotel_name 失败: %s", esp_err_to_name(err));
-                            return;
-                        }
-                        err = nvs_set_str(handle, "room_name", room_name.c_str());
-                        if (err != ESP_OK) {
-                            ESP_LOGE(TAG, "写入 room_name 失败: %s", esp_err_to_name(err));
-                            return;
-                        }
-                        err = nvs_commit(handle);
-                        if (err != ESP_OK) {
-                            ESP_LOGE(TAG, "提交数据失败: %s", esp_err_to_name(err));
-                            return;
-                        }
-                        nvs_close(handle);
-                        register_the_rcu();
-                    }
+// 一条ctl里带"items":[{deviceid, operation, param}, ...]时, 拼成一个临时动作组一次执行完,
+// 所有动作在工作任务里背靠背下发, 指示灯只在最后刷一次, 状态变化也落在同一次合并上报里;
+// 执行完回一条ctl_ack, 带每一项的结果和耗时. 模式本身就是动作组, 不能放进items; 延时项直接回错误
+static void on_ctl_batch(yyjson_val* msg, yyjson_val* items) {
+    auto& lord = LordManager::instance();
+    int64_t start_us = esp_timer_get_time();
+    json results = json::array();
+    std::vector<AtomicAction> actions;
+    std::vector<size_t> result_of;                  // 每个动作对应results里的第几项
+    size_t idx, max;
+    yyjson_val* item;
+    yyjson_arr_foreach(items, idx, max, item) {
+        json result;
+        int did = -1;
+        field_int(item, "deviceid", did);
+        const char* operation = json_get_str_safe(item, "operation");
+        result["deviceid"] = did;
+        result["operation"] = operation;
+        IDevice* dev = did >= 0 ? lord.getDeviceByDid(static_cast<uint16_t>(did)) : nullptr;
+        if (idx >= CTL_BATCH_MAX) {
+            result["error"] = "too many items";
+        } else if (!dev) {
+            result["error"] = "no device";
+        } else {
+            AtomicAction action = compileAtomicAction(dev, operation, ctl_param(item), false);
+            if (action.op == Opcode::NONE) {
+                result["error"] = "bad operation";
+            } else if (action.op == Opcode::DELAY) {
+                // 临时动作组在工作任务里一口气执行完, 不能挂起, 延时做不到就不能回ok
+                result["error"] = "delay not supported";
+            } else {
+                actions.push_back(action);
+                result_of.push_back(results.size());
+            }
+        }
+        result["ok"] = false;
+        results.push_back(std::move(result));
+    }
+
+    if (!actions.empty()) {
+        ESP_LOGI_CYAN(TAG, "后台批量控制, %u项, 有效%u项", results.size(), actions.size());
+        ActionGroup group(CTL_BATCH_AID, "ctl_batch", false, std::move(actions));
+        std::vector<int64_t> step_us;
+        group.runInline(step_us);
+        for (size_t i = 0; i < step_us.size(); i++) {
+            json& result = results[result_of[i]];
+            if (step_us[i] < 0) {
+                result["error"] = "cancelled";
+            } else {
+                result["ok"] = true;
+                result["us"] = step_us[i];
+            }
+        }
+    }
+
+    json ack;
+    ack["mac"] = getSerialNum();
+    ack["type"] = "ctl_ack";
+    if (yyjson_val* id = yyjson_obj_get(msg, "id")) {
+        if (yyjson_is_str(id)) {
+            ack["id"] = yyjson_get_str(id);
+        } else if (yyjson_is_num(id)) {
+            ack["id"] = static_cast<int64_t>(yyjson_get_num(id));
+        }
+    }
+    ack["results"] = std::move(results);
+    ack["total_us"] = esp_timer_get_time() - start_us;
+    mqtt_publish_message(ack.dump(), 1, 0);
+}
+
+static void on_ctl(std::string_view body) {
+    IngestLine line(body);
+    if (yyjson_val* msg = line.object()) {
+        yyjson_val* items = yyjson_obj_get(msg, "items");
+        if (yyjson_is_arr(items)) {
+            on_ctl_batch(msg, items);
+            return;
+        }
+        const char* dev_type = json_get_str_safe(msg, "devicetype");
+        int dev_did = -1;
+        field_int(msg, "deviceid", dev_did);
+        const char* operation = json_get_str_safe(msg, "operation");
+        std::string parameter = ctl_param(msg);
+
+        if (strcmp(dev_type, "mode") == 0) {
+            for (auto* mode : LordManager::instance().getAllModeActionGroup()) {
+                if (strcmp(mode->getName(), operation) == 0) {
+                    ESP_LOGI_CYAN(TAG, "后台调用[%s]", mode->getName());
+                    mode->executeAllAtomicAction();
                 }
-                return;
-            } else if (type == "air_cfg") {
-                auto msg = json::parse(lines[1]);
-                if (msg.is_object()) {
-                    ESP_LOGI(TAG, "通过网络收到空调配置");
-                    auto& air_config = AirConGlobalConfig::getInstance();
-                    bool changed = false;
-
-                    if (msg.contains("defaultTargetTemp") && msg["defaultTargetTemp"].is_number_integer()) {
-                        air_config.default_target_temp = static_cast<uint8_t>(msg["defaultTargetTemp"].get<int>());
-                        changed = true;
-                    }
-                    if (msg.contains("defaultMode") && msg["defaultMode"].is_number_integer()) {
-                        air_config.default_mode = static_cast<ACMode>(msg["defaultMode"].get<int>());
-                        changed = true;
-                    }
-                    if (msg.contains("defaultFanSpeed") && msg["defaultFanSpeed"].is_number_integer()) {
-                        air_config.default_fan_speed = static_cast<ACFanSpeed>(msg["defaultFanSpeed"].get<int>());
-                        changed = true;
-                    }
-                    if (msg.contains("stopThreshold") && msg["stopThreshold"].is_number_integer()) {
-                        air_config.stop_threshold = static_cast<uint8_t>(msg["stopThreshold"].get<int>());
-                        changed = true;
-                    }
-                    if (msg.contains("reworkThreshold") && msg["reworkThreshold"].is_number_integer()) {
-                        air_config.rework_threshold = static_cast<uint8_t>(msg["reworkThreshold"].get<int>());
-                        changed = true;
-                    }
-                    if (msg.contains("stopAction") && msg["stopAction"].is_number_integer()) {
-                        air_config.stop_action = static_cast<ACStopAction>(msg["stopAction"].get<int>());
-                        changed = true;
-                    }
-                    if (msg.contains("shutdownAfterDuration") && msg["shutdownAfterDuration"].is_number_integer()) {
-                        air_config.shutdown_after_duration = static_cast<uint16_t>(msg["shutdownAfterDuration"].get<int>());
-                        changed = true;
-                    }
-                    if (msg.contains("shutdownAfterFanSpeed") && msg["shutdownAfterFanSpeed"].is_number_integer()) {
-                        air_config.shutdown_after_fan_speed = static_cast<ACFanSpeed>(msg["shutdownAfterFanSpeed"].get<int>());
-                        changed = true;
-                    }
-                    if (msg.contains("removeCardAirUsable") && msg["removeCardAirUsable"].is_boolean()) {
-                        air_config.remove_card_air_usable = msg["removeCardAirUsable"].get<bool>();
-                        changed = true;
-                    }
-                    // 嵌套 autoFan
-                    if (msg.contains("autoFan") && msg["autoFan"].is_object()) {
-                        const auto& af = msg["autoFan"];
-                        if (af.contains("lowFanTempDiff") && af["lowFanTempDiff"].is_number_integer()) {
-                            air_config.low_diff = static_cast<uint8_t>(af["lowFanTempDiff"].get<int>());
-                            changed = true;
-                        }
-                        if (af.contains("highFanTempDiff") && af["highFanTempDiff"].is_number_integer()) {
-                            air_config.high_diff = static_cast<uint8_t>(af["highFanTempDiff"].get<int>());
-                            changed = true;
-                        }
-                        if (af.contains("autoVentFanSpeed") && af["autoVentFanSpeed"].is_number_integer()) {
-                            air_config.auto_fun_wind_speed = static_cast<ACFanSpeed>(af["autoVentFanSpeed"].get<int>());
-                            changed = true;
-                        }
-                    }
+            }
+        } else {
+            if (auto* dev = LordManager::instance().getDeviceByDid(static_cast<uint16_t>(dev_did))) {
+                dev->executeByName(operation, parameter);
+                // 后台单控完设备后要同步那个设备可能存在的按键指示灯
+                IndicatorHolder::getInstance().requestFlush();
+            }
+        }
+    }
+}
+
+static void on_ota(std::string_view body) {
+    IngestLine line(body);
+    if (yyjson_val* msg = line.object()) {
+        const char* ver = json_get_str_safe(msg, "ver", nullptr);
+        const char* ota_url = json_get_str_safe(msg, "url", nullptr);
+        if (ver && ota_url) {
+            if (strcmp(ver, AETHORAC_VERSION) != 0) {
+                ESP_LOGI(TAG, "OTA: %s -> %s", AETHORAC_VERSION, ver);
+                start_ota_upgrade(ota_url);
+            } else {
+                ESP_LOGI(TAG, "Same version, skip OTA.");
+                urgentPublishDebugLog("OTA版本相同, 跳过升级");
+            }
+        }
+    }
+}
 
-                    if (changed) {
-                        esp_err_t err = air_config.save();
-                        if (err == ESP_OK) {
-                            ESP_LOGI(TAG, "空调配置已更新并保存");
-                            air_config.load();  // 重新应用
-                        } else {
-                            ESP_LOGE(TAG, "空调配置保存失败: %s", esp_err_to_name(err));
-                        }
+static void on_oracle(std::string_view body) {
+    ESP_LOGI("ORACLE", "mqtt: %.*s", (int)body.size(), body.data());
+    IngestLine line(body);
+    yyjson_val* msg = line.object();
+    const char* operation = msg ? json_get_str_safe(msg, "operation", nullptr) : nullptr;
+    if (operation) {
+        int target = 0;
+        int state = 0;
+        bool has_target = field_int(msg, "target", target);
+        bool has_state = field_int(msg, "state", state);
+        // 查stm32版本号
+        if (strcmp(operation, "stm32_version") == 0) {
+            sendStm32Cmd(0xFF, 00, 00, 00, 00);
+        }
+        // 指定继电器进入测试模式
+        else if (strcmp(operation, "stm32_test") == 0) {
+            if (has_target && has_state) {
+                sendStm32Cmd(0x07, target, state, 00, 00);
+            }
+        }
+        // 重定向控制台到mqtt
+        else if (strcmp(operation, "air_log") == 0) {
+            if (has_state) {
+                if (state == 1) {
+                    if (!orig_vprintf) {
+                        orig_vprintf = esp_log_set_vprintf(my_log_send_func);
                     } else {
-                        ESP_LOGI(TAG, "空调配置未变化或无有效字段");
+                        esp_log_set_vprintf(my_log_send_func);
                     }
+                    ESP_LOGI(TAG, "日志已重定向至mqtt: %s", log_topic);
+                } else if (orig_vprintf) {
+                    esp_log_set_vprintf(orig_vprintf);
+                    ESP_LOGI(TAG, "日志已重定向至初始值");
                 }
+            }
+        }
+        // 查询固件信息
+        else if (strcmp(operation, "ver") == 0) {
+            xTaskCreate([](void *param) {
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                report_firmware_status("");
+                vTaskDelete(nullptr);
+            }, "report_fireware_status_task", 4096, nullptr, 3, nullptr);
+        }
+        // 开关rs485日志打印
+        else if (strcmp(operation, "rs485_print") == 0) {
+            if (has_state) {
+                global_RS485_log_enable_flag = state == 1;
+            }
+        }
+        // 开关stm32日志打印
+        else if (strcmp(operation, "stm32_print") == 0) {
+            if (has_state) {
+                global_STM32_log_enable_flag = state == 1;
+            }
+        }
+        // 控制干接点输入
+        else if (strcmp(operation, "input_channel_ctl") == 0) {
+            if (has_target && has_state) {
+                uart_frame_t frame;
+                build_frame(CMD_DRYCONTACT_INPUT, 0x00, target, state, 0x00, &frame);
+                handle_response(&frame);
+            }
+        }
+        // 查看动作组执行池的排队与饱和情况
+        else if (strcmp(operation, "ag_pool") == 0) {
+            logActionExecutorStats();
+        }
+        // 导出最近的动作组执行记录与耗时直方图, 带"clear":"1"则导出后清空
+        else if (strcmp(operation, "scene_trace") == 0) {
+            mqtt_publish_message(generateSceneTraces().dump(), 0, 0);
+            if (strcmp(json_get_str_safe(msg, "clear"), "1") == 0) {
+                SceneTracer::getInstance().clear();
+            }
+        }
+        // 查看日志上报的行数、丢弃与截断
+        else if (strcmp(operation, "log_shipper") == 0) {
+            auto st = LogShipper::getInstance().getStats();
+            ESP_LOGI(TAG, "日志上报: 写入%lu行, 已发%lu行/%lu条消息, 丢弃%lu行, 截断%lu行",
+                     st.lines, st.shipped, st.batches, st.dropped, st.truncated);
+        }
+        // 导出运行时指标
+        else if (strcmp(operation, "metrics") == 0) {
+            publish_metrics();
+        }
+        // 查看告警通道的发送与确认情况
+        else if (strcmp(operation, "alarm") == 0) {
+            auto st = AlarmChannel::getInstance().getStats();
+            ESP_LOGI(TAG, "告警: 触发%lu条, 已确认%lu条, 待发%lu条, 发布%lu次, 挤掉%lu条, 最近一条确认耗时%lums",
+                     st.raised, st.acked, st.pending, st.attempts, st.dropped, st.last_ack_ms);
+        }
+        // 测操作日志环形缓冲的追加耗时, 可带"n":"次数", 默认10000
+        else if (strcmp(operation, "oplog_bench") == 0) {
+            int n = 10000;
+            field_int(msg, "n", n);
+            mqtt_publish_message(benchOpLogAppend(n).dump(), 0, 0);
+        }
+        // 对比下行消息用yyjson和nlohmann解析的耗时与堆占用, 可带"n":"次数", 默认1000
+        else if (strcmp(operation, "ingest_bench") == 0) {
+            int n = 1000;
+            field_int(msg, "n", n);
+            mqtt_publish_message(benchMqttIngest(n).dump(), 0, 0);
+        }
+        // 重启
+        else if (strcmp(operation, "restart") == 0) {
+            ESP_LOGI(TAG, "收到重启命令, 准备重启");
+            vTaskDelay(pdMS_TO_TICKS(2000));
+            esp_restart();
+        }
+    }
+}
+
+static void on_get_file(std::string_view body) {
+    // 第二行可选: {"file": "config"/"journal"/"traces", "offset": 续传的起点}, 不带就是从头传配置
+    const char* file = "config";
+    int offset = 0;
+    IngestLine line(body);
+    if (yyjson_val* msg = line.object()) {
+        file = json_get_str_safe(msg, "file", file);
+        field_int(msg, "offset", offset);
+    }
+    ESP_LOGI(TAG, "通过MQTT收到 GET_FILE 命令: %s, 从%d字节开始", file, offset);
+    auto& uploader = FileUploader::getInstance();
+    uploader.start(publish_qos1);
+    uploader.request(file, std::max(offset, 0));
+}
+
+static void on_room_info(std::string_view body) {
+    IngestLine line(body);
+    if (yyjson_val* msg = line.object()) {
+        ESP_LOGI(TAG, "收到房间信息数据");
+        const char* hotel_name = json_get_str_safe(msg, "hotel_name", nullptr);
+        const char* room_name = json_get_str_safe(msg, "room_name", nullptr);
+        if (hotel_name && room_name) {
+            ESP_LOGI(TAG, "hotel_name: %s, room_name: %s", hotel_name, room_name);
+
+            nvs_handle_t handle;
+            esp_err_t err = nvs_open("storage", NVS_READWRITE, &handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "打开 NVS 句柄失败: %s", esp_err_to_name(err));
                 return;
-            } else if (type == "wifi_cfg") {
-                auto msg = json::parse(lines[1]);
-                if (msg.is_object()) {
-                    ESP_LOGI(TAG, "通过网络收到WiFi配置");
-                    if (msg.contains("ssid") && msg["ssid"].is_string() &&
-                        msg.contains("pass") && msg["pass"].is_string()) {
-                            save_wifi_credentials(msg["ssid"].get<std::string>().c_str(),
-                                                msg["pass"].get<std::string>().c_str());
-                    }
-                }
+            }
+            err = nvs_set_str(handle, "hotel_name", hotel_name);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "写入 hotel_name 失败: %s", esp_err_to_name(err));
                 return;
-            } else if (type == "change_net_type") {
-                auto msg = json::parse(lines[1]);
-                if (msg.is_object()) {
-                    ESP_LOGI(TAG, "通过网络收到更改网络驱动请求");
-                    if (msg.contains("target") && msg["target"].is_string()) {
-                        auto val = msg["target"].get<std::string>();
-                        if (val == "1") {
-                            change_network_type_and_reboot(NET_TYPE_WIFI);
-                        } else if (val == "2") {
-                            change_network_type_and_reboot(NET_TYPE_ETHERNET);
-                        } else {
-                            ESP_LOGE(TAG, "错误参数: %s", val.c_str());
-                        }
-                    }
-                }
+            }
+            err = nvs_set_str(handle, "room_name", room_name);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "写入 room_name 失败: %s", esp_err_to_name(err));
                 return;
-            } else if (type == "Laminor2") {
-                ESP_LOGI(TAG, "通过MQTT收到 JSON 配置数据");
-                char buffer[128];
-                size_t total = 0, used = 0;
-                esp_err_t ret = esp_littlefs_info("littlefs", &total, &used);
-                if (ret == ESP_OK) {
-                    ESP_LOGI(TAG, "LittleFS 总容量: %d 字节, 已用: %d 字节", total, used);
-                } else {
-                    snprintf(buffer, sizeof(buffer), "获取 LittleFS 信息失败: %s", esp_err_to_name(ret));
-                    ESP_LOGE(TAG, "%s", buffer);
-                    urgentPublishDebugLog(buffer);
-                }
-
-                int file_fd = open(LOGIC_CONFIG_FILE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-                if (file_fd < 0) {
-                    snprintf(buffer, sizeof(buffer), "打开文件失败: %s", strerror(errno));
-                    ESP_LOGE(TAG, "%s", buffer);
-                    urgentPublishDebugLog(buffer);
-                } else {
-                    ssize_t bytes_written = write(file_fd, data, data_len);
-                    if (bytes_written < 0) {
-                        snprintf(buffer, sizeof(buffer), "写入文件失败: %s %d", strerror(errno), errno);
-                        ESP_LOGE(TAG, "%s", buffer);
-                        urgentPublishDebugLog(buffer);
-                    } else {
-                        ESP_LOGI(TAG, "成功保存到文件, 5秒后应用配置");
-            
-                        xTaskCreate([](void *param) {
-                            printCurrentFreeMemory();
-                            vTaskDelay(3000 / portTICK_PERIOD_MS);
-                            printCurrentFreeMemory();
-                            parseLocalLogicConfig();
-                            vTaskDelay(2000 / portTICK_PERIOD_MS);   // 等物理查询结果
-                            register_the_rcu();
-                            vTaskDelete(nullptr);
-                        }, "parsejson", 8192, nullptr, 3, nullptr);
-                    }
-                    close(file_fd);
-                }
+            }
+            err = nvs_commit(handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "提交数据失败: %s", esp_err_to_name(err));
                 return;
-            } else if (type == "restart") {
-                esp_restart();
+            }
+            nvs_close(handle);
+            register_the_rcu();
+        }
+    }
+}
+
+static void on_air_cfg(std::string_view body) {
+    IngestLine line(body);
+    if (yyjson_val* msg = line.object()) {
+        ESP_LOGI(TAG, "通过网络收到空调配置");
+        auto& air_config = AirConGlobalConfig::getInstance();
+        bool changed = false;
+        // 字段存在且是整数才覆盖
+        auto take_int = [&changed](yyjson_val* obj, const char* key, auto& field) {
+            yyjson_val* v = yyjson_obj_get(obj, key);
+            if (yyjson_is_int(v)) {
+                field = static_cast<std::remove_reference_t<decltype(field)>>(yyjson_get_int(v));
+                changed = true;
+            }
+        };
+
+        take_int(msg, "defaultTargetTemp", air_config.default_target_temp);
+        take_int(msg, "defaultMode", air_config.default_mode);
+        take_int(msg, "defaultFanSpeed", air_config.default_fan_speed);
+        take_int(msg, "stopThreshold", air_config.stop_threshold);
+        take_int(msg, "reworkThreshold", air_config.rework_threshold);
+        take_int(msg, "stopAction", air_config.stop_action);
+        take_int(msg, "shutdownAfterDuration", air_config.shutdown_after_duration);
+        take_int(msg, "shutdownAfterFanSpeed", air_config.shutdown_after_fan_speed);
+        if (yyjson_val* v = yyjson_obj_get(msg, "removeCardAirUsable"); yyjson_is_bool(v)) {
+            air_config.remove_card_air_usable = yyjson_get_bool(v);
+            changed = true;
+        }
+        // 嵌套 autoFan
+        if (yyjson_val* af = yyjson_obj_get(msg, "autoFan"); yyjson_is_obj(af)) {
+            take_int(af, "lowFanTempDiff", air_config.low_diff);
+            take_int(af, "highFanTempDiff", air_config.high_diff);
+            take_int(af, "autoVentFanSpeed", air_config.auto_fun_wind_speed);
+        }
+
+        if (changed) {
+            esp_err_t err = air_config.save();
+            if (err == ESP_OK) {
+                ESP_LOGI(TAG, "空调配置已更新并保存");
+                air_config.load();  // 重新应用
             } else {
-                ESP_LOGE(TAG, "未知的操作类型: %s", type.c_str());
-                return;
+                ESP_LOGE(TAG, "空调配置保存失败: %s", esp_err_to_name(err));
             }
+        } else {
+            ESP_LOGI(TAG, "空调配置未变化或无有效字段");
         }
-    } catch(const std::exception& e) {
-        ESP_LOGE(TAG, "%s: %s\n内容: %s", __func__, e.what(), data);
     }
 }
 
-static volatile bool in_hook = false;
-int my_log_send_func(const char *fmt, va_list args) {
-    if (in_hook) return 0;
-    in_hook = true;
+static void on_wifi_cfg(std::string_view body) {
+    IngestLine line(body);
+    if (yyjson_val* msg = line.object()) {
+        ESP_LOGI(TAG, "通过网络收到WiFi配置");
+        const char* ssid = json_get_str_safe(msg, "ssid", nullptr);
+        const char* pass = json_get_str_safe(msg, "pass", nullptr);
+        if (ssid && pass) {
+            save_wifi_credentials(ssid, pass);
+        }
+    }
+}
 
-    static char logbuf[512];
-    size_t len = vsnprintf(logbuf, sizeof(logbuf), fmt, args);
-    if (len >= sizeof(logbuf)) 
-        len = sizeof(logbuf) - 1;
+static void on_change_net_type(std::string_view body) {
+    IngestLine line(body);
+    if (yyjson_val* msg = line.object()) {
+        ESP_LOGI(TAG, "通过网络收到更改网络驱动请求");
+        if (const char* val = json_get_str_safe(msg, "target", nullptr)) {
+            if (strcmp(val, "1") == 0) {
+                change_network_type_and_reboot(NET_TYPE_WIFI);
+            } else if (strcmp(val, "2") == 0) {
+                change_network_type_and_reboot(NET_TYPE_ETHERNET);
+            } else {
+                ESP_LOGE(TAG, "错误参数: %s", val);
+            }
+        }
+    }
+}
 
-    if (client) {
-        esp_mqtt_client_publish(client, log_topic,
-                                logbuf, len, 0, 0);
+// 配置要原样存下来, 拿到的是整条消息
+static void on_laminor2(std::string_view msg) {
+    ESP_LOGI(TAG, "通过MQTT收到 JSON 配置数据");
+    if (reject_while_reloading() || !littlefs_fits_config(msg.size())) {
+        return;
+    }
+    ConfigHash hash;
+    mbedtls_sha256(reinterpret_cast<const uint8_t*>(msg.data()), msg.size(), hash.bytes, 0);
+    if (skip_unchanged_config(hash)) {
+        return;
+    }
+    // 先写暂存文件, 校验通过才换进不在用的槽并切换
+    auto& slots = ConfigSlots::getInstance();
+    if (slots.beginWrite() && slots.write(msg.data(), msg.size())) {
+        commit_new_config();
+    } else {
+        slots.abort();
+        urgentPublishDebugLog("保存新配置失败, 继续使用当前配置");
+    }
+}
+
+static void on_config_rollback(std::string_view body) {
+    ESP_LOGI(TAG, "通过MQTT收到配置回滚命令");
+    if (reject_while_reloading()) {
+        return;
+    }
+    if (!ConfigSlots::getInstance().rollback()) {
+        urgentPublishDebugLog("没有可回滚的配置");
+    } else {
+        reload_config("rollback", 0);           // 上一份配置的镜像还在, 不用等
+    }
+}
+
+static void on_restart(std::string_view body) {
+    esp_restart();
+}
+
+// 按type查处理函数; whole为true时拿到整条消息, 否则只拿第二行. 每种消息单独统计执行耗时
+struct MqttCommand {
+    const char* type;
+    void (*handler)(std::string_view payload);
+    bool whole;
+    MetricHistogram exec_ms;
+};
+
+#define MQTT_CMD_MS_EDGES {1, 5, 10, 50, 100, 500, 2000}
+static MqttCommand mqtt_commands[] = {
+    {"urge",            on_urge,            false, {"mqtt.cmd.urge_ms", MQTT_CMD_MS_EDGES}},
+    {"ctl",             on_ctl,             false, {"mqtt.cmd.ctl_ms", MQTT_CMD_MS_EDGES}},
+    {"ota",             on_ota,             false, {"mqtt.cmd.ota_ms", MQTT_CMD_MS_EDGES}},
+    {"oracle",          on_oracle,          false, {"mqtt.cmd.oracle_ms", MQTT_CMD_MS_EDGES}},
+    {"GET_FILE",        on_get_file,        false, {"mqtt.cmd.get_file_ms", MQTT_CMD_MS_EDGES}},
+    {"room_info",       on_room_info,       false, {"mqtt.cmd.room_info_ms", MQTT_CMD_MS_EDGES}},
+    {"air_cfg",         on_air_cfg,         false, {"mqtt.cmd.air_cfg_ms", MQTT_CMD_MS_EDGES}},
+    {"wifi_cfg",        on_wifi_cfg,        false, {"mqtt.cmd.wifi_cfg_ms", MQTT_CMD_MS_EDGES}},
+    {"change_net_type", on_change_net_type, false, {"mqtt.cmd.change_net_type_ms", MQTT_CMD_MS_EDGES}},
+    {"Laminor2",        on_laminor2,        true,  {"mqtt.cmd.laminor2_ms", MQTT_CMD_MS_EDGES}},
+    {"config_rollback", on_config_rollback, false, {"mqtt.cmd.config_rollback_ms", MQTT_CMD_MS_EDGES}},
+    {"restart",         on_restart,         false, {"mqtt.cmd.restart_ms", MQTT_CMD_MS_EDGES}},
+};
+static MetricHistogram m_mqtt_fragment_ms("mqtt.cmd.fragment_ms", MQTT_CMD_MS_EDGES);
+
+static MqttCommand* find_command(std::string_view type) {
+    // 只在mqtt任务里调用, 第一次用时建好索引
+    static const auto index = [] {
+        std::unordered_map<std::string_view, MqttCommand*> map;
+        for (auto& cmd : mqtt_commands) {
+            map.emplace(cmd.type, &cmd);
+        }
+        return map;
+    }();
+    auto it = index.find(type);
+    return it == index.end() ? nullptr : it->second;
+}
+
+// mqtt任务只拆出type、拷贝消息、入队, 处理函数都在工作任务里按顺序执行,
+// 执行场景、写flash、发STM32帧、延时都不会卡住mqtt的收发和心跳
+struct MqttJob {
+    enum Kind : uint8_t { COMMAND, FRAGMENT, FRAGMENT_ABORT } kind;
+    MqttCommand* cmd;
+    char* data;                     // 消息或分片的拷贝, 工作任务处理完释放
+    uint32_t len;
+    uint32_t offset;                // 分片在整条消息里的位置
+    uint32_t total;
+    int64_t enqueue_us;
+};
+
+#define MQTT_JOB_QUEUE_LEN      8
+#define MQTT_JOB_BYTES_MAX      (24 * 1024)     // 队列里的拷贝最多占这么多内存, 比MQTT缓冲大一点, 一整条消息总能放进来
+#define MQTT_FRAGMENT_WAIT_MS   5000            // 配置分片等写flash腾出位置的最长时间, 期间mqtt任务不收新数据
+
+static QueueHandle_t mqtt_job_queue = nullptr;
+static std::atomic<size_t> mqtt_job_bytes{0};
+
+static MetricCounter m_mqtt_job_dropped("mqtt.job_dropped");    // 队列满被丢掉的消息
+static MetricHistogram m_mqtt_job_wait_ms("mqtt.job_wait_ms", {1, 5, 10, 50, 100, 500, 2000});
+
+static bool post_job(MqttJob::Kind kind, MqttCommand* cmd, std::string_view payload,
+                     size_t offset = 0, size_t total = 0, uint32_t wait_ms = 0) {
+    if (!mqtt_job_queue) {
+        return false;
     }
+    // 配置分片比写flash来得快时在这里等, 相当于给TCP施加背压; 普通消息不等, 满了就丢
+    int64_t deadline = esp_timer_get_time() + wait_ms * 1000LL;
+    while (mqtt_job_bytes.load(std::memory_order_relaxed) + payload.size() > MQTT_JOB_BYTES_MAX) {
+        if (esp_timer_get_time() >= deadline) {
+            m_mqtt_job_dropped.inc();
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    MqttJob job = {kind, cmd, nullptr, static_cast<uint32_t>(payload.size()),
+                   static_cast<uint32_t>(offset), static_cast<uint32_t>(total), esp_timer_get_time()};
+    if (!payload.empty()) {
+        job.data = static_cast<char*>(malloc(payload.size()));
+        if (!job.data) {
+            m_mqtt_job_dropped.inc();
+            return false;
+        }
+        memcpy(job.data, payload.data(), payload.size());
+    }
+    mqtt_job_bytes.fetch_add(job.len, std::memory_order_relaxed);
+    if (xQueueSend(mqtt_job_queue, &job, pdMS_TO_TICKS(wait_ms)) != pdTRUE) {
+        mqtt_job_bytes.fetch_sub(job.len, std::memory_order_relaxed);
+        free(job.data);
+        m_mqtt_job_dropped.inc();
+        return false;
+    }
+    return true;
+}
+
+static void mqtt_worker_task(void* param) {
+    MqttJob job;
+    while (true) {
+        if (xQueueReceive(mqtt_job_queue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        int64_t start = esp_timer_get_time();
+        m_mqtt_job_wait_ms.record((start - job.enqueue_us) / 1000);
+        switch (job.kind) {
+            case MqttJob::COMMAND:
+                job.cmd->handler({job.data, job.len});
+                job.cmd->exec_ms.record((esp_timer_get_time() - start) / 1000);
+                break;
+            case MqttJob::FRAGMENT:
+                handle_config_fragment(job.data, job.len, job.offset, job.total);
+                m_mqtt_fragment_ms.record((esp_timer_get_time() - start) / 1000);
+                break;
+            case MqttJob::FRAGMENT_ABORT:
+                abort_config_rx();
+                break;
+        }
+        free(job.data);
+        mqtt_job_bytes.fetch_sub(job.len, std::memory_order_relaxed);
+    }
+    vTaskDelete(nullptr);
+}
+
+static void start_mqtt_worker() {
+    if (mqtt_job_queue) {
+        return;
+    }
+    mqtt_job_queue = xQueueCreate(MQTT_JOB_QUEUE_LEN, sizeof(MqttJob));
+    assert(mqtt_job_queue);
+    metrics_watch_queue("mqtt.jobs", mqtt_job_queue);
+    xTaskCreate(mqtt_worker_task, "mqtt_worker", 8192, nullptr, 4, nullptr);
+}
 
-    in_hook = false;
-    return len;
+// 以下在mqtt任务里: 超过缓冲的消息只接收配置, 其它的丢掉
+static bool fragment_wanted = false;
+
+static void cancel_config_rx() {
+    fragment_wanted = false;
+    post_job(MqttJob::FRAGMENT_ABORT, nullptr, {});
+}
+
+static void handle_mqtt_fragment(const char* data, size_t len, size_t offset, size_t total) {
+    if (offset == 0) {
+        // type在第一行, 肯定在第一个分片里
+        std::string_view raw{data, len};
+        char type[32];
+        fragment_wanted = read_message_type(raw.substr(0, raw.find('\n')), type) && strcmp(type, "Laminor2") == 0;
+        if (!fragment_wanted) {
+            ESP_LOGW(TAG, "%u字节的消息超过MQTT缓冲, 只有配置可以分片接收, 丢弃", total);
+            m_mqtt_rx_dropped.inc();
+            return;
+        }
+    }
+    if (fragment_wanted && !post_job(MqttJob::FRAGMENT, nullptr, {data, len}, offset, total, MQTT_FRAGMENT_WAIT_MS)) {
+        ESP_LOGE(TAG, "配置分片排不进队列, 放弃");
+        cancel_config_rx();
+    }
+}
+
+// 在mqtt任务里: 取出type查表, 把要处理的部分拷进队列
+static void handle_mqtt_ndjson(const char* data, size_t data_len) {
+    std::string_view raw{data, data_len};
+    size_t first_end = raw.find('\n');
+    std::string_view head = raw.substr(0, first_end);
+    std::string_view body;
+    if (first_end != std::string_view::npos) {
+        body = raw.substr(first_end + 1);
+        body = body.substr(0, body.find('\n'));
+    }
+
+    if (head.empty()) {
+        ESP_LOGW(TAG, "接收到空行，忽略");
+        return;
+    }
+
+    char type[32];
+    if (!read_message_type(head, type)) {
+        return;
+    }
+    MqttCommand* cmd = find_command(type);
+    if (!cmd) {
+        ESP_LOGE(TAG, "未知的操作类型: %s", type);
+        return;
+    }
+    if (!post_job(MqttJob::COMMAND, cmd, cmd->whole ? raw : body)) {
+        ESP_LOGE(TAG, "命令队列满, 丢弃%s", type);
+    }
+}
+
+// 在LogShipper的发送任务里调用, 一次发一批日志
+static void publish_log_batch(const char* data, size_t len) {
+    if (client && mqtt_connected) {
+        esp_mqtt_client_publish(client, log_topic, data, len, 0, 0);
+    }
+}
+
+void start_alarm_channel() {
+    AlarmChannel::getInstance().start(publish_qos1);
+}
+
+// 上报任务连上mqtt才创建, 在那之前叫醒它的通知直接忽略, 所以订阅可以在开机时就登记
+void subscribe_state_report() {
+    RoomStateStore::getInstance().subscribe(on_room_state_changed);
+}
+
+// 告警和文件块直接以QoS1发到上行主题, 不经过mqtt_publish_message(不拼std::string, 不打印)
+static int publish_qos1(const char* data, size_t len) {
+    if (!client || !mqtt_connected) {
+        return -1;
+    }
+    return esp_mqtt_client_publish(client, up_topic, data, len, 1, 0);
+}
+
+// 日志只进LogShipper的缓冲, 不在调用者的任务里发mqtt; 本地串口照常输出
+int my_log_send_func(const char *fmt, va_list args) {
+    va_list copy;
+    va_copy(copy, args);
+    LogShipper::getInstance().write(fmt, copy);
+    va_end(copy);
+    vprintf_like_t local = orig_vprintf;
+    return local ? local(fmt, args) : vprintf(fmt, args);
 }
 
 static esp_err_t ota_dbg_handler(esp_http_client_event_t *e) {
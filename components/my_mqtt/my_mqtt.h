@@ -6,9 +6,11 @@
 
 void mqtt_app_start();
 void mqtt_app_stop(void);
-void mqtt_publish_message(const std::string& message, int qos, int retain);
+int mqtt_publish_message(const std::string& message, int qos, int retain);     // 返回msg_id, 没发出去返回-1
 
 void report_states();
+void start_alarm_channel();     // 开机时调用, 联网之前触发的SOS也会在连上后发出
+void subscribe_state_report();  // 开机时调用, 房间状态变化时叫醒状态上报任务
 
 int my_log_send_func(const char *fmt, va_list args);
 
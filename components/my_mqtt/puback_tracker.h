@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// 给自己等QoS1确认、同时只有一条在途的发送者用(AlarmChannel, FileUploader, OpJournal)
+// 每个PUBACK都会广播给所有发送者, 别人的PUBACK很多时只记最近一个会把自己的挤掉, 所以:
+// 发出后用expect()登记要等的msg_id, onPublished遇到它就单独记下来, 不会被别人的PUBACK覆盖;
+// PUBACK可能比expect()还早到, 再用一个小环记住最近几个msg_id兜住这段空隙
+// onPublished在mqtt任务里调用, 全是原子操作, 不拿锁
+class PubackTracker {
+public:
+    PubackTracker() {
+        for (auto& id : recent) {
+            id.store(-1, std::memory_order_relaxed);
+        }
+    }
+
+    // MQTT_EVENT_PUBLISHED
+    void onPublished(int msg_id) {
+        uint32_t pos = recent_pos.fetch_add(1);
+        recent[pos % RECENT].store(msg_id);
+        if (awaited.load() == msg_id) {
+            matched.store(msg_id);
+        }
+    }
+
+    // 发布成功拿到msg_id后立即调用; 和onPublished一先一后, 至少有一方能看到另一方
+    void expect(int msg_id) {
+        matched.store(-1);          // msg_id会循环使用, 清掉上一轮的
+        awaited.store(msg_id);
+        if (inRecent(msg_id)) {
+            matched.store(msg_id);
+        }
+    }
+
+    bool isAcked(int msg_id) const {
+        return msg_id >= 0 && (matched.load() == msg_id || inRecent(msg_id));
+    }
+
+private:
+    static constexpr size_t RECENT = 4;
+
+    std::atomic<int> recent[RECENT];
+    std::atomic<uint32_t> recent_pos{0};
+    std::atomic<int> awaited{-1};
+    std::atomic<int> matched{-1};
+
+    bool inRecent(int msg_id) const {
+        for (auto& id : recent) {
+            if (id.load() == msg_id) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
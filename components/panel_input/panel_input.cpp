@@ -3,8 +3,6 @@
 #include "rs485_comm.h"
 #include "indicator.h"
 #include "lord_manager.h"
-#include "drycontact_out.h"
-#include "lamp.h"
 
 #define TAG "PANEL_INPUT"
 PanelButtonInput *last_press_btn;
@@ -24,18 +22,10 @@ void PanelButtonInput::execute() {
             lord.useAliveHeartBeat();
             // 睡眠会将所有指示灯熄灭, 但有些设备实际上并没有被"关"
             // 所以在醒来后, 要再点亮那些设备的指示灯
-            for (auto* dry : lord.getDevicesByType<Lamp>()) {
-                dry->syncAssBtnToDevState();
-            }
-            for (auto* dry : lord.getDevicesByType<SingleRelayDevice>()) {
-                dry->syncAssBtnToDevState();
-            }
-            for (auto* dry : lord.getDevicesByType<DryContactOut>()) {
-                dry->syncAssBtnToDevState();
-            }
+            lord.syncAllAssBtnToDevState();
         }
-        // 在return前发布已注册的指示灯函数
-        IndicatorHolder::getInstance().callAllAndClear();
+        // 在return前刷新已标记的指示灯
+        IndicatorHolder::getInstance().requestFlush();
         return;
     }
 
@@ -47,15 +37,7 @@ void PanelButtonInput::execute() {
     // 无任意键执行时, 也要一次这个
     if (lord.isSleep() && lord.getAlive()) {
         lord.useAliveHeartBeat();
-        for (auto* dry : lord.getDevicesByType<Lamp>()) {
-            dry->syncAssBtnToDevState();
-        }
-        for (auto* dry : lord.getDevicesByType<SingleRelayDevice>()) {
-            dry->syncAssBtnToDevState();
-        }
-        for (auto* dry : lord.getDevicesByType<DryContactOut>()) {
-            dry->syncAssBtnToDevState();
-        }
+        lord.syncAllAssBtnToDevState();
     }
 
     // 判断上一次execute是否与现在是同一个按钮, 不是的话就重置current_index
@@ -72,22 +54,26 @@ void PanelButtonInput::execute() {
 }
 
 void Panel::set_button_bl_state(uint8_t button_id, bool state) {
-    uint8_t bl_states = button_bl_states;
     if (state) {
-        bl_states |= (1 << button_id);
+        button_bl_states.fetch_or(1 << button_id);
     } else {
-        bl_states &= ~(1 << button_id);
+        button_bl_states.fetch_and(~(1 << button_id));
     }
-    set_button_bl_states(bl_states);
 }
 
 void Panel::publish_bl_state(void) {               // 第五位(0xFF)传什么都没事, 面板不在乎
-    generate_response(SWITCH_WRITE, 0x00, pid, 0xFF, button_bl_states);
+    generate_response(SWITCH_WRITE, 0x00, pid, 0xFF, button_bl_states.load());
+}
+
+void Panel::publishByPid(uint8_t pid) {
+    // 每次都重新按pid查找, 刷新时面板已被重新加载的配置替换也不会用到旧指针
+    if (Panel* panel = LordManager::instance().getPanelByPid(pid)) {
+        panel->publish_bl_state();
+    }
 }
 
 void Panel::register_publish_bl_state() {
-    // 将当前实例的 publish_bl_state 添加到 IndicatorHolder
-    IndicatorHolder::getInstance().addFunction([this]() { publish_bl_state(); }, this);
+    IndicatorHolder::getInstance().markDirty(pid);
 }
 
 void Panel::wishIndicatorByButton(uint8_t bid, uint8_t state) {
@@ -100,6 +86,12 @@ void Panel::wishIndicatorByPanel(uint8_t state) {
     register_publish_bl_state();
 }
 
+void Panel::wishIndicatorByMask(uint8_t mask, uint8_t states) {
+    uint8_t old_states = button_bl_states.load();
+    while (!button_bl_states.compare_exchange_weak(old_states, (old_states & ~mask) | (states & mask))) {}
+    register_publish_bl_state();
+}
+
 void Panel::shortLightIndicator(uint8_t bid) {
     set_button_bl_state(bid, true);
     short_light_bids.push_back(bid);
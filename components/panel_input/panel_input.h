@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <unordered_map>
 #include <memory>
 #include <vector>
@@ -45,12 +46,23 @@ public:
     }
 
     uint8_t getPid() const { return pid; }
+    std::vector<PanelButtonInput*> getButtons() const {
+        std::vector<PanelButtonInput*> result;
+        for (const auto& [bid, btn] : buttons_map) {
+            result.push_back(btn.get());
+        }
+        return result;
+    }
 
     // 修改此面板指定按键的指示灯状态并注册更新函数, 之后必须在某处使用Indicator来call
     void wishIndicatorByButton(uint8_t bid, uint8_t state);
     // 修改此面板所有按键的指示灯状态并注册更新函数, 之后必须在某处使用Indicator来call
     void wishIndicatorByPanel(uint8_t state);
+    // 只改mask里的按键, 改成states里对应的位, 其余按键不动; 同样之后必须在某处使用Indicator来call
+    void wishIndicatorByMask(uint8_t mask, uint8_t states);
     void shortLightIndicator(uint8_t bid);
+    // 给IndicatorHolder的刷新任务用, 按pid找到面板并发出它当前的背光状态
+    static void publishByPid(uint8_t pid);
 
     // 处理485发来的开关上报码, 真正的处理函数
     void switchReport(uint8_t target_buttons, uint8_t old_bl_state);
@@ -68,15 +80,15 @@ private:
     static void light_off_timer_callback(TimerHandle_t xTimer);
 
     // ================ 驱动层 ================
-    uint8_t button_bl_states = 0x00;        // 所有按钮的背光状态, 1亮0灭
+    std::atomic<uint8_t> button_bl_states = 0x00;   // 所有按钮的背光状态, 1亮0灭, 多个动作组可能同时改
     uint8_t button_operation_flags = 0x00;  // 按钮们的"正在操作"标记
 
     // 设置此面板所有按钮的指示灯, 之后必须在某处进行publish_bl_state才算真的修改了物理指示灯
-    void set_button_bl_states(uint8_t state) { button_bl_states = state; }
+    void set_button_bl_states(uint8_t state) { button_bl_states.store(state); }
     // 设置此面板指定按钮的指示灯, 之后必须在某处进行publish_bl_state才算真的修改了物理指示灯
     void set_button_bl_state(uint8_t button_id, bool state);
 
-    // 注册此面板到某个结构里, 表示此面板想要更新指示灯
+    // 在IndicatorHolder里标记此面板, 表示此面板想要更新指示灯
     void register_publish_bl_state();
 
     // 终端函数, 发送指令更新面板状态
@@ -1,7 +1,6 @@
 #include <esp_log.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
-#include <charconv>
 #include "preset_device.h"
 #include "lord_manager.h"
 #include "commons.h"
@@ -10,7 +9,6 @@
 #include "room_state.h"
 #include "relay_out.h"
 #include "drycontact_out.h"
-#include "my_mqtt.h"
 #include <bgm.h>
 
 #define TAG "PRESET_DEVICE"
@@ -18,21 +16,21 @@ static bool have_spanshot = false;                                  // 是否有
 std::unordered_map<uint16_t, bool> all_device_onoff_snapshot = {};  // <did, isOn> 房间设备快照
 static bool room_alive_snapshot = false;                            // 此快照里的房间是否为插卡状态
 
-void PresetDevice::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
-    ESP_LOGI_CYAN(TAG, "[%s]收到操作[%s], par[%s], aid[%d]", name.c_str(), operation.c_str(), parameter.c_str(), self_action_group ? self_action_group->getAid() : -1);
+void PresetDevice::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
+    ESP_LOGI_CYAN(TAG, "[%s]收到操作[%s], par[%s|%d], aid[%d]", getName(), opcodeName(op), str_of(RoomStateStore::getInstance().nameOf(param.state)), (int)param.value, self_action_group ? self_action_group->getAid() : -1);
     static auto& lord = LordManager::instance();
     switch (type) {
         case DeviceType::HEARTBEAT:
             // 如果收到睡眠操作, 改变心跳包
-            if (operation == "睡眠") {
-                // 注册所有指示灯的函数, 等当前动作组结束后会发布
+            if (op == Opcode::SLEEP) {
+                // 标记所有面板的指示灯, 等当前动作组结束后会刷新
                 lord.wishIndicatorAllPanel(false);
                 // 切换为睡眠心跳包
                 lord.useSleepHeartBeat();
-            } else if (operation == "拔卡") {
+            } else if (op == Opcode::REMOVE_CARD) {
                 lord.useSleepHeartBeat();
                 lord.setAlive(false);
-            } else if (operation == "插卡") {
+            } else if (op == Opcode::INSERT_CARD) {
                 // 进入插卡状态
                 lord.useAliveHeartBeat();
                 lord.setAlive(true);
@@ -51,18 +49,15 @@ void PresetDevice::execute(std::string operation, std::string parameter, ActionG
             break;
         
         case DeviceType::ROOM_STATE:
-            if (operation == "添加") {
-                add_state(parameter);
-                // 如果是SOS, 立即上报状态
-                if (parameter == "SOS") {
-                    report_states();;
-                }
-            } else if (operation == "删除") {
-                remove_state(parameter);
-            } else if (operation == "反转") {
-                toggle_state(parameter);
-            } else if (operation == "如果存在此状态则跳出") {
-                if (exist_state(parameter)) {
+            if (op == Opcode::STATE_ADD) {
+                // SOS和勿扰由my_mqtt订阅状态变化后立即上报
+                RoomStateStore::getInstance().add(param.state);
+            } else if (op == Opcode::STATE_REMOVE) {
+                RoomStateStore::getInstance().remove(param.state);
+            } else if (op == Opcode::TOGGLE) {
+                RoomStateStore::getInstance().toggle(param.state);
+            } else if (op == Opcode::STATE_BREAK_IF_EXIST) {
+                if (RoomStateStore::getInstance().exists(param.state)) {
                     if (self_action_group) {
                         self_action_group->suicide();
                     } else {
@@ -72,54 +67,43 @@ void PresetDevice::execute(std::string operation, std::string parameter, ActionG
             }
             break;
         case DeviceType::DELAYER:
-            if (operation == "延时") {
-                int delay = 0;
-                auto result = std::from_chars(parameter.data(), parameter.data() + parameter.size(), delay);
-                if (result.ec != std::errc() || delay < 0) {
-                    ESP_LOGE(TAG, "延时参数非法: %s", parameter.c_str());
-                    break;
-                }
+            if (op == Opcode::DELAY) {
+                // 参数已在解析配置时校验过
+                int delay = param.value;
 
                 ESP_LOGI(TAG, "延时%d秒\n", delay);
-                // 在进入延时前先发布已注册的指示灯函数
-                IndicatorHolder::getInstance().callAllAndClear();
+                // 在进入延时前先刷新已标记的指示灯
+                IndicatorHolder::getInstance().requestFlush();
                 if (self_action_group) {
-                    if (!self_action_group->delay_ms(delay * 1000)) {
-                        ESP_LOGW(TAG, "延时被取消，中止后续动作");
-                        break;
-                    }
+                    // 不在这里阻塞, 本动作返回后动作组会挂起, 定时器到期再继续
+                    self_action_group->sleep_ms(delay * 1000);
                 } else {
                     vTaskDelay(delay * 1000 / portTICK_PERIOD_MS);
                 }
             }
             break;
         case DeviceType::ACTION_GROUP_OP: {
-            int id = 0;
-            auto result = std::from_chars(parameter.data(), parameter.data() + parameter.size(), id);
-            if (result.ec != std::errc() || id < 0) {
-                ESP_LOGE(TAG, "非法的动作组ID: %s", parameter.c_str());
-                break;
-            }
+            int id = param.value;
 
-            if (operation == "调用") {
+            if (op == Opcode::AG_CALL) {
                 if (auto* ag = lord.getActionGroupByAid(id)) {
-                    ESP_LOGI(TAG, "调用[%s](%u)", ag->getName().c_str(), ag->getAid());
+                    ESP_LOGI(TAG, "调用[%s](%u)", ag->getName(), ag->getAid());
                     ag->executeAllAtomicAction();
                 }
-            } else if (operation == "中断") {
+            } else if (op == Opcode::AG_INTERRUPT) {
                 if (auto* ag = lord.getActionGroupByAid(id)) {
-                    ESP_LOGI(TAG, "中断[%s](%u)", ag->getName().c_str(), ag->getAid());
+                    ESP_LOGI(TAG, "中断[%s](%u)", ag->getName(), ag->getAid());
                     ag->suicide();
                 }
-            } else if (operation == "生成任意键执行") {
+            } else if (op == Opcode::AG_SET_ANY_KEY) {
                 lord.setAnyKeyActionGroup(id);
-            } else if (operation == "删除任意键执行") {
+            } else if (op == Opcode::AG_CLEAR_ANY_KEY) {
                 lord.clearAnyKeyActionGroup();
             }
             break;
         }
         case DeviceType::SNAPSHOT: {
-            if (operation == "记录快照") {
+            if (op == Opcode::SNAPSHOT_RECORD) {
                 all_device_onoff_snapshot.clear();
                 for(auto* dev : lord.getDevicesByType<IDevice>()) {
                     // 跳过预设设备
@@ -135,7 +119,7 @@ void PresetDevice::execute(std::string operation, std::string parameter, ActionG
                 }
                 room_alive_snapshot = lord.getAlive();
                 have_spanshot = true;
-            } else if (operation == "读取并删除快照") {
+            } else if (op == Opcode::SNAPSHOT_RESTORE) {
                 if (have_spanshot) {
                     for (auto [did, is_on] : all_device_onoff_snapshot) {
                         if (IDevice* dev = lord.getDeviceByDid(did)) {
@@ -146,12 +130,12 @@ void PresetDevice::execute(std::string operation, std::string parameter, ActionG
                                 case DeviceType::INFRARED_AIR:
                                 case DeviceType::SINGLE_AIR:
                                 case DeviceType::DRY_CONTACT:
-                                    dev->execute(is_on ? "开" : "关", "");
+                                    dev->execute(is_on ? Opcode::OPEN : Opcode::CLOSE);
                                     break;
                                 case DeviceType::RELAY:
                                     if (auto* relay = dynamic_cast<SingleRelayDevice*>(dev)) {
                                         if (relay->getType() != DeviceType::DOORBELL) {
-                                            relay->execute(is_on ? "开" : "关", "");
+                                            relay->execute(is_on ? Opcode::OPEN : Opcode::CLOSE);
                                         }
                                     }
                                     break;
@@ -172,7 +156,7 @@ void PresetDevice::execute(std::string operation, std::string parameter, ActionG
                 } else {
                     ESP_LOGI(TAG, "没有快照可恢复");
                 }
-            } else if (operation == "删除快照") {
+            } else if (op == Opcode::SNAPSHOT_DELETE) {
                 if (have_spanshot) {
                     ESP_LOGI(TAG, "删除快照");
                     all_device_onoff_snapshot.clear();
@@ -181,7 +165,7 @@ void PresetDevice::execute(std::string operation, std::string parameter, ActionG
                 } else {
                     ESP_LOGI(TAG, "没有快照可删除");
                 }
-            } else if (operation == "清除快照并跳出") {
+            } else if (op == Opcode::SNAPSHOT_CLEAR_AND_BREAK) {
                 if (have_spanshot) {
                     ESP_LOGI(TAG, "清除快照并跳出");
                     all_device_onoff_snapshot.clear();
@@ -199,17 +183,13 @@ void PresetDevice::execute(std::string operation, std::string parameter, ActionG
             break;
         }
         case DeviceType::INDICATOR: {
-            int pid, bid;
-            if (sscanf(parameter.c_str(), "%d,%d", &pid, &bid) != 2) {
-                ESP_LOGE(TAG, "Indicator错误, 无法获取按键: %s", parameter.c_str());
-                break;
-            }
+            int pid = param.pid, bid = param.bid;
             if (Panel* panel = lord.getPanelByPid(pid)) {
-                if (operation == "亮") {
+                if (op == Opcode::INDICATOR_ON) {
                     panel->wishIndicatorByButton(bid, true);
-                } else if (operation == "灭") {
+                } else if (op == Opcode::INDICATOR_OFF) {
                     panel->wishIndicatorByButton(bid, false);
-                } else if (operation == "亮1秒") {
+                } else if (op == Opcode::INDICATOR_FLASH) {
                     panel->shortLightIndicator(bid);
                 }
             } else {
@@ -8,7 +8,7 @@ public:
         : IDevice(did, type, name, carry_state) {}
 
 private:
-    void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
+    void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
     void addAssBtn(PanelButtonPair) override { ESP_LOGW("PresetDevice", "预设设备不应该添加关联按钮"); }
     void syncAssBtnToDevState() override { ESP_LOGW("PresetDevice", "预设设备不应该有关联按钮"); }
     bool isOn() const override { ESP_LOGW("PresetDevice", "预设设备不应该调用isOn"); return false; }
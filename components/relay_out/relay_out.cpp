@@ -4,18 +4,24 @@
 
 #define TAG "RELAY_OUT"
 
-void SingleRelayDevice::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
-    ESP_LOGI_CYAN(TAG, "单继电器设备[%s]收到操作[%s]", name.c_str(), operation.c_str());
-    if (operation == "开" || operation == "打开") {
-        open_self(should_log);
-    } else if (operation == "关" || operation == "关闭") {
-        close_self(should_log);
-    } else if (operation == "反转") {
-        if (isOn()) {
-            close_self(should_log);
-        } else {
+void SingleRelayDevice::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
+    ESP_LOGI_CYAN(TAG, "单继电器设备[%s]收到操作[%s]", getName(), opcodeName(op));
+    switch (op) {
+        case Opcode::OPEN:
             open_self(should_log);
-        }
+            break;
+        case Opcode::CLOSE:
+            close_self(should_log);
+            break;
+        case Opcode::TOGGLE:
+            if (isOn()) {
+                close_self(should_log);
+            } else {
+                open_self(should_log);
+            }
+            break;
+        default:
+            break;
     }
 }
 
@@ -23,7 +29,7 @@ void SingleRelayDevice::open_self(bool should_log) {
     controlRelay(channel, true);
     updateButtonIndicator(true);
     change_state(true);
-    sync_link_devices("开");
+    sync_link_devices(Opcode::OPEN);
     close_repel_devices();
 }
 
@@ -31,7 +37,7 @@ void SingleRelayDevice::close_self(bool should_log) {
     controlRelay(channel, false);
     updateButtonIndicator(false);
     change_state(false);
-    sync_link_devices("关");
+    sync_link_devices(Opcode::CLOSE);
 }
 
 void SingleRelayDevice::syncAssBtnToDevState() {
@@ -11,10 +11,11 @@ public:
         updateButtonIndicator(initial_state);
     }
     ~SingleRelayDevice() = default;
-    void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
+    void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
     void addAssBtn(PanelButtonPair pair) override { associated_buttons.push_back(pair);}
     void syncAssBtnToDevState() override;
     bool isOn() const override;
+    uint8_t getChannel() const { return channel; }
 protected:
     uint8_t channel;
     void open_self(bool should_log);
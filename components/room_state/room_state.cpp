@@ -1,40 +1,169 @@
 #include "room_state.h"
-#include <algorithm>
+#include <esp_log.h>
 #include "commons.h"
 
-void add_state(const std::string& state) {
-    std::lock_guard<std::mutex> lock(state_mutex);
-    state_map[state] = get_current_timestamp();
+#define TAG "ROOM_STATE"
+
+RoomStateStore::RoomStateStore() {
+    names[ROOM_STATE_CHECK_IN] = STR_CHECK_IN;
+    names[ROOM_STATE_DND] = STR_DND;
+    names[ROOM_STATE_SOS] = STR_SOS;
+    count.store(3, std::memory_order_release);
 }
 
-bool remove_state(const std::string& state) {
-    std::lock_guard<std::mutex> lock(state_mutex);
-    return state_map.erase(state) != 0;
+RoomStateId RoomStateStore::registerState(StrHandle name) {
+    if (name == STR_EMPTY || name == STR_INVALID) {
+        return ROOM_STATE_NONE;
+    }
+    // 已登记的条目不会再改, 先不加锁找一遍
+    size_t n = count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        if (names[i] == name) {
+            return i;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    n = count.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < n; i++) {
+        if (names[i] == name) {
+            return i;
+        }
+    }
+    if (n >= MAX_ROOM_STATES) {
+        ESP_LOGE(TAG, "房间状态已满%u个, 忽略[%s]", MAX_ROOM_STATES, str_of(name));
+        return ROOM_STATE_NONE;
+    }
+    names[n] = name;
+    count.store(n + 1, std::memory_order_release);
+    return n;
+}
+
+RoomStateId RoomStateStore::find(StrHandle name) const {
+    if (name == STR_EMPTY || name == STR_INVALID) {
+        return ROOM_STATE_NONE;
+    }
+    size_t n = count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        if (names[i] == name) {
+            return i;
+        }
+    }
+    return ROOM_STATE_NONE;
 }
 
-void toggle_state(const std::string &state) {
-    std::lock_guard<std::mutex> lock(state_mutex);
+void RoomStateStore::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    constexpr size_t FIXED = ROOM_STATE_SOS + 1;
+    uint64_t set = bits.load(std::memory_order_acquire);
+    struct Kept {
+        std::string name;
+        time_t happen_time;
+    };
+    std::vector<Kept> kept;
+    for (size_t id = FIXED; id < count.load(std::memory_order_relaxed); id++) {
+        if ((set >> id) & 1) {
+            kept.push_back({str_of(names[id]), happen_times[id]});
+        }
+    }
 
-    auto it = state_map.find(state);
-    if (it != state_map.end())
-        state_map.erase(it);
-    else
-        state_map.emplace(state, get_current_timestamp());
+    count.store(FIXED, std::memory_order_release);
+    StringPool::getInstance().reset();
+    uint64_t next = set & ((1ULL << FIXED) - 1);
+    for (const auto& k : kept) {
+        size_t id = count.load(std::memory_order_relaxed);
+        names[id] = intern_str(k.name);
+        happen_times[id] = k.happen_time;
+        next |= 1ULL << id;
+        count.store(id + 1, std::memory_order_release);
+    }
+    bits.store(next, std::memory_order_release);
+    if (!kept.empty()) {
+        ESP_LOGI(TAG, "重建房间状态表, 保留%u个当前存在的状态", kept.size());
+    }
 }
 
-bool exist_state(const std::string &state) {
-    std::lock_guard<std::mutex> lock(state_mutex);
-    return state_map.find(state) != state_map.end();
+StrHandle RoomStateStore::nameOf(RoomStateId id) const {
+    if (id >= count.load(std::memory_order_acquire)) {
+        return STR_EMPTY;
+    }
+    return names[id];
 }
 
-nlohmann::json get_states_json() {
-    std::lock_guard<std::mutex> lock(state_mutex);
+void RoomStateStore::add(RoomStateId id) {
+    if (id >= MAX_ROOM_STATES) {
+        return;
+    }
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        happen_times[id] = get_current_timestamp();
+        changed = !(bits.fetch_or(1ULL << id, std::memory_order_acq_rel) & (1ULL << id));
+    }
+    if (changed) {
+        notify(id, true);
+    }
+}
+
+bool RoomStateStore::remove(RoomStateId id) {
+    if (id >= MAX_ROOM_STATES) {
+        return false;
+    }
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed = bits.fetch_and(~(1ULL << id), std::memory_order_acq_rel) & (1ULL << id);
+    }
+    if (changed) {
+        notify(id, false);
+    }
+    return changed;
+}
+
+void RoomStateStore::toggle(RoomStateId id) {
+    if (id >= MAX_ROOM_STATES) {
+        return;
+    }
+    bool present;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        present = !(bits.fetch_xor(1ULL << id, std::memory_order_acq_rel) & (1ULL << id));
+        if (present) {
+            happen_times[id] = get_current_timestamp();
+        }
+    }
+    notify(id, present);
+}
+
+nlohmann::json RoomStateStore::toJson() const {
+    std::lock_guard<std::mutex> lock(mutex);
     nlohmann::json arr = nlohmann::json::array();
-    for (const auto& [name, ts] : state_map) {
-        arr.push_back({
-            {"name", name},
-            {"happentime", static_cast<long long>(ts)}
-        });
+    uint64_t set = bits.load(std::memory_order_acquire);
+    for (RoomStateId id = 0; set != 0; id++, set >>= 1) {
+        if (set & 1) {
+            arr.push_back({
+                {"name", str_of(names[id])},
+                {"happentime", static_cast<long long>(happen_times[id])}
+            });
+        }
     }
     return arr;     // 返回的 json 支持复制与移动
-}
\ No newline at end of file
+}
+
+void RoomStateStore::subscribe(Subscriber subscriber) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t n = subscriber_count.load(std::memory_order_relaxed);
+    if (n >= MAX_SUBSCRIBERS) {
+        ESP_LOGE(TAG, "房间状态订阅已满%u个", MAX_SUBSCRIBERS);
+        return;
+    }
+    subscribers[n] = subscriber;
+    subscriber_count.store(n + 1, std::memory_order_release);
+}
+
+void RoomStateStore::notify(RoomStateId id, bool present) {
+    size_t n = subscriber_count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < n; i++) {
+        subscribers[i](id, present);
+    }
+}
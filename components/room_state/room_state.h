@@ -1,15 +1,74 @@
 #pragma once
 
-#include <vector>
+#include <stdint.h>
+#include <ctime>
 #include <mutex>
-#include <unordered_map>
+#include <atomic>
+#include <vector>
 #include "../json.hpp"
+#include "string_pool.h"
+
+// 房间状态的小整数id, 也是状态位图里的位号
+// 解析配置时第一次见到某个状态名就分配, 后台ctl只能用配置里已有的名字;
+// 重新解析配置前reset(), 当前存在的状态按名字重新登记, 所以不会因为换了配置而丢掉
+using RoomStateId = uint8_t;
+constexpr size_t MAX_ROOM_STATES = 64;
+constexpr RoomStateId ROOM_STATE_NONE = 0xFF;
+
+// 固定存在的几个房间状态, 与STR_CHECK_IN等一一对应
+constexpr RoomStateId ROOM_STATE_CHECK_IN = 0;     // 入住
+constexpr RoomStateId ROOM_STATE_DND = 1;          // 勿扰
+constexpr RoomStateId ROOM_STATE_SOS = 2;          // SOS
 
 // 当前房间的图示状态, 显示在后台的
-static std::unordered_map<std::string, time_t> state_map;
-static std::mutex state_mutex;
-void add_state(const std::string& state);
-bool remove_state(const std::string& state);
-void toggle_state(const std::string &state);
-bool exist_state(const std::string &state);
-nlohmann::json get_states_json();
\ No newline at end of file
+// exists()只读一个原子位图, 不加锁, 门铃这种热路径可以随便查
+class RoomStateStore {
+public:
+    static RoomStateStore& getInstance() {
+        static RoomStateStore instance;
+        return instance;
+    }
+
+    // 状态变化时的回调, 在改状态的任务里执行(不持锁), 不要在里面做耗时的事
+    using Subscriber = void (*)(RoomStateId id, bool present);
+
+    RoomStateId registerState(StrHandle name);      // 已登记则返回原id, 空名或表满返回ROOM_STATE_NONE
+    RoomStateId find(StrHandle name) const;         // 只查不登记, 没有返回ROOM_STATE_NONE
+    // 清掉除固定状态外的登记, 连同字符串池一起重建, 只在LordManager::clearAll里调用;
+    // 当前存在的自定义状态保留下来, 只是id可能变
+    void reset();
+    StrHandle nameOf(RoomStateId id) const;         // 无效id返回STR_EMPTY
+
+    void add(RoomStateId id);                       // 已存在也会刷新发生时间
+    bool remove(RoomStateId id);
+    void toggle(RoomStateId id);
+    bool exists(RoomStateId id) const {
+        return id < MAX_ROOM_STATES && (bits.load(std::memory_order_acquire) >> id) & 1;
+    }
+    uint64_t bitmap() const { return bits.load(std::memory_order_acquire); }
+
+    nlohmann::json toJson() const;
+
+    // 只在开机时、输入和执行池启动前调用, 不支持取消; notify()不加锁遍历订阅表
+    void subscribe(Subscriber subscriber);
+
+private:
+    std::atomic<uint64_t> bits{0};
+    StrHandle names[MAX_ROOM_STATES] = {};
+    time_t happen_times[MAX_ROOM_STATES] = {};
+    std::atomic<size_t> count{0};
+    static constexpr size_t MAX_SUBSCRIBERS = 4;
+    Subscriber subscribers[MAX_SUBSCRIBERS] = {};   // 定长, 登记时不会搬动正在被遍历的表
+    std::atomic<size_t> subscriber_count{0};
+    mutable std::mutex mutex;
+
+    void notify(RoomStateId id, bool present);
+
+    RoomStateStore();
+    RoomStateStore(const RoomStateStore&) = delete;
+    RoomStateStore& operator=(const RoomStateStore&) = delete;
+};
+
+// 简写
+inline RoomStateId room_state_id(std::string_view name) { return RoomStateStore::getInstance().registerState(intern_str(name)); }
+inline RoomStateId room_state_find(std::string_view name) { return RoomStateStore::getInstance().find(StringPool::getInstance().find(name)); }
@@ -17,6 +17,7 @@
 #include "identity.h"
 #include <bgm.h>
 #include <indicator.h>
+#include "metrics.h"
 
 #define TAG "RS485"
 
@@ -43,6 +44,12 @@ static uint8_t expected_pass_packet = 0;
 
 static QueueHandle_t rs485Queue = nullptr;
 
+static MetricCounter m_rs485_tx("rs485.tx");
+static MetricCounter m_rs485_tx_drop("rs485.tx_drop");        // 发送队列3秒内都是满的
+static MetricCounter m_rs485_rx("rs485.rx");
+static MetricCounter m_rs485_rx_bad("rs485.rx_bad");          // 帧尾或校验和不对
+static MetricCounter m_rs485_rx_noise("rs485.rx_noise");      // 等帧头时收到的杂字节
+
 void uart_init_rs485() {
     uart_config_t uart_config = {
         .baud_rate = RS485_BAUD_RATE,
@@ -65,6 +72,7 @@ void uart_init_rs485() {
         ESP_LOGE(TAG, "Failed to create RS485 command queue");
         return;
     }
+    metrics_watch_queue("rs485_tx", rs485Queue);
 
     // 心跳任务
     xTaskCreate([] (void* param) {
@@ -110,6 +118,7 @@ void uart_init_rs485() {
         while (true) {
             if (xQueueReceive(rs485Queue, &cmd, portMAX_DELAY) == pdPASS) {
                 uart_write_bytes(RS485_UART_PORT, reinterpret_cast<const char*>(cmd.data), cmd.len);
+                m_rs485_tx.inc();
                 vTaskDelay(pdMS_TO_TICKS(100));
             }
         }
@@ -138,6 +147,7 @@ void uart_init_rs485() {
                             byte_index = 0;
                             buffer[byte_index++] = byte;
                         } else {
+                            m_rs485_rx_noise.inc();
                             ESP_LOGE(TAG, "错误帧头: 0x%02x", byte);
                         }
                         break;
@@ -146,8 +156,11 @@ void uart_init_rs485() {
                         buffer[byte_index++] = byte;
                         if (byte_index == frame_size) {
                             if (buffer[0] == RS485_FRAME_HEADER &&
-                                buffer[frame_size - 1] == RS485_FRAME_FOOTER)
-                            handle_rs485_data(buffer, frame_size);
+                                buffer[frame_size - 1] == RS485_FRAME_FOOTER) {
+                                handle_rs485_data(buffer, frame_size);
+                            } else {
+                                m_rs485_rx_bad.inc();
+                            }
                             state = WAIT_FOR_HEADER; // 无论成功或失败，都重新等待下一帧
                         }
                         break;
@@ -170,6 +183,7 @@ void sendRS485CMD(const std::vector<uint8_t>& data) {
     }
     memcpy(cmd.data, data.data(), cmd.len);
     if (xQueueSend(rs485Queue, &cmd, pdMS_TO_TICKS(3000)) != pdPASS) {
+        m_rs485_tx_drop.inc();
         ESP_LOGE(TAG, "Failed to send command to queue");
     }
 }
@@ -190,6 +204,7 @@ uint8_t calculate_checksum(const std::vector<uint8_t>& data) {
 void handle_rs485_data(uint8_t* data, int length) {
     uint8_t checksum = calculate_checksum(std::vector<uint8_t>(data, data + 6));
     if (data[6] != checksum) {
+        m_rs485_rx_bad.inc();
         ESP_LOGE(TAG, "校验和错误: %d", checksum);
         char hexbuf[8 * 3 + 1]; // 每个字节两位+空格，最后一个\0
         int pos = 0;
@@ -199,6 +214,7 @@ void handle_rs485_data(uint8_t* data, int length) {
         ESP_LOGE(TAG, "数据包: %s", hexbuf);
         return;
     }
+    m_rs485_rx.inc();
 
     if (global_RS485_log_enable_flag) {
         char hexbuf[8 * 3 + 1];
@@ -248,10 +264,10 @@ void handle_rs485_data(uint8_t* data, int length) {
         // 因为背景音乐可能会自己变模式, 所以这里收到变化后直接更新按键指示灯
         if (data[5] == BGM_REPORT_MODE_BL) {
             lord.handleBGMModeChange(BGMMode::BL);
-            IndicatorHolder::getInstance().callAllAndClear();
+            IndicatorHolder::getInstance().requestFlush();
         } else if (data[5] == BGM_REPORT_MODE_TF) {
             lord.handleBGMModeChange(BGMMode::TF);
-            IndicatorHolder::getInstance().callAllAndClear();
+            IndicatorHolder::getInstance().requestFlush();
         }
     }
     
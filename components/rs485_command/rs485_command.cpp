@@ -2,9 +2,9 @@
 #include "rs485_command.h"
 #include "esp_log.h"
 
-void RS485Command::execute(std::string operation, std::string parameter, ActionGroup* self_action_group, bool should_log) {
-    ESP_LOGI_CYAN("RS485Command", "发送485指令[%s]\n", name.c_str());
-    if (operation == "发送") {
+void RS485Command::execute(Opcode op, const ActionParam& param, ActionGroup* self_action_group, bool should_log) {
+    ESP_LOGI_CYAN("RS485Command", "发送485指令[%s]\n", getName());
+    if (op == Opcode::RS485_SEND) {
         sendRS485CMD(code);
     }
 }
\ No newline at end of file
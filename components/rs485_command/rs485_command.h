@@ -10,7 +10,7 @@ public:
         this->code = pavectorseHexToFixedArray(code);
     }
 
-    void execute(std::string operation, std::string parameter, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
+    void execute(Opcode op, const ActionParam& param = {}, ActionGroup* self_action_group = nullptr, bool should_log = false) override;
     void addAssBtn(PanelButtonPair) override { ESP_LOGW("RS485Command", "指令码设备不应该添加关联按钮"); }
     void syncAssBtnToDevState() override { ESP_LOGW("RS485Command", "指令码设备不应该有关联按钮"); }
     bool isOn() const override { ESP_LOGW("RS485Command", "指令码设备不应该调用isOn"); return false; }
@@ -1,5 +1,6 @@
 #include "esp_log.h"
 #include "driver/uart.h"
+#include "esp_timer.h"
 #include "stdint.h"
 
 #include "stm32_comm_types.h"
@@ -9,11 +10,16 @@
 #include "lord_manager.h"
 #include "stm32_tx.h"
 #include <curtain.h>
+#include "metrics.h"
 
 #define TAG "STM32_RX"
 
 bool global_STM32_log_enable_flag = false;
 
+static MetricCounter m_stm32_rx("stm32.rx");
+static MetricCounter m_stm32_rx_bad("stm32.rx_bad");          // 帧尾或校验和不对
+static MetricHistogram m_stm32_handle_us("stm32.handle_us", {100, 500, 1000, 5000, 10000, 50000, 100000});
+
 // 打印数据包的内容
 static void print_response(const uart_frame_t *frame) {
     ESP_LOGI(TAG, "收到: %02X %02X %02X %02X %02X %02X %02X %02X",
@@ -79,7 +85,7 @@ void handle_response(uart_frame_t *frame) {
             }
             // 是门铃的话要判断处不处于勿扰状态
             else if (tags.contains(InputTag::IS_DOORBELL_CHANNEL)) {
-                if (exist_state("勿扰")) {
+                if (RoomStateStore::getInstance().exists(ROOM_STATE_DND)) {
                     return;
                 }
             }
@@ -166,8 +172,12 @@ void stm32_receive_task(void *pvParameters) {
                         // 接收到完整的数据包
                         if (frame.footer == STM32_FRAME_FOOTER && frame.checksum == calculate_checksum(&frame)) {
                             // 处理数据包
+                            m_stm32_rx.inc();
+                            int64_t start = esp_timer_get_time();
                             handle_response(&frame);
+                            m_stm32_handle_us.record(esp_timer_get_time() - start);
                         } else {
+                            m_stm32_rx_bad.inc();
                             ESP_LOGE(TAG, "数据包错误");
                         }
                         state = WAIT_FOR_HEADER; // 无论成功或失败，都重新等待下一帧
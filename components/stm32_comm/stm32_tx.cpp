@@ -2,9 +2,12 @@
 #include "stm32_tx.h"
 #include "esp_log.h"
 #include "driver/uart.h"
+#include "metrics.h"
 
 #define TAG "STM32_TX"
 
+static MetricCounter m_stm32_tx("stm32.tx");
+
 // 构造指令帧
 void build_frame(uint8_t cmd_type, uint8_t board_id, uint8_t channel, uint8_t param1, uint8_t param2, uart_frame_t *frame) {
     frame->header = STM32_FRAME_HEADER;           // 帧头
@@ -25,6 +28,7 @@ void send_frame(uart_frame_t *frame) {
 
     // 发送数据
     uart_write_bytes(UART_NUM, (const char *)data, frame_size);
+    m_stm32_tx.inc();
 
     // 打印发送的数据
     if (global_STM32_log_enable_flag) {
@@ -0,0 +1,137 @@
+#include <cstring>
+#include <algorithm>
+#include <esp_log.h>
+#include "string_pool.h"
+
+#define TAG "STRING_POOL"
+
+// std::string在esp32上是24字节, 超过15字节的内容会另外在堆上分配(再加约8字节的堆头)
+static constexpr size_t STD_STRING_SIZE = 24;
+static constexpr size_t STD_STRING_SSO = 15;
+static constexpr size_t HEAP_OVERHEAD = 8;
+
+StringPool::StringPool() {
+    // 顺序必须与string_pool.h里的常量一致
+    intern("");
+    intern("入住");
+    intern("勿扰");
+    intern("SOS");
+    fixed_block_used = block_used;
+    naive_bytes = 0;
+}
+
+const char* StringPool::store(std::string_view str) {
+    size_t need = str.size() + 1;
+    // 最后一个字节留作哨兵, 不分配出去
+    if (block_used + need > BLOCK_SIZE - 1) {
+        if (current_block) {
+            block_index++;
+        }
+        if (block_index < blocks.size()) {
+            current_block = blocks[block_index];
+        } else {
+            current_block = new char[BLOCK_SIZE];
+            current_block[BLOCK_SIZE - 1] = '\0';
+            blocks.push_back(current_block);
+            block_bytes += BLOCK_SIZE;
+        }
+        block_used = 0;
+    }
+    char* dst = current_block + block_used;
+    block_used += need;
+    memcpy(dst, str.data(), str.size());
+    dst[str.size()] = '\0';
+    return dst;
+}
+
+size_t StringPool::lowerBound(std::string_view str) const {
+    auto it = std::lower_bound(sorted.begin(), sorted.end(), str,
+        [this](StrHandle h, std::string_view s) { return view(h) < s; });
+    return it - sorted.begin();
+}
+
+StrHandle StringPool::intern(std::string_view str) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    naive_bytes += STD_STRING_SIZE + (str.size() > STD_STRING_SSO ? str.size() + 1 + HEAP_OVERHEAD : 0);
+
+    size_t pos = lowerBound(str);
+    if (pos < sorted.size() && view(sorted[pos]) == str) {
+        return sorted[pos];
+    }
+
+    size_t n = size.load(std::memory_order_relaxed);
+    if (str.size() > BLOCK_SIZE - 2) {
+        ESP_LOGE(TAG, "字符串太长(%u字节), 无法驻留: %.32s...", str.size(), str.data());
+        return STR_EMPTY;
+    }
+    if (n >= ENTRIES_PER_CHUNK * MAX_CHUNKS) {
+        if (!full_logged) {
+            full_logged = true;
+            ESP_LOGE(TAG, "字符串池已满%u个, 之后的新字符串都会变成空串, 首个: %.*s", n, (int)str.size(), str.data());
+        }
+        return STR_EMPTY;
+    }
+    Entry*& chunk = chunks[n / ENTRIES_PER_CHUNK];
+    if (!chunk) {
+        chunk = new Entry[ENTRIES_PER_CHUNK];
+    }
+    chunk[n % ENTRIES_PER_CHUNK] = Entry{store(str), static_cast<uint16_t>(str.size())};
+
+    StrHandle handle = static_cast<StrHandle>(n);
+    sorted.insert(sorted.begin() + pos, handle);
+    // 先写好条目再发布size, get()就不需要加锁
+    size.store(n + 1, std::memory_order_release);
+    return handle;
+}
+
+StrHandle StringPool::find(std::string_view str) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t pos = lowerBound(str);
+    if (pos < sorted.size() && view(sorted[pos]) == str) {
+        return sorted[pos];
+    }
+    return STR_INVALID;
+}
+
+void StringPool::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    // 先缩小size, get()对被清掉的句柄马上返回""
+    size.store(FIXED_COUNT, std::memory_order_release);
+    sorted.erase(std::remove_if(sorted.begin(), sorted.end(), [](StrHandle h) { return h >= FIXED_COUNT; }),
+                 sorted.end());
+    block_index = 0;
+    current_block = blocks[0];
+    block_used = fixed_block_used;
+    full_logged = false;
+}
+
+const char* StringPool::get(StrHandle handle) const {
+    if (handle >= size.load(std::memory_order_acquire)) {
+        return "";
+    }
+    return entry(handle).str;
+}
+
+size_t StringPool::usedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t chunk_count = 0;
+    for (auto* chunk : chunks) {
+        chunk_count += chunk ? 1 : 0;
+    }
+    return block_bytes
+         + chunk_count * ENTRIES_PER_CHUNK * sizeof(Entry)
+         + sorted.capacity() * sizeof(StrHandle)
+         + blocks.capacity() * sizeof(char*);
+}
+
+void StringPool::resetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    naive_bytes = 0;
+}
+
+void StringPool::logStats() const {
+    size_t used = usedBytes();
+    ESP_LOGI(TAG, "字符串池: %u个字符串, 占用%u字节, 若每处存std::string约需%u字节, 节省约%d字节",
+             count(), used, naive_bytes, (int)naive_bytes - (int)used);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// 字符串句柄, 0固定是空字符串
+using StrHandle = uint16_t;
+constexpr StrHandle STR_EMPTY = 0;
+constexpr StrHandle STR_INVALID = 0xFFFF;
+
+// 固定存在的几个房间状态, 不用每次查表
+constexpr StrHandle STR_CHECK_IN = 1;       // 入住
+constexpr StrHandle STR_DND = 2;            // 勿扰
+constexpr StrHandle STR_SOS = 3;            // SOS
+
+// 驻留字符串表, 两次配置之间只增不删
+// 配置里同样的设备名/房间状态名会出现几百次, 驻留后每处只存一个16位句柄
+// 重新解析配置前由reset()清空, 只留固定的几个. 存储块和句柄表都不释放而是重用, 每块最后一个字节永远是'\0',
+// 所以get()不用加锁: 别的任务手里拿着的旧句柄或旧指针, 最坏读到的是别的字符串, 不会越界
+class StringPool {
+public:
+    static StringPool& getInstance() {
+        static StringPool instance;
+        return instance;
+    }
+
+    StrHandle intern(std::string_view str);         // 驻留字符串, 已存在则返回原句柄, 满了或太长返回STR_EMPTY
+    StrHandle find(std::string_view str) const;     // 只查找不驻留, 不存在返回STR_INVALID
+    const char* get(StrHandle handle) const;        // 无效句柄返回""
+    void reset();                                   // 清掉除固定句柄外的所有字符串, 只在LordManager::clearAll里调用
+
+    // 统计, 用于估算节省的内存
+    size_t count() const { return size.load(std::memory_order_acquire); }
+    size_t usedBytes() const;                       // 字符串池本身占用的字节
+    size_t naiveBytes() const { return naive_bytes; }   // 如果每处都存std::string大概要占用的字节
+    void resetStats();                              // 每次解析配置前调用
+    void logStats() const;
+
+private:
+    static constexpr size_t BLOCK_SIZE = 512;       // 字符存储块大小, 块一旦分配就不会移动, 单个字符串最长BLOCK_SIZE - 2字节
+    static constexpr size_t FIXED_COUNT = 4;        // STR_EMPTY到STR_SOS, reset()时保留
+    static constexpr size_t ENTRIES_PER_CHUNK = 64; // 每个句柄表分块能放的字符串数
+    static constexpr size_t MAX_CHUNKS = 16;        // 最多 64 * 16 = 1024 个字符串
+
+    struct Entry {
+        const char* str;
+        uint16_t len;
+    };
+
+    std::vector<char*> blocks;                      // 所有字符存储块
+    size_t block_index = 0;                         // 正在填充的块, reset()后从头重用
+    char* current_block = nullptr;                  // 正在填充的块
+    size_t block_used = BLOCK_SIZE;                 // 当前块已用字节, 初始视为已满
+    size_t fixed_block_used = 0;                    // 固定字符串占用第一块的字节数
+    bool full_logged = false;                       // 池满只报一次错
+    size_t block_bytes = 0;                         // 所有块一共分配的字节
+    Entry* chunks[MAX_CHUNKS] = {};                 // 句柄 -> 字符串, 分块分配, 已发布的条目不会移动
+    std::atomic<size_t> size{0};
+    std::vector<StrHandle> sorted;                  // 按内容排序的句柄, 用于二分查找
+    size_t naive_bytes = 0;
+    mutable std::mutex mutex;
+
+    const Entry& entry(StrHandle handle) const {
+        return chunks[handle / ENTRIES_PER_CHUNK][handle % ENTRIES_PER_CHUNK];
+    }
+    std::string_view view(StrHandle handle) const { return {entry(handle).str, entry(handle).len}; }
+    size_t lowerBound(std::string_view str) const;
+    const char* store(std::string_view str);
+
+    StringPool();
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+};
+
+// 简写
+inline StrHandle intern_str(std::string_view str) { return StringPool::getInstance().intern(str); }
+inline const char* str_of(StrHandle handle) { return StringPool::getInstance().get(handle); }
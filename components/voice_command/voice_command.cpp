@@ -4,21 +4,17 @@
 
 #include "action_group.h"
 #include "rs485_comm.h"
-#include "lamp.h"
 #include "lord_manager.h"
-#include <drycontact_out.h>
 
 #define TAG "VOICE_CMD"
 
 void VoiceCommand::execute() {
-    ESP_LOGI_CYAN(TAG, "语音指令[%s]开始执行动作组(%u/%u)", name.c_str(), current_index + 1, action_groups.size());
+    ESP_LOGI_CYAN(TAG, "语音指令[%s]开始执行动作组(%u/%u)", getName(), current_index + 1, action_groups.size());
     static auto& lord = LordManager::instance();
 
     if (lord.isSleep()) {
         lord.useAliveHeartBeat();
-        for (auto* dry : lord.getDevicesByType<DryContactOut>()) {
-            dry->syncAssBtnToDevState();
-        }
+        lord.syncAllAssBtnToDevState();
     }
 
     // 语音输入应该不需要任意键执行
@@ -19,6 +19,10 @@
 #include "identity.h"
 #include "air_conditioner.h"
 #include "json_codec.h"
+#include "config_slots.h"
+#include "action_group.h"
+#include "indicator.h"
+#include "my_mqtt.h"
 
 #define TAG "app_main"
 
@@ -80,9 +84,15 @@ extern "C" void app_main(void) {
     printCurrentFreeMemory("开始初始化驱动");
     init_littlefs();
     init_nvs();
+    ConfigSlots::getInstance().init();
+    startOpLogReporter();
+    start_alarm_channel();
+    subscribe_state_report();
     uart_init_stm32();
     uart_init_rs485();
     esp_netif_init();
+    initActionExecutors();
+    IndicatorHolder::getInstance().start(Panel::publishByPid);
     
     xTaskCreate([] (void *param) {
         LordManager::instance().syncAllRelayPhysicsOnoff();
@@ -0,0 +1,474 @@
+// scene_sim: 在主机上干跑一份配置, 给出每个场景的最坏耗时, 帧数, 以及配置里的悬空did和联动环
+//
+// 用法: scene_sim <config.json> [-v] [--limit 秒]
+//
+// 解析用的就是固件的parseLogicConfig, 场景由固件的动作组执行池执行, 只有驱动层是替身.
+// 每个场景都在一份刚解析出来的配置上单独跑, 所以结果与场景顺序无关;
+// 继电器全部从"关"开始, 因此"切换"一律按"开"计算, 这也是会关闭排斥设备的那一边.
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "sim_runtime.h"
+#include "json.hpp"
+#include "lord_manager.h"
+#include "indicator.h"
+#include "json_codec.h"
+#include "config_partition.h"
+#include "mbedtls/sha256.h"
+#include "yyjson.h"
+
+namespace {
+
+// 单个场景默认最多模拟10分钟的虚拟时间, 超过的多半是周期性的东西停不下来
+constexpr int DEFAULT_LIMIT_S = 600;
+
+struct SceneRef {
+    bool is_input;
+    uint16_t id;                    // aid或者iid
+    uint8_t index;                  // 输入的第几个动作组
+};
+
+struct SceneResult {
+    SceneRef ref;
+    std::string name;
+    size_t actions;
+    int64_t delay_ms;               // 动作组自身写的延时总和, 不含被调用的动作组
+    int64_t exec_ms;                // 执行池跑完所有动作(包括被调用的)的时刻
+    int64_t total_ms;               // 再算上485队列排空
+    uint32_t fanout;                // 联动与排斥额外带动的设备数
+    bool quiesced;
+    sim::Counters c;
+};
+
+// ================ 配置检查 ================
+// 直接读原始JSON, 因为固件解析时会把指向不存在设备的动作悄悄丢掉
+struct RawConfig {
+    std::map<uint16_t, int> device_types;                       // did, type
+    std::map<uint16_t, std::vector<uint16_t>> link_dids;
+    std::map<uint16_t, std::vector<uint16_t>> repel_dids;
+    std::set<uint16_t> aids;
+    std::set<std::pair<int, int>> panel_buttons;                // pid, bid
+};
+
+int get_int(yyjson_val* obj, const char* key, int def) {
+    yyjson_val* v = yyjson_obj_get(obj, key);
+    return (v && yyjson_is_int(v)) ? yyjson_get_int(v) : def;
+}
+
+const char* get_str(yyjson_val* obj, const char* key) {
+    yyjson_val* v = yyjson_obj_get(obj, key);
+    return (v && yyjson_is_str(v)) ? yyjson_get_str(v) : "";
+}
+
+std::vector<uint16_t> get_dids(yyjson_val* obj, const char* key) {
+    std::vector<uint16_t> out;
+    yyjson_val* arr = yyjson_obj_get(obj, key);
+    size_t idx, max;
+    yyjson_val* item;
+    yyjson_arr_foreach(arr, idx, max, item) {
+        if (yyjson_is_int(item)) {
+            out.push_back(yyjson_get_int(item));
+        }
+    }
+    return out;
+}
+
+class Linter {
+public:
+    explicit Linter(const std::vector<std::string_view>& lines) {
+        devices = yyjson_read(lines[3].data(), lines[3].size(), 0);
+        groups = yyjson_read(lines[4].data(), lines[4].size(), 0);
+        inputs = yyjson_read(lines[5].data(), lines[5].size(), 0);
+        collect();
+    }
+    ~Linter() {
+        yyjson_doc_free(devices);
+        yyjson_doc_free(groups);
+        yyjson_doc_free(inputs);
+    }
+
+    const RawConfig& raw() const { return cfg; }
+    const std::vector<std::string>& issues() const { return found; }
+
+    void run() {
+        size_t idx, max;
+        yyjson_val* obj;
+        yyjson_arr_foreach(yyjson_obj_get(yyjson_doc_get_root(devices), "d"), idx, max, obj) {
+            int did = get_int(obj, "did", -1);
+            for (auto d : get_dids(obj, "lkds")) {
+                if (!cfg.device_types.contains(d)) report("设备(%d)的联动设备(%u)不存在", did, d);
+            }
+            for (auto d : get_dids(obj, "rpds")) {
+                if (!cfg.device_types.contains(d)) report("设备(%d)的排斥设备(%u)不存在", did, d);
+            }
+        }
+        yyjson_arr_foreach(yyjson_obj_get(yyjson_doc_get_root(groups), "a"), idx, max, obj) {
+            std::string where = "动作组(" + std::to_string(get_int(obj, "aid", -1)) + ")";
+            check_actions(yyjson_obj_get(obj, "a"), where, get_int(obj, "aid", -1));
+        }
+        yyjson_arr_foreach(yyjson_obj_get(yyjson_doc_get_root(inputs), "i"), idx, max, obj) {
+            int iid = get_int(obj, "iid", -1);
+            if (int lbd = get_int(obj, "lbd", -1); lbd > -1 && !cfg.device_types.contains(lbd)) {
+                report("输入(%d)的指示灯绑定设备(%d)不存在", iid, lbd);
+            }
+            size_t idx1, max1;
+            yyjson_val* arr;
+            yyjson_arr_foreach(yyjson_obj_get(obj, "a"), idx1, max1, arr) {
+                std::string where = "输入(" + std::to_string(iid) + ")#" + std::to_string(idx1);
+                check_actions(arr, where, -1);
+            }
+        }
+        find_cycles(cfg.link_dids, "联动环: 设备");
+        find_cycles(calls, "调用环: 动作组");
+    }
+
+private:
+    yyjson_doc* devices;
+    yyjson_doc* groups;
+    yyjson_doc* inputs;
+    RawConfig cfg;
+    std::map<uint16_t, std::vector<uint16_t>> calls;            // aid -> 它调用的aid
+    std::vector<std::string> found;
+
+    template <typename... Args>
+    void report(const char* fmt, Args... args) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), fmt, args...);
+        found.emplace_back(buf);
+    }
+
+    void collect() {
+        size_t idx, max;
+        yyjson_val* obj;
+        yyjson_arr_foreach(yyjson_obj_get(yyjson_doc_get_root(devices), "d"), idx, max, obj) {
+            uint16_t did = get_int(obj, "did", -1);
+            cfg.device_types[did] = get_int(obj, "type", (int)DeviceType::NONE);
+            cfg.link_dids[did] = get_dids(obj, "lkds");
+            cfg.repel_dids[did] = get_dids(obj, "rpds");
+        }
+        yyjson_arr_foreach(yyjson_obj_get(yyjson_doc_get_root(groups), "a"), idx, max, obj) {
+            cfg.aids.insert(get_int(obj, "aid", -1));
+        }
+        yyjson_arr_foreach(yyjson_obj_get(yyjson_doc_get_root(inputs), "i"), idx, max, obj) {
+            if (get_int(obj, "type", -1) == (int)InputType::PANEL_BTN) {
+                cfg.panel_buttons.insert({get_int(obj, "pid", -1), get_int(obj, "bid", -1)});
+            }
+        }
+    }
+
+    void check_actions(yyjson_val* arr, const std::string& where, int aid) {
+        size_t idx, max;
+        yyjson_val* act;
+        yyjson_arr_foreach(arr, idx, max, act) {
+            int did = get_int(act, "t", -1);
+            const char* op = get_str(act, "o");
+            const char* par = get_str(act, "p");
+            auto it = cfg.device_types.find(did);
+            if (it == cfg.device_types.end()) {
+                report("%s第%zu个动作的设备(%d)不存在", where.c_str(), idx, did);
+                continue;
+            }
+            Opcode code = opcodeFromName(op);
+            if (code == Opcode::NONE) {
+                report("%s第%zu个动作的操作[%s]无法识别", where.c_str(), idx, op);
+                continue;
+            }
+            auto type = static_cast<DeviceType>(it->second);
+            if (type == DeviceType::ACTION_GROUP_OP && code != Opcode::AG_CLEAR_ANY_KEY) {
+                int target = atoi(par);
+                if (!cfg.aids.contains(target)) {
+                    report("%s第%zu个动作[%s]的动作组(%d)不存在", where.c_str(), idx, op, target);
+                } else if (code == Opcode::AG_CALL && aid >= 0) {
+                    calls[aid].push_back(target);
+                }
+            } else if (type == DeviceType::INDICATOR) {
+                int pid, bid;
+                if (sscanf(par, "%d,%d", &pid, &bid) == 2 && !cfg.panel_buttons.contains({pid, bid})) {
+                    report("%s第%zu个动作的面板按键(%d,%d)不存在", where.c_str(), idx, pid, bid);
+                }
+            }
+        }
+    }
+
+    // 每个环只报一次, 从环上编号最小的节点开始
+    void find_cycles(const std::map<uint16_t, std::vector<uint16_t>>& graph, const char* head) {
+        std::set<std::vector<uint16_t>> cycles;
+        std::vector<uint16_t> path;
+        std::set<uint16_t> on_path;
+        std::function<void(uint16_t)> dfs = [&](uint16_t node) {
+            path.push_back(node);
+            on_path.insert(node);
+            if (auto it = graph.find(node); it != graph.end()) {
+                for (uint16_t next : it->second) {
+                    if (on_path.contains(next)) {
+                        std::vector<uint16_t> cyc(std::find(path.begin(), path.end(), next), path.end());
+                        std::rotate(cyc.begin(), std::min_element(cyc.begin(), cyc.end()), cyc.end());
+                        cycles.insert(cyc);
+                    } else if (path.size() < 64) {
+                        dfs(next);
+                    }
+                }
+            }
+            on_path.erase(node);
+            path.pop_back();
+        };
+        for (const auto& [node, _] : graph) {
+            dfs(node);
+        }
+        for (const auto& cyc : cycles) {
+            std::string text = head;
+            for (auto n : cyc) {
+                text += " " + std::to_string(n) + " ->";
+            }
+            text += " " + std::to_string(cyc.front());
+            found.push_back(text);
+        }
+    }
+};
+
+// ================ 场景模拟 ================
+ActionGroup* resolve(const SceneRef& ref, std::string& name) {
+    auto& lord = LordManager::instance();
+    if (!ref.is_input) {
+        ActionGroup* ag = lord.getActionGroupByAid(ref.id);
+        name = ag ? ag->getName() : "";
+        return ag;
+    }
+    for (auto* input : lord.getAllInputs()) {
+        if (input->getIid() == ref.id && ref.index < input->getActionGroups().size()) {
+            name = input->getName();
+            return input->getActionGroups()[ref.index].get();
+        }
+    }
+    return nullptr;
+}
+
+// 继电器类设备开关时总会带动联动设备, 打开时还会关掉链上每个设备的排斥设备
+uint32_t static_fanout(const ActionGroup& ag, const RawConfig& raw) {
+    uint32_t n = 0;
+    for (const auto& a : ag.actions) {
+        if (!a.target_device) continue;
+        bool opens = a.op == Opcode::OPEN || a.op == Opcode::TOGGLE;
+        if (!opens && a.op != Opcode::CLOSE) continue;
+        uint16_t did = a.target_device->getDid();
+        std::set<uint16_t> chain = {did};
+        std::vector<uint16_t> todo = {did};
+        while (!todo.empty()) {
+            uint16_t cur = todo.back();
+            todo.pop_back();
+            if (auto it = raw.link_dids.find(cur); it != raw.link_dids.end()) {
+                for (auto next : it->second) {
+                    if (raw.device_types.contains(next) && chain.insert(next).second) todo.push_back(next);
+                }
+            }
+        }
+        n += chain.size() - 1;
+        if (!opens) continue;
+        for (auto d : chain) {
+            if (auto it = raw.repel_dids.find(d); it != raw.repel_dids.end()) {
+                for (auto r : it->second) {
+                    if (raw.device_types.contains(r)) n++;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+// 互相调用之类停不下来的场景, 到时限后把所有动作组都取消掉, 让下一个场景能重新解析
+bool cancel_everything(int limit_s) {
+    auto& lord = LordManager::instance();
+    for (auto* ag : lord.getAllActionGroups()) {
+        ag->request_cancel();
+    }
+    for (auto* input : lord.getAllInputs()) {
+        for (const auto& ag : input->getActionGroups()) {
+            ag->request_cancel();
+        }
+    }
+    return sim::runUntilIdle(sim::now_us() + (int64_t)limit_s * 1000 * 1000);
+}
+
+int64_t static_delay_ms(const ActionGroup& ag) {
+    int64_t ms = 0;
+    for (const auto& a : ag.actions) {
+        if (a.op == Opcode::DELAY) ms += (int64_t)a.param.value * 1000;
+    }
+    return ms;
+}
+
+}
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    int limit_s = DEFAULT_LIMIT_S;
+    int bench_runs = 0;
+    bool use_image = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-v") {
+            sim_log_verbose = true;
+        } else if (arg == "--limit" && i + 1 < argc) {
+            limit_s = atoi(argv[++i]);
+        } else if (arg == "--bench" && i + 1 < argc) {
+            bench_runs = atoi(argv[++i]);
+        } else if (arg == "--image") {
+            use_image = true;
+        } else if (arg == "--partition") {
+            use_image = true;
+            sim::config_partition = true;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "用法: %s <config.json> [-v] [--limit 秒] [--image] [--partition] [--bench 次数]\n", argv[0]);
+        return 2;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        fprintf(stderr, "无法打开 %s\n", path);
+        return 2;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    const std::string config_json = ss.str();
+
+    sim::init();
+    initActionExecutors();
+    IndicatorHolder::getInstance().start(Panel::publishByPid);
+    // 顺便编译出二进制镜像, --image时改为从镜像加载, 结果应该和直接解析json一模一样
+    ConfigHash config_hash;
+    mbedtls_sha256(reinterpret_cast<const uint8_t*>(config_json.data()), config_json.size(), config_hash.bytes, 0);
+    FILE* image = tmpfile();
+    if (!image || !parseLogicConfig(config_json, image, config_hash)) {
+        fprintf(stderr, "配置解析失败\n");
+        return 2;
+    }
+    fflush(image);
+    // --partition时镜像先写进模拟的配置分区, 再像开机时一样映射进来原地加载
+    auto load_image = [&] {
+        if (sim::config_partition) {
+            return ConfigPartition::getInstance().load([&](const uint8_t* data, size_t len) {
+                return loadLogicConfigImage(data, len, config_hash);
+            });
+        }
+        return loadLogicConfigImage(image, config_hash);
+    };
+    if (sim::config_partition && !ConfigPartition::getInstance().write(image)) {
+        fprintf(stderr, "配置镜像写入分区失败\n");
+        return 2;
+    }
+    if (use_image && !load_image()) {
+        fprintf(stderr, "配置镜像加载失败\n");
+        return 2;
+    }
+    // 只测解析耗时, 不跑场景
+    if (bench_runs > 0) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < bench_runs; i++) {
+            parseLogicConfig(config_json);
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        printf("配置%zu字节, 解析%d次, 平均%.1fms\n", config_json.size(), bench_runs, us / bench_runs / 1000);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < bench_runs; i++) {
+            load_image();
+        }
+        us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        fseek(image, 0, SEEK_END);
+        printf("%s镜像%ld字节, 加载%d次, 平均%.1fms\n", sim::config_partition ? "分区" : "",
+               ftell(image), bench_runs, us / bench_runs / 1000);
+        fflush(stdout);
+        _exit(0);
+    }
+    fclose(image);
+
+    const auto lines = splitByLineView(config_json);
+    Linter linter(lines);
+    linter.run();
+
+    auto& lord = LordManager::instance();
+    std::vector<SceneRef> scenes;
+    for (auto* ag : lord.getAllActionGroups()) {
+        scenes.push_back({false, ag->getAid(), 0});
+    }
+    std::vector<InputBase*> inputs = lord.getAllInputs();
+    for (auto* input : inputs) {
+        for (size_t i = 0; i < input->getActionGroups().size(); i++) {
+            scenes.push_back({true, input->getIid(), (uint8_t)i});
+        }
+    }
+    std::sort(scenes.begin(), scenes.end(), [](const SceneRef& a, const SceneRef& b) {
+        return std::tie(a.is_input, a.id, a.index) < std::tie(b.is_input, b.id, b.index);
+    });
+
+    std::vector<SceneResult> results;
+    bool stale = false;                 // 当前的设备状态是不是被上一个场景动过了
+    bool can_reparse = true;
+    for (const auto& ref : scenes) {
+        // 上一个场景没跑完时还有定时器和任务指着旧对象, 这时不能重新解析, 只能接着用
+        if (stale && can_reparse) {
+            parseLogicConfig(config_json);
+        }
+        SceneResult r = {.ref = ref};
+        ActionGroup* ag = resolve(ref, r.name);
+        if (!ag) continue;
+        r.actions = ag->actions.size();
+        r.delay_ms = static_delay_ms(*ag);
+        r.fanout = static_fanout(*ag, linter.raw());
+
+        sim::resetCounters();
+        int64_t start = sim::now_us();
+        ag->executeAllAtomicAction();
+        r.quiesced = sim::runUntilIdle(start + (int64_t)limit_s * 1000 * 1000);
+        r.c = sim::counters();
+        r.exec_ms = (sim::now_us() - start) / 1000;
+        r.total_ms = (std::max(sim::now_us(), r.c.rs485_busy_until_us) - start) / 1000;
+        results.push_back(r);
+        stale = true;
+        can_reparse = r.quiesced || cancel_everything(limit_s);
+        if (!can_reparse) {
+            fprintf(stderr, "注意: %s(%u)取消后仍没有停下, 下一个场景沿用它留下的状态\n",
+                    r.ref.is_input ? "输入" : "动作组", r.ref.id);
+        }
+    }
+
+    printf("================ 配置检查 ================\n");
+    for (const auto& issue : linter.issues()) {
+        printf("  %s\n", issue.c_str());
+    }
+    printf("  %zu个问题\n\n", linter.issues().size());
+
+    printf("================ 场景 ================\n");
+    printf("%-6s %5s %2s %4s %8s %8s %8s %6s %6s %6s %8s %4s %4s %4s  %s\n",
+           "类型", "id", "#", "动作", "延时ms", "执行ms", "总计ms", "STM32", "继电器", "485帧",
+           "485忙ms", "阻塞", "MQTT", "扇出", "名称");
+    for (const auto& r : results) {
+        printf("%-6s %5u %2u %4zu %8lld %8lld %8lld %6u %6u %6u %8lld %4u %4u %4u  %s%s\n",
+               r.ref.is_input ? "输入" : "动作组", r.ref.id, r.ref.index, r.actions,
+               (long long)r.delay_ms, (long long)r.exec_ms, (long long)r.total_ms,
+               r.c.stm32_frames, r.c.relay_ops, r.c.rs485_frames,
+               (long long)(r.c.rs485_frames * 100), r.c.rs485_stalls, r.c.mqtt_msgs, r.fanout,
+               r.name.c_str(), r.quiesced ? "" : " (未停止)");
+    }
+    if (!results.empty()) {
+        auto worst = std::max_element(results.begin(), results.end(),
+                                      [](const auto& a, const auto& b) { return a.total_ms < b.total_ms; });
+        auto busiest = std::max_element(results.begin(), results.end(),
+                                        [](const auto& a, const auto& b) { return a.c.rs485_frames < b.c.rs485_frames; });
+        printf("\n最慢: %s(%u)#%u %lldms, 485最多: %s(%u)#%u %u帧\n",
+               worst->name.c_str(), worst->ref.id, worst->ref.index, (long long)worst->total_ms,
+               busiest->name.c_str(), busiest->ref.id, busiest->ref.index, busiest->c.rs485_frames);
+    }
+    fflush(stdout);
+    // 执行者任务还阻塞在队列上, 不走静态析构
+    _exit(linter.issues().empty() ? 0 : 1);
+}
@@ -0,0 +1,319 @@
+// 固件里直接碰硬件和网络的那几个组件的替身, 只统计帧数和总线占用
+#include <algorithm>
+#include <array>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "sim_runtime.h"
+#include "driver/uart.h"
+#include "nvs.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+#include "lord_manager.h"
+#include "rs485_comm.h"
+#include "stm32_comm_types.h"
+#include "stm32_rx.h"
+#include "my_mqtt.h"
+#include "identity.h"
+#include "network.h"
+
+// 485发送任务每发一帧后固定歇100ms, 见rs485_comm.cpp的485_send_bus
+#define SIM_RS485_FRAME_US  (100 * 1000)
+
+bool global_RS485_log_enable_flag = false;
+bool global_STM32_log_enable_flag = false;
+bool mqtt_connected = false;
+
+// ================ STM32串口 ================
+// STM32这边直接当作立刻执行成功, 继电器控制帧同时更新物理状态, 相当于它回了查询响应
+int uart_write_bytes(int port, const void* data, size_t len) {
+    if (port != UART_NUM || len != sizeof(uart_frame_t)) {
+        return len;
+    }
+    const auto* frame = static_cast<const uart_frame_t*>(data);
+    auto& c = sim::counters();
+    c.stm32_frames++;
+    if (frame->cmd_type == CMD_RELAY_CONTROL) {
+        c.relay_ops++;
+        LordManager::instance().updateRelayPhysicsState(frame->channel, frame->param1);
+    } else if (frame->cmd_type == CMD_DRYCONTACT_OUT_CONTROL) {
+        c.drycontact_ops++;
+    }
+    return len;
+}
+
+void handle_response(uart_frame_t*) {}
+
+// ================ RS485 ================
+uint8_t calculate_checksum(const std::vector<uint8_t>& data) {
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < 6; ++i) {
+        checksum += data[i];
+    }
+    return checksum & 0xFF;
+}
+
+// 真实的发送队列长RS485_QUEUE_LEN, 排满后调用者会阻塞到有空位为止
+void sendRS485CMD(const std::vector<uint8_t>&) {
+    auto& c = sim::counters();
+    int64_t now = sim::now_us();
+    if (c.rs485_busy_until_us < now) {
+        c.rs485_busy_until_us = now;
+    }
+    int64_t backlog_us = c.rs485_busy_until_us - now;
+    if (backlog_us >= (int64_t)RS485_QUEUE_LEN * SIM_RS485_FRAME_US) {
+        c.rs485_stalls++;
+        if (!sim::inTimerCallback()) {
+            vTaskDelay(pdMS_TO_TICKS((backlog_us - (RS485_QUEUE_LEN - 1) * SIM_RS485_FRAME_US) / 1000));
+        }
+    }
+    c.rs485_frames++;
+    c.rs485_busy_until_us += SIM_RS485_FRAME_US;
+}
+
+void generate_response(uint8_t param1, uint8_t param2, uint8_t param3, uint8_t param4, uint8_t param5) {
+    sendRS485CMD({RS485_FRAME_HEADER, param1, param2, param3, param4, param5, 0x00, RS485_FRAME_FOOTER});
+}
+
+void uart_init_rs485() {}
+void handle_rs485_data(uint8_t*, int) {}
+bool is_test_mode() { return false; }
+void report_net_state_to_rs485() {}
+
+// ================ MQTT与网络 ================
+int mqtt_publish_message(const std::string&, int, int) { sim::counters().mqtt_msgs++; return 0; }
+void report_states() { sim::counters().mqtt_msgs++; }
+int my_log_send_func(const char*, va_list) { return 0; }
+
+bool network_is_ready() { return false; }
+net_type_t network_current_type() { return NET_TYPE_NONE; }
+uint32_t get_ip_raw() { return 0; }
+
+const char* getSerialNum() { return "SIM00000"; }
+void read_room_info_from_nvs(std::string& hotel_name, std::string& room_name) {
+    hotel_name = "sim";
+    room_name = "sim";
+}
+
+// ================ ROM ================
+// 和ROM里一样查表, 按位算太慢, --bench里配置镜像的加载时间会被它拖偏
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c >> 1) ^ (0xEDB88320 & -(c & 1));
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    while (len--) {
+        crc = (crc >> 8) ^ table[(crc ^ *buf++) & 0xFF];
+    }
+    return ~crc;
+}
+
+// 配置哈希用的SHA-256, 只实现固件用到的几个函数
+static void sha256_block(uint32_t state[8], const uint8_t* p) {
+    static const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 | (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t v[8];
+    memcpy(v, state, sizeof(v));
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = v[7] + (rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) + K[i] + w[i];
+        uint32_t t2 = (rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(v + 1, v, sizeof(uint32_t) * 7);
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) {
+        state[i] += v[i];
+    }
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx) { memset(ctx, 0, sizeof(*ctx)); }
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx) { memset(ctx, 0, sizeof(*ctx)); }
+void mbedtls_sha256_clone(mbedtls_sha256_context* dst, const mbedtls_sha256_context* src) { *dst = *src; }
+
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int) {
+    static const uint32_t H[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(ctx->state, H, sizeof(H));
+    ctx->total = 0;
+    return 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t ilen) {
+    while (ilen > 0) {
+        size_t used = ctx->total % 64;
+        size_t n = std::min(ilen, 64 - used);
+        memcpy(ctx->buffer + used, input, n);
+        ctx->total += n;
+        input += n;
+        ilen -= n;
+        if (used + n == 64) {
+            sha256_block(ctx->state, ctx->buffer);
+        }
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]) {
+    uint64_t bits = ctx->total * 8;
+    uint8_t pad[72] = {0x80};
+    size_t pad_len = (ctx->total % 64 < 56 ? 56 : 120) - ctx->total % 64;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + i] = bits >> (56 - i * 8);
+    }
+    mbedtls_sha256_update(ctx, pad, pad_len + 8);
+    for (int i = 0; i < 8; i++) {
+        for (int k = 0; k < 4; k++) {
+            output[i * 4 + k] = ctx->state[i] >> (24 - k * 8);
+        }
+    }
+    return 0;
+}
+
+int mbedtls_sha256(const unsigned char* input, size_t ilen, unsigned char output[32], int is224) {
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, is224);
+    mbedtls_sha256_update(&ctx, input, ilen);
+    mbedtls_sha256_finish(&ctx, output);
+    return 0;
+}
+
+// ================ 配置分区 ================
+// 用临时文件当flash: 擦除写0xFF, 写只能把1变成0, 映射就是mmap这个文件
+bool sim::config_partition = false;
+
+struct SimPartition {
+    esp_partition_t part;
+    int fd;
+};
+
+static SimPartition* sim_partition(const char* label) {
+    static std::vector<SimPartition> parts = [] {
+        std::vector<SimPartition> v;
+        for (const char* name : {"cfg_a", "cfg_b"}) {
+            SimPartition p = {};
+            p.part.type = ESP_PARTITION_TYPE_DATA;
+            p.part.subtype = 0x7A;
+            p.part.size = 36 * 1024;
+            p.part.erase_size = 4096;
+            strncpy(p.part.label, name, sizeof(p.part.label) - 1);
+            FILE* f = tmpfile();
+            p.fd = f ? dup(fileno(f)) : -1;
+            std::vector<uint8_t> ff(p.part.size, 0xFF);
+            if (p.fd < 0 || pwrite(p.fd, ff.data(), ff.size(), 0) != (ssize_t)ff.size()) {
+                continue;
+            }
+            v.push_back(p);
+        }
+        return v;
+    }();
+    for (auto& p : parts) {
+        if (strcmp(p.part.label, label) == 0) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+static SimPartition* sim_partition(const esp_partition_t* part) {
+    return part ? sim_partition(part->label) : nullptr;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+    SimPartition* p = label ? sim_partition(label) : nullptr;
+    if (!p || !sim::config_partition || p->part.type != type || p->part.subtype != subtype) {
+        return nullptr;
+    }
+    return &p->part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t offset, void* dst, size_t size) {
+    SimPartition* p = sim_partition(part);
+    if (!p || offset + size > part->size) return ESP_ERR_INVALID_ARG;
+    return pread(p->fd, dst, size, offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t offset, const void* src, size_t size) {
+    SimPartition* p = sim_partition(part);
+    if (!p || offset + size > part->size) return ESP_ERR_INVALID_ARG;
+    std::vector<uint8_t> cur(size);
+    if (pread(p->fd, cur.data(), size, offset) != (ssize_t)size) return ESP_FAIL;
+    for (size_t i = 0; i < size; i++) {
+        cur[i] &= static_cast<const uint8_t*>(src)[i];
+    }
+    return pwrite(p->fd, cur.data(), size, offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t offset, size_t size) {
+    SimPartition* p = sim_partition(part);
+    if (!p || offset + size > part->size || offset % part->erase_size || size % part->erase_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::vector<uint8_t> ff(size, 0xFF);
+    return pwrite(p->fd, ff.data(), size, offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+static std::vector<std::pair<void*, size_t>> sim_mmaps;
+
+esp_err_t esp_partition_mmap(const esp_partition_t* part, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t, const void** out_ptr, esp_partition_mmap_handle_t* out_handle) {
+    SimPartition* p = sim_partition(part);
+    if (!p || offset + size > part->size) return ESP_ERR_INVALID_ARG;
+    // 文件映射的偏移要按页对齐, 和真的mmap一样在里面对齐
+    size_t page = offset & ~(size_t)4095;
+    void* base = mmap(nullptr, size + offset - page, PROT_READ, MAP_SHARED, p->fd, page);
+    if (base == MAP_FAILED) return ESP_FAIL;
+    sim_mmaps.push_back({base, size + offset - page});
+    *out_ptr = static_cast<uint8_t*>(base) + (offset - page);
+    *out_handle = sim_mmaps.size();
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+    if (handle == 0 || handle > sim_mmaps.size() || !sim_mmaps[handle - 1].first) return;
+    munmap(sim_mmaps[handle - 1].first, sim_mmaps[handle - 1].second);
+    sim_mmaps[handle - 1].first = nullptr;
+}
+
+// ================ NVS ================
+// 不持久化任何东西, 每次都像第一次上电
+esp_err_t nvs_open(const char*, nvs_open_mode_t, nvs_handle_t* out) { *out = 1; return ESP_OK; }
+esp_err_t nvs_get_str(nvs_handle_t, const char*, char*, size_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+esp_err_t nvs_set_str(nvs_handle_t, const char*, const char*) { return ESP_OK; }
+esp_err_t nvs_get_blob(nvs_handle_t, const char*, void*, size_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+esp_err_t nvs_set_blob(nvs_handle_t, const char*, const void*, size_t) { return ESP_OK; }
+esp_err_t nvs_get_u32(nvs_handle_t, const char*, uint32_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+esp_err_t nvs_set_u32(nvs_handle_t, const char*, uint32_t) { return ESP_OK; }
+esp_err_t nvs_get_u8(nvs_handle_t, const char*, uint8_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+esp_err_t nvs_set_u8(nvs_handle_t, const char*, uint8_t) { return ESP_OK; }
+esp_err_t nvs_commit(nvs_handle_t) { return ESP_OK; }
+void nvs_close(nvs_handle_t) {}
@@ -0,0 +1,511 @@
+#include "sim_runtime.h"
+
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "esp_log.h"
+
+bool sim_log_verbose = false;
+
+namespace {
+
+constexpr int64_t NEVER = INT64_MAX;
+
+struct SimQueue;
+
+struct SimTask {
+    enum class State { READY, RUNNING, DELAYED, WAIT_QUEUE, WAIT_NOTIFY, WAIT_IDLE, DEAD };
+    std::string name;
+    TaskFunction_t fn = nullptr;
+    void* arg = nullptr;
+    State state = State::READY;
+    int64_t wake_us = NEVER;
+    SimQueue* wait_queue = nullptr;
+    uint32_t notify_value = 0;
+    bool notify_pending = false;
+    bool deleted = false;
+};
+
+struct SimQueue {
+    size_t item_size;
+    size_t capacity;
+    std::deque<std::vector<uint8_t>> items;
+    std::deque<SimTask*> receivers;
+};
+
+struct SimTimer {
+    bool is_rtos;                           // FreeRTOS软件定时器还是esp_timer
+    esp_timer_cb_t esp_cb = nullptr;
+    TimerCallbackFunction_t rtos_cb = nullptr;
+    void* arg = nullptr;                    // esp_timer的参数或者FreeRTOS定时器的ID
+    int64_t deadline_us = -1;               // -1表示没有启动
+    int64_t period_us = 0;                  // 0表示单次
+    int64_t rtos_period_us = 0;             // FreeRTOS定时器设定的周期, 单次的也要用它算到期时间
+    uint64_t seq = 0;                       // 同一时刻到期时按启动顺序触发
+};
+
+// 调度只用这一把锁做交接, 任务代码本身总是单线程地运行, 不需要再加锁
+std::mutex handoff_mutex;
+std::condition_variable handoff_cv;
+SimTask* current = nullptr;
+SimTask* main_task = nullptr;
+std::deque<SimTask*> ready;
+std::vector<SimTask*> all_tasks;
+std::list<SimTimer*> timers;
+uint64_t timer_seq = 0;
+int64_t clock_us = 0;
+int64_t idle_deadline_us = 0;
+bool idle_reached = false;
+bool in_timer_cb = false;
+sim::Counters sim_counters = {};
+
+struct TaskDeleted {};
+
+void make_ready(SimTask* t) {
+    t->state = SimTask::State::READY;
+    t->wake_us = NEVER;
+    ready.push_back(t);
+}
+
+int64_t next_event_us() {
+    int64_t t = NEVER;
+    for (auto* task : all_tasks) {
+        if ((task->state == SimTask::State::DELAYED || task->state == SimTask::State::WAIT_QUEUE
+             || task->state == SimTask::State::WAIT_NOTIFY) && task->wake_us < t) {
+            t = task->wake_us;
+        }
+    }
+    for (auto* timer : timers) {
+        if (timer->deadline_us >= 0 && timer->deadline_us < t) {
+            t = timer->deadline_us;
+        }
+    }
+    return t;
+}
+
+void fire_due_timers() {
+    while (true) {
+        SimTimer* due = nullptr;
+        for (auto* timer : timers) {
+            if (timer->deadline_us >= 0 && timer->deadline_us <= clock_us
+                && (!due || timer->deadline_us < due->deadline_us
+                    || (timer->deadline_us == due->deadline_us && timer->seq < due->seq))) {
+                due = timer;
+            }
+        }
+        if (!due) {
+            return;
+        }
+        if (due->period_us > 0) {
+            due->deadline_us += due->period_us;
+            due->seq = timer_seq++;
+        } else {
+            due->deadline_us = -1;
+        }
+        in_timer_cb = true;
+        if (due->is_rtos) {
+            due->rtos_cb(static_cast<TimerHandle_t>(due));
+        } else {
+            due->esp_cb(due->arg);
+        }
+        in_timer_cb = false;
+    }
+}
+
+void wake_due_tasks() {
+    for (auto* task : all_tasks) {
+        if (task->wake_us > clock_us) {
+            continue;
+        }
+        if (task->state == SimTask::State::WAIT_QUEUE) {
+            auto& rx = task->wait_queue->receivers;
+            std::erase(rx, task);
+            make_ready(task);
+        } else if (task->state == SimTask::State::DELAYED || task->state == SimTask::State::WAIT_NOTIFY) {
+            make_ready(task);
+        }
+    }
+}
+
+// 选出下一个要运行的任务, 必要时推进虚拟时钟
+SimTask* pick_next() {
+    while (true) {
+        if (!ready.empty()) {
+            SimTask* t = ready.front();
+            ready.pop_front();
+            return t;
+        }
+        int64_t t = next_event_us();
+        if (main_task->state == SimTask::State::WAIT_IDLE && (t == NEVER || t > idle_deadline_us)) {
+            idle_reached = (t == NEVER);
+            return main_task;
+        }
+        if (t == NEVER) {
+            fprintf(stderr, "scene_sim: 所有任务都在无限等待, 模拟卡死\n");
+            _exit(3);
+        }
+        clock_us = t;
+        fire_due_timers();
+        wake_due_tasks();
+    }
+}
+
+// 挂起当前任务, 把执行权交给下一个, 轮到自己时返回
+void block_current() {
+    SimTask* self = current;
+    std::unique_lock<std::mutex> lock(handoff_mutex);
+    current = pick_next();
+    current->state = SimTask::State::RUNNING;
+    handoff_cv.notify_all();
+    handoff_cv.wait(lock, [self] { return current == self; });
+    if (self->deleted) {
+        throw TaskDeleted{};
+    }
+}
+
+void task_entry(SimTask* self) {
+    {
+        std::unique_lock<std::mutex> lock(handoff_mutex);
+        handoff_cv.wait(lock, [self] { return current == self; });
+    }
+    if (!self->deleted) {
+        try {
+            self->fn(self->arg);
+        } catch (const TaskDeleted&) {
+        }
+    }
+    self->state = SimTask::State::DEAD;
+    std::unique_lock<std::mutex> lock(handoff_mutex);
+    current = pick_next();
+    current->state = SimTask::State::RUNNING;
+    handoff_cv.notify_all();
+}
+
+}
+
+namespace sim {
+
+void init() {
+    main_task = new SimTask{.name = "main", .state = SimTask::State::RUNNING};
+    all_tasks.push_back(main_task);
+    current = main_task;
+}
+
+int64_t now_us() { return clock_us; }
+Counters& counters() { return sim_counters; }
+
+void resetCounters() {
+    sim_counters = {};
+    sim_counters.rs485_busy_until_us = clock_us;
+}
+
+bool runUntilIdle(int64_t deadline_us) {
+    idle_deadline_us = deadline_us;
+    main_task->state = SimTask::State::WAIT_IDLE;
+    block_current();
+    return idle_reached;
+}
+
+bool inTimerCallback() { return in_timer_cb; }
+
+}
+
+// ================ FreeRTOS任务 ================
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t, void* arg, UBaseType_t, TaskHandle_t* handle) {
+    auto* task = new SimTask{.name = name ? name : "", .fn = fn, .arg = arg};
+    all_tasks.push_back(task);
+    ready.push_back(task);
+    if (handle) {
+        *handle = task;
+    }
+    std::thread(task_entry, task).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack, void* arg, UBaseType_t prio, TaskHandle_t* handle, BaseType_t) {
+    return xTaskCreate(fn, name, stack, arg, prio, handle);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    auto* task = static_cast<SimTask*>(handle);
+    if (!task || task == current) {
+        throw TaskDeleted{};
+    }
+    if (task->state == SimTask::State::DEAD || task->deleted) {
+        return;
+    }
+    // 被别人删掉的任务醒来后直接退出, 不再执行它剩下的代码
+    task->deleted = true;
+    if (task->state == SimTask::State::WAIT_QUEUE) {
+        std::erase(task->wait_queue->receivers, task);
+    }
+    if (task->state != SimTask::State::READY) {
+        make_ready(task);
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (in_timer_cb) {
+        return;
+    }
+    if (ticks == 0) {
+        make_ready(current);
+    } else {
+        current->state = SimTask::State::DELAYED;
+        current->wake_us = clock_us + (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+    }
+    block_current();
+}
+
+TickType_t xTaskGetTickCount(void) { return clock_us / 1000 / portTICK_PERIOD_MS; }
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return current; }
+const char* pcTaskGetName(TaskHandle_t handle) { return static_cast<SimTask*>(handle ? handle : current)->name.c_str(); }
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+BaseType_t xTaskAbortDelay(TaskHandle_t handle) {
+    auto* task = static_cast<SimTask*>(handle);
+    if (task && task->state == SimTask::State::DELAYED) {
+        make_ready(task);
+        return pdPASS;
+    }
+    return pdFAIL;
+}
+
+BaseType_t xTaskNotify(TaskHandle_t handle, uint32_t value, eNotifyAction action) {
+    auto* task = static_cast<SimTask*>(handle);
+    if (!task) {
+        return pdFAIL;
+    }
+    switch (action) {
+        case eSetBits: task->notify_value |= value; break;
+        case eIncrement: task->notify_value++; break;
+        case eSetValueWithOverwrite:
+        case eSetValueWithoutOverwrite: task->notify_value = value; break;
+        default: break;
+    }
+    task->notify_pending = true;
+    if (task->state == SimTask::State::WAIT_NOTIFY) {
+        make_ready(task);
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) { return xTaskNotify(handle, 0, eIncrement); }
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t timeout) {
+    SimTask* self = current;
+    if (!self->notify_pending) {
+        self->notify_value &= ~clear_on_entry;
+        if (timeout == 0 || in_timer_cb) {
+            return pdFALSE;
+        }
+        self->state = SimTask::State::WAIT_NOTIFY;
+        self->wake_us = timeout == portMAX_DELAY ? NEVER : clock_us + (int64_t)timeout * 1000;
+        block_current();
+        if (!self->notify_pending) {
+            return pdFALSE;
+        }
+    }
+    if (value) {
+        *value = self->notify_value;
+    }
+    self->notify_value &= ~clear_on_exit;
+    self->notify_pending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout) {
+    uint32_t value = 0;
+    if (xTaskNotifyWait(0, 0, &value, timeout) != pdTRUE) {
+        return 0;
+    }
+    current->notify_value = clear_on_exit ? 0 : value - 1;
+    return value;
+}
+
+BaseType_t xTaskNotifyStateClear(TaskHandle_t handle) {
+    auto* task = static_cast<SimTask*>(handle ? handle : current);
+    bool was = task->notify_pending;
+    task->notify_pending = false;
+    return was ? pdTRUE : pdFALSE;
+}
+
+uint32_t ulTaskNotifyValueClear(TaskHandle_t handle, uint32_t bits) {
+    auto* task = static_cast<SimTask*>(handle ? handle : current);
+    uint32_t old = task->notify_value;
+    task->notify_value &= ~bits;
+    return old;
+}
+
+// ================ 队列 ================
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return new SimQueue{.item_size = item_size, .capacity = length};
+}
+
+static BaseType_t queue_send(QueueHandle_t handle, const void* item, bool to_front) {
+    auto* q = static_cast<SimQueue*>(handle);
+    if (q->items.size() >= q->capacity) {
+        return pdFAIL;
+    }
+    const auto* bytes = static_cast<const uint8_t*>(item);
+    std::vector<uint8_t> copy(bytes, bytes + q->item_size);
+    if (to_front) {
+        q->items.push_front(std::move(copy));
+    } else {
+        q->items.push_back(std::move(copy));
+    }
+    if (!q->receivers.empty()) {
+        SimTask* rx = q->receivers.front();
+        q->receivers.pop_front();
+        make_ready(rx);
+    }
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t) { return queue_send(q, item, false); }
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void* item, TickType_t) { return queue_send(q, item, false); }
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void* item, TickType_t) { return queue_send(q, item, true); }
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t timeout) {
+    auto* q = static_cast<SimQueue*>(handle);
+    if (q->items.empty()) {
+        if (timeout == 0 || in_timer_cb) {
+            return pdFALSE;
+        }
+        SimTask* self = current;
+        self->state = SimTask::State::WAIT_QUEUE;
+        self->wait_queue = q;
+        self->wake_us = timeout == portMAX_DELAY ? NEVER : clock_us + (int64_t)timeout * 1000;
+        q->receivers.push_back(self);
+        block_current();
+        if (q->items.empty()) {
+            return pdFALSE;
+        }
+    }
+    memcpy(item, q->items.front().data(), q->item_size);
+    q->items.pop_front();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) { return static_cast<SimQueue*>(q)->items.size(); }
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t handle) {
+    auto* q = static_cast<SimQueue*>(handle);
+    return q->capacity - q->items.size();
+}
+void vQueueDelete(QueueHandle_t q) { delete static_cast<SimQueue*>(q); }
+
+// 协作式调度下任务之间不会抢占, 互斥量不需要真的锁
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return new int(0); }
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return new int(0); }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+
+// ================ 定时器 ================
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+    auto* timer = new SimTimer{.is_rtos = false, .esp_cb = args->callback, .arg = args->arg};
+    timers.push_back(timer);
+    *out = reinterpret_cast<esp_timer_handle_t>(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t handle, uint64_t timeout_us) {
+    auto* timer = reinterpret_cast<SimTimer*>(handle);
+    timer->deadline_us = clock_us + timeout_us;
+    timer->period_us = 0;
+    timer->seq = timer_seq++;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t handle, uint64_t period_us) {
+    auto* timer = reinterpret_cast<SimTimer*>(handle);
+    timer->deadline_us = clock_us + period_us;
+    timer->period_us = period_us;
+    timer->seq = timer_seq++;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t handle) {
+    auto* timer = reinterpret_cast<SimTimer*>(handle);
+    if (timer->deadline_us < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deadline_us = -1;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t handle) {
+    auto* timer = reinterpret_cast<SimTimer*>(handle);
+    timers.remove(timer);
+    delete timer;
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t handle) { return reinterpret_cast<SimTimer*>(handle)->deadline_us >= 0; }
+int64_t esp_timer_get_time(void) { return clock_us; }
+
+TimerHandle_t xTimerCreate(const char*, TickType_t period, UBaseType_t auto_reload, void* id, TimerCallbackFunction_t cb) {
+    auto* timer = new SimTimer{.is_rtos = true, .rtos_cb = cb, .arg = id};
+    timer->rtos_period_us = (int64_t)period * portTICK_PERIOD_MS * 1000;
+    timer->period_us = auto_reload ? timer->rtos_period_us : 0;
+    timers.push_back(timer);
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t handle, TickType_t) {
+    auto* timer = static_cast<SimTimer*>(handle);
+    timer->deadline_us = clock_us + timer->rtos_period_us;
+    timer->seq = timer_seq++;
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t handle, TickType_t ticks) { return xTimerStart(handle, ticks); }
+
+BaseType_t xTimerStop(TimerHandle_t handle, TickType_t) {
+    static_cast<SimTimer*>(handle)->deadline_us = -1;
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t handle, TickType_t period, TickType_t ticks) {
+    auto* timer = static_cast<SimTimer*>(handle);
+    bool reload = timer->period_us > 0;
+    timer->rtos_period_us = (int64_t)period * portTICK_PERIOD_MS * 1000;
+    timer->period_us = reload ? timer->rtos_period_us : 0;
+    return xTimerStart(handle, ticks);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t handle, TickType_t) {
+    auto* timer = static_cast<SimTimer*>(handle);
+    timers.remove(timer);
+    delete timer;
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t handle) { return static_cast<SimTimer*>(handle)->deadline_us >= 0; }
+void* pvTimerGetTimerID(TimerHandle_t handle) { return static_cast<SimTimer*>(handle)->arg; }
+
+// ================ 杂项 ================
+const char* esp_err_to_name(esp_err_t err) { return err == ESP_OK ? "ESP_OK" : "ESP_FAIL"; }
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) { return func; }
+size_t heap_caps_get_free_size(uint32_t) { return 200 * 1024; }
+size_t heap_caps_get_minimum_free_size(uint32_t) { return 200 * 1024; }
+size_t heap_caps_get_largest_free_block(uint32_t) { return 100 * 1024; }
+void* heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+uint32_t esp_get_free_heap_size(void) { return 200 * 1024; }
+uint32_t esp_get_minimum_free_heap_size(void) { return 200 * 1024; }
+void esp_restart(void) {
+    fprintf(stderr, "scene_sim: 固件调用了esp_restart\n");
+    _exit(4);
+}
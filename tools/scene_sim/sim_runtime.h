@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+// scene_sim的模拟运行时: 用虚拟时钟代替真实时间, FreeRTOS任务是真线程,
+// 但同一时刻只有一个在跑(协作式), vTaskDelay/队列等待/定时器都按虚拟时间推进,
+// 所以固件代码里的延时不会真的等待, 结果也是确定的
+namespace sim {
+
+// 驱动桩统计到的总线开销, 每个场景开始前清零
+struct Counters {
+    uint32_t stm32_frames;          // 发给STM32的帧
+    uint32_t relay_ops;             // 其中的继电器控制帧
+    uint32_t drycontact_ops;        // 其中的干接点输出控制帧
+    uint32_t rs485_frames;          // 进入485发送队列的帧
+    uint32_t rs485_stalls;          // 485队列满导致调用者阻塞的次数
+    int64_t rs485_busy_until_us;    // 485发送任务排空队列的时刻
+    uint32_t mqtt_msgs;             // 上报/发布的MQTT消息
+};
+
+void init();                        // 把调用线程登记为主任务, 必须最先调用
+int64_t now_us();
+Counters& counters();
+void resetCounters();
+
+// 主任务让出执行权, 直到所有任务都阻塞且在deadline_us之前没有待触发的事件,
+// 返回false表示到deadline_us时仍有事件没跑完
+bool runUntilIdle(int64_t deadline_us);
+bool inTimerCallback();             // 定时器回调在调度器里执行, 不能阻塞
+
+extern bool config_partition;       // 分区表里有没有配置分区cfg_a/cfg_b, 有的话用临时文件模拟
+
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#define UART_NUM_1 1
+#define UART_PIN_NO_CHANGE -1
+typedef enum { UART_DATA_8_BITS = 3 } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE = 0 } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE = 0 } uart_hw_flowcontrol_t;
+typedef enum { UART_MODE_RS485_HALF_DUPLEX = 1 } uart_mode_t;
+typedef struct { int baud_rate; uart_word_length_t data_bits; uart_parity_t parity; uart_stop_bits_t stop_bits; uart_hw_flowcontrol_t flow_ctrl; } uart_config_t;
+esp_err_t uart_param_config(int, const uart_config_t*);
+esp_err_t uart_set_pin(int, int, int, int, int);
+esp_err_t uart_driver_install(int, int, int, int, void*, int);
+esp_err_t uart_set_mode(int, uart_mode_t);
+int uart_write_bytes(int, const void*, size_t);
+int uart_read_bytes(int, void*, uint32_t, TickType_t);
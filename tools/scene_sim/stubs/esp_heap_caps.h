@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#define MALLOC_CAP_INTERNAL 1
+#define MALLOC_CAP_DMA 2
+#define MALLOC_CAP_8BIT 4
+#define MALLOC_CAP_SPIRAM 8
+size_t heap_caps_get_free_size(uint32_t);
+size_t heap_caps_get_minimum_free_size(uint32_t);
+size_t heap_caps_get_largest_free_block(uint32_t);
+void* heap_caps_malloc(size_t, uint32_t);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
@@ -0,0 +1,16 @@
+#pragma once
+#include <stdio.h>
+#include <stdarg.h>
+#include "esp_err.h"
+
+// 固件日志默认静音, scene_sim -v 时才打印
+extern bool sim_log_verbose;
+
+typedef int (*vprintf_like_t)(const char*, va_list);
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t);
+#define SIM_LOG(level, tag, fmt, ...) do { if (sim_log_verbose) printf(level " %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, fmt, ...) SIM_LOG("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) SIM_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...) SIM_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { } while (0)
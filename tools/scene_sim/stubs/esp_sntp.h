@@ -0,0 +1,4 @@
+#pragma once
+#include <time.h>
+#include "esp_heap_caps.h"
+#include "esp_system.h"
@@ -0,0 +1,3 @@
+#pragma once
+#include "esp_heap_caps.h"
+void esp_restart(void);
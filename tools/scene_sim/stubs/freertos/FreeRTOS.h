@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <mutex>
+#include <array>
+#include <set>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+typedef int BaseType_t; typedef unsigned UBaseType_t; typedef uint32_t TickType_t;
+typedef void* TaskHandle_t; typedef void* QueueHandle_t; typedef void* SemaphoreHandle_t; typedef void* TimerHandle_t; typedef void* EventGroupHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef uint32_t StackType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) ((TickType_t)(x))
+#define pdTICKS_TO_MS(x) ((uint32_t)(x))
+#define INCLUDE_xTaskAbortDelay 1
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY 0x7fffffff
+#define BIT0 1
+#define portMUX_INITIALIZER_UNLOCKED {}
+typedef struct { int x; } portMUX_TYPE;
+#define taskENTER_CRITICAL(m) ((void)(m))
+#define taskEXIT_CRITICAL(m) ((void)(m))
+#define portENTER_CRITICAL(m) ((void)(m))
+#define portEXIT_CRITICAL(m) ((void)(m))
+typedef enum { eNoAction, eSetBits, eIncrement, eSetValueWithOverwrite, eSetValueWithoutOverwrite } eNotifyAction;
+#include "freertos/task.h"
+#include "freertos/semphr.h"
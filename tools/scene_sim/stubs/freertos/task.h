@@ -0,0 +1,19 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, BaseType_t);
+void vTaskDelete(TaskHandle_t);
+void vTaskDelay(TickType_t);
+TickType_t xTaskGetTickCount(void);
+BaseType_t xTaskNotifyWait(uint32_t, uint32_t, uint32_t*, TickType_t);
+BaseType_t xTaskNotify(TaskHandle_t, uint32_t, eNotifyAction);
+BaseType_t xTaskNotifyGive(TaskHandle_t);
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t);
+BaseType_t xTaskNotifyStateClear(TaskHandle_t);
+BaseType_t xTaskAbortDelay(TaskHandle_t);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t);
+const char* pcTaskGetName(TaskHandle_t);
+void vTaskSetThreadLocalStoragePointer(TaskHandle_t, BaseType_t, void*);
+void* pvTaskGetThreadLocalStoragePointer(TaskHandle_t, BaseType_t);
+uint32_t ulTaskNotifyValueClear(TaskHandle_t, uint32_t);